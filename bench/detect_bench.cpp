@@ -0,0 +1,684 @@
+// End-to-end run of the detect pipeline without a camera, display or
+// accelerator: frames come from any source detect reads (or are
+// synthesized), decoded ahead by a FramePrefetcher, the Hailo device is replaced by SimulatedDevice, and the run ends with a
+// throughput, latency, CPU and memory report for the chosen settings.
+//
+// With --soak-minutes the input loops until the time is up while RSS,
+// heap, allocations per frame, thread count and tail latency are sampled
+// periodically; the exit status says whether any of them kept growing.
+
+#include "AllocationCounter.hpp"
+#include "AllocationReport.hpp"
+#include "DetectPipeline.hpp"
+#include "FrameSink.hpp"
+#include "FrameSource.hpp"
+#include "LatencyHistogram.hpp"
+#include "Log.hpp"
+#include "OutputSinks.hpp"
+#include "PerceptualHash.hpp"
+#include "PipelineStats.hpp"
+#include "PooledMatAllocator.hpp"
+#include "ProcessStats.hpp"
+#include "SimulatedDevice.hpp"
+#include "SnapshotEncoder.hpp"
+#include "SnapshotStore.hpp"
+#include "SoakMonitor.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+constexpr char syntheticSource[] = "synthetic";
+
+struct BenchArguments {
+    std::string source;
+    size_t loops;
+    size_t maxFrames;
+    size_t serviceUs;
+    size_t detections;
+    size_t threads;
+    size_t queueDepth;
+    size_t prefetchThreads;
+    int interpolation;
+    bool annotate;
+    size_t snapshotEvery;
+    int dedupeDistance;
+    size_t soakMinutes;
+    size_t sampleSeconds;
+    SoakLimits soakLimits;
+    bool checkAllocations;
+    size_t allocationWarmup;
+    bool matPool;
+    bool spin;
+    placement::Plan placement;
+    int cvThreads;
+    size_t loadThreads;
+    std::vector<std::string> sinks;
+};
+
+struct ThreadUsage {
+    std::string name;
+    double cpuSeconds;
+};
+
+// shared by the workers and main
+struct BenchState {
+    PipelineStats stats;
+    LatencyHistogram endToEnd;
+    RollingLatency endToEndWindow;
+    std::atomic<uint64_t> frames{0};
+    std::atomic<size_t> workersDone{0};
+    std::vector<ThreadUsage> usage;
+    std::mutex usageMutex;
+
+    // CPU time of the calling thread unless given
+    void
+    addUsage (std::string name, double cpuSeconds = process::threadCpuSeconds())
+    {
+        std::lock_guard<std::mutex> lock(usageMutex);
+        usage.push_back({std::move(name), cpuSeconds});
+    }
+};
+
+// detect's 't' key path: dedupe, annotate and encode off thread, keep the
+// best few in a digest store that is emptied whenever it fills up
+class SnapshotPath
+{
+public:
+    SnapshotPath (int dedupeDistance, PipelineStats& stats)
+    :
+        m_deduper(dedupeDistance, 16),
+        m_store(4, 4096 * 1024),
+        m_encoder(JpegSettings::fromPreset(JpegPreset::Baseline), 4, &stats.stage(Stage::Encode), &m_deduper)
+    { }
+
+    void
+    offer (cv::Mat&& frame, const std::vector<utils::Detection>& detections)
+    {
+        Snapshot snapshot;
+        snapshot.score = 0.0f;
+        snapshot.timestamp = std::chrono::system_clock::now();
+        for (const auto& detection : detections)
+        {
+            snapshot.score = std::max(snapshot.score, detection.boundingBox.score);
+            snapshot.classIds.push_back(detection.classId);
+        }
+
+        m_encoder.submit(std::move(frame), detections, 0.0, [this, snapshot](SnapshotEncoder::Jpeg jpg) mutable {
+            snapshot.jpg = std::move(jpg);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_store.offer(std::move(snapshot));
+            if (m_store.offered() % 16 == 0)
+                m_store.take();
+        });
+    }
+
+    void shutdown () { m_encoder.shutdown(); }
+
+    EncoderMetrics metrics () const { return m_encoder.metrics(); }
+
+private:
+    std::mutex m_mutex;
+    SnapshotDeduper m_deduper;
+    SnapshotStore m_store;
+    SnapshotEncoder m_encoder;
+};
+
+// a handful of distinct frames, cloned so every frame owns its buffer,
+// with a moving bar so snapshots are not all duplicates; never ends
+class SyntheticSource : public FrameSource
+{
+public:
+    SyntheticSource ()
+    {
+        for (uint64_t seed = 0; seed < 8; seed++)
+            m_frames.push_back(simulated::frame(defaultCaptureWidth, defaultCaptureHeight, seed));
+    }
+
+    const char* kind () const override { return "synthetic"; }
+    bool live () const override { return false; }
+
+    bool
+    read (SourceFrame& out) override
+    {
+        out.frame = m_frames[m_produced % m_frames.size()].clone();
+        int x = static_cast<int>((m_produced * 37) % (defaultCaptureWidth - 160));
+        cv::rectangle(out.frame, cv::Rect(x, 0, 160, defaultCaptureHeight), cv::Scalar::all(0), cv::FILLED);
+        m_produced++;
+        return true;
+    }
+
+    bool rewind () override { return true; }
+
+    cv::Size frameSize () const override { return cv::Size(defaultCaptureWidth, defaultCaptureHeight); }
+
+private:
+    std::vector<cv::Mat> m_frames;
+    uint64_t m_produced = 0;
+};
+
+static
+int
+parseArguments (
+    int argc,
+    const char* const* argv,
+    BenchArguments& args
+)
+{
+    const cv::String keys = "{ h help ?   | | print this message }"
+                            "{ loops      | 1 | times to replay a video file or images }"
+                            "{ frames     | 0 | stop after this many frames, 0 runs the whole input }"
+                            "{ service-us | 8000 | simulated device time per frame in microseconds }"
+                            "{ detections | 10 | canned detections returned for every frame }"
+                            "{ threads    | 1 | worker threads running preprocess through draw }"
+                            "{ queue      | 4 | decoded frames buffered ahead of the workers, rounded up to a power of two }"
+                            "{ prefetch-threads | 2 | threads decoding an image directory or glob ahead of the workers }"
+                            "{ spin       | true | spin briefly before parking on an empty or full frame queue }"
+                            "{ preprocess | linear | resize interpolation: nearest, linear or area }"
+                            "{ annotate   | true | draw boxes and labels in the worker, standing in for detect's display when --sinks is empty }"
+                            "{ snapshot-every | 0 | push every Nth frame through dedupe, JPEG encode and the digest store, 0 disables }"
+                            "{ dedupe-distance | 6 | snapshot dedupe threshold in hash bits, -1 disables }"
+                            "{ soak-minutes | 0 | loop the input this long and check resource trends, 0 runs once }"
+                            "{ sample-seconds | 60 | seconds between soak samples }"
+                            "{ warmup-samples | 2 | soak samples ignored while the process settles }"
+                            "{ max-rss-growth | 8 | soak limit for RSS growth, MB per hour }"
+                            "{ max-heap-growth | 4 | soak limit for live heap growth, MB per hour }"
+                            "{ max-alloc-growth | 10 | soak limit for allocations per frame growth, percent per hour }"
+                            "{ max-latency-growth | 25 | soak limit for p99 latency growth, percent per hour }"
+                            "{ max-thread-growth | 0 | soak limit for threads started and never joined }"
+                            "{ check-allocs | false | fail if preprocess, write, read, postprocess or publish allocate once warmed up, or a Mat buffer misses the --mat-pool }"
+                            "{ alloc-warmup | 100 | frames before allocations are counted against --check-allocs }"
+                            "{ mat-pool   | true | recycle Mat buffers through PooledMatAllocator like detect, false uses OpenCV's allocator }"
+                            "{ pin        | | pin threads to cores like detect, roles capture (decoding), worker, load, a sink's name or helper thread (recorder, clip-writer, dlog) and default, e.g. \"worker=2-3 load=0-1\" }"
+                            "{ priority   | | space separated role=fifo:N or role=nice:N, e.g. \"capture=fifo:10 load=nice:19\" }"
+                            "{ cv-threads | -1 | size of OpenCV's internal thread pool, -1 keeps OpenCV's default }"
+                            "{ load-threads | 0 | busy threads competing for the cores, standing in for HailoRT, the GUI and other processes }"
+                            "{ sinks      | | comma separated detect outputs fed by the workers: video:PATH, clip:PATH, log:DIR, json:PATH (not json:-, stdout carries the report), mjpeg:PORT, shm:NAME, null; empty disables }"
+                            "{ @source    | synthetic | any detect source (video file, image directory or glob, camera, URL, shm:NAME), or synthetic for generated frames }"
+                            ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help"))
+    {
+        parser.printMessage();
+        return -1;
+    }
+
+    args.source = parser.get<std::string>("@source");
+    args.loops = parser.get<size_t>("loops");
+    args.maxFrames = parser.get<size_t>("frames");
+    args.serviceUs = parser.get<size_t>("service-us");
+    args.detections = parser.get<size_t>("detections");
+    args.threads = parser.get<size_t>("threads");
+    args.queueDepth = parser.get<size_t>("queue");
+    args.prefetchThreads = std::max<size_t>(parser.get<size_t>("prefetch-threads"), 1);
+    args.annotate = parser.get<bool>("annotate");
+    args.snapshotEvery = parser.get<size_t>("snapshot-every");
+    args.dedupeDistance = parser.get<int>("dedupe-distance");
+    args.soakMinutes = parser.get<size_t>("soak-minutes");
+    args.sampleSeconds = parser.get<size_t>("sample-seconds");
+    args.soakLimits.warmupSamples = parser.get<size_t>("warmup-samples");
+    args.soakLimits.maxRssGrowthMBPerHour = parser.get<double>("max-rss-growth");
+    args.soakLimits.maxHeapGrowthMBPerHour = parser.get<double>("max-heap-growth");
+    args.soakLimits.maxAllocationGrowthPercentPerHour = parser.get<double>("max-alloc-growth");
+    args.soakLimits.maxLatencyGrowthPercentPerHour = parser.get<double>("max-latency-growth");
+    args.soakLimits.maxThreadGrowth = parser.get<size_t>("max-thread-growth");
+    args.checkAllocations = parser.get<bool>("check-allocs");
+    args.allocationWarmup = parser.get<size_t>("alloc-warmup");
+    args.matPool = parser.get<bool>("mat-pool");
+    args.spin = parser.get<bool>("spin");
+    args.cvThreads = parser.get<int>("cv-threads");
+    args.loadThreads = parser.get<size_t>("load-threads");
+
+    std::istringstream sinks(parser.get<std::string>("sinks"));
+    std::string sink;
+    while (std::getline(sinks, sink, ','))
+    {
+        if (writesToStdout(sink))
+        {
+            LOG_ERROR("{} would interleave with the report on stdout", sink);
+            return -6;
+        }
+        if (!sink.empty())
+            args.sinks.push_back(sink);
+    }
+
+    std::string placementError;
+    if (!placement::parse(parser.get<std::string>("pin"), parser.get<std::string>("priority"), args.placement, placementError))
+    {
+        LOG_ERROR("invalid thread placement: {}", placementError);
+        return -5;
+    }
+
+    std::string preprocess = parser.get<std::string>("preprocess");
+    if (preprocess == "nearest")
+        args.interpolation = cv::INTER_NEAREST;
+    else if (preprocess == "linear")
+        args.interpolation = cv::INTER_LINEAR;
+    else if (preprocess == "area")
+        args.interpolation = cv::INTER_AREA;
+    else
+    {
+        LOG_ERROR("unknown preprocess mode: {}", preprocess);
+        return -2;
+    }
+
+    if (args.threads == 0 || args.queueDepth == 0 || args.loops == 0)
+    {
+        LOG_ERROR("threads, queue and loops must be at least 1");
+        return -3;
+    }
+    if (args.soakMinutes > 0 && args.sampleSeconds == 0)
+    {
+        LOG_ERROR("sample-seconds must be at least 1 for a soak run");
+        return -4;
+    }
+
+    // sinks draw on their own copy of the frame, like they do in detect
+    if (!args.sinks.empty())
+        args.annotate = false;
+
+    // a soak runs on time, everything else on a frame budget
+    if (args.soakMinutes > 0)
+        args.maxFrames = 0;
+    else if (args.source == syntheticSource && args.maxFrames == 0)
+        args.maxFrames = 1000;
+    return 0;
+}
+
+// detect's frame loop after capture; the drawing a display would do is
+// done here unless there are sinks to do it
+static
+void
+processFrames (
+    const BenchArguments& args,
+    size_t index,
+    FramePrefetcher& frames,
+    SimulatedDevice& device,
+    SnapshotPath* snapshots,
+    SinkSet& sinks,
+    BenchState& state
+)
+{
+    trace::setThreadName("worker");
+    placement::registerThread("worker");
+    PipelineStats& stats = state.stats;
+    cv::Mat processingFrame;
+    std::vector<float32_t> inferenceOutput(device.getOutVStreamFrameSize());
+    std::vector<utils::Detection> detections;
+    SourceFrame item;
+
+    while (true)
+    {
+        // only the wait for a decoded frame; decoding is on the prefetcher's threads
+        bool captured;
+        {
+            ScopedStage timer(stats, Stage::Capture);
+            captured = frames.next(item);
+        }
+        if (!captured)
+            break;
+
+        {
+            ScopedStage timer(stats, Stage::Preprocess);
+            preProcess(item.frame, processingFrame, args.interpolation);
+        }
+
+        hailo_status status;
+        {
+            ScopedStage timer(stats, Stage::Write);
+            status = device.write(processingFrame, inputSize);
+        }
+        if (status == HAILO_SUCCESS)
+        {
+            ScopedStage timer(stats, Stage::Read);
+            status = device.read(inferenceOutput);
+        }
+        if (status != HAILO_SUCCESS)
+        {
+            LOG_ERROR("simulated device failed: {}", hailo_get_status_message(status));
+            continue;
+        }
+
+        {
+            ScopedStage timer(stats, Stage::Postprocess);
+            postProcess(inferenceOutput, detections);
+        }
+
+        if (args.annotate)
+        {
+            ScopedStage timer(stats, Stage::Draw);
+            annotateFrame(item.frame, detections, 0.0);
+        }
+
+        // handing the frame to the sinks is all the loop should pay for them
+        {
+            ScopedStage timer(stats, Stage::Publish);
+            sinks.publish(trace::nextFrameId(), item.frame, detections, 0.0);
+        }
+
+        uint64_t latencyNs = trace::nowNs() - item.captureStartNs;
+        state.endToEnd.record(latencyNs);
+        state.endToEndWindow.record(latencyNs);
+        uint64_t frameNumber = state.frames.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        // the frame may have gone to the sinks already
+        if (snapshots != nullptr && frameNumber % args.snapshotEvery == 0 && !item.frame.empty())
+            snapshots->offer(std::move(item.frame), detections);
+    }
+
+    state.addUsage("worker-" + std::to_string(index));
+    state.workersDone.fetch_add(1);
+}
+
+// stages whose code lives in this tree; capture and draw are reported but
+// not enforced because OpenCV's decoders and putText allocate internally.
+// Mat pixel buffers bypass operator new, so with the Mat pool installed
+// any buffer it had to get from the system fails the check as well,
+// whichever thread asked for it.
+static
+bool
+checkSteadyStateAllocations (
+    const alloc::Snapshot& from,
+    const alloc::Snapshot& to,
+    const MatPoolStats* matFrom,
+    const MatPoolStats* matTo
+)
+{
+    bool ok = true;
+    for (Stage stage : {Stage::Preprocess, Stage::Write, Stage::Read, Stage::Postprocess, Stage::Publish})
+    {
+        uint64_t count = to.perTag[stageTag(stage)] - from.perTag[stageTag(stage)];
+        if (count > 0)
+        {
+            LOG_ERROR("{} allocated {} times after warmup", stageName(stage), count);
+            ok = false;
+        }
+    }
+    if (matFrom != nullptr && matTo != nullptr)
+    {
+        uint64_t misses = (matTo->allocations - matTo->poolHits) - (matFrom->allocations - matFrom->poolHits);
+        if (misses > 0)
+        {
+            LOG_ERROR("{} Mat buffers allocated outside the pool after warmup", misses);
+            ok = false;
+        }
+    }
+    else
+        LOG_WARN("Mat buffers are only checked with --mat-pool");
+    if (ok)
+        LOG_INFO("steady state allocation check passed");
+    return ok;
+}
+
+// burns CPU until told to stop, to see how placement holds up under contention
+static
+void
+generateLoad (
+    const std::atomic<bool>& stop
+)
+{
+    trace::setThreadName("load");
+    placement::registerThread("load");
+    volatile uint64_t sink = 0;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        for (int i = 0; i < 10000; i++)
+            sink = sink * 6364136223846793005ull + 1;
+    }
+}
+
+// samples the process every args.sampleSeconds until the soak is over
+static
+bool
+soak (
+    const BenchArguments& args,
+    BenchState& state
+)
+{
+    using namespace std::chrono;
+
+    SoakMonitor monitor(args.soakLimits);
+    const auto start = steady_clock::now();
+    const auto end = start + minutes(args.soakMinutes);
+    uint64_t lastFrames = state.frames.load();
+    uint64_t lastAllocations = alloc::totals().allocations;
+
+    for (auto next = start + seconds(args.sampleSeconds); next <= end; next += seconds(args.sampleSeconds))
+    {
+        std::this_thread::sleep_until(next);
+
+        alloc::Counts heap = alloc::totals();
+        uint64_t frames = state.frames.load();
+        uint64_t framesInWindow = frames - lastFrames;
+
+        SoakSample sample;
+        sample.elapsedSeconds = duration<double>(steady_clock::now() - start).count();
+        sample.frames = frames;
+        sample.rssBytes = process::residentBytes();
+        sample.liveHeapBytes = heap.liveBytes;
+        sample.threads = process::threadCount();
+        sample.allocationsPerFrame = framesInWindow > 0
+            ? static_cast<double>(heap.allocations - lastAllocations) / framesInWindow
+            : 0.0;
+        sample.p99Ns = state.endToEndWindow.rotate().percentile(0.99);
+        std::ostringstream report;
+        monitor.add(sample, report);
+        logging::writeLines(logging::Level::Info, report.str());
+
+        if (framesInWindow == 0)
+            LOG_ERROR("soak: no frames completed in the last {}s", args.sampleSeconds);
+
+        lastFrames = frames;
+        lastAllocations = heap.allocations;
+    }
+
+    std::ostringstream report;
+    bool passed = monitor.check(report);
+    logging::writeLines(logging::Level::Info, report.str());
+    return passed;
+}
+
+int
+main (
+    int argc,
+    char *argv[]
+)
+{
+    BenchArguments args;
+    if (parseArguments(argc, argv, args) != 0)
+    {
+        return -1;
+    }
+
+    using namespace std;
+
+    placement::configure(std::move(args.placement));
+    if (args.cvThreads >= 0)
+        cv::setNumThreads(args.cvThreads);
+    cv::parallel_for_(cv::Range(0, cv::getNumThreads()), [](const cv::Range&) { });
+    logging::start();
+    LOG_INFO("main thread: {}, OpenCV threads: {}", placement::describeCurrentThread(), cv::getNumThreads());
+
+    if (args.matPool)
+        PooledMatAllocator::installAsDefault();
+
+    SimulatedDevice device(chrono::microseconds(args.serviceUs), args.detections);
+    BenchState state;
+
+    unique_ptr<FrameSource> source;
+    try
+    {
+        if (args.source == syntheticSource)
+            source = make_unique<SyntheticSource>();
+        else
+            source = openFrameSource(args.source, cv::Size(defaultCaptureWidth, defaultCaptureHeight));
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("{}", e.what());
+        return -1;
+    }
+    const bool soaking = args.soakMinutes > 0;
+    SinkSet sinks(&state.stats.stage(Stage::Draw));
+    for (const auto& spec : args.sinks)
+    {
+        auto sink = makeSink(spec, SinkOptions());
+        if (!sink)
+            return -1;
+        sinks.add(std::move(sink));
+    }
+
+    unique_ptr<SnapshotPath> snapshots;
+    if (args.snapshotEvery > 0)
+        snapshots = make_unique<SnapshotPath>(args.dedupeDistance, state.stats);
+
+    // a soak replays the input until it is over
+    PrefetchConfig prefetch;
+    prefetch.threads = args.prefetchThreads;
+    prefetch.depth = args.queueDepth;
+    prefetch.loops = soaking ? 0 : args.loops;
+    prefetch.maxFrames = args.maxFrames;
+    prefetch.wait = args.spin ? ring::WaitPolicy::SpinThenPark : ring::WaitPolicy::Park;
+    FramePrefetcher frames(std::move(source), prefetch);
+
+    LOG_INFO("source: {} ({}, {} decoding threads) threads: {} queue: {} service: {}us detections: {}",
+        args.source, frames.source().kind(), frames.threads(),
+        args.threads, args.queueDepth, args.serviceUs, args.detections);
+
+    double cpuStart = process::processCpuSeconds();
+    auto wallStart = chrono::steady_clock::now();
+
+    atomic<bool> stopLoad{false};
+    vector<thread> load;
+    for (size_t i = 0; i < args.loadThreads; i++)
+        load.emplace_back(generateLoad, cref(stopLoad));
+
+    vector<thread> workers;
+    for (size_t i = 0; i < args.threads; i++)
+        workers.emplace_back(processFrames, cref(args), i, ref(frames), ref(device), snapshots.get(), ref(sinks), ref(state));
+
+    // let pools, queues and reusable buffers reach their working size
+    while (state.frames.load() < args.allocationWarmup && state.workersDone.load() < args.threads)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    alloc::Snapshot allocStart = alloc::snapshot();
+    MatPoolStats matStart = PooledMatAllocator::instance().stats();
+    uint64_t allocStartFrames = state.frames.load();
+
+    bool soakPassed = true;
+    if (soaking)
+    {
+        LOG_INFO("soaking for {} minutes, sampling every {}s", args.soakMinutes, args.sampleSeconds);
+        soakPassed = soak(args, state);
+        frames.stop();
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+    stopLoad.store(true);
+    for (auto& loader : load)
+        loader.join();
+    if (snapshots)
+        snapshots->shutdown();
+    sinks.shutdown();
+    // what the sinks logged comes before the report
+    logging::stop();
+
+    double wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+    double cpuSeconds = process::processCpuSeconds() - cpuStart;
+    uint64_t done = state.frames.load();
+
+    state.stats.rotate();
+    std::ostringstream report;
+    state.stats.report(report);
+
+    char line[128];
+    snprintf(line, sizeof(line), "end to end (ms)  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+        state.endToEnd.percentile(0.50) / 1e6,
+        state.endToEnd.percentile(0.90) / 1e6,
+        state.endToEnd.percentile(0.99) / 1e6,
+        state.endToEnd.max() / 1e6);
+    report << line;
+
+    snprintf(line, sizeof(line), "frames: %llu in %.2fs, %.1f fps (device bound: %.1f fps)\n",
+        static_cast<unsigned long long>(done),
+        wallSeconds,
+        wallSeconds > 0 ? done / wallSeconds : 0.0,
+        args.serviceUs > 0 ? 1e6 / args.serviceUs : 0.0);
+    report << line;
+
+    PrefetchMetrics decoded = frames.metrics();
+    snprintf(line, sizeof(line), "decoded: %llu frames, %llu lost, %.2f ms each\n",
+        static_cast<unsigned long long>(decoded.decoded),
+        static_cast<unsigned long long>(decoded.lost),
+        decoded.decoded + decoded.lost > 0 ? decoded.decodeNs / 1e6 / (decoded.decoded + decoded.lost) : 0.0);
+    report << line;
+
+    if (snapshots)
+    {
+        EncoderMetrics encoded = snapshots->metrics();
+        report << "snapshots encoded: " << encoded.encoded << " dropped: " << encoded.dropped << "\n";
+    }
+
+    for (const auto& sink : sinks.metrics())
+    {
+        report << "sink " << sink.name << ": " << sink.delivered << " delivered, "
+            << sink.replaced << " replaced, " << sink.dropped << " dropped\n";
+    }
+
+    if (args.matPool)
+    {
+        MatPoolStats matPool = PooledMatAllocator::instance().stats();
+        report << "mat buffers: " << matPool.allocations << " allocations, "
+            << matPool.poolHits << " reused from the pool, "
+            << matPool.pooledBytes / 1024 << " KB pooled\n";
+    }
+
+    // the decoding and sink threads are done by now and report their own
+    state.addUsage("capture", decoded.cpuNs / 1e9);
+    for (const auto& sink : sinks.metrics())
+        state.addUsage(std::string("sink ") + sink.name, sink.cpuNs / 1e9);
+
+    report << "cpu utilization (100% = one core)\n";
+    for (const auto& entry : state.usage)
+    {
+        snprintf(line, sizeof(line), "  %-12s %6.1f%%\n",
+            entry.name.c_str(), 100.0 * entry.cpuSeconds / wallSeconds);
+        report << line;
+    }
+    snprintf(line, sizeof(line), "  %-12s %6.1f%%\n", "process", 100.0 * cpuSeconds / wallSeconds);
+    report << line;
+
+    report << "peak rss: " << process::peakResidentBytes() / (1024 * 1024) << " MB\n";
+    alloc::Snapshot allocEnd = alloc::snapshot();
+    MatPoolStats matEnd = PooledMatAllocator::instance().stats();
+    alloc::reportPerFrame(report, allocStart, allocEnd, done - allocStartFrames);
+    logging::writeLines(logging::Level::Info, report.str());
+
+    if (!soakPassed)
+        return 2;
+    if (args.checkAllocations)
+    {
+        if (done - allocStartFrames == 0)
+        {
+            LOG_ERROR("no frames after the {} frame warmup to check", args.allocationWarmup);
+            return 3;
+        }
+        bool pooled = args.matPool;
+        if (!checkSteadyStateAllocations(allocStart, allocEnd, pooled ? &matStart : nullptr, pooled ? &matEnd : nullptr))
+            return 3;
+    }
+    return done > 0 ? 0 : 1;
+}
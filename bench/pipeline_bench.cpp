@@ -0,0 +1,681 @@
+// Host-side hot paths of detect and classify on synthetic inputs.
+// Nothing here touches a Hailo device, camera or display.
+
+#include "ClassifyPipeline.hpp"
+#include "CocoClass.hpp"
+#include "DetectPipeline.hpp"
+#include "DetectionLog.hpp"
+#include "DetectionQuery.hpp"
+#include "FrameBus.hpp"
+#include "FrameSource.hpp"
+#include "FrameTrace.hpp"
+#include "JsonLines.hpp"
+#include "Log.hpp"
+#include "PerceptualHash.hpp"
+#include "PipelineStats.hpp"
+#include "PooledMatAllocator.hpp"
+#include "RingQueue.hpp"
+#include "SimulatedDevice.hpp"
+#include "SnapshotEncoder.hpp"
+#include "Utils.hpp"
+
+#include <benchmark/benchmark.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+
+namespace
+{
+
+cv::Mat
+syntheticFrame (
+    void
+)
+{
+    return simulated::frame(defaultCaptureWidth, defaultCaptureHeight);
+}
+
+std::vector<utils::Detection>
+syntheticDetections (
+    size_t count
+)
+{
+    return postProcess(simulated::nmsOutput(count));
+}
+
+// frame queues in the pipeline hold a handful of frames
+constexpr size_t handoffCapacity = 8;
+
+// the mutex and condition variable queue the rings are measured against
+template<typename T>
+class MutexQueue
+{
+public:
+    MutexQueue (size_t capacity, ring::WaitPolicy /*policy*/) : m_capacity(capacity) { }
+
+    void
+    push (T&& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_items.size() < m_capacity; });
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+    }
+
+    bool
+    pop (T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return !m_items.empty(); });
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+private:
+    const size_t m_capacity;
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::deque<T> m_items;
+};
+
+} // end anonymous namespace
+
+static
+void
+BM_PreProcess (
+    benchmark::State& state
+)
+{
+    cv::Mat frame = syntheticFrame();
+    cv::Mat processed;
+    for (auto _ : state)
+    {
+        preProcess(frame, processed);
+        benchmark::DoNotOptimize(processed.data);
+    }
+}
+BENCHMARK(BM_PreProcess);
+
+static
+void
+BM_ClassifyPreprocessImage (
+    benchmark::State& state
+)
+{
+    cv::Mat image = syntheticFrame();
+    cv::Mat processed;
+    for (auto _ : state)
+    {
+        preprocessImage(image, processed);
+        benchmark::DoNotOptimize(processed.data);
+    }
+}
+BENCHMARK(BM_ClassifyPreprocessImage);
+
+static
+void
+BM_PostProcess (
+    benchmark::State& state
+)
+{
+    std::vector<float32_t> output = simulated::nmsOutput(state.range(0));
+    for (auto _ : state)
+    {
+        auto detections = postProcess(output);
+        benchmark::DoNotOptimize(detections.data());
+    }
+    state.counters["detections"] = state.range(0);
+}
+BENCHMARK(BM_PostProcess)->Arg(0)->Arg(1)->Arg(10)->Arg(50)->Arg(200);
+
+// the detect loop's form: one vector reused across frames
+static
+void
+BM_PostProcessReuse (
+    benchmark::State& state
+)
+{
+    std::vector<float32_t> output = simulated::nmsOutput(state.range(0));
+    std::vector<utils::Detection> detections;
+    for (auto _ : state)
+    {
+        postProcess(output, detections);
+        benchmark::DoNotOptimize(detections.data());
+    }
+    state.counters["detections"] = state.range(0);
+}
+BENCHMARK(BM_PostProcessReuse)->Arg(0)->Arg(1)->Arg(10)->Arg(50)->Arg(200);
+
+static
+void
+BM_Softmax (
+    benchmark::State& state
+)
+{
+    std::vector<float> logits(state.range(0));
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist;
+    for (auto& logit : logits)
+        logit = dist(rng);
+
+    for (auto _ : state)
+    {
+        auto probabilities = utils::softmax(logits);
+        benchmark::DoNotOptimize(probabilities.data());
+    }
+}
+BENCHMARK(BM_Softmax)->Arg(1000);
+
+static
+void
+BM_Argmax (
+    benchmark::State& state
+)
+{
+    std::vector<uint8_t> scores(state.range(0));
+    std::mt19937 rng(42);
+    for (auto& score : scores)
+        score = static_cast<uint8_t>(rng());
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(utils::argmax(scores));
+}
+BENCHMARK(BM_Argmax)->Arg(1000);
+
+static
+void
+BM_AnnotateFrame (
+    benchmark::State& state
+)
+{
+    cv::Mat source = syntheticFrame();
+    cv::Mat frame = source.clone();
+    auto detections = syntheticDetections(state.range(0));
+    for (auto _ : state)
+    {
+        annotateFrame(frame, detections, 29.97);
+        benchmark::DoNotOptimize(frame.data);
+    }
+    state.counters["detections"] = state.range(0);
+}
+BENCHMARK(BM_AnnotateFrame)->Arg(0)->Arg(1)->Arg(10)->Arg(50);
+
+static
+void
+BM_DrawRectOnFrame (
+    benchmark::State& state
+)
+{
+    cv::Mat frame = syntheticFrame();
+    cv::Rect rect(100, 100, 200, 300);
+    const cv::String label = "person 87.500000%";
+    for (auto _ : state)
+    {
+        utils::drawRectOnFrame(frame, rect, label);
+        benchmark::DoNotOptimize(frame.data);
+    }
+}
+BENCHMARK(BM_DrawRectOnFrame);
+
+static
+void
+BM_CocoNameFromIndex (
+    benchmark::State& state
+)
+{
+    size_t cls = 0;
+    for (auto _ : state)
+    {
+        auto name = CocoClass::nameFromIndex(cls);
+        benchmark::DoNotOptimize(name);
+        cls = (cls + 1) % (CocoClass::numClasses + 1);
+    }
+}
+BENCHMARK(BM_CocoNameFromIndex);
+
+static
+void
+BM_JpegEncode (
+    benchmark::State& state
+)
+{
+    JpegSettings settings = JpegSettings::fromPreset(static_cast<JpegPreset>(state.range(0)));
+    cv::Mat frame = syntheticFrame();
+    cv::Mat scratch;
+    std::vector<uint8_t> jpg;
+    for (auto _ : state)
+    {
+        SnapshotEncoder::encode(frame, settings, scratch, jpg);
+        benchmark::DoNotOptimize(jpg.data());
+    }
+    state.counters["bytes"] = static_cast<double>(jpg.size());
+    state.SetLabel(state.range(0) == 0 ? "quality" : state.range(0) == 1 ? "baseline" : "fast");
+}
+BENCHMARK(BM_JpegEncode)
+    ->Arg(static_cast<int>(JpegPreset::Quality))
+    ->Arg(static_cast<int>(JpegPreset::Baseline))
+    ->Arg(static_cast<int>(JpegPreset::Fast))
+    ->Unit(benchmark::kMillisecond);
+
+static
+void
+BM_DHash (
+    benchmark::State& state
+)
+{
+    cv::Mat frame = syntheticFrame();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(phash::dHash(frame));
+}
+BENCHMARK(BM_DHash);
+
+// the Mat buffers one frame goes through: capture, the resized model
+// input and a snapshot copy, all released at the end of the frame.
+// Arg 0 is OpenCV's default allocator, arg 1 the pooled one.
+static
+void
+BM_FrameBuffers (
+    benchmark::State& state
+)
+{
+    cv::MatAllocator* allocator = state.range(0) == 0
+        ? cv::Mat::getStdAllocator()
+        : &PooledMatAllocator::instance();
+    cv::Mat source = syntheticFrame();
+    for (auto _ : state)
+    {
+        cv::Mat frame, processed, snapshot;
+        frame.allocator = allocator;
+        processed.allocator = allocator;
+        snapshot.allocator = allocator;
+
+        frame.create(source.size(), source.type());
+        processed.create(yolov8ModelInputHeight, yolov8ModelInputWidth, CV_8UC3);
+        snapshot.create(source.size(), source.type());
+        benchmark::DoNotOptimize(frame.data);
+        benchmark::DoNotOptimize(processed.data);
+        benchmark::DoNotOptimize(snapshot.data);
+    }
+    state.SetLabel(state.range(0) == 0 ? "std" : "pooled");
+}
+BENCHMARK(BM_FrameBuffers)->Arg(0)->Arg(1)->ThreadRange(1, 4);
+
+// cost of the per-stage instrumentation itself: one ScopedStage is what
+// every stage of every frame pays
+static
+void
+BM_HistogramRecord (
+    benchmark::State& state
+)
+{
+    LatencyHistogram histogram;
+    uint64_t value = 1000;
+    for (auto _ : state)
+    {
+        histogram.record(value);
+        value = value * 1103515245 % 100000000;
+    }
+}
+BENCHMARK(BM_HistogramRecord);
+
+static
+void
+BM_ScopedStage (
+    benchmark::State& state
+)
+{
+    PipelineStats stats;
+    for (auto _ : state)
+    {
+        ScopedStage timer(stats, Stage::Postprocess);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ScopedStage);
+
+static
+void
+BM_ScopedStageTracing (
+    benchmark::State& state
+)
+{
+    trace::Config config;
+    config.directory = "/tmp";
+    trace::start(config);
+
+    PipelineStats stats;
+    for (auto _ : state)
+    {
+        ScopedStage timer(stats, Stage::Postprocess);
+        benchmark::ClobberMemory();
+    }
+
+    trace::stop();
+}
+BENCHMARK(BM_ScopedStageTracing);
+
+// frame handoff under contention: even threads push, odd threads pop, one
+// item per iteration each. Every thread runs the same number of
+// iterations, so the queue ends each run empty. Arg 0 parks waiting
+// threads right away, arg 1 spins first; the mutex queue ignores it.
+template<typename Queue>
+static
+void
+BM_Handoff (
+    benchmark::State& state
+)
+{
+    // created before the loop's start barrier, so every thread sees it
+    static std::unique_ptr<Queue> queue;
+    if (state.thread_index() == 0)
+        queue = std::make_unique<Queue>(handoffCapacity, static_cast<ring::WaitPolicy>(state.range(0)));
+
+    const bool producer = state.thread_index() % 2 == 0;
+    uint64_t item = 0;
+    for (auto _ : state)
+    {
+        if (producer)
+        {
+            uint64_t value = item++;
+            queue->push(std::move(value));
+        }
+        else
+        {
+            queue->pop(item);
+            benchmark::DoNotOptimize(item);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(state.range(0) == 0 ? "park" : "spin-then-park");
+
+    if (state.thread_index() == 0)
+        queue.reset();
+}
+BENCHMARK_TEMPLATE(BM_Handoff, MutexQueue<uint64_t>)->Arg(0)->Threads(2)->Threads(4)->Threads(8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Handoff, SpscRing<uint64_t>)->Arg(0)->Arg(1)->Threads(2)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Handoff, MpmcRing<uint64_t>)->Arg(0)->Arg(1)->Threads(2)->Threads(4)->Threads(8)->UseRealTime();
+
+// a full drop-oldest ring: every push evicts the oldest element first
+static
+void
+BM_DropOldestPush (
+    benchmark::State& state
+)
+{
+    MpmcRing<uint64_t> queue(handoffCapacity, ring::WaitPolicy::Park, ring::FullPolicy::DropOldest);
+    uint64_t item = 0;
+    for (auto _ : state)
+    {
+        uint64_t value = item++;
+        queue.push(std::move(value));
+    }
+    benchmark::DoNotOptimize(queue.dropped());
+}
+BENCHMARK(BM_DropOldestPush);
+
+// what the detection log's writer thread pays per frame, encode and
+// copy into the mapped segment; rotates to a fresh segment when full
+static
+void
+BM_DetectionLogAppend (
+    benchmark::State& state
+)
+{
+    const std::string path = "/tmp/bench-detections.dlog";
+    std::vector<utils::Detection> detections = syntheticDetections(state.range(0));
+    dlog::SegmentWriter segment;
+    uint64_t frameId = 0;
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        if (!segment.isOpen() || !segment.append(frameId * 33333, frameId, detections))
+        {
+            state.PauseTiming();
+            bytes += segment.bytes();
+            segment.close();
+            std::remove(path.c_str());
+            segment.open(path, 0, 64 << 20, frameId * 33333, frameId);
+            state.ResumeTiming();
+            segment.append(frameId * 33333, frameId, detections);
+        }
+        frameId++;
+    }
+    bytes += segment.bytes();
+    segment.close();
+    std::remove(path.c_str());
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["bytes_per_frame"] = static_cast<double>(bytes) / state.iterations();
+}
+BENCHMARK(BM_DetectionLogAppend)->Arg(0)->Arg(10)->Arg(50);
+
+// "every person in a two hour window" over three days of synthetic log
+// at 10 fps, hourly segments; arg 0 decodes every record, 1 uses the index
+static
+void
+BM_DetectionQuery (
+    benchmark::State& state
+)
+{
+    static const std::vector<std::string> segments = [] {
+        const std::string directory = "/tmp/bench-dlog-query";
+        std::filesystem::remove_all(directory);
+        dlog::writeSyntheticLog(directory, 3, 10, 0);
+        return dlog::listSegments(directory);
+    }();
+
+    int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    dlog::Query query;
+    query.fromUs = nowUs - 36LL * 3600 * 1000000;
+    query.toUs = query.fromUs + 2LL * 3600 * 1000000;
+    query.classId = CocoClass::indexFromName("person");
+    query.useIndex = state.range(0) == 1;
+
+    dlog::QueryStats stats;
+    size_t matches = 0;
+    for (auto _ : state)
+        matches = dlog::runQuery(segments, query, 4, stats).size();
+
+    state.counters["matches"] = static_cast<double>(matches);
+    state.counters["records_decoded"] = static_cast<double>(stats.records);
+    state.SetLabel(query.useIndex ? "index" : "scan");
+}
+BENCHMARK(BM_DetectionQuery)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// one detect frame as a JSON line, into a buffer reused across frames
+static
+void
+BM_JsonDetectionEvent (
+    benchmark::State& state
+)
+{
+    SinkFrame frame;
+    frame.frameId = 123456;
+    frame.timestamp = std::chrono::system_clock::now();
+    frame.fps = 29.97;
+    frame.detections = syntheticDetections(state.range(0));
+
+    std::string line;
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        line.clear();
+        json::appendDetectionEvent(line, frame);
+        bytes += line.size();
+        benchmark::DoNotOptimize(line.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_JsonDetectionEvent)->Arg(0)->Arg(1)->Arg(10)->Arg(50);
+
+// a typical status line through the asynchronous logger; the flusher
+// writes to /dev/null and is drained outside the timed region so the
+// thread buffer never fills
+static
+void
+BM_LogAsync (
+    benchmark::State& state
+)
+{
+    int devNull = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    logging::Config config;
+    config.outFd = devNull;
+    config.errFd = devNull;
+    config.threadBufferBytes = 1024 * 1024;
+    logging::start(config);
+
+    const std::string path = "/var/lib/detect/out-20250301-142500.avi";
+    uint64_t frames = 0;
+    for (auto _ : state)
+    {
+        LOG_INFO("closed {} after {} frames, {} MB", path, frames, frames * 0.04);
+        if (++frames % 1024 == 0)
+        {
+            state.PauseTiming();
+            logging::flush();
+            state.ResumeTiming();
+        }
+    }
+
+    logging::stop();
+    ::close(devNull);
+    state.counters["dropped"] = static_cast<double>(logging::dropped());
+}
+BENCHMARK(BM_LogAsync);
+
+// the same line the way the sinks used to log it
+static
+void
+BM_LogIostream (
+    benchmark::State& state
+)
+{
+    std::ofstream devNull("/dev/null");
+    const std::string path = "/var/lib/detect/out-20250301-142500.avi";
+    uint64_t frames = 0;
+    for (auto _ : state)
+    {
+        devNull << "[i] closed " << path << " after " << frames << " frames, " << frames * 0.04 << " MB" << std::endl;
+        frames++;
+    }
+}
+BENCHMARK(BM_LogIostream);
+
+// one capture-sized frame with ten detections into the shared memory
+// ring: the copy plus the futex wake, nobody reading
+static
+void
+BM_FrameBusPublish (
+    benchmark::State& state
+)
+{
+    bus::WriterConfig config;
+    config.name = "pipeline_bench";
+    config.frameBytes = defaultCaptureWidth * defaultCaptureHeight * 3;
+    bus::Writer writer(config);
+
+    std::vector<uint8_t> pixels(config.frameBytes, 0x80);
+    std::vector<bus::Detection> detections(10, bus::Detection{ 1, 0.9f, 0.1f, 0.1f, 0.5f, 0.5f });
+    bus::FrameInfo info;
+    info.width = defaultCaptureWidth;
+    info.height = defaultCaptureHeight;
+    info.type = CV_8UC3;
+    info.step = defaultCaptureWidth * 3;
+    for (auto _ : state)
+    {
+        info.frameId++;
+        writer.publish(info, pixels.data(), detections);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * config.frameBytes);
+}
+BENCHMARK(BM_FrameBusPublish);
+
+// what a reader pays to find the newest frame and check it afterwards,
+// without touching the pixels
+static
+void
+BM_FrameBusLatest (
+    benchmark::State& state
+)
+{
+    bus::WriterConfig config;
+    config.name = "pipeline_bench";
+    config.frameBytes = defaultCaptureWidth * defaultCaptureHeight * 3;
+    bus::Writer writer(config);
+
+    std::vector<uint8_t> pixels(config.frameBytes);
+    bus::FrameInfo info;
+    info.width = defaultCaptureWidth;
+    info.height = defaultCaptureHeight;
+    info.step = defaultCaptureWidth * 3;
+    writer.publish(info, pixels.data(), {});
+
+    bus::Reader reader;
+    std::string error;
+    if (!reader.open(config.name, error))
+    {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+    for (auto _ : state)
+    {
+        bus::FrameView view;
+        benchmark::DoNotOptimize(reader.latest(view));
+        benchmark::DoNotOptimize(reader.valid(view));
+    }
+}
+BENCHMARK(BM_FrameBusLatest);
+
+// a directory of capture-sized JPEGs decoded through the prefetcher by
+// 1, 2 and 4 threads, drained in order by one consumer
+static
+void
+BM_ImageSourcePrefetch (
+    benchmark::State& state
+)
+{
+    static const std::string directory = [] {
+        const std::string path = "/tmp/bench-frames";
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+        for (uint64_t i = 0; i < 32; i++)
+        {
+            char name[64];
+            std::snprintf(name, sizeof(name), "/frame%03llu.jpg", static_cast<unsigned long long>(i));
+            cv::imwrite(path + name, simulated::frame(defaultCaptureWidth, defaultCaptureHeight, i));
+        }
+        return path;
+    }();
+
+    PrefetchConfig config;
+    config.threads = static_cast<size_t>(state.range(0));
+    size_t frames = 0;
+    for (auto _ : state)
+    {
+        FramePrefetcher prefetcher(std::make_unique<ImageSource>(directory), config);
+        SourceFrame frame;
+        while (prefetcher.next(frame))
+            frames++;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(frames));
+}
+BENCHMARK(BM_ImageSourcePrefetch)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
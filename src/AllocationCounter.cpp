@@ -0,0 +1,198 @@
+#include "AllocationCounter.hpp"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+
+namespace
+{
+
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> frees{0};
+std::atomic<uint64_t> liveBytes{0};
+std::array<std::atomic<uint64_t>, alloc::maxTags> tagAllocations{};
+
+// one cache line per thread so counting never bounces between cores;
+// threads past maxThreads share the last slot
+struct alignas(64) ThreadSlot
+{
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> allocations{0};
+};
+
+std::array<ThreadSlot, alloc::maxThreads> threadSlots;
+std::atomic<size_t> threadSlotsUsed{0};
+thread_local ThreadSlot* currentSlot = nullptr;
+
+void
+countAllocation (
+    void* p
+)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    liveBytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    tagAllocations[alloc::currentTag].fetch_add(1, std::memory_order_relaxed);
+
+    if (currentSlot == nullptr)
+    {
+        size_t index = threadSlotsUsed.fetch_add(1, std::memory_order_relaxed);
+        currentSlot = &threadSlots[index < alloc::maxThreads ? index : alloc::maxThreads - 1];
+    }
+    currentSlot->allocations.fetch_add(1, std::memory_order_relaxed);
+    if (alloc::threadName != nullptr)
+        currentSlot->name.store(alloc::threadName, std::memory_order_relaxed);
+}
+
+void*
+countedAlloc (
+    std::size_t size,
+    std::size_t alignment
+)
+{
+    if (size == 0)
+        size = 1;
+
+    void* p = nullptr;
+    if (alignment > alignof(std::max_align_t))
+    {
+        if (posix_memalign(&p, alignment, size) != 0)
+            p = nullptr;
+    }
+    else
+    {
+        p = std::malloc(size);
+    }
+
+    if (p != nullptr)
+        countAllocation(p);
+    return p;
+}
+
+void
+countedFree (
+    void* p
+)
+{
+    if (p == nullptr)
+        return;
+
+    frees.fetch_add(1, std::memory_order_relaxed);
+    liveBytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+    std::free(p);
+}
+
+} // end anonymous namespace
+
+namespace alloc
+{
+
+Counts
+totals (
+    void
+)
+{
+    return Counts {
+        .allocations = allocations.load(std::memory_order_relaxed),
+        .frees = frees.load(std::memory_order_relaxed),
+        .liveBytes = liveBytes.load(std::memory_order_relaxed)
+    };
+}
+
+Snapshot
+snapshot (
+    void
+)
+{
+    Snapshot result;
+    for (size_t i = 0; i < maxTags; i++)
+        result.perTag[i] = tagAllocations[i].load(std::memory_order_relaxed);
+
+    size_t used = std::min(threadSlotsUsed.load(std::memory_order_relaxed), maxThreads);
+    result.perThread.reserve(used);
+    for (size_t i = 0; i < used; i++)
+    {
+        result.perThread.push_back({
+            threadSlots[i].name.load(std::memory_order_relaxed),
+            threadSlots[i].allocations.load(std::memory_order_relaxed)
+        });
+    }
+
+    // last, so the totals cover at least everything in the breakdown
+    result.totals = totals();
+    return result;
+}
+
+} // end namespace alloc
+
+void*
+operator new (
+    std::size_t size
+)
+{
+    void* p = countedAlloc(size, alignof(std::max_align_t));
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void*
+operator new[] (
+    std::size_t size
+)
+{
+    return operator new(size);
+}
+
+void*
+operator new (
+    std::size_t size,
+    std::align_val_t alignment
+)
+{
+    void* p = countedAlloc(size, static_cast<std::size_t>(alignment));
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void*
+operator new[] (
+    std::size_t size,
+    std::align_val_t alignment
+)
+{
+    return operator new(size, alignment);
+}
+
+void*
+operator new (
+    std::size_t size,
+    const std::nothrow_t&
+) noexcept
+{
+    return countedAlloc(size, alignof(std::max_align_t));
+}
+
+void*
+operator new[] (
+    std::size_t size,
+    const std::nothrow_t&
+) noexcept
+{
+    return countedAlloc(size, alignof(std::max_align_t));
+}
+
+void operator delete (void* p) noexcept { countedFree(p); }
+void operator delete[] (void* p) noexcept { countedFree(p); }
+void operator delete (void* p, std::size_t) noexcept { countedFree(p); }
+void operator delete[] (void* p, std::size_t) noexcept { countedFree(p); }
+void operator delete (void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[] (void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete (void* p, std::size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[] (void* p, std::size_t, std::align_val_t) noexcept { countedFree(p); }
@@ -0,0 +1,85 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Counts heap traffic through the global operator new/delete. Linking
+// AllocationCounter.cpp into a binary replaces those operators with
+// versions that bump a few relaxed atomics before calling malloc/free;
+// binaries that don't link it are unaffected. detect links it only when
+// configured with -DDETECT_COUNT_ALLOCATIONS=ON.
+//
+// Allocations are also attributed to the allocating thread and to the
+// tag that thread has set, which ScopedStage points at the current
+// pipeline stage. Memory that OpenCV allocates for Mat pixel data goes
+// through cv::fastMalloc rather than operator new and is not counted;
+// PooledMatAllocator's stats count those buffers instead.
+namespace alloc
+{
+
+constexpr size_t maxTags = 16;
+constexpr size_t maxThreads = 64;
+
+// 0 is "untagged"; the tag and name only take effect while counting is linked in
+inline thread_local size_t currentTag = 0;
+inline thread_local const char* threadName = nullptr;
+
+// name must be a string literal or otherwise outlive the process
+inline
+void
+nameThread (
+    const char* name
+)
+{
+    threadName = name;
+}
+
+class ScopedTag
+{
+public:
+    explicit ScopedTag (size_t tag) : m_previous(currentTag) { currentTag = tag < maxTags ? tag : 0; }
+    ~ScopedTag () { currentTag = m_previous; }
+
+    ScopedTag (const ScopedTag&) = delete;
+    ScopedTag& operator= (const ScopedTag&) = delete;
+
+private:
+    const size_t m_previous;
+};
+
+struct Counts
+{
+    uint64_t allocations;
+    uint64_t frees;
+
+    // usable size of the blocks currently allocated through operator new
+    uint64_t liveBytes;
+};
+
+struct ThreadCounts
+{
+    const char* name;
+    uint64_t allocations;
+};
+
+// point in time copy of every counter, for computing rates between two
+struct Snapshot
+{
+    Counts totals;
+    std::array<uint64_t, maxTags> perTag;
+
+    // one entry per thread that has allocated, in order of first allocation
+    std::vector<ThreadCounts> perThread;
+};
+
+Counts totals ();
+
+Snapshot snapshot ();
+
+} // end namespace alloc
+
+#endif // ALLOCATION_COUNTER_H
@@ -0,0 +1,73 @@
+#ifndef ALLOCATION_REPORT_H
+#define ALLOCATION_REPORT_H
+
+#include "AllocationCounter.hpp"
+#include "PipelineStats.hpp"
+
+#include <cstdio>
+#include <ostream>
+
+
+namespace alloc
+{
+
+inline
+const char*
+tagName (
+    size_t tag
+)
+{
+    if (tag == 0 || tag > PipelineStats::stageCount)
+        return "(untagged)";
+    return stageName(static_cast<Stage>(tag - 1));
+}
+
+// allocations between two snapshots divided by the frames processed in
+// between, by stage and by thread; quiet stages and threads are left out
+inline
+void
+reportPerFrame (
+    std::ostream& out,
+    const Snapshot& from,
+    const Snapshot& to,
+    uint64_t frames
+)
+{
+    if (frames == 0)
+        return;
+
+    char line[128];
+    double perFrame = static_cast<double>(to.totals.allocations - from.totals.allocations) / frames;
+    std::snprintf(line, sizeof(line), "[i] allocations per frame: %.2f (%llu frames, %.1f KB live)\n",
+        perFrame,
+        static_cast<unsigned long long>(frames),
+        to.totals.liveBytes / 1024.0);
+    out << line;
+
+    for (size_t tag = 0; tag < maxTags; tag++)
+    {
+        uint64_t count = to.perTag[tag] - from.perTag[tag];
+        if (count == 0)
+            continue;
+        std::snprintf(line, sizeof(line), "[i]   stage  %-14s %10.2f\n",
+            tagName(tag), static_cast<double>(count) / frames);
+        out << line;
+    }
+
+    for (size_t i = 0; i < to.perThread.size(); i++)
+    {
+        uint64_t before = i < from.perThread.size() ? from.perThread[i].allocations : 0;
+        uint64_t count = to.perThread[i].allocations - before;
+        if (count == 0)
+            continue;
+        const char* name = to.perThread[i].name != nullptr ? to.perThread[i].name : "(unnamed)";
+        std::snprintf(line, sizeof(line), "[i]   thread %-14s %10.2f\n",
+            name, static_cast<double>(count) / frames);
+        out << line;
+    }
+    out.flush();
+}
+
+} // end namespace alloc
+
+#endif // ALLOCATION_REPORT_H
@@ -0,0 +1,95 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// Hands out byte buffers that return to the pool, capacity intact, when
+// their last reference goes away. Buffers may outlive the pool.
+class BufferPool : public std::enable_shared_from_this<BufferPool>
+{
+public:
+    using Buffer = std::vector<uint8_t>;
+
+    static
+    std::shared_ptr<BufferPool>
+    create (size_t maxPooled)
+    {
+        return std::shared_ptr<BufferPool>(new BufferPool(maxPooled));
+    }
+
+    std::shared_ptr<Buffer>
+    acquire ()
+    {
+        Buffer* buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_free.empty())
+            {
+                buffer = m_free.back().release();
+                m_free.pop_back();
+            }
+            else
+            {
+                m_allocated++;
+            }
+        }
+        if (!buffer)
+            buffer = new Buffer();
+
+        std::weak_ptr<BufferPool> pool = weak_from_this();
+        return std::shared_ptr<Buffer>(buffer, [pool](Buffer* released) {
+            if (auto owner = pool.lock())
+                owner->release(released);
+            else
+                delete released;
+        });
+    }
+
+    // raises or lowers how many idle buffers are kept; surplus ones are
+    // freed as they come back
+    void
+    setMaxPooled (size_t maxPooled)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxPooled = maxPooled;
+    }
+
+    // buffers currently alive, in use or pooled
+    size_t
+    allocated () const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_allocated;
+    }
+
+private:
+    explicit BufferPool (size_t maxPooled)
+    :
+        m_maxPooled(maxPooled)
+    { }
+
+    void
+    release (Buffer* buffer)
+    {
+        buffer->clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.size() < m_maxPooled)
+        {
+            m_free.emplace_back(buffer);
+            return;
+        }
+        m_allocated--;
+        delete buffer;
+    }
+
+    mutable std::mutex m_mutex;
+    size_t m_maxPooled;
+    std::vector<std::unique_ptr<Buffer>> m_free;
+    size_t m_allocated = 0;
+};
+
+#endif // BUFFER_POOL_H
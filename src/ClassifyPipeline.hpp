@@ -0,0 +1,22 @@
+#ifndef CLASSIFY_PIPELINE_H
+#define CLASSIFY_PIPELINE_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+
+constexpr int resnetInputSize = 224;
+
+// BGR image of any size to the RGB 224x224 input resnet_v1_50 expects
+inline
+void
+preprocessImage (
+    const cv::Mat& imageIn,
+    cv::Mat& imageOut
+)
+{
+    cv::cvtColor(imageIn, imageOut, cv::COLOR_BGR2RGB);
+    cv::resize(imageOut, imageOut, cv::Size(resnetInputSize, resnetInputSize));
+}
+
+#endif // CLASSIFY_PIPELINE_H
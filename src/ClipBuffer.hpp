@@ -0,0 +1,79 @@
+#ifndef CLIP_BUFFER_H
+#define CLIP_BUFFER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+
+struct EncodedFrame
+{
+    uint64_t frameId;
+    std::chrono::system_clock::time_point timestamp;
+    std::shared_ptr<const std::vector<uint8_t>> data;
+};
+
+// The most recent compressed frames, bounded by total bytes and by age.
+// Frames are shared, so copying a window out for a clip costs no pixel
+// copies. Oldest frames are evicted first. Not thread safe.
+class ClipBuffer
+{
+public:
+    ClipBuffer (size_t maxBytes, std::chrono::system_clock::duration maxAge)
+    :
+        m_maxBytes(maxBytes),
+        m_maxAge(maxAge)
+    { }
+
+    void
+    push (EncodedFrame frame)
+    {
+        m_bytes += frame.data->size();
+        auto newest = frame.timestamp;
+        m_frames.push_back(std::move(frame));
+        while (!m_frames.empty()
+            && (m_bytes > m_maxBytes || newest - m_frames.front().timestamp > m_maxAge))
+        {
+            if (m_bytes > m_maxBytes)
+                m_evicted++;
+            m_bytes -= m_frames.front().data->size();
+            m_frames.pop_front();
+        }
+        m_peakBytes = std::max(m_peakBytes, m_bytes);
+    }
+
+    // every buffered frame at or after since, oldest first
+    std::vector<EncodedFrame>
+    since (std::chrono::system_clock::time_point since) const
+    {
+        std::vector<EncodedFrame> result;
+        for (const auto& frame : m_frames)
+        {
+            if (frame.timestamp >= since)
+                result.push_back(frame);
+        }
+        return result;
+    }
+
+    size_t size () const { return m_frames.size(); }
+    size_t bytes () const { return m_bytes; }
+    size_t peakBytes () const { return m_peakBytes; }
+
+    // frames pushed out by the byte limit before they aged out, i.e.
+    // pre-roll lost to the memory budget
+    uint64_t evicted () const { return m_evicted; }
+
+private:
+    const size_t m_maxBytes;
+    const std::chrono::system_clock::duration m_maxAge;
+
+    std::deque<EncodedFrame> m_frames;
+    size_t m_bytes = 0;
+    size_t m_peakBytes = 0;
+    uint64_t m_evicted = 0;
+};
+
+#endif // CLIP_BUFFER_H
@@ -0,0 +1,194 @@
+#include "ClipSink.hpp"
+
+#include "DetectPipeline.hpp"
+#include "FrameTrace.hpp"
+#include "Log.hpp"
+#include "RecordingSink.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+
+namespace
+{
+
+// JPEG buffers kept for reuse until the frame rate is known
+constexpr size_t minPooledBuffers = 16;
+
+} // end anonymous namespace
+
+ClipSink::ClipSink (
+    ClipConfig config
+)
+:
+    m_config(std::move(config)),
+    m_jpegFlags({ cv::IMWRITE_JPEG_QUALITY, m_config.jpegQuality }),
+    m_pool(BufferPool::create(minPooledBuffers)),
+    m_queue(m_config.writeQueue, ring::WaitPolicy::Park),
+    m_pooledBuffers(minPooledBuffers),
+    m_buffer(m_config.maxBytes, m_config.preRoll),
+    m_writer(&ClipSink::writeClips, this)
+{ }
+
+ClipSink::~ClipSink (
+    void
+)
+{
+    close();
+}
+
+void
+ClipSink::consume (
+    const SinkFrame& frame
+)
+{
+    // other sinks share the pixels, so draw on a copy
+    frame.frame.copyTo(m_canvas);
+    annotateFrame(m_canvas, frame.detections, frame.fps);
+
+    // a clip holds its frames until the writer is done with it and then
+    // lets go of most of them at once; keeping that many buffers lets the
+    // next clip encode into them instead of allocating
+    if (frame.fps > 0)
+    {
+        auto clipSeconds = std::chrono::duration<double>(m_config.preRoll + m_config.postRoll).count();
+        size_t clipFrames = static_cast<size_t>(std::ceil(clipSeconds * frame.fps));
+        if (clipFrames > m_pooledBuffers)
+        {
+            m_pooledBuffers = clipFrames;
+            m_pool->setMaxPooled(m_pooledBuffers);
+        }
+    }
+
+    auto jpg = m_pool->acquire();
+    uint64_t startNs = trace::nowNs();
+    bool ok = cv::imencode(".jpg", m_canvas, *jpg, m_jpegFlags);
+    uint64_t endNs = trace::nowNs();
+    trace::record("clip encode", startNs, endNs);
+    if (!ok)
+    {
+        LOG_ERROR("clip frame encode failed");
+        return;
+    }
+    m_encoded++;
+    m_totalEncodeUs += (endNs - startNs) / 1000;
+
+    EncodedFrame encoded { frame.frameId, frame.timestamp, std::move(jpg) };
+    bool detected = !frame.detections.empty();
+    if (detected && !m_active)
+    {
+        // the event; everything still buffered is its pre-roll
+        m_active = true;
+        m_clip.event = frame.timestamp;
+        m_clip.frames = m_buffer.since(frame.timestamp - m_config.preRoll);
+        m_clipBytes = 0;
+        for (const auto& buffered : m_clip.frames)
+            m_clipBytes += buffered.data->size();
+    }
+    if (detected)
+        m_lastDetection = frame.timestamp;
+
+    m_buffer.push(encoded);
+    m_bufferedBytes.store(m_buffer.bytes(), std::memory_order_relaxed);
+
+    if (!m_active)
+        return;
+    m_clipBytes += encoded.data->size();
+    m_clip.frames.push_back(std::move(encoded));
+    if (frame.timestamp - m_lastDetection >= m_config.postRoll || m_clipBytes >= m_config.maxBytes)
+        finishClip();
+}
+
+uint64_t
+ClipSink::bufferedBytes (
+    void
+) const
+{
+    return m_bufferedBytes.load(std::memory_order_relaxed);
+}
+
+void
+ClipSink::close (
+    void
+)
+{
+    if (m_active)
+        finishClip();
+    m_queue.close();
+    if (!m_writer.joinable())
+        return;
+    m_writer.join();
+
+    LOG_INFO("clips: {} written, {} dropped, buffer peak {} KB, {} frames of pre-roll over budget, avg encode {}us",
+        m_written, m_droppedClips, m_buffer.peakBytes() / 1024, m_buffer.evicted(),
+        m_encoded > 0 ? m_totalEncodeUs / m_encoded : 0);
+}
+
+void
+ClipSink::finishClip (
+    void
+)
+{
+    m_active = false;
+    m_clipBytes = 0;
+    if (!m_queue.tryPush(std::move(m_clip)))
+    {
+        m_droppedClips++;
+        LOG_ERROR("clip writer fell behind, clip dropped");
+    }
+    m_clip = Clip();
+}
+
+void
+ClipSink::writeClips (
+    void
+)
+{
+    trace::setThreadName("clip-writer");
+    placement::registerThread("clip-writer");
+    Clip clip;
+    while (m_queue.pop(clip))
+    {
+        if (writeClip(clip))
+            m_written++;
+        clip = Clip();
+    }
+}
+
+bool
+ClipSink::writeClip (
+    const Clip& clip
+)
+{
+    std::string path = timestampedPath(m_config.path, clip.event, ".mjpg");
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (out == nullptr)
+    {
+        LOG_ERROR("failed to open {} for writing", path);
+        return false;
+    }
+
+    size_t bytes = 0;
+    bool ok = true;
+    for (const auto& frame : clip.frames)
+    {
+        ok = ok && std::fwrite(frame.data->data(), 1, frame.data->size(), out) == frame.data->size();
+        bytes += frame.data->size();
+    }
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok)
+    {
+        LOG_ERROR("failed to write {}", path);
+        return false;
+    }
+
+    auto preRoll = clip.frames.empty()
+        ? std::chrono::milliseconds(0)
+        : std::chrono::duration_cast<std::chrono::milliseconds>(clip.event - clip.frames.front().timestamp);
+    LOG_INFO("clip written to {}: {} frames, {} KB, {}s before the event",
+        path, clip.frames.size(), bytes / 1024, preRoll.count() / 1000.0);
+    return true;
+}
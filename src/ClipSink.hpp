@@ -0,0 +1,97 @@
+#ifndef CLIP_SINK_H
+#define CLIP_SINK_H
+
+#include "BufferPool.hpp"
+#include "ClipBuffer.hpp"
+#include "FrameSink.hpp"
+#include "RingQueue.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct ClipConfig
+{
+    // clips are named <stem>-<YYYYmmdd-HHMMSS><extension> after the event
+    std::string path;
+
+    // an event is the first frame with detections after a quiet stretch;
+    // a clip holds preRoll before it and ends postRoll after the last
+    // frame with detections
+    std::chrono::seconds preRoll{10};
+    std::chrono::seconds postRoll{10};
+
+    // JPEG bytes kept for the pre-roll; the same budget caps a single
+    // clip, which is cut short and written when it reaches it
+    size_t maxBytes = 32 << 20;
+
+    int jpegQuality = 75;
+
+    // finished clips waiting for the writer; beyond that a clip is dropped
+    size_t writeQueue = 2;
+};
+
+// Pre/post-event clips. Every frame is annotated and JPEG compressed on
+// the sink's thread and kept in a ClipBuffer, so the pre-roll costs tens
+// of kilobytes per frame instead of a raw frame. Clips are written as
+// motion JPEG, the compressed frames back to back, by a writer thread
+// of their own; VLC, ffplay and cv::VideoCapture play them.
+class ClipSink : public FrameSink
+{
+public:
+    explicit ClipSink (ClipConfig config);
+
+    ~ClipSink () override;
+
+    const char* name () const override { return "clip"; }
+    bool needsPixels () const override { return true; }
+
+    void consume (const SinkFrame& frame) override;
+    uint64_t bufferedBytes () const override;
+    void close () override;
+
+private:
+    struct Clip
+    {
+        std::chrono::system_clock::time_point event;
+        std::vector<EncodedFrame> frames;
+    };
+
+    const ClipConfig m_config;
+    const std::vector<int> m_jpegFlags;
+    std::shared_ptr<BufferPool> m_pool;
+    SpscRing<Clip> m_queue;
+
+    // sink thread only
+    size_t m_pooledBuffers;
+    cv::Mat m_canvas;
+    ClipBuffer m_buffer;
+    Clip m_clip;
+    size_t m_clipBytes = 0;
+    bool m_active = false;
+    std::chrono::system_clock::time_point m_lastDetection;
+    uint64_t m_encoded = 0;
+    uint64_t m_totalEncodeUs = 0;
+    uint64_t m_droppedClips = 0;
+
+    // writer thread only
+    uint64_t m_written = 0;
+
+    std::atomic<uint64_t> m_bufferedBytes{0};
+
+    // last, so everything above exists before the thread starts
+    std::thread m_writer;
+
+    void finishClip ();
+    void writeClips ();
+    bool writeClip (const Clip& clip);
+};
+
+#endif // CLIP_SINK_H
@@ -9,11 +9,12 @@ public:
     static constexpr size_t numClasses = 80;
     static constexpr size_t boxesPerClass = 100;
 
+    // static storage, so naming a detection never allocates
     static
-    std::string
+    const char*
     nameFromIndex (size_t cls)
     {
-        std::string result = "N/A";
+        const char* result = "N/A";
         switch(cls)
         {
         case 0:  result = "__background__"; break;
@@ -100,6 +101,19 @@ public:
         }
         return result;
     }
+
+    // -1 if name is not a class
+    static
+    int
+    indexFromName (const std::string& name)
+    {
+        for (size_t cls = 1; cls <= numClasses; cls++)
+        {
+            if (name == nameFromIndex(cls))
+                return static_cast<int>(cls);
+        }
+        return -1;
+    }
 };
 
 #endif // COCO_CLASS_H
\ No newline at end of file
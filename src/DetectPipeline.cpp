@@ -0,0 +1,96 @@
+#include "DetectPipeline.hpp"
+
+#include "CocoClass.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <cassert>
+#include <cstdio>
+
+
+void
+preProcess (
+    cv::InputArray& inputFrame,
+    cv::OutputArray& processed,
+    int interpolation
+)
+{
+    cv::resize(
+        inputFrame,
+        processed,
+        cv::Size(yolov8ModelInputHeight, yolov8ModelInputWidth),
+        0,
+        0,
+        interpolation);
+}
+
+void
+postProcess (
+    const std::vector<float32_t>& inferenceOutput,
+    std::vector<utils::Detection>& detections
+)
+{
+    assert(sizeof(float32_t) == 4);
+
+    detections.clear();
+    const float32_t* data = inferenceOutput.data();
+    size_t offset = 0;
+    
+    // skip class index 0: _background_ which is not detected
+    for (size_t classIndex = 1; classIndex < CocoClass::numClasses; classIndex++)
+    {
+        float32_t detCount = *(data + offset);
+        offset++;
+
+        for (size_t detIndex = 0; detIndex < detCount; detIndex++)
+        {
+            utils::Detection det;
+            hailo_bbox_float32_t bbox =
+                *(reinterpret_cast<const hailo_bbox_float32_t*>(data + offset));
+            det.classId = classIndex;
+            det.boundingBox = bbox;
+            detections.push_back(det);
+            offset += 5; // each bbox is 5 floats wide
+        }
+    }
+}
+
+std::vector<utils::Detection>
+postProcess (
+    const std::vector<float32_t>& inferenceOutput
+)
+{
+    std::vector<utils::Detection> detections;
+    postProcess(inferenceOutput, detections);
+    return detections;
+}
+
+void
+annotateFrame (
+    cv::InputOutputArray& frame,
+    const std::vector<utils::Detection>& detections,
+    double fps
+)
+{
+    // formatted in place into per thread strings whose capacity survives
+    // from frame to frame
+    thread_local cv::String fpsString, boxLabel;
+    char text[64];
+    // sources other than a camera deliver frames of any size
+    const cv::Size size = frame.size();
+
+    for (const auto& detection : detections)
+    {
+        std::snprintf(text, sizeof(text), "%s %f%%",
+            CocoClass::nameFromIndex(detection.classId),
+            detection.boundingBox.score * 100);
+        boxLabel.assign(text);
+        cv::Rect rect = utils::rectFromDetection(detection,
+            static_cast<size_t>(size.width),
+            static_cast<size_t>(size.height));
+        utils::drawRectOnFrame(frame, rect, boxLabel);
+    }
+    std::snprintf(text, sizeof(text), "FPS: %f", fps);
+    fpsString.assign(text);
+    utils::drawFpsLabel(frame, fpsString);
+}
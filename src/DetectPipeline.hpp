@@ -0,0 +1,47 @@
+#ifndef DETECT_PIPELINE_H
+#define DETECT_PIPELINE_H
+
+#include <hailo/hailort.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "Utils.hpp"
+
+#include <string>
+#include <vector>
+
+
+constexpr size_t defaultCaptureHeight = 600;
+constexpr size_t defaultCaptureWidth = 800;
+constexpr size_t yolov8ModelInputHeight = 640;
+constexpr size_t yolov8ModelInputWidth = 640;
+constexpr size_t defaultDeviceId = 0;
+constexpr size_t inputSize = yolov8ModelInputHeight * yolov8ModelInputHeight * 3;
+
+// stretches the frame to the model input; interpolation is a cv::InterpolationFlags
+void
+preProcess (
+    cv::InputArray& inputFrame,
+    cv::OutputArray& processed,
+    int interpolation = cv::INTER_LINEAR);
+
+// replaces the contents of detections, reusing its capacity so a warmed
+// up caller does not allocate
+void
+postProcess (
+    const std::vector<float32_t>& inferenceOutput,
+    std::vector<utils::Detection>& detections);
+
+std::vector<utils::Detection>
+postProcess (
+    const std::vector<float32_t>& inferenceOutput);
+
+// boxes, labels and the FPS counter, drawn into frame; the boxes'
+// relative coordinates are scaled to frame's own size
+void
+annotateFrame (
+    cv::InputOutputArray& frame,
+    const std::vector<utils::Detection>& detections,
+    double fps);
+
+#endif // DETECT_PIPELINE_H
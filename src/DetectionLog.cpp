@@ -0,0 +1,555 @@
+#include "DetectionLog.hpp"
+
+#include "Log.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+#include <utility>
+
+
+namespace dlog
+{
+
+namespace
+{
+
+constexpr size_t maxVarintBytes = 10;
+
+uint64_t
+zigzag (
+    int64_t value
+)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t
+unzigzag (
+    uint64_t value
+)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+size_t
+varintSize (
+    uint64_t value
+)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+uint8_t*
+putVarint (
+    uint8_t* out,
+    uint64_t value
+)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+// false if the varint runs past end or is too long
+bool
+getVarint (
+    const uint8_t*& in,
+    const uint8_t* end,
+    uint64_t& value
+)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && in < end; shift += 7)
+    {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+uint16_t
+quantize (
+    float value
+)
+{
+    return static_cast<uint16_t>(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+uint8_t*
+putU16 (
+    uint8_t* out,
+    uint16_t value
+)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    return out + 2;
+}
+
+SegmentHeader&
+headerAt (
+    uint8_t* base
+)
+{
+    return *reinterpret_cast<SegmentHeader*>(base);
+}
+
+} // end anonymous namespace
+
+SegmentIndex::SegmentIndex (
+    uint32_t blockRecords
+)
+:
+    m_blockRecords(std::max<uint32_t>(blockRecords, 1))
+{ }
+
+void
+SegmentIndex::addRecord (
+    size_t offset,
+    int64_t timestampUs,
+    int64_t previousTimestampUs,
+    uint64_t previousFrameId
+)
+{
+    if (m_entries.empty() || m_entries.back().records >= m_blockRecords)
+    {
+        IndexEntry entry = {};
+        entry.firstTimestampUs = timestampUs;
+        entry.lastTimestampUs = timestampUs;
+        entry.offset = offset;
+        entry.previousTimestampUs = previousTimestampUs;
+        entry.previousFrameId = previousFrameId;
+        m_entries.push_back(entry);
+    }
+
+    // timestamps may step back when the clock is adjusted
+    IndexEntry& entry = m_entries.back();
+    entry.firstTimestampUs = std::min(entry.firstTimestampUs, timestampUs);
+    entry.lastTimestampUs = std::max(entry.lastTimestampUs, timestampUs);
+    entry.records++;
+}
+
+void
+SegmentIndex::addDetection (
+    int classId,
+    uint16_t score
+)
+{
+    IndexEntry& entry = m_entries.back();
+    int bit = std::clamp(classId, 0, 127);
+    entry.classes[bit / 64] |= uint64_t(1) << (bit % 64);
+    entry.maxScore = std::max(entry.maxScore, score);
+}
+
+bool
+SegmentIndex::save (
+    const std::string& path,
+    const SegmentHeader& segment
+) const
+{
+    IndexHeader header = {};
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.headerSize = sizeof(IndexHeader);
+    header.blockRecords = m_blockRecords;
+    header.entries = static_cast<uint32_t>(m_entries.size());
+    header.baseTimestampUs = segment.baseTimestampUs;
+    header.dataBytes = segment.dataBytes;
+
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (out == nullptr)
+        return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1
+        && std::fwrite(m_entries.data(), sizeof(IndexEntry), m_entries.size(), out) == m_entries.size();
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok)
+        std::remove(path.c_str());
+    return ok;
+}
+
+bool
+SegmentIndex::load (
+    const std::string& path,
+    const SegmentHeader& segment
+)
+{
+    m_entries.clear();
+    FILE* in = std::fopen(path.c_str(), "rb");
+    if (in == nullptr)
+        return false;
+
+    IndexHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, in) == 1
+        && std::memcmp(header.magic, indexMagic, sizeof(indexMagic)) == 0
+        && header.version == indexVersion
+        && header.headerSize == sizeof(IndexHeader)
+        && header.baseTimestampUs == segment.baseTimestampUs
+        && header.dataBytes == segment.dataBytes;
+    if (ok)
+    {
+        m_blockRecords = header.blockRecords;
+        m_entries.resize(header.entries);
+        ok = std::fread(m_entries.data(), sizeof(IndexEntry), m_entries.size(), in) == m_entries.size();
+    }
+    std::fclose(in);
+    if (!ok)
+        m_entries.clear();
+    return ok;
+}
+
+SegmentWriter::~SegmentWriter (
+    void
+)
+{
+    close();
+}
+
+bool
+SegmentWriter::open (
+    const std::string& path,
+    uint32_t streamId,
+    size_t capacity,
+    int64_t baseTimestampUs,
+    uint64_t baseFrameId
+)
+{
+    close();
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+    {
+        LOG_ERROR("failed to create {}: {}", path, std::strerror(errno));
+        return false;
+    }
+
+    capacity = std::max(capacity, sizeof(SegmentHeader) + maxRecordBytes(0));
+    void* mapped = MAP_FAILED;
+    if (::ftruncate(m_fd, static_cast<off_t>(capacity)) == 0)
+        mapped = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        LOG_ERROR("failed to map {}: {}", path, std::strerror(errno));
+        ::close(m_fd);
+        ::unlink(path.c_str());
+        m_fd = -1;
+        return false;
+    }
+
+    m_path = path;
+    m_base = static_cast<uint8_t*>(mapped);
+    m_capacity = capacity;
+    m_offset = sizeof(SegmentHeader);
+    m_lastTimestampUs = baseTimestampUs;
+    m_lastFrameId = baseFrameId;
+    m_index.clear();
+
+    SegmentHeader& header = headerAt(m_base);
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.headerSize = sizeof(SegmentHeader);
+    header.streamId = streamId;
+    header.flags = 0;
+    header.baseTimestampUs = baseTimestampUs;
+    header.baseFrameId = baseFrameId;
+    header.dataBytes = 0;
+    header.records = 0;
+    header.lastTimestampUs = baseTimestampUs;
+    return true;
+}
+
+size_t
+SegmentWriter::maxRecordBytes (
+    size_t detections
+)
+{
+    return 4 * maxVarintBytes + detections * (1 + 5 * sizeof(uint16_t));
+}
+
+bool
+SegmentWriter::append (
+    int64_t timestampUs,
+    uint64_t frameId,
+    const std::vector<utils::Detection>& detections
+)
+{
+    const size_t count = detections.size();
+    const uint64_t timestampDelta = zigzag(timestampUs - m_lastTimestampUs);
+    const uint64_t frameDelta = zigzag(static_cast<int64_t>(frameId - m_lastFrameId));
+    const size_t bodyBytes = varintSize(timestampDelta) + varintSize(frameDelta) + varintSize(count)
+        + count * (1 + 5 * sizeof(uint16_t));
+    if (m_offset + varintSize(bodyBytes) + bodyBytes > m_capacity)
+        return false;
+
+    m_index.addRecord(m_offset, timestampUs, m_lastTimestampUs, m_lastFrameId);
+    uint8_t* out = putVarint(m_base + m_offset, bodyBytes);
+    out = putVarint(out, timestampDelta);
+    out = putVarint(out, frameDelta);
+    out = putVarint(out, count);
+
+    // one array per field, so columns of similar values sit together
+    for (const auto& detection : detections)
+        *out++ = static_cast<uint8_t>(std::clamp(detection.classId, 0, 255));
+    for (const auto& detection : detections)
+    {
+        uint16_t score = quantize(detection.boundingBox.score);
+        m_index.addDetection(detection.classId, score);
+        out = putU16(out, score);
+    }
+    for (const auto& detection : detections)
+        out = putU16(out, quantize(detection.boundingBox.x_min));
+    for (const auto& detection : detections)
+        out = putU16(out, quantize(detection.boundingBox.y_min));
+    for (const auto& detection : detections)
+        out = putU16(out, quantize(detection.boundingBox.x_max));
+    for (const auto& detection : detections)
+        out = putU16(out, quantize(detection.boundingBox.y_max));
+
+    m_offset = out - m_base;
+    m_lastTimestampUs = timestampUs;
+    m_lastFrameId = frameId;
+
+    SegmentHeader& header = headerAt(m_base);
+    header.records++;
+    header.lastTimestampUs = timestampUs;
+    std::atomic_ref<uint64_t>(header.dataBytes).store(m_offset - sizeof(SegmentHeader), std::memory_order_release);
+    return true;
+}
+
+uint64_t
+SegmentWriter::records (
+    void
+) const
+{
+    return m_base ? headerAt(m_base).records : 0;
+}
+
+int64_t
+SegmentWriter::baseTimestampUs (
+    void
+) const
+{
+    return m_base ? headerAt(m_base).baseTimestampUs : 0;
+}
+
+void
+SegmentWriter::close (
+    void
+)
+{
+    if (m_base == nullptr)
+        return;
+
+    if (!m_index.save(m_path + indexExtension, headerAt(m_base)))
+        LOG_ERROR("failed to write the index of {}", m_path);
+    ::munmap(m_base, m_capacity);
+    if (::ftruncate(m_fd, static_cast<off_t>(m_offset)) != 0)
+        LOG_ERROR("failed to trim {}: {}", m_path, std::strerror(errno));
+    ::close(m_fd);
+    m_base = nullptr;
+    m_fd = -1;
+}
+
+SegmentReader::~SegmentReader (
+    void
+)
+{
+    close();
+}
+
+bool
+SegmentReader::open (
+    const std::string& path,
+    std::string& error
+)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat status;
+    void* mapped = MAP_FAILED;
+    if (::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(SegmentHeader))
+        mapped = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        error = path + ": not a detection log segment";
+        return false;
+    }
+
+    m_base = static_cast<uint8_t*>(mapped);
+    m_size = status.st_size;
+    const SegmentHeader& segment = header();
+    if (std::memcmp(segment.magic, magic, sizeof(magic)) != 0
+        || segment.headerSize < sizeof(SegmentHeader)
+        || segment.headerSize > m_size)
+    {
+        error = path + ": not a detection log segment";
+        close();
+        return false;
+    }
+    if (segment.version > version)
+    {
+        error = path + ": segment version " + std::to_string(segment.version) + " is newer than this reader";
+        close();
+        return false;
+    }
+
+    // records are read front to back
+    ::madvise(m_base, m_size, MADV_SEQUENTIAL);
+    rewind();
+    return true;
+}
+
+void
+SegmentReader::rewind (
+    void
+)
+{
+    m_offset = header().headerSize;
+    m_timestampUs = header().baseTimestampUs;
+    m_frameId = header().baseFrameId;
+    m_damaged = false;
+}
+
+void
+SegmentReader::seek (
+    const IndexEntry& entry
+)
+{
+    m_offset = entry.offset;
+    m_timestampUs = entry.previousTimestampUs;
+    m_frameId = entry.previousFrameId;
+    m_damaged = false;
+}
+
+void
+SegmentReader::buildIndex (
+    SegmentIndex& index
+)
+{
+    index.clear();
+    rewind();
+    int64_t previousTimestampUs = m_timestampUs;
+    uint64_t previousFrameId = m_frameId;
+    RecordView record;
+    while (next(record))
+    {
+        index.addRecord(record.offset, record.timestampUs, previousTimestampUs, previousFrameId);
+        for (size_t i = 0; i < record.count; i++)
+        {
+            uint16_t score;
+            std::memcpy(&score, record.scores + 2 * i, sizeof(score));
+            index.addDetection(record.classId(i), score);
+        }
+        previousTimestampUs = record.timestampUs;
+        previousFrameId = record.frameId;
+    }
+}
+
+bool
+SegmentReader::next (
+    RecordView& record
+)
+{
+    const SegmentHeader& segment = header();
+    auto& published = const_cast<uint64_t&>(segment.dataBytes);
+    uint64_t dataBytes = std::atomic_ref<uint64_t>(published).load(std::memory_order_acquire);
+    const uint8_t* end = m_base + std::min<uint64_t>(m_size, segment.headerSize + dataBytes);
+    const uint8_t* in = m_base + m_offset;
+    if (m_damaged || in >= end)
+        return false;
+
+    uint64_t bodyBytes, timestampDelta, frameDelta, count;
+    if (!getVarint(in, end, bodyBytes) || bodyBytes > static_cast<uint64_t>(end - in))
+    {
+        m_damaged = true;
+        return false;
+    }
+    const uint8_t* bodyEnd = in + bodyBytes;
+    if (!getVarint(in, bodyEnd, timestampDelta)
+        || !getVarint(in, bodyEnd, frameDelta)
+        || !getVarint(in, bodyEnd, count)
+        || count > static_cast<uint64_t>(bodyEnd - in) / (1 + 5 * sizeof(uint16_t)))
+    {
+        m_damaged = true;
+        return false;
+    }
+
+    m_timestampUs += unzigzag(timestampDelta);
+    m_frameId += unzigzag(frameDelta);
+
+    record.streamId = segment.streamId;
+    record.frameId = m_frameId;
+    record.timestampUs = m_timestampUs;
+    record.count = count;
+    record.offset = m_offset;
+    record.classes = in;
+    record.scores = in + count;
+    record.boxes = in + count + 2 * count;
+
+    m_offset = bodyEnd - m_base;
+    return true;
+}
+
+void
+SegmentReader::close (
+    void
+)
+{
+    if (m_base != nullptr)
+        ::munmap(m_base, m_size);
+    m_base = nullptr;
+    m_size = 0;
+}
+
+std::vector<std::string>
+listSegments (
+    const std::string& directory
+)
+{
+    std::vector<std::pair<int64_t, std::string>> found;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+    {
+        if (entry.path().extension() != extension)
+            continue;
+        SegmentReader reader;
+        std::string ignored;
+        if (reader.open(entry.path().string(), ignored))
+            found.emplace_back(reader.header().baseTimestampUs, entry.path().string());
+    }
+    std::sort(found.begin(), found.end());
+
+    std::vector<std::string> segments;
+    for (auto& [timestamp, path] : found)
+        segments.push_back(std::move(path));
+    return segments;
+}
+
+} // end namespace dlog
@@ -0,0 +1,267 @@
+#ifndef DETECTION_LOG_H
+#define DETECTION_LOG_H
+
+#include <hailo/hailort.h>
+
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+// Append-only binary log of detections, one record per frame, in memory
+// mapped segment files.
+//
+// A segment is a 64 byte SegmentHeader followed by records. Each record
+// is a varint body length and a body of
+//
+//   zigzag varint  timestamp delta, microseconds, from the previous record
+//   zigzag varint  frame id delta from the previous record
+//   varint         detection count n
+//   u8[n]          class ids
+//   u16[n]         scores, 0..1 scaled to 0..65535
+//   u16[n] x4      x_min, y_min, x_max, y_max, same scaling
+//
+// little-endian throughout. The first record's deltas are from the
+// header's base values. Readers skip unknown trailing body bytes, so
+// later versions may append fields to the body.
+//
+// A closed segment has a sparse index next to it, <segment>.idx: an
+// IndexHeader and one IndexEntry per block of records, so a query can
+// skip blocks by time, class and score without decoding them.
+namespace dlog
+{
+
+constexpr char magic[4] = { 'D', 'L', 'O', 'G' };
+constexpr uint16_t version = 1;
+constexpr const char* extension = ".dlog";
+
+constexpr char indexMagic[4] = { 'D', 'I', 'D', 'X' };
+constexpr uint16_t indexVersion = 1;
+constexpr const char* indexExtension = ".idx";
+constexpr uint32_t defaultBlockRecords = 256;
+
+struct SegmentHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t streamId;
+    uint32_t flags;
+    int64_t baseTimestampUs;
+    uint64_t baseFrameId;
+
+    // bytes of records after the header, published after every record so
+    // a reader may follow a segment that is still being written
+    uint64_t dataBytes;
+    uint64_t records;
+    int64_t lastTimestampUs;
+    uint8_t reserved[8];
+};
+static_assert(sizeof(SegmentHeader) == 64);
+
+struct IndexHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t blockRecords;
+    uint32_t entries;
+
+    // of the segment as indexed; an index that does not match its
+    // segment is stale and ignored
+    int64_t baseTimestampUs;
+    uint64_t dataBytes;
+    uint8_t reserved[32];
+};
+static_assert(sizeof(IndexHeader) == 64);
+
+struct IndexEntry
+{
+    int64_t firstTimestampUs;
+    int64_t lastTimestampUs;
+
+    // of the block's first record, and the delta base it was encoded
+    // against, so a reader can start there
+    uint64_t offset;
+    int64_t previousTimestampUs;
+    uint64_t previousFrameId;
+
+    uint32_t records;
+    uint16_t maxScore;
+    uint16_t reserved;
+
+    // bit n set if class n is detected in the block, classes >= 128 set bit 127
+    uint64_t classes[2];
+
+    bool
+    hasClass (int classId) const
+    {
+        int bit = std::min(classId, 127);
+        return (classes[bit / 64] >> (bit % 64)) & 1;
+    }
+};
+static_assert(sizeof(IndexEntry) == 64);
+
+// one record in place in the mapping; valid while its reader is open
+struct RecordView
+{
+    uint32_t streamId;
+    uint64_t frameId;
+    int64_t timestampUs;
+    size_t count;
+    size_t offset;
+
+    const uint8_t* classes;
+    const uint8_t* scores;
+    const uint8_t* boxes;
+
+    int classId (size_t i) const { return classes[i]; }
+    float score (size_t i) const { return unit(scores, i); }
+
+    hailo_bbox_float32_t
+    box (size_t i) const
+    {
+        hailo_bbox_float32_t box;
+        box.x_min = unit(boxes, i);
+        box.y_min = unit(boxes, count + i);
+        box.x_max = unit(boxes, 2 * count + i);
+        box.y_max = unit(boxes, 3 * count + i);
+        box.score = score(i);
+        return box;
+    }
+
+private:
+    static
+    float
+    unit (const uint8_t* array, size_t i)
+    {
+        uint16_t value;
+        std::memcpy(&value, array + 2 * i, sizeof(value));
+        return value / 65535.0f;
+    }
+};
+
+// One IndexEntry per blockRecords records. Not thread safe.
+class SegmentIndex
+{
+public:
+    explicit SegmentIndex (uint32_t blockRecords = defaultBlockRecords);
+
+    // a record at offset, encoded against the previous record's values
+    void addRecord (size_t offset, int64_t timestampUs, int64_t previousTimestampUs, uint64_t previousFrameId);
+
+    // a detection of the record added last; score as stored, 0..65535
+    void addDetection (int classId, uint16_t score);
+
+    const std::vector<IndexEntry>& entries () const { return m_entries; }
+    void clear () { m_entries.clear(); }
+
+    bool save (const std::string& path, const SegmentHeader& segment) const;
+
+    // false if there is no index or it does not match segment
+    bool load (const std::string& path, const SegmentHeader& segment);
+
+private:
+    uint32_t m_blockRecords;
+    std::vector<IndexEntry> m_entries;
+};
+
+// Writes one segment. Not thread safe.
+class SegmentWriter
+{
+public:
+    SegmentWriter () = default;
+    ~SegmentWriter ();
+
+    SegmentWriter (const SegmentWriter&) = delete;
+    SegmentWriter& operator= (const SegmentWriter&) = delete;
+
+    // creates path and maps capacity bytes of it; false and a message on
+    // stderr on failure
+    bool open (
+        const std::string& path,
+        uint32_t streamId,
+        size_t capacity,
+        int64_t baseTimestampUs,
+        uint64_t baseFrameId);
+
+    bool isOpen () const { return m_base != nullptr; }
+
+    // false if the record does not fit, the segment is then full
+    bool append (int64_t timestampUs, uint64_t frameId, const std::vector<utils::Detection>& detections);
+
+    // trims the file to what was written and saves the index
+    void close ();
+
+    const std::string& path () const { return m_path; }
+    size_t bytes () const { return m_offset; }
+    uint64_t records () const;
+    int64_t baseTimestampUs () const;
+
+    // upper bound of a record's size
+    static size_t maxRecordBytes (size_t detections);
+
+private:
+    std::string m_path;
+    int m_fd = -1;
+    uint8_t* m_base = nullptr;
+    size_t m_capacity = 0;
+    size_t m_offset = 0;
+    int64_t m_lastTimestampUs = 0;
+    uint64_t m_lastFrameId = 0;
+    SegmentIndex m_index;
+};
+
+// Iterates the records of one segment straight from the mapping. Not
+// thread safe.
+class SegmentReader
+{
+public:
+    SegmentReader () = default;
+    ~SegmentReader ();
+
+    SegmentReader (const SegmentReader&) = delete;
+    SegmentReader& operator= (const SegmentReader&) = delete;
+
+    // false and error set if the file cannot be mapped or is not a
+    // segment of a known version
+    bool open (const std::string& path, std::string& error);
+
+    const SegmentHeader& header () const { return *reinterpret_cast<const SegmentHeader*>(m_base); }
+
+    // the next record, false at the end of what has been written so far
+    // or at a damaged record
+    bool next (RecordView& record);
+
+    // back to the first record
+    void rewind ();
+
+    // to the first record of an index entry
+    void seek (const IndexEntry& entry);
+
+    // scans the segment into index; leaves the reader at the end
+    void buildIndex (SegmentIndex& index);
+
+    bool damaged () const { return m_damaged; }
+
+private:
+    uint8_t* m_base = nullptr;
+    size_t m_size = 0;
+    size_t m_offset = 0;
+    int64_t m_timestampUs = 0;
+    uint64_t m_frameId = 0;
+    bool m_damaged = false;
+
+    void close ();
+};
+
+// segments in directory, oldest first by their base timestamp
+std::vector<std::string> listSegments (const std::string& directory);
+
+} // end namespace dlog
+
+#endif // DETECTION_LOG_H
@@ -0,0 +1,136 @@
+#include "DetectionLogSink.hpp"
+
+#include "FrameTrace.hpp"
+#include "Log.hpp"
+#include "RecordingSink.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <filesystem>
+
+
+DetectionLogSink::DetectionLogSink (
+    DetectionLogConfig config
+)
+:
+    m_config(std::move(config)),
+    m_queue(m_config.queueCapacity, ring::WaitPolicy::Park),
+    m_spare(m_config.queueCapacity, ring::WaitPolicy::Park),
+    m_thread(&DetectionLogSink::run, this)
+{ }
+
+DetectionLogSink::~DetectionLogSink (
+    void
+)
+{
+    close();
+}
+
+void
+DetectionLogSink::consume (
+    const SinkFrame& frame
+)
+{
+    SinkFrame queued;
+    queued.frameId = frame.frameId;
+    queued.timestamp = frame.timestamp;
+    m_spare.tryPop(queued.detections);
+    queued.detections.assign(frame.detections.begin(), frame.detections.end());
+    if (!m_queue.tryPush(std::move(queued)))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t
+DetectionLogSink::dropped (
+    void
+) const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void
+DetectionLogSink::close (
+    void
+)
+{
+    m_queue.close();
+    if (!m_thread.joinable())
+        return;
+    m_thread.join();
+
+    LOG_INFO("detection log: {} frames, {} KB in {} segments, {} dropped",
+        m_records, m_bytes / 1024, m_segments, dropped());
+}
+
+void
+DetectionLogSink::run (
+    void
+)
+{
+    trace::setThreadName("dlog");
+    placement::registerThread("dlog");
+
+    std::error_code error;
+    std::filesystem::create_directories(m_config.directory, error);
+
+    SinkFrame frame;
+    while (m_queue.pop(frame))
+    {
+        if (m_failed)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        int64_t timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            frame.timestamp.time_since_epoch()).count();
+        uint64_t startNs = trace::nowNs();
+        // a full segment takes one more try in a fresh one
+        if (!append(frame, timestampUs) && !append(frame, timestampUs))
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        trace::record("log", startNs, trace::nowNs());
+
+        // the next pop moves over frame.detections, so hand it back first
+        frame.detections.clear();
+        m_spare.tryPush(std::move(frame.detections));
+    }
+    m_segment.close();
+}
+
+bool
+DetectionLogSink::append (
+    const SinkFrame& frame,
+    int64_t timestampUs
+)
+{
+    if (m_failed)
+        return false;
+
+    const int64_t maxAgeUs = std::chrono::duration_cast<std::chrono::microseconds>(m_config.segmentDuration).count();
+    if (m_segment.isOpen() && maxAgeUs > 0 && timestampUs - m_segment.baseTimestampUs() >= maxAgeUs)
+        m_segment.close();
+
+    if (!m_segment.isOpen())
+    {
+        std::string path = timestampedPath(
+            (std::filesystem::path(m_config.directory) / ("stream" + std::to_string(m_config.streamId))).string(),
+            frame.timestamp,
+            dlog::extension);
+        if (!m_segment.open(path, m_config.streamId, m_config.segmentBytes, timestampUs, frame.frameId))
+        {
+            LOG_ERROR("detection log stopped");
+            m_failed = true;
+            return false;
+        }
+        m_segments++;
+    }
+
+    size_t before = m_segment.bytes();
+    if (!m_segment.append(timestampUs, frame.frameId, frame.detections))
+    {
+        m_segment.close();
+        return false;
+    }
+    m_records++;
+    m_bytes += m_segment.bytes() - before;
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef DETECTION_LOG_SINK_H
+#define DETECTION_LOG_SINK_H
+
+#include "DetectionLog.hpp"
+#include "FrameSink.hpp"
+#include "RingQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct DetectionLogConfig
+{
+    // segments are named stream<id>-<YYYYmmdd-HHMMSS>.dlog in here
+    std::string directory;
+    uint32_t streamId = 0;
+
+    // a new segment starts when either is reached
+    size_t segmentBytes = 64 << 20;
+    std::chrono::seconds segmentDuration{3600};
+
+    // frames waiting for the writer thread; beyond that new ones are dropped
+    size_t queueCapacity = 1024;
+};
+
+// Every frame's detections, appended to a dlog segment by a thread of
+// its own. consume() runs on the publishing thread for every frame and
+// only queues the detections, without the pixels, in a vector the writer
+// has handed back, so once warm it neither allocates nor blocks.
+class DetectionLogSink : public FrameSink
+{
+public:
+    explicit DetectionLogSink (DetectionLogConfig config);
+
+    ~DetectionLogSink () override;
+
+    const char* name () const override { return "log"; }
+    bool needsPixels () const override { return false; }
+
+    void consume (const SinkFrame& frame) override;
+    bool queuesEveryFrame () const override { return true; }
+    uint64_t dropped () const override;
+    void close () override;
+
+private:
+    const DetectionLogConfig m_config;
+    SpscRing<SinkFrame> m_queue;
+
+    // emptied detections vectors on their way back from the writer, so
+    // consume() can reuse their capacity
+    SpscRing<std::vector<utils::Detection>> m_spare;
+
+    // writer thread only
+    dlog::SegmentWriter m_segment;
+    uint64_t m_records = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_segments = 0;
+    bool m_failed = false;
+
+    std::atomic<uint64_t> m_dropped{0};
+
+    // last, so everything above exists before the thread starts
+    std::thread m_thread;
+
+    void run ();
+    bool append (const SinkFrame& frame, int64_t timestampUs);
+};
+
+#endif // DETECTION_LOG_SINK_H
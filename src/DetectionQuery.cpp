@@ -0,0 +1,226 @@
+#include "DetectionQuery.hpp"
+
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <thread>
+
+
+namespace dlog
+{
+
+namespace
+{
+
+struct SegmentResult
+{
+    std::vector<Match> matches;
+    QueryStats stats;
+};
+
+void
+matchRecord (
+    const RecordView& record,
+    const Query& query,
+    std::vector<Match>& matches
+)
+{
+    if (record.timestampUs < query.fromUs || record.timestampUs > query.toUs)
+        return;
+
+    for (size_t i = 0; i < record.count; i++)
+    {
+        if (query.classId >= 0 && record.classId(i) != query.classId)
+            continue;
+        if (record.score(i) < query.minScore)
+            continue;
+        matches.push_back(Match { record.streamId, record.frameId, record.timestampUs, record.classId(i), record.box(i) });
+    }
+}
+
+bool
+blockMayMatch (
+    const IndexEntry& entry,
+    const Query& query
+)
+{
+    return entry.lastTimestampUs >= query.fromUs
+        && entry.firstTimestampUs <= query.toUs
+        && (query.classId < 0 || entry.hasClass(query.classId))
+        && entry.maxScore / 65535.0f >= query.minScore;
+}
+
+void
+querySegment (
+    const std::string& path,
+    const Query& query,
+    SegmentResult& result
+)
+{
+    SegmentReader reader;
+    std::string error;
+    if (!reader.open(path, error))
+    {
+        LOG_ERROR("{}", error);
+        return;
+    }
+    if (query.streamId >= 0 && reader.header().streamId != query.streamId)
+        return;
+
+    RecordView record;
+    SegmentIndex index;
+    if (!query.useIndex || !index.load(path + indexExtension, reader.header()))
+    {
+        if (query.useIndex)
+            result.stats.unindexed++;
+        result.stats.segmentsRead++;
+        while (reader.next(record))
+        {
+            result.stats.records++;
+            matchRecord(record, query, result.matches);
+        }
+        return;
+    }
+
+    bool read = false;
+    for (const IndexEntry& entry : index.entries())
+    {
+        result.stats.blocks++;
+        if (!blockMayMatch(entry, query))
+            continue;
+
+        read = true;
+        result.stats.blocksRead++;
+        reader.seek(entry);
+        for (uint32_t i = 0; i < entry.records && reader.next(record); i++)
+        {
+            result.stats.records++;
+            matchRecord(record, query, result.matches);
+        }
+    }
+    if (read)
+        result.stats.segmentsRead++;
+}
+
+} // end anonymous namespace
+
+std::vector<Match>
+runQuery (
+    const std::vector<std::string>& segments,
+    const Query& query,
+    size_t threads,
+    QueryStats& stats
+)
+{
+    std::vector<SegmentResult> results(segments.size());
+    std::atomic<size_t> nextSegment{0};
+    auto scan = [&]() {
+        for (size_t i = nextSegment++; i < segments.size(); i = nextSegment++)
+            querySegment(segments[i], query, results[i]);
+    };
+
+    std::vector<std::thread> scanners;
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(segments.size(), 1));
+    for (size_t i = 1; i < threads; i++)
+        scanners.emplace_back(scan);
+    scan();
+    for (auto& scanner : scanners)
+        scanner.join();
+
+    stats = QueryStats();
+    stats.segments = segments.size();
+    std::vector<Match> matches;
+    for (auto& result : results)
+    {
+        stats.segmentsRead += result.stats.segmentsRead;
+        stats.blocks += result.stats.blocks;
+        stats.blocksRead += result.stats.blocksRead;
+        stats.records += result.stats.records;
+        stats.unindexed += result.stats.unindexed;
+        matches.insert(matches.end(), result.matches.begin(), result.matches.end());
+    }
+
+    // segments of different streams overlap in time
+    std::stable_sort(matches.begin(), matches.end(),
+        [](const Match& a, const Match& b) { return a.timestampUs < b.timestampUs; });
+    return matches;
+}
+
+bool
+writeSyntheticLog (
+    const std::string& directory,
+    double days,
+    double fps,
+    uint32_t streamId
+)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    constexpr int64_t segmentUs = 3600LL * 1000000;
+    constexpr int visitors[] = { 1, 1, 1, 3, 3, 17 };   // person, car, dog
+    const int64_t frameUs = static_cast<int64_t>(1e6 / fps);
+    const uint64_t frames = static_cast<uint64_t>(days * 86400 * fps);
+    const int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const int64_t startUs = nowUs - static_cast<int64_t>(frames) * frameUs;
+
+    // something comes into view every ten minutes on average and stays
+    // for 5 to 60 seconds
+    std::mt19937 random(streamId + 1);
+    std::exponential_distribution<double> quietSeconds(1.0 / 600);
+    std::uniform_real_distribution<double> visitSeconds(5, 60);
+    std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+    std::uniform_real_distribution<float> score(0.3f, 0.95f);
+
+    int64_t visitStartUs = startUs + static_cast<int64_t>(quietSeconds(random) * 1e6);
+    int64_t visitEndUs = visitStartUs + static_cast<int64_t>(visitSeconds(random) * 1e6);
+    int visitor = visitors[random() % std::size(visitors)];
+    size_t count = 1 + random() % 3;
+
+    SegmentWriter segment;
+    size_t segments = 0;
+    std::vector<utils::Detection> detections;
+    for (uint64_t frame = 0; frame < frames; frame++)
+    {
+        int64_t timestampUs = startUs + static_cast<int64_t>(frame) * frameUs;
+        if (timestampUs >= visitEndUs)
+        {
+            visitStartUs = visitEndUs + static_cast<int64_t>(quietSeconds(random) * 1e6);
+            visitEndUs = visitStartUs + static_cast<int64_t>(visitSeconds(random) * 1e6);
+            visitor = visitors[random() % std::size(visitors)];
+            count = 1 + random() % 3;
+        }
+
+        detections.clear();
+        for (size_t i = 0; timestampUs >= visitStartUs && i < count; i++)
+        {
+            utils::Detection detection;
+            detection.classId = visitor;
+            float x = 0.1f + 0.25f * i + jitter(random);
+            detection.boundingBox = { 0.3f + jitter(random), x, 0.8f + jitter(random), x + 0.2f, score(random) };
+            detections.push_back(detection);
+        }
+
+        if (!segment.isOpen() || timestampUs - segment.baseTimestampUs() >= segmentUs
+            || !segment.append(timestampUs, frame, detections))
+        {
+            segment.close();
+            char name[64];
+            std::snprintf(name, sizeof(name), "stream%u-synthetic-%04zu%s", streamId, segments++, extension);
+            std::string path = (std::filesystem::path(directory) / name).string();
+            if (!segment.open(path, streamId, 256 << 20, timestampUs, frame)
+                || !segment.append(timestampUs, frame, detections))
+                return false;
+        }
+    }
+    segment.close();
+    return true;
+}
+
+} // end namespace dlog
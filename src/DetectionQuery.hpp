@@ -0,0 +1,71 @@
+#ifndef DETECTION_QUERY_H
+#define DETECTION_QUERY_H
+
+#include "DetectionLog.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+
+namespace dlog
+{
+
+struct Query
+{
+    int64_t fromUs = std::numeric_limits<int64_t>::min();
+    int64_t toUs = std::numeric_limits<int64_t>::max();
+
+    // -1 matches every stream or class
+    int64_t streamId = -1;
+    int classId = -1;
+
+    float minScore = 0.0f;
+
+    // false decodes every record, for measuring what the index saves
+    bool useIndex = true;
+};
+
+struct Match
+{
+    uint32_t streamId;
+    uint64_t frameId;
+    int64_t timestampUs;
+    int classId;
+    hailo_bbox_float32_t box;
+};
+
+struct QueryStats
+{
+    size_t segments = 0;
+    size_t segmentsRead = 0;
+    size_t blocks = 0;
+    size_t blocksRead = 0;
+    size_t records = 0;
+
+    // segments without a usable .idx, still being written or cut short
+    size_t unindexed = 0;
+};
+
+// Runs query over segments, up to threads of them at a time. Each
+// segment's index rules out blocks by time, class and top score before a
+// record is decoded. Matches come back ordered by timestamp.
+std::vector<Match> runQuery (
+    const std::vector<std::string>& segments,
+    const Query& query,
+    size_t threads,
+    QueryStats& stats);
+
+// Writes days of made up detections at fps into directory, ending now:
+// hourly segments with a person, a car or a dog in view now and then.
+// For trying out and benchmarking queries.
+bool writeSyntheticLog (
+    const std::string& directory,
+    double days,
+    double fps,
+    uint32_t streamId);
+
+} // end namespace dlog
+
+#endif // DETECTION_QUERY_H
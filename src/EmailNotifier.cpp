@@ -1,19 +1,14 @@
 #include "EmailNotifier.hpp"
 
-#include <iostream>
+#include "Log.hpp"
+
+#include <algorithm>
 #include <stdexcept>
-#include <sstream>
 #include <string>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
-#include <memory>
-
 
-struct ReadData
-{
-    const char *message;
-    size_t offset;
-};
 
 struct ReadImageData
 {
@@ -22,35 +17,16 @@ struct ReadImageData
     size_t offset;
 };
 
-size_t
-EmailNotifier::sendReadData (
-    char* buffer,
-    size_t size,
-    size_t nitems,
-    void* userdata
-)
+// everything one recipient's transfer needs to outlive curl_multi_perform
+struct Transfer
 {
-    assert(size == 1);
-    assert(buffer != nullptr);
-    assert(userdata != nullptr);
-
-    ReadData* readData = (ReadData*)userdata;
-    const char* data = readData->message + readData->offset;
-
-    size_t room = size * nitems;
-    size_t messageLen = strlen(data);
-    if (messageLen > room)
-        readData->offset = room;
-    else
-        readData->offset = messageLen;
-
-    if (messageLen)
-    {
-        memcpy(buffer, data, readData->offset);
-        return readData->offset;
-    }
-    return 0;    
-}
+    CURL* handle = nullptr;
+    struct curl_slist* rcpt = nullptr;
+    curl_mime* mime = nullptr;
+    std::vector<ReadImageData> images;
+    std::string recipient;
+    CURLcode result = CURLE_OK;
+};
 
 size_t
 EmailNotifier::sendReadImageData (
@@ -60,7 +36,6 @@ EmailNotifier::sendReadImageData (
     void* userp
 )
 {
-    assert(size == 1);
     assert(ptr != nullptr);
     assert(userp != nullptr);
 
@@ -71,119 +46,258 @@ EmailNotifier::sendReadImageData (
     size_t toCopy = (remaining > max) ? max : remaining;
     if (toCopy > 0)
     {
-        memcpy(ptr, imageData->data, toCopy);
+        memcpy(ptr, imageData->data + imageData->offset, toCopy);
         imageData->offset += toCopy;
-        return imageData->offset;
     }
-    return 0;
+    return toCopy;
+}
+
+int
+EmailNotifier::seekImageData (
+    void* userp,
+    curl_off_t offset,
+    int origin
+)
+{
+    assert(userp != nullptr);
+
+    ReadImageData* imageData = static_cast<ReadImageData*>(userp);
+    if (origin != SEEK_SET || offset < 0 || static_cast<size_t>(offset) > imageData->size)
+        return CURL_SEEKFUNC_CANTSEEK;
+
+    imageData->offset = static_cast<size_t>(offset);
+    return CURL_SEEKFUNC_OK;
 }
 
 EmailNotifier::EmailNotifier (
     const std::string& username,
     const std::string& password,
-    const std::string& url
+    const std::string& url,
+    bool useTls
 )
 :
     m_username(username),
     m_password(password),
-    m_url(url)
-{ }
+    m_url(url),
+    m_useTls(useTls),
+    m_multi(curl_multi_init())
+{
+    if (!m_multi)
+        throw std::runtime_error("failed to create curl multi handle");
+}
 
-EmailCode
-EmailNotifier::connectAndSendImage (
-    const std::string& from,
-    const std::vector<std::string>& to,
-    const std::string& body,
-    const std::vector<uint8_t>& imageData
+EmailNotifier::~EmailNotifier (
+    void
 )
 {
-    CURL* curl;
-    curl = curl_easy_init();
+    for (auto& [recipient, handle] : m_handles)
+        curl_easy_cleanup(handle);
+    curl_multi_cleanup(m_multi);
+}
+
+CURL*
+EmailNotifier::handleForRecipient (
+    const std::string& recipient
+)
+{
+    auto found = m_handles.find(recipient);
+    if (found != m_handles.end())
+        return found->second;
+
+    CURL* curl = curl_easy_init();
     if (!curl)
-        return CURLE_FAILED_INIT;
+        return nullptr;
 
 #ifdef DBG
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 #endif
-    
+
     // auth
     curl_easy_setopt(curl, CURLOPT_URL, m_url.c_str());
     curl_easy_setopt(curl, CURLOPT_USERNAME, m_username.c_str());
     curl_easy_setopt(curl, CURLOPT_PASSWORD, m_password.c_str());
 
     // force ssl
-    curl_easy_setopt(curl, CURLOPT_USE_SSL, (long)CURLUSESSL_ALL);
+    if (m_useTls)
+        curl_easy_setopt(curl, CURLOPT_USE_SSL, (long)CURLUSESSL_ALL);
 
-    // mail from
-    std::string toStr("<" + from + ">");
-    curl_easy_setopt(curl, CURLOPT_MAIL_FROM, toStr.c_str());
-
-    // mail to
+    // the session itself stays open in the multi handle's connection
+    // cache, which every transfer shares; keepalive probes only notice a
+    // cached connection the server or a middlebox dropped while idle
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
     curl_easy_setopt(curl, CURLOPT_MAIL_RCPT_ALLLOWFAILS, 1L);
-    std::vector<std::string> formattedRecipients;
+
+    m_handles.emplace(recipient, curl);
+    return curl;
+}
+
+EmailCode
+EmailNotifier::connectAndSendImage (
+    const std::string& from,
+    const std::vector<std::string>& to,
+    const std::string& body,
+    const std::vector<uint8_t>& imageData
+)
+{
+    std::vector<std::span<const uint8_t>> images;
+    if (!imageData.empty())
+        images.emplace_back(imageData);
+    return connectAndSendImages(from, to, body, images);
+}
+
+EmailCode
+EmailNotifier::connectAndSendImages (
+    const std::string& from,
+    const std::vector<std::string>& to,
+    const std::string& body,
+    const std::vector<std::span<const uint8_t>>& images
+)
+{
+    std::string fromStr("<" + from + ">");
+    struct curl_slist* headers = nullptr;
+    headers = curl_slist_append(headers, "Subject: [ai detection]");
+
+    // a recipient listed twice would add its handle to the multi handle twice
+    std::vector<std::string> recipients;
+    recipients.reserve(to.size());
     for (const auto& recipient : to)
     {
-        std::string tmp = "<" + recipient + ">";
-        formattedRecipients.push_back(tmp);
+        if (std::find(recipients.begin(), recipients.end(), recipient) == recipients.end())
+            recipients.push_back(recipient);
     }
 
-    struct curl_slist* rcpt = nullptr;
-    for (const auto& recipient : formattedRecipients)
+    // sized up front: the read callbacks keep pointers into these vectors
+    std::vector<Transfer> transfers(recipients.size());
+    CURLcode status = CURLE_OK;
+    for (size_t i = 0; i < recipients.size() && status == CURLE_OK; i++)
     {
-        rcpt = curl_slist_append(rcpt, recipient.c_str());
-    }
-    curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, rcpt); 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Subject: [ai detection]");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        Transfer& transfer = transfers[i];
+        transfer.recipient = recipients[i];
+        transfer.handle = handleForRecipient(recipients[i]);
+        if (!transfer.handle)
+        {
+            status = CURLE_FAILED_INIT;
+            break;
+        }
 
-    // Start of MIME parts
-    curl_mime *mime = curl_mime_init(curl);
-    if (!mime)
-        return CURLE_OUT_OF_MEMORY;
+        CURL* curl = transfer.handle;
+        curl_easy_setopt(curl, CURLOPT_MAIL_FROM, fromStr.c_str());
 
-    // body (MIME part)
-    curl_mimepart *part = curl_mime_addpart(mime);
-    curl_mime_data(part, body.c_str(), CURL_ZERO_TERMINATED);
-    curl_mime_type(part, "text/plain");
+        std::string rcptStr("<" + recipients[i] + ">");
+        transfer.rcpt = curl_slist_append(nullptr, rcptStr.c_str());
+        curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, transfer.rcpt);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
-    // attach image (MIME part)
-    part = curl_mime_addpart(mime);
-    if (!part)
-        return CURLE_OUT_OF_MEMORY;
+        // Start of MIME parts
+        transfer.mime = curl_mime_init(curl);
+        if (!transfer.mime)
+        {
+            status = CURLE_OUT_OF_MEMORY;
+            break;
+        }
 
-    ReadImageData jpgData = {
-        .data = imageData.data(),
-        .size = imageData.size(),
-        .offset = 0
-    };
+        // body (MIME part)
+        curl_mimepart* part = curl_mime_addpart(transfer.mime);
+        curl_mime_data(part, body.c_str(), CURL_ZERO_TERMINATED);
+        curl_mime_type(part, "text/plain");
 
-    CURLcode status = CURLE_OK;
-    status = curl_mime_data(
-        part,
-        reinterpret_cast<const char*>(jpgData.data),
-        jpgData.size);
-    if (status != CURLE_OK)
-    {
-        std::cerr << "EmailNotifier add mime data cb: " << std::endl;
-        goto free;
+        // attach images (MIME parts), streamed from the caller's buffers
+        transfer.images.resize(images.size());
+        for (size_t n = 0; n < images.size() && status == CURLE_OK; n++)
+        {
+            part = curl_mime_addpart(transfer.mime);
+            if (!part)
+            {
+                status = CURLE_OUT_OF_MEMORY;
+                break;
+            }
+
+            transfer.images[n] = {
+                .data = images[n].data(),
+                .size = images[n].size(),
+                .offset = 0
+            };
+            status = curl_mime_data_cb(
+                part,
+                static_cast<curl_off_t>(images[n].size()),
+                &EmailNotifier::sendReadImageData,
+                &EmailNotifier::seekImageData,
+                nullptr,
+                &transfer.images[n]);
+            if (status != CURLE_OK)
+            {
+                LOG_ERROR("EmailNotifier add mime data cb: {}", curl_easy_strerror(status));
+                break;
+            }
+
+            std::string filename = images.size() == 1
+                ? std::string("image.jpg")
+                : "image" + std::to_string(n + 1) + ".jpg";
+            curl_mime_filename(part, filename.c_str());
+            curl_mime_type(part, "image/jpeg");
+            curl_mime_encoder(part, "base64");
+        }
+        if (status != CURLE_OK)
+            break;
+        curl_easy_setopt(curl, CURLOPT_MIMEPOST, transfer.mime);
     }
-    curl_mime_filename(part, "image.jpg");
-    curl_mime_type(part, "image/jpeg");
-    curl_mime_encoder(part, "base64");
-    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
-    status = curl_easy_perform(curl);
-    if (status != CURLE_OK)
+
+    if (status == CURLE_OK)
     {
-        std::cerr << "EmailNotifier connect and perform: " << std::endl;
-        goto free;
+        for (auto& transfer : transfers)
+            curl_multi_add_handle(m_multi, transfer.handle);
+
+        int running = 0;
+        do
+        {
+            CURLMcode mc = curl_multi_perform(m_multi, &running);
+            if (mc == CURLM_OK && running)
+                mc = curl_multi_poll(m_multi, nullptr, 0, 1000, nullptr);
+            if (mc != CURLM_OK)
+            {
+                LOG_ERROR("EmailNotifier multi perform: {}", curl_multi_strerror(mc));
+                status = CURLE_SEND_ERROR;
+                break;
+            }
+        } while (running);
+
+        int pending = 0;
+        while (CURLMsg* msg = curl_multi_info_read(m_multi, &pending))
+        {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            for (auto& transfer : transfers)
+            {
+                if (transfer.handle == msg->easy_handle)
+                    transfer.result = msg->data.result;
+            }
+        }
+
+        for (auto& transfer : transfers)
+        {
+            curl_multi_remove_handle(m_multi, transfer.handle);
+            if (transfer.result != CURLE_OK)
+            {
+                LOG_ERROR("EmailNotifier send to {}: {}", transfer.recipient, curl_easy_strerror(transfer.result));
+                if (status == CURLE_OK)
+                    status = transfer.result;
+            }
+        }
     }
 
-free:
-    curl_slist_free_all(rcpt);
+    for (auto& transfer : transfers)
+    {
+        if (transfer.handle)
+        {
+            // the mime and recipient list are freed below
+            curl_easy_setopt(transfer.handle, CURLOPT_MIMEPOST, nullptr);
+            curl_easy_setopt(transfer.handle, CURLOPT_MAIL_RCPT, nullptr);
+            curl_easy_setopt(transfer.handle, CURLOPT_HTTPHEADER, nullptr);
+        }
+        curl_slist_free_all(transfer.rcpt);
+        curl_mime_free(transfer.mime);
+    }
     curl_slist_free_all(headers);
-    curl_mime_free(mime);
-    curl_easy_cleanup(curl);
 
     return status;
 }
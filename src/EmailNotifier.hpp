@@ -3,21 +3,37 @@
 
 #include <curl/curl.h>
 
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using EmailCode = CURLcode;
 
+// Keeps one easy handle (and with it one SMTP session) alive per
+// recipient inside a curl multi handle, so consecutive messages skip the
+// connect + TLS handshake and all recipients are connected to and sent
+// their message concurrently. curl does wait for each server's final
+// acknowledgement in turn.
+// Not thread safe: use one instance per thread.
 class EmailNotifier
 {
 public:
+    // useTls requires STARTTLS; only a relay on the same box, or a test
+    // server, should be talked to without it
     EmailNotifier (
         const std::string& username,
         const std::string& password,
-        const std::string& url);
+        const std::string& url,
+        bool useTls);
 
-    ~EmailNotifier () = default;
+    ~EmailNotifier ();
 
+    EmailNotifier (const EmailNotifier&) = delete;
+    EmailNotifier& operator= (const EmailNotifier&) = delete;
+
+    // imageData is streamed to curl as it encodes the message and must
+    // stay valid until the call returns
     EmailCode
     connectAndSendImage (
         const std::string& mailFrom,
@@ -25,22 +41,38 @@ public:
         const std::string& body,
         const std::vector<uint8_t>& imageData);
 
+    // one message carrying every image as its own attachment, in order
+    EmailCode
+    connectAndSendImages (
+        const std::string& mailFrom,
+        const std::vector<std::string>& recipients,
+        const std::string& body,
+        const std::vector<std::span<const uint8_t>>& images);
+
 private:
     const std::string m_username;
     const std::string m_password;
     const std::string m_url;
+    const bool m_useTls;
 
-    size_t
-    sendReadData (char* buffer,
-        size_t size,
-        size_t nitems,
-        void* userdata);
+    CURLM* m_multi;
+    std::unordered_map<std::string, CURL*> m_handles;
 
+    CURL*
+    handleForRecipient (const std::string& recipient);
+
+    static
     size_t
     sendReadImageData (char* ptr,
         size_t size,
         size_t nitems,
         void* userp);
+
+    static
+    int
+    seekImageData (void* userp,
+        curl_off_t offset,
+        int origin);
 };
 
-#endif // EMAIL_NOTIFIER_H
\ No newline at end of file
+#endif // EMAIL_NOTIFIER_H
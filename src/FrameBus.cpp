@@ -0,0 +1,412 @@
+#include "FrameBus.hpp"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+
+namespace bus
+{
+
+namespace
+{
+
+size_t
+align64 (
+    size_t bytes
+)
+{
+    return (bytes + 63) & ~size_t{63};
+}
+
+size_t
+pixelsOffset (
+    uint32_t maxDetections
+)
+{
+    return align64(sizeof(SlotHeader) + maxDetections * sizeof(Detection));
+}
+
+// not private: the waiters are other processes
+void
+futexWake (
+    const std::atomic<uint32_t>& word
+)
+{
+    ::syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void
+futexWait (
+    const std::atomic<uint32_t>& word,
+    uint32_t expected,
+    std::chrono::nanoseconds timeout
+)
+{
+    timespec relative{};
+    relative.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    relative.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    ::syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), FUTEX_WAIT, expected, &relative, nullptr, 0);
+}
+
+bool
+isBus (
+    const Header* header
+)
+{
+    return std::memcmp(header->magic, magic, sizeof(magic)) == 0;
+}
+
+} // end anonymous namespace
+
+
+std::string
+shmName (
+    const std::string& name
+)
+{
+    return name.starts_with('/') ? name : "/" + name;
+}
+
+
+Writer::Writer (
+    const WriterConfig& config
+)
+:
+    m_name(shmName(config.name))
+{
+    if (m_name.size() < 2 || m_name.find('/', 1) != std::string::npos || config.slotCount < 2)
+        throw std::runtime_error("invalid frame bus: " + config.name);
+
+    // readers still following a writer that died get told it is gone
+    int stale = ::shm_open(m_name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (stale >= 0)
+    {
+        struct stat status;
+        if (::fstat(stale, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Header))
+        {
+            void* mapped = ::mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, stale, 0);
+            if (mapped != MAP_FAILED)
+            {
+                Header* header = static_cast<Header*>(mapped);
+                if (isBus(header))
+                {
+                    header->closed.store(1, std::memory_order_release);
+                    header->wake.fetch_add(1, std::memory_order_release);
+                    futexWake(header->wake);
+                }
+                ::munmap(mapped, sizeof(Header));
+            }
+        }
+        ::close(stale);
+        ::shm_unlink(m_name.c_str());
+    }
+
+    const uint64_t slotBytes = pixelsOffset(config.maxDetections) + align64(config.frameBytes);
+    m_size = sizeof(Header) + slotBytes * config.slotCount;
+
+    m_fd = ::shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+        throw std::runtime_error("shm_open " + m_name + ": " + strerror(errno));
+
+    void* mapped = MAP_FAILED;
+    if (::ftruncate(m_fd, static_cast<off_t>(m_size)) == 0)
+        mapped = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        std::string reason = strerror(errno);
+        ::close(m_fd);
+        ::shm_unlink(m_name.c_str());
+        throw std::runtime_error("failed to map " + m_name + ": " + reason);
+    }
+
+    m_base = static_cast<uint8_t*>(mapped);
+    m_header = static_cast<Header*>(mapped);
+    m_header->version = version;
+    m_header->slotCount = config.slotCount;
+    m_header->maxDetections = config.maxDetections;
+    m_header->slotBytes = slotBytes;
+    m_header->frameBytes = config.frameBytes;
+    m_header->writerPid = ::getpid();
+
+    // the magic last: a reader that sees it sees the rest of the header
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(m_header->magic, magic, sizeof(magic));
+}
+
+Writer::~Writer (
+    void
+)
+{
+    m_header->closed.store(1, std::memory_order_release);
+    m_header->wake.fetch_add(1, std::memory_order_release);
+    futexWake(m_header->wake);
+    ::munmap(m_base, m_size);
+
+    // leave the name alone if another writer has taken it over
+    int current = ::shm_open(m_name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (current >= 0)
+    {
+        struct stat ours;
+        struct stat theirs;
+        if (::fstat(m_fd, &ours) == 0 && ::fstat(current, &theirs) == 0 && ours.st_ino == theirs.st_ino)
+            ::shm_unlink(m_name.c_str());
+        ::close(current);
+    }
+    ::close(m_fd);
+}
+
+bool
+Writer::publish (
+    const FrameInfo& info,
+    const uint8_t* pixels,
+    std::span<const Detection> detections
+)
+{
+    const size_t frameBytes = static_cast<size_t>(info.height) * info.step;
+    if (frameBytes > m_header->frameBytes)
+        return false;
+
+    const uint64_t sequence = m_published;
+    uint8_t* slotBase = m_base + sizeof(Header) + (sequence % m_header->slotCount) * m_header->slotBytes;
+    SlotHeader* slot = reinterpret_cast<SlotHeader*>(slotBase);
+
+    slot->version.store(2 * sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const size_t count = std::min<size_t>(detections.size(), m_header->maxDetections);
+    slot->frameId = info.frameId;
+    slot->timestampUs = info.timestampUs;
+    slot->fps = info.fps;
+    slot->width = info.width;
+    slot->height = info.height;
+    slot->type = info.type;
+    slot->step = info.step;
+    slot->detectionCount = static_cast<uint32_t>(count);
+    std::memcpy(slotBase + sizeof(SlotHeader), detections.data(), count * sizeof(Detection));
+    std::memcpy(slotBase + pixelsOffset(m_header->maxDetections), pixels, frameBytes);
+
+    slot->version.store(2 * sequence + 2, std::memory_order_release);
+    m_published = sequence + 1;
+    m_header->published.store(m_published, std::memory_order_release);
+
+    // one system call per frame, whether or not anybody waits: the
+    // readers cannot say so without writing to the ring
+    m_header->wake.fetch_add(1, std::memory_order_release);
+    futexWake(m_header->wake);
+    return true;
+}
+
+
+Reader::~Reader (
+    void
+)
+{
+    close();
+}
+
+bool
+Reader::open (
+    const std::string& name,
+    std::string& error
+)
+{
+    close();
+
+    const std::string path = shmName(name);
+    int fd = ::shm_open(path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat status;
+    void* mapped = MAP_FAILED;
+    if (::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Header))
+        mapped = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        error = path + ": not ready";
+        return false;
+    }
+
+    const Header* header = static_cast<const Header*>(mapped);
+    const size_t size = static_cast<size_t>(status.st_size);
+    if (!isBus(header))
+        error = path + ": not ready";
+    else if (header->version != version)
+        error = path + ": layout version " + std::to_string(header->version) + ", expected " + std::to_string(version);
+    else if (header->slotCount == 0
+        || header->slotBytes < pixelsOffset(header->maxDetections) + header->frameBytes
+        || sizeof(Header) + header->slotBytes * header->slotCount > size)
+        error = path + ": damaged header";
+    else
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        m_header = header;
+        m_base = static_cast<const uint8_t*>(mapped);
+        m_size = size;
+        return true;
+    }
+    ::munmap(mapped, size);
+    return false;
+}
+
+void
+Reader::close (
+    void
+)
+{
+    if (m_header == nullptr)
+        return;
+    ::munmap(const_cast<uint8_t*>(m_base), m_size);
+    m_header = nullptr;
+    m_base = nullptr;
+    m_size = 0;
+}
+
+bool
+Reader::writerClosed (
+    void
+) const
+{
+    return m_header->closed.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t
+Reader::published (
+    void
+) const
+{
+    return m_header->published.load(std::memory_order_acquire);
+}
+
+const SlotHeader*
+Reader::slotAt (
+    uint64_t sequence
+) const
+{
+    return reinterpret_cast<const SlotHeader*>(
+        m_base + sizeof(Header) + (sequence % m_header->slotCount) * m_header->slotBytes);
+}
+
+bool
+Reader::latest (
+    FrameView& view
+) const
+{
+    // a writer lapping the ring between the two loads makes the slot
+    // move under us; a few tries are plenty at camera frame rates
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        const uint64_t published = m_header->published.load(std::memory_order_acquire);
+        if (published == 0)
+            return false;
+
+        const uint64_t sequence = published - 1;
+        const SlotHeader* slot = slotAt(sequence);
+        const uint64_t before = slot->version.load(std::memory_order_acquire);
+        if (before != 2 * sequence + 2)
+            continue;
+
+        FrameInfo info;
+        info.frameId = slot->frameId;
+        info.timestampUs = slot->timestampUs;
+        info.fps = slot->fps;
+        info.width = slot->width;
+        info.height = slot->height;
+        info.type = slot->type;
+        info.step = slot->step;
+        const uint32_t count = slot->detectionCount;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->version.load(std::memory_order_relaxed) != before)
+            continue;
+        if (count > m_header->maxDetections || static_cast<size_t>(info.height) * info.step > m_header->frameBytes)
+            return false;
+
+        const uint8_t* slotBase = reinterpret_cast<const uint8_t*>(slot);
+        view.sequence = sequence;
+        view.info = info;
+        view.pixels = slotBase + pixelsOffset(m_header->maxDetections);
+        view.detections = { reinterpret_cast<const Detection*>(slotBase + sizeof(SlotHeader)), count };
+        view.slot = slot;
+        view.version = before;
+        return true;
+    }
+    return false;
+}
+
+bool
+Reader::valid (
+    const FrameView& view
+) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return view.slot != nullptr && view.slot->version.load(std::memory_order_relaxed) == view.version;
+}
+
+bool
+Reader::waitNewer (
+    uint64_t seen,
+    std::chrono::milliseconds timeout
+) const
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true)
+    {
+        // read before checking, so a frame published in between changes
+        // the word and the wait returns at once
+        const uint32_t wake = m_header->wake.load(std::memory_order_acquire);
+        if (published() > seen)
+            return true;
+        if (writerClosed())
+            return false;
+
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::steady_clock::duration::zero())
+            return false;
+        futexWait(m_header->wake, wake, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
+    }
+}
+
+bool
+Reader::copyLatest (
+    FrameInfo& info,
+    std::vector<uint8_t>& pixels,
+    std::vector<Detection>& detections
+) const
+{
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        FrameView view;
+        if (!latest(view))
+            return false;
+
+        const size_t frameBytes = static_cast<size_t>(view.info.height) * view.info.step;
+        pixels.resize(frameBytes);
+        std::memcpy(pixels.data(), view.pixels, frameBytes);
+        detections.assign(view.detections.begin(), view.detections.end());
+        if (valid(view))
+        {
+            info = view.info;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+} // end namespace bus
@@ -0,0 +1,201 @@
+#ifndef FRAME_BUS_H
+#define FRAME_BUS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+
+// Frames and their detections in a named POSIX shared memory ring, for
+// other processes on the same box. One writer, any number of readers,
+// and no coordination between them: readers map the ring read-only and
+// look at the newest frame in place.
+//
+// Each slot is guarded by a seqlock. Its version is odd while the writer
+// is inside the slot and 2 * (sequence + 1) once frame number sequence
+// is complete. A reader notes the version, uses the slot, and checks the
+// version again; if it changed the writer came round the ring meanwhile
+// and what was read must be discarded. With the default four slots a
+// reader has about three frame intervals to use a frame in place.
+//
+// The layout is plain data with lock-free atomics and carries no OpenCV
+// types; type is the OpenCV type code of the pixels (CV_8UC3 for the
+// capture's BGR frames).
+namespace bus
+{
+
+
+constexpr char magic[4] = { 'F', 'B', 'U', 'S' };
+constexpr uint32_t version = 1;
+
+struct Detection
+{
+    uint32_t classId;
+    float score;
+    float xMin;
+    float yMin;
+    float xMax;
+    float yMax;
+};
+
+struct alignas(64) Header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t maxDetections;
+    uint64_t slotBytes;
+    uint64_t frameBytes;
+    int32_t writerPid;
+
+    // set when the writer closes the bus; the name is gone by then
+    std::atomic<uint32_t> closed;
+
+    // frames published so far; the newest is sequence published - 1
+    alignas(64) std::atomic<uint64_t> published;
+
+    // bumped with every frame; readers sleep on it with futex(2)
+    std::atomic<uint32_t> wake;
+};
+
+struct alignas(64) SlotHeader
+{
+    std::atomic<uint64_t> version;
+    uint64_t frameId;
+    int64_t timestampUs;
+    double fps;
+    uint32_t width;
+    uint32_t height;
+    int32_t type;
+    uint32_t step;
+    uint32_t detectionCount;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+    "atomics in shared memory must be lock-free");
+
+// "/detect" for "detect"; shm_open wants a single leading slash
+std::string shmName (const std::string& name);
+
+
+struct WriterConfig
+{
+    std::string name;
+    uint32_t slotCount = 4;
+
+    // largest frame, in bytes, that fits a slot
+    size_t frameBytes = 0;
+
+    uint32_t maxDetections = 256;
+};
+
+struct FrameInfo
+{
+    uint64_t frameId = 0;
+    int64_t timestampUs = 0;
+    double fps = 0.0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int32_t type = 0;
+    uint32_t step = 0;
+};
+
+class Writer
+{
+public:
+    // creates the shared memory, replacing a stale one of the same name;
+    // throws std::runtime_error on failure
+    explicit Writer (const WriterConfig& config);
+
+    // marks the bus closed and removes the name; readers that have it
+    // mapped keep their mapping
+    ~Writer ();
+
+    Writer (const Writer&) = delete;
+    Writer& operator= (const Writer&) = delete;
+
+    // height rows of info.step bytes; false if they do not fit a slot.
+    // Detections beyond maxDetections are left out.
+    bool publish (const FrameInfo& info, const uint8_t* pixels, std::span<const Detection> detections);
+
+    uint64_t published () const { return m_published; }
+    size_t frameBytes () const { return m_header->frameBytes; }
+    const std::string& name () const { return m_name; }
+
+private:
+    std::string m_name;
+    int m_fd = -1;
+    Header* m_header = nullptr;
+    uint8_t* m_base = nullptr;
+    size_t m_size = 0;
+    uint64_t m_published = 0;
+};
+
+
+// A frame still in shared memory. The pointers stay valid for as long as
+// the Reader is open, but the contents only until the writer reuses the
+// slot: check Reader::valid() after using them.
+struct FrameView
+{
+    uint64_t sequence = 0;
+    FrameInfo info;
+    const uint8_t* pixels = nullptr;
+    std::span<const Detection> detections;
+
+    const SlotHeader* slot = nullptr;
+    uint64_t version = 0;
+};
+
+class Reader
+{
+public:
+    Reader () = default;
+    ~Reader ();
+
+    Reader (const Reader&) = delete;
+    Reader& operator= (const Reader&) = delete;
+
+    // false with the reason in error if there is no bus of that name yet
+    // or it has another layout version; may be retried
+    bool open (const std::string& name, std::string& error);
+    void close ();
+
+    bool isOpen () const { return m_header != nullptr; }
+
+    // the writer has shut down; reopen to follow its successor
+    bool writerClosed () const;
+
+    // frames published so far
+    uint64_t published () const;
+
+    // the newest complete frame; false if none was published yet or the
+    // writer kept overwriting it
+    bool latest (FrameView& view) const;
+
+    // true if the frame behind view has not been overwritten since
+    // latest() returned it
+    bool valid (const FrameView& view) const;
+
+    // waits until more than seen frames are published; false on timeout
+    bool waitNewer (uint64_t seen, std::chrono::milliseconds timeout) const;
+
+    // the newest frame copied out, for readers that keep frames longer
+    // than the ring does; false as for latest()
+    bool copyLatest (FrameInfo& info, std::vector<uint8_t>& pixels, std::vector<Detection>& detections) const;
+
+private:
+    const Header* m_header = nullptr;
+    const uint8_t* m_base = nullptr;
+    size_t m_size = 0;
+
+    const SlotHeader* slotAt (uint64_t sequence) const;
+};
+
+
+} // end namespace bus
+
+#endif // FRAME_BUS_H
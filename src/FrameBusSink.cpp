@@ -0,0 +1,77 @@
+#include "FrameBusSink.hpp"
+
+#include "Log.hpp"
+
+#include <chrono>
+
+
+FrameBusSink::FrameBusSink (
+    const bus::WriterConfig& config
+)
+:
+    m_writer(std::make_unique<bus::Writer>(config))
+{
+    m_detections.reserve(config.maxDetections);
+    LOG_INFO("frame bus {}: {} slots of {} KB", m_writer->name(), config.slotCount, config.frameBytes / 1024);
+}
+
+void
+FrameBusSink::consume (
+    const SinkFrame& frame
+)
+{
+    if (!m_writer || frame.frame.empty())
+        return;
+
+    m_detections.clear();
+    for (const utils::Detection& detection : frame.detections)
+    {
+        const hailo_bbox_float32_t& box = detection.boundingBox;
+        m_detections.push_back({ static_cast<uint32_t>(detection.classId), box.score,
+            box.x_min, box.y_min, box.x_max, box.y_max });
+    }
+
+    // a view into a larger image would be copied past its last row
+    const cv::Mat& pixels = frame.frame.isContinuous() ? frame.frame : (m_packed = frame.frame.clone());
+
+    bus::FrameInfo info;
+    info.frameId = frame.frameId;
+    info.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        frame.timestamp.time_since_epoch()).count();
+    info.fps = frame.fps;
+    info.width = static_cast<uint32_t>(pixels.cols);
+    info.height = static_cast<uint32_t>(pixels.rows);
+    info.type = pixels.type();
+    info.step = static_cast<uint32_t>(pixels.step);
+
+    if (!m_writer->publish(info, pixels.data, m_detections))
+    {
+        // once per run of a size, and counted as dropped in /metrics
+        uint64_t dropped = m_dropped.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (!m_warned)
+            LOG_WARN("frame bus {}: {}x{} frames do not fit its slots of {} KB, dropping them ({} so far)",
+                m_writer->name(), info.width, info.height, m_writer->frameBytes() / 1024, dropped);
+        m_warned = true;
+        return;
+    }
+    m_warned = false;
+}
+
+uint64_t
+FrameBusSink::dropped (
+    void
+) const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void
+FrameBusSink::close (
+    void
+)
+{
+    if (!m_writer)
+        return;
+    LOG_INFO("frame bus {}: {} frames published, {} dropped", m_writer->name(), m_writer->published(), dropped());
+    m_writer.reset();
+}
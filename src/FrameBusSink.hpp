@@ -0,0 +1,43 @@
+#ifndef FRAME_BUS_SINK_H
+#define FRAME_BUS_SINK_H
+
+#include "FrameBus.hpp"
+#include "FrameSink.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// Publishes the raw capture and its detections on a shared memory frame
+// bus for other processes; see FrameBus.hpp. A frame costs one copy into
+// the ring on the sink's thread, however many readers there are.
+class FrameBusSink : public FrameSink
+{
+public:
+    // config.frameBytes should fit the capture's frames, larger ones are
+    // dropped; throws std::runtime_error if the bus cannot be created
+    explicit FrameBusSink (const bus::WriterConfig& config);
+
+    const char* name () const override { return "shm"; }
+    bool needsPixels () const override { return true; }
+
+    void consume (const SinkFrame& frame) override;
+    uint64_t dropped () const override;
+    void close () override;
+
+private:
+    std::unique_ptr<bus::Writer> m_writer;
+
+    // sink thread only
+    std::vector<bus::Detection> m_detections;
+    cv::Mat m_packed;
+    bool m_warned = false;
+
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+#endif // FRAME_BUS_SINK_H
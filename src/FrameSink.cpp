@@ -0,0 +1,296 @@
+#include "FrameSink.hpp"
+
+#include "FrameTrace.hpp"
+#include "ProcessStats.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+
+namespace
+{
+
+// how often an idle sink gets to run idle()
+constexpr auto idleInterval = std::chrono::milliseconds(20);
+
+} // end anonymous namespace
+
+// A published frame and how many runners still hold it. The last one to
+// let go drops the pixels and hands the slot back to publish(), which
+// keeps the detections vector's capacity for the next frame.
+struct SinkSet::Slot
+{
+    SinkFrame frame;
+    std::atomic<size_t> holders{0};
+    std::atomic<bool> free{true};
+
+    void
+    release ()
+    {
+        if (holders.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            frame.frame.release();
+            free.store(true, std::memory_order_release);
+        }
+    }
+};
+
+// A sink and, unless it queues every frame itself, the thread that
+// feeds it the latest one.
+class SinkSet::Runner
+{
+public:
+    Runner (
+        std::unique_ptr<FrameSink> sink,
+        RollingLatency* drawLatency
+    )
+    :
+        m_sink(std::move(sink)),
+        m_drawLatency(m_sink->needsPixels() ? drawLatency : nullptr),
+        m_thread(m_sink->queuesEveryFrame() ? std::thread() : std::thread(&Runner::run, this))
+    { }
+
+    ~Runner () { stop(); }
+
+    FrameSink& sink () { return *m_sink; }
+
+    void
+    offer (
+        Slot* slot
+    )
+    {
+        Slot* replaced;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            replaced = std::exchange(m_pending, slot);
+        }
+        m_cv.notify_one();
+        if (replaced != nullptr)
+        {
+            m_replaced.fetch_add(1, std::memory_order_relaxed);
+            replaced->release();
+        }
+    }
+
+    // publishing thread, for sinks that queue every frame
+    void
+    deliver (
+        const SinkFrame& frame
+    )
+    {
+        uint64_t startNs = trace::nowNs();
+        m_sink->consume(frame);
+        trace::record(m_sink->name(), startNs, trace::nowNs());
+        m_delivered.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void
+    stop ()
+    {
+        bool stopped;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            stopped = std::exchange(m_stopping, true);
+        }
+        m_cv.notify_one();
+        if (m_thread.joinable())
+            m_thread.join();
+        else if (!stopped && m_sink->queuesEveryFrame())
+            m_sink->close();
+    }
+
+    SinkMetrics
+    metrics () const
+    {
+        return SinkMetrics {
+            .name = m_sink->name(),
+            .delivered = m_delivered.load(std::memory_order_relaxed),
+            .replaced = m_replaced.load(std::memory_order_relaxed),
+            .dropped = m_sink->dropped(),
+            .bufferedBytes = m_sink->bufferedBytes(),
+            .cpuNs = m_cpuNs.load(std::memory_order_relaxed)
+        };
+    }
+
+private:
+    const std::unique_ptr<FrameSink> m_sink;
+    RollingLatency* const m_drawLatency;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Slot* m_pending = nullptr;
+    bool m_stopping = false;
+
+    std::atomic<uint64_t> m_delivered{0};
+    std::atomic<uint64_t> m_replaced{0};
+    std::atomic<uint64_t> m_cpuNs{0};
+
+    // last, so everything above exists before the thread starts
+    std::thread m_thread;
+
+    void
+    run ()
+    {
+        trace::setThreadName(m_sink->name());
+        placement::registerThread(m_sink->name());
+        while (true)
+        {
+            Slot* slot;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait_for(lock, idleInterval, [this] { return m_stopping || m_pending != nullptr; });
+                slot = std::exchange(m_pending, nullptr);
+                if (slot == nullptr && m_stopping)
+                    break;
+            }
+
+            if (slot == nullptr)
+            {
+                m_sink->idle();
+                continue;
+            }
+
+            trace::setCurrentFrame(slot->frame.frameId);
+            uint64_t startNs = trace::nowNs();
+            m_sink->consume(slot->frame);
+            uint64_t endNs = trace::nowNs();
+            slot->release();
+            trace::record(m_sink->name(), startNs, endNs);
+            if (m_drawLatency)
+                m_drawLatency->record(endNs - startNs);
+            m_delivered.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_sink->close();
+        m_cpuNs.store(static_cast<uint64_t>(process::threadCpuSeconds() * 1e9), std::memory_order_relaxed);
+    }
+};
+
+SinkSet::SinkSet (
+    RollingLatency* drawLatency
+)
+:
+    m_drawLatency(drawLatency)
+{ }
+
+SinkSet::~SinkSet (
+    void
+)
+{
+    shutdown();
+}
+
+void
+SinkSet::add (
+    std::unique_ptr<FrameSink> sink
+)
+{
+    if (sink->queuesEveryFrame())
+    {
+        m_queueing.push_back(std::make_unique<Runner>(std::move(sink), m_drawLatency));
+        return;
+    }
+    m_needsPixels = m_needsPixels || sink->needsPixels();
+    m_runners.push_back(std::make_unique<Runner>(std::move(sink), m_drawLatency));
+    while (m_slots.size() < 2 * m_runners.size() + 1)
+        m_slots.push_back(std::make_unique<Slot>());
+}
+
+void
+SinkSet::publish (
+    uint64_t frameId,
+    cv::Mat& frame,
+    const std::vector<utils::Detection>& detections,
+    double fps
+)
+{
+    if (m_runners.empty() && m_queueing.empty())
+        return;
+
+    // round robin, so a slot a runner just let go of gets some rest
+    size_t index = 0;
+    while (index < m_slots.size()
+        && !m_slots[(m_nextSlot + index) % m_slots.size()]->free.load(std::memory_order_acquire))
+    {
+        index++;
+    }
+    if (index == m_slots.size())
+    {
+        // only if a runner held more slots than it should
+        m_slots.push_back(std::make_unique<Slot>());
+        m_nextSlot = m_slots.size() - 1;
+        index = 0;
+    }
+    index = (m_nextSlot + index) % m_slots.size();
+    m_nextSlot = index + 1;
+    Slot* slot = m_slots[index].get();
+
+    SinkFrame& item = slot->frame;
+    item.frameId = frameId;
+    item.timestamp = std::chrono::system_clock::now();
+    item.fps = fps;
+    item.detections.assign(detections.begin(), detections.end());
+    if (m_needsPixels)
+        item.frame = std::move(frame);
+
+    // they copy what they keep, so the slot is not held for them
+    for (auto& queueing : m_queueing)
+        queueing->deliver(item);
+    if (m_runners.empty())
+        return;
+
+    slot->free.store(false, std::memory_order_relaxed);
+    slot->holders.store(m_runners.size(), std::memory_order_relaxed);
+    for (auto& runner : m_runners)
+        runner->offer(slot);
+}
+
+void
+SinkSet::pollMainThread (
+    void
+)
+{
+    for (auto& runner : m_runners)
+        runner->sink().pollMainThread();
+}
+
+int
+SinkSet::takeKey (
+    void
+)
+{
+    for (auto& runner : m_runners)
+    {
+        int key = runner->sink().takeKey();
+        if (key >= 0)
+            return key;
+    }
+    return -1;
+}
+
+void
+SinkSet::shutdown (
+    void
+)
+{
+    for (auto& runner : m_runners)
+        runner->stop();
+    for (auto& queueing : m_queueing)
+        queueing->stop();
+}
+
+std::vector<SinkMetrics>
+SinkSet::metrics (
+    void
+) const
+{
+    std::vector<SinkMetrics> result;
+    for (const auto& runner : m_runners)
+        result.push_back(runner->metrics());
+    for (const auto& queueing : m_queueing)
+        result.push_back(queueing->metrics());
+    return result;
+}
@@ -0,0 +1,152 @@
+#ifndef FRAME_SINK_H
+#define FRAME_SINK_H
+
+#include <hailo/hailort.h>
+#include <opencv2/core.hpp>
+
+#include "LatencyHistogram.hpp"
+#include "Utils.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// One inference result as handed to the outputs. frame holds the raw
+// capture, unannotated, and is empty unless some sink needs pixels.
+struct SinkFrame
+{
+    uint64_t frameId;
+    std::chrono::system_clock::time_point timestamp;
+    double fps;
+    std::vector<utils::Detection> detections;
+    cv::Mat frame;
+};
+
+// An output of the detect loop: a window, a file, a stream. Every sink
+// runs on its own thread; consume() may be as slow as it likes, frames
+// that arrive meanwhile replace each other and only the latest is seen.
+// A sink that must see every frame queues them itself, see
+// queuesEveryFrame().
+class FrameSink
+{
+public:
+    virtual ~FrameSink () = default;
+
+    // thread and metrics name; must be a string literal
+    virtual const char* name () const = 0;
+
+    // false if the sink only looks at detections; the loop then neither
+    // hands over nor annotates the frame
+    virtual bool needsPixels () const = 0;
+
+    virtual void consume (const SinkFrame& frame) = 0;
+
+    // true if consume() only hands the frame to a queue of the sink's own
+    // and never blocks. It is then called on the publishing thread for
+    // every frame, nothing is replaced, and what the queue cannot take
+    // is counted in dropped(); idle() and takeKey() are not used
+    virtual bool queuesEveryFrame () const { return false; }
+
+    // called regularly while no frame arrives
+    virtual void idle () { }
+
+    // work that has to happen on the main thread, like HighGUI calls,
+    // which the Qt and Cocoa backends refuse anywhere else; called through
+    // SinkSet::pollMainThread()
+    virtual void pollMainThread () { }
+
+    // oldest key pressed in a window and not taken yet, -1 if none; main
+    // thread only, sinks without a window keep the default
+    virtual int takeKey () { return -1; }
+
+    // frames consume() accepted but the sink later discarded, e.g. when
+    // its own queue was full
+    virtual uint64_t dropped () const { return 0; }
+
+    // memory the sink holds on to between frames; read from other threads
+    virtual uint64_t bufferedBytes () const { return 0; }
+
+    // on the sink's thread after the last frame
+    virtual void close () { }
+};
+
+struct SinkMetrics
+{
+    const char* name;
+    uint64_t delivered;
+    uint64_t replaced;
+    uint64_t dropped;
+    uint64_t bufferedBytes;
+
+    // CPU time of the sink's thread, once it has finished; 0 for sinks
+    // that queue every frame on threads of their own
+    uint64_t cpuNs;
+};
+
+// Owns one thread per sink and hands each of them the latest frame.
+// publish() never waits on a sink: a frame the sink has not picked up yet
+// is replaced by the newer one and counted as replaced. Sinks that queue
+// every frame get no thread and are handed each frame in publish().
+// Published frames live in slots that are recycled once every sink is
+// done with them, so publish() does not allocate once the detections
+// vectors have grown.
+class SinkSet
+{
+public:
+    // consume time of sinks that need pixels is recorded in drawLatency
+    explicit SinkSet (RollingLatency* drawLatency = nullptr);
+
+    ~SinkSet ();
+
+    SinkSet (const SinkSet&) = delete;
+    SinkSet& operator= (const SinkSet&) = delete;
+
+    // before the first publish
+    void add (std::unique_ptr<FrameSink> sink);
+
+    bool empty () const { return m_runners.empty() && m_queueing.empty(); }
+    bool needsPixels () const { return m_needsPixels; }
+
+    // when a sink needs pixels the frame's buffer moves to the sinks and
+    // frame is left empty, so capture grabs into a fresh buffer; one
+    // thread publishes
+    void publish (
+        uint64_t frameId,
+        cv::Mat& frame,
+        const std::vector<utils::Detection>& detections,
+        double fps);
+
+    // lets every sink do its main thread work; call it from the main
+    // thread once per frame, before takeKey()
+    void pollMainThread ();
+
+    // first pending key press of any sink, -1 if none
+    int takeKey ();
+
+    // lets every sink finish the frame it has, then closes it
+    void shutdown ();
+
+    std::vector<SinkMetrics> metrics () const;
+
+private:
+    class Runner;
+    struct Slot;
+
+    RollingLatency* const m_drawLatency;
+
+    // a runner holds at most two slots, its pending frame and the one it
+    // consumes, so one more than twice the runners is never exhausted.
+    // Before the runners, which may hold slots until they are destroyed
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    size_t m_nextSlot = 0;
+
+    std::vector<std::unique_ptr<Runner>> m_runners;
+
+    // sinks that queue every frame, called from publish()
+    std::vector<std::unique_ptr<Runner>> m_queueing;
+    bool m_needsPixels = false;
+};
+
+#endif // FRAME_SINK_H
@@ -0,0 +1,459 @@
+#include "FrameSource.hpp"
+
+#include "FrameTrace.hpp"
+#include "Log.hpp"
+#include "ProcessStats.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <glob.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <stdexcept>
+
+
+// a camera that keeps handing out nothing has gone away
+constexpr size_t maxConsecutiveEmptyGrabs = 100;
+
+
+CaptureSource::CaptureSource (
+    const std::string& device,
+    cv::Size captureSize,
+    bool live
+)
+:
+    m_device(device),
+    m_captureSize(captureSize),
+    m_live(live)
+{
+    open();
+    m_fps = m_capture.get(cv::CAP_PROP_FPS);
+    m_frameSize = cv::Size(
+        static_cast<int>(m_capture.get(cv::CAP_PROP_FRAME_WIDTH)),
+        static_cast<int>(m_capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
+
+void
+CaptureSource::open (
+    void
+)
+{
+    const bool index = !m_device.empty() && std::all_of(m_device.begin(), m_device.end(), ::isdigit);
+    if (m_device == DEVICE_AUTO)
+        m_capture.open(0);
+    else if (index)
+        m_capture.open(std::stoi(m_device));
+    else
+        m_capture.open(m_device);
+
+    if (!m_capture.isOpened())
+        throw std::runtime_error("failed to open " + m_device);
+
+    if (m_live && m_captureSize.width > 0 && m_captureSize.height > 0)
+    {
+        m_capture.set(cv::CAP_PROP_FRAME_WIDTH, m_captureSize.width);
+        m_capture.set(cv::CAP_PROP_FRAME_HEIGHT, m_captureSize.height);
+    }
+}
+
+bool
+CaptureSource::read (
+    SourceFrame& out
+)
+{
+    m_capture >> out.frame;
+    if (!out.frame.empty())
+    {
+        m_emptyGrabs = 0;
+        return true;
+    }
+
+    // the end of a file; a camera gets some slack before it is given up
+    if (!m_live)
+        return false;
+    if (++m_emptyGrabs < maxConsecutiveEmptyGrabs)
+        return true;
+    LOG_ERROR("capture stopped returning frames");
+    return false;
+}
+
+bool
+CaptureSource::rewind (
+    void
+)
+{
+    if (m_live)
+        return false;
+    try
+    {
+        open();
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("{}", e.what());
+        return false;
+    }
+    return true;
+}
+
+
+ImageSource::ImageSource (
+    const std::string& pattern
+)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error;
+    if (fs::is_directory(pattern, error))
+    {
+        for (const auto& entry : fs::directory_iterator(pattern, error))
+        {
+            if (entry.is_regular_file(error) && isImagePath(entry.path().string()))
+                m_paths.push_back(entry.path().string());
+        }
+    }
+    else if (pattern.find_first_of("*?[") != std::string::npos)
+    {
+        glob_t matches;
+        if (::glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+        {
+            for (size_t i = 0; i < matches.gl_pathc; i++)
+            {
+                if (fs::is_regular_file(matches.gl_pathv[i], error))
+                    m_paths.push_back(matches.gl_pathv[i]);
+            }
+        }
+        ::globfree(&matches);
+    }
+    else if (fs::is_regular_file(pattern, error))
+    {
+        m_paths.push_back(pattern);
+    }
+
+    if (m_paths.empty())
+        throw std::runtime_error("no images in " + pattern);
+    std::sort(m_paths.begin(), m_paths.end());
+
+    // the first image that decodes sets the size every other one is
+    // scaled to, so sinks and the frame bus see one frame size
+    SourceFrame first;
+    for (size_t i = 0; i < m_paths.size() && m_frameSize.empty(); i++)
+    {
+        if (readIndexed(i, first))
+            m_frameSize = first.frame.size();
+    }
+    if (m_frameSize.empty())
+        throw std::runtime_error("no readable images in " + pattern);
+}
+
+bool
+ImageSource::isImagePath (
+    const std::string& path
+)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    for (const char* known : { ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".webp", ".ppm", ".pgm" })
+    {
+        if (extension == known)
+            return true;
+    }
+    return false;
+}
+
+bool
+ImageSource::read (
+    SourceFrame& out
+)
+{
+    if (m_next >= m_paths.size())
+        return false;
+    // an unreadable image comes back empty, as a lost frame
+    readIndexed(m_next++, out);
+    return true;
+}
+
+bool
+ImageSource::readIndexed (
+    size_t index,
+    SourceFrame& out
+)
+{
+    out.name = m_paths[index];
+    out.frame = cv::imread(out.name, cv::IMREAD_COLOR);
+    if (out.frame.empty())
+    {
+        LOG_WARN("failed to decode {}", out.name);
+        return false;
+    }
+    if (!m_frameSize.empty() && out.frame.size() != m_frameSize)
+    {
+        LOG_DEBUG("scaling {} from {}x{} to {}x{}", out.name,
+            out.frame.cols, out.frame.rows, m_frameSize.width, m_frameSize.height);
+        cv::resize(out.frame, out.frame, m_frameSize, 0, 0, cv::INTER_AREA);
+    }
+    return true;
+}
+
+bool
+ImageSource::rewind (
+    void
+)
+{
+    m_next = 0;
+    return true;
+}
+
+
+FrameBusSource::FrameBusSource (
+    const std::string& name,
+    std::chrono::milliseconds timeout
+)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::string error;
+    while (!m_reader.open(name, error))
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+            throw std::runtime_error("frame bus " + error);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    bus::FrameView view;
+    if (m_reader.latest(view))
+    {
+        m_fps = view.info.fps;
+        m_frameSize = cv::Size(static_cast<int>(view.info.width), static_cast<int>(view.info.height));
+    }
+    m_seen = m_reader.published();
+}
+
+bool
+FrameBusSource::read (
+    SourceFrame& out
+)
+{
+    while (!m_cancelled.load(std::memory_order_relaxed))
+    {
+        if (m_reader.writerClosed())
+        {
+            LOG_INFO("frame bus writer closed");
+            return false;
+        }
+        if (!m_reader.waitNewer(m_seen, std::chrono::milliseconds(200)))
+            continue;
+
+        bus::FrameView view;
+        if (!m_reader.latest(view))
+            continue;
+
+        // the ring is only good for a few frames, so the frame is copied
+        // out; a copy the writer overwrote meanwhile is thrown away
+        cv::Mat shared(static_cast<int>(view.info.height), static_cast<int>(view.info.width), view.info.type,
+            const_cast<uint8_t*>(view.pixels), view.info.step);
+        shared.copyTo(out.frame);
+        if (!m_reader.valid(view))
+            continue;
+        m_seen = view.sequence + 1;
+        return true;
+    }
+    return false;
+}
+
+
+std::unique_ptr<FrameSource>
+openFrameSource (
+    const std::string& spec,
+    cv::Size captureSize
+)
+{
+    if (spec.starts_with("shm:"))
+        return std::make_unique<FrameBusSource>(spec.substr(4), std::chrono::seconds(5));
+
+    const bool index = !spec.empty() && std::all_of(spec.begin(), spec.end(), ::isdigit);
+    if (spec == DEVICE_AUTO || index || spec.starts_with("/dev/") || spec.find("://") != std::string::npos)
+        return std::make_unique<CaptureSource>(spec, captureSize, true);
+
+    std::error_code error;
+    if (std::filesystem::is_directory(spec, error) || spec.find_first_of("*?[") != std::string::npos || ImageSource::isImagePath(spec))
+        return std::make_unique<ImageSource>(spec);
+
+    return std::make_unique<CaptureSource>(spec, captureSize, false);
+}
+
+
+FramePrefetcher::FramePrefetcher (
+    std::unique_ptr<FrameSource> source,
+    const PrefetchConfig& config
+)
+:
+    m_source(std::move(source)),
+    m_config(config),
+    m_queue(config.depth, config.wait,
+        m_source->live() ? ring::FullPolicy::DropOldest : ring::FullPolicy::Wait)
+{
+    const bool indexed = m_source->indexedCount() > 0;
+    const size_t threads = indexed ? std::max<size_t>(config.threads, 1) : 1;
+    m_running.store(threads);
+    for (size_t i = 0; i < threads; i++)
+        m_threads.emplace_back(indexed ? &FramePrefetcher::readIndexed : &FramePrefetcher::readStream, this);
+}
+
+FramePrefetcher::~FramePrefetcher (
+    void
+)
+{
+    stop();
+}
+
+bool
+FramePrefetcher::next (
+    SourceFrame& frame
+)
+{
+    return m_queue.pop(frame);
+}
+
+void
+FramePrefetcher::stop (
+    void
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_orderMutex);
+        m_stopping.store(true);
+    }
+    m_turn.notify_all();
+    m_source->cancel();
+    m_queue.close();
+
+    for (auto& thread : m_threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+}
+
+PrefetchMetrics
+FramePrefetcher::metrics (
+    void
+) const
+{
+    return {
+        m_decoded.load(std::memory_order_relaxed),
+        m_lost.load(std::memory_order_relaxed),
+        m_queue.dropped(),
+        m_decodeNs.load(std::memory_order_relaxed),
+        m_cpuNs.load(std::memory_order_relaxed)
+    };
+}
+
+void
+FramePrefetcher::readStream (
+    void
+)
+{
+    trace::setThreadName("capture");
+    placement::registerThread("capture");
+    uint64_t attempts = 0;
+    bool more = true;
+    for (size_t loop = 0; more && (m_config.loops == 0 || loop < m_config.loops); loop++)
+    {
+        if (loop > 0 && (m_source->live() || !m_source->rewind()))
+            break;
+
+        while (true)
+        {
+            if (m_stopping.load(std::memory_order_relaxed) || (m_config.maxFrames > 0 && attempts >= m_config.maxFrames))
+            {
+                more = false;
+                break;
+            }
+
+            SourceFrame frame;
+            frame.captureStartNs = trace::nowNs();
+            if (!m_source->read(frame))
+                break;
+            attempts++;
+            uint64_t endNs = trace::nowNs();
+            m_decodeNs.fetch_add(endNs - frame.captureStartNs, std::memory_order_relaxed);
+            trace::record("decode", frame.captureStartNs, endNs);
+            if (frame.frame.empty())
+            {
+                m_lost.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            m_decoded.fetch_add(1, std::memory_order_relaxed);
+            if (!m_queue.push(std::move(frame)))
+            {
+                more = false;
+                break;
+            }
+        }
+    }
+    finished();
+}
+
+void
+FramePrefetcher::readIndexed (
+    void
+)
+{
+    trace::setThreadName("capture");
+    placement::registerThread("capture");
+    const uint64_t count = m_source->indexedCount();
+    uint64_t total = m_config.loops == 0 ? UINT64_MAX : count * m_config.loops;
+    if (m_config.maxFrames > 0)
+        total = std::min<uint64_t>(total, m_config.maxFrames);
+
+    while (!m_stopping.load(std::memory_order_relaxed))
+    {
+        const uint64_t ticket = m_nextTicket.fetch_add(1, std::memory_order_relaxed);
+        if (ticket >= total)
+            break;
+
+        SourceFrame frame;
+        frame.captureStartNs = trace::nowNs();
+        const bool decoded = m_source->readIndexed(ticket % count, frame);
+        uint64_t endNs = trace::nowNs();
+        m_decodeNs.fetch_add(endNs - frame.captureStartNs, std::memory_order_relaxed);
+        trace::record("decode", frame.captureStartNs, endNs);
+        (decoded ? m_decoded : m_lost).fetch_add(1, std::memory_order_relaxed);
+
+        // frames go into the queue in ticket order
+        {
+            std::unique_lock<std::mutex> lock(m_orderMutex);
+            m_turn.wait(lock, [&] { return m_nextToQueue == ticket || m_stopping.load(); });
+            if (m_stopping.load())
+                break;
+        }
+        const bool queued = !decoded || m_queue.push(std::move(frame));
+        {
+            std::lock_guard<std::mutex> lock(m_orderMutex);
+            m_nextToQueue++;
+        }
+        m_turn.notify_all();
+        if (!queued)
+            break;
+    }
+    finished();
+}
+
+void
+FramePrefetcher::finished (
+    void
+)
+{
+    // before the queue closes, so a consumer that saw it close reads
+    // the CPU time of every thread
+    m_cpuNs.fetch_add(static_cast<uint64_t>(process::threadCpuSeconds() * 1e9), std::memory_order_relaxed);
+
+    // the last thread out lets the consumer drain the queue and stop
+    if (m_running.fetch_sub(1) == 1)
+        m_queue.close();
+}
@@ -0,0 +1,250 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "FrameBus.hpp"
+#include "RingQueue.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct SourceFrame
+{
+    cv::Mat frame;
+
+    // the file an image source decoded, empty otherwise
+    std::string name;
+
+    // trace::nowNs() when decoding started
+    uint64_t captureStartNs = 0;
+};
+
+// Where the pipeline's frames come from. Frames are decoded into fresh
+// Mats, so with PooledMatAllocator installed their buffers are recycled.
+class FrameSource
+{
+public:
+    virtual ~FrameSource () = default;
+
+    // "camera", "video", "images" or "shm"; a string literal
+    virtual const char* kind () const = 0;
+
+    // frames arrive at their own pace and are worthless once stale
+    virtual bool live () const = 0;
+
+    // the next frame in order; false at the end, or once a live source
+    // stops delivering. An empty out.frame is a frame that was lost, e.g.
+    // a failed grab or an unreadable image.
+    virtual bool read (SourceFrame& out) = 0;
+
+    // sources whose frames decode independently say how many they have,
+    // and readIndexed() may then be called from several threads at once;
+    // 0 for sources read in order from one thread. readIndexed() is
+    // false if the frame could not be decoded.
+    virtual size_t indexedCount () const { return 0; }
+    virtual bool readIndexed (size_t /*index*/, SourceFrame& /*out*/) { return false; }
+
+    // back to the first frame for another loop; false if not possible
+    virtual bool rewind () { return false; }
+
+    // makes a read() waiting for a live frame give up soon; any thread
+    virtual void cancel () { }
+
+    // 0 and an empty size when unknown
+    virtual double fps () const { return 0.0; }
+    virtual cv::Size frameSize () const { return cv::Size(); }
+};
+
+// V4L2 devices and network streams through cv::VideoCapture, which also
+// plays video files
+class CaptureSource : public FrameSource
+{
+public:
+    // device is "auto", a device path or index, a URL or a file;
+    // throws std::runtime_error if it cannot be opened
+    CaptureSource (const std::string& device, cv::Size captureSize, bool live);
+
+    const char* kind () const override { return m_live ? "camera" : "video"; }
+    bool live () const override { return m_live; }
+
+    bool read (SourceFrame& out) override;
+    bool rewind () override;
+
+    double fps () const override { return m_fps; }
+    cv::Size frameSize () const override { return m_frameSize; }
+
+private:
+    const std::string m_device;
+    const cv::Size m_captureSize;
+    const bool m_live;
+    cv::VideoCapture m_capture;
+    double m_fps = 0.0;
+    cv::Size m_frameSize;
+    size_t m_emptyGrabs = 0;
+
+    void open ();
+};
+
+// Still images: every image in a directory, those matching a glob, or a
+// single file, in name order. Images decode independently, so several
+// threads can decode ahead at once. Every image is scaled to the size of
+// the first one that decodes, so a directory of mixed sizes still gives
+// the pipeline frames of one size.
+class ImageSource : public FrameSource
+{
+public:
+    // throws std::runtime_error if nothing matches or nothing decodes
+    explicit ImageSource (const std::string& pattern);
+
+    const char* kind () const override { return "images"; }
+    bool live () const override { return false; }
+
+    bool read (SourceFrame& out) override;
+    size_t indexedCount () const override { return m_paths.size(); }
+    bool readIndexed (size_t index, SourceFrame& out) override;
+    bool rewind () override;
+
+    // of the first image that decodes
+    cv::Size frameSize () const override { return m_frameSize; }
+
+    static bool isImagePath (const std::string& path);
+
+private:
+    std::vector<std::string> m_paths;
+    size_t m_next = 0;
+    cv::Size m_frameSize;
+};
+
+// Frames another detect publishes with shm:NAME, copied out of the ring
+class FrameBusSource : public FrameSource
+{
+public:
+    // waits up to timeout for the bus to appear; throws
+    // std::runtime_error if it does not
+    FrameBusSource (const std::string& name, std::chrono::milliseconds timeout);
+
+    const char* kind () const override { return "shm"; }
+    bool live () const override { return true; }
+
+    bool read (SourceFrame& out) override;
+    void cancel () override { m_cancelled.store(true, std::memory_order_relaxed); }
+
+    double fps () const override { return m_fps; }
+    cv::Size frameSize () const override { return m_frameSize; }
+
+private:
+    bus::Reader m_reader;
+    uint64_t m_seen = 0;
+    double m_fps = 0.0;
+    cv::Size m_frameSize;
+    std::atomic<bool> m_cancelled{false};
+};
+
+// the first camera found
+constexpr char DEVICE_AUTO[] = "auto";
+
+// "auto" or a device ("/dev/video0", "0"), a URL ("rtsp://..."), a video
+// file, a directory of images, a glob ("frames/*.jpg"), an image file or
+// "shm:NAME"; throws std::runtime_error if it cannot be opened
+std::unique_ptr<FrameSource> openFrameSource (const std::string& spec, cv::Size captureSize);
+
+
+struct PrefetchConfig
+{
+    // decoding threads for sources with indexed frames; others get one
+    size_t threads = 2;
+
+    // frames decoded ahead of the consumer. When it is full a live
+    // source drops its oldest frame, anything else waits.
+    size_t depth = 4;
+
+    // times to play a source that can rewind, 0 until stopped
+    size_t loops = 1;
+
+    // frames to read in all, lost ones included; 0 for no limit
+    size_t maxFrames = 0;
+
+    // how the consumer and the decoding threads wait on the queue
+    ring::WaitPolicy wait = ring::WaitPolicy::Park;
+};
+
+struct PrefetchMetrics
+{
+    uint64_t decoded;
+
+    // failed grabs and unreadable images
+    uint64_t lost;
+
+    // live frames evicted from a full queue
+    uint64_t dropped;
+
+    uint64_t decodeNs;
+
+    // CPU time of the decoding threads, counted as each of them finishes
+    uint64_t cpuNs;
+};
+
+// Decodes a source ahead of its consumer on threads of its own, so that
+// decoding overlaps with inference. Frames come out in source order
+// however many threads decode them; a thread that finishes early waits
+// for its turn to queue its frame.
+class FramePrefetcher
+{
+public:
+    FramePrefetcher (std::unique_ptr<FrameSource> source, const PrefetchConfig& config);
+
+    ~FramePrefetcher ();
+
+    FramePrefetcher (const FramePrefetcher&) = delete;
+    FramePrefetcher& operator= (const FramePrefetcher&) = delete;
+
+    // the next frame; waits for one, false once the source is done, or
+    // stopped, and everything decoded was handed out. Any thread.
+    bool next (SourceFrame& frame);
+
+    // stops decoding and wakes everyone waiting
+    void stop ();
+
+    const FrameSource& source () const { return *m_source; }
+    size_t threads () const { return m_threads.size(); }
+
+    PrefetchMetrics metrics () const;
+
+private:
+    const std::unique_ptr<FrameSource> m_source;
+    const PrefetchConfig m_config;
+    MpmcRing<SourceFrame> m_queue;
+
+    std::atomic<bool> m_stopping{false};
+    std::atomic<size_t> m_running{0};
+
+    // indexed sources: frames are numbered by ticket and queued in order
+    std::atomic<uint64_t> m_nextTicket{0};
+    std::mutex m_orderMutex;
+    std::condition_variable m_turn;
+    uint64_t m_nextToQueue = 0;
+
+    std::atomic<uint64_t> m_decoded{0};
+    std::atomic<uint64_t> m_lost{0};
+    std::atomic<uint64_t> m_decodeNs{0};
+    std::atomic<uint64_t> m_cpuNs{0};
+
+    // last, so everything above exists before the threads start
+    std::vector<std::thread> m_threads;
+
+    void readStream ();
+    void readIndexed ();
+    void finished ();
+};
+
+#endif // FRAME_SOURCE_H
@@ -0,0 +1,383 @@
+#include "FrameTrace.hpp"
+
+#include "Log.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace trace
+{
+
+
+namespace
+{
+
+constexpr size_t ringCapacity = 4096;
+static_assert((ringCapacity & (ringCapacity - 1)) == 0, "ring capacity must be a power of two");
+
+struct Event
+{
+    const char* name;
+    uint64_t frameId;
+    uint64_t beginNs;
+    uint64_t endNs;
+    uint32_t tid;
+};
+
+// Single writer ring. Each slot carries a sequence number that is odd
+// while the slot is being written, so the dumping thread can tell a torn
+// slot from a complete one without ever blocking the writer.
+class Ring
+{
+public:
+    explicit Ring (uint32_t tid)
+    :
+        m_tid(tid)
+    { }
+
+    void
+    push (const char* name, uint64_t frameId, uint64_t beginNs, uint64_t endNs)
+    {
+        uint64_t index = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[index & (ringCapacity - 1)];
+
+        slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.frameId.store(frameId, std::memory_order_relaxed);
+        slot.beginNs.store(beginNs, std::memory_order_relaxed);
+        slot.endNs.store(endNs, std::memory_order_relaxed);
+        slot.seq.store(2 * index + 2, std::memory_order_release);
+
+        m_head.store(index + 1, std::memory_order_release);
+    }
+
+    void
+    collect (std::vector<Event>& out) const
+    {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t first = head > ringCapacity ? head - ringCapacity : 0;
+        for (uint64_t index = first; index < head; index++)
+        {
+            const Slot& slot = m_slots[index & (ringCapacity - 1)];
+            uint64_t before = slot.seq.load(std::memory_order_acquire);
+            if (before != 2 * index + 2)
+                continue;
+
+            Event event {
+                .name = slot.name.load(std::memory_order_relaxed),
+                .frameId = slot.frameId.load(std::memory_order_relaxed),
+                .beginNs = slot.beginNs.load(std::memory_order_relaxed),
+                .endNs = slot.endNs.load(std::memory_order_relaxed),
+                .tid = m_tid
+            };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == before)
+                out.push_back(event);
+        }
+    }
+
+    uint32_t tid () const { return m_tid; }
+
+    std::atomic<const char*> threadName{nullptr};
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> frameId{0};
+        std::atomic<uint64_t> beginNs{0};
+        std::atomic<uint64_t> endNs{0};
+    };
+
+    const uint32_t m_tid;
+    std::atomic<uint64_t> m_head{0};
+    std::array<Slot, ringCapacity> m_slots;
+};
+
+struct Tracer
+{
+    Config config;
+    std::atomic<bool> enabled{false};
+    std::atomic<uint64_t> nextFrame{1};
+    std::atomic<uint64_t> lastAutoDumpNs{0};
+
+    // rings are never freed while the process runs, so threads that
+    // exit leave their spans behind for the next dump
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    std::mutex dumpMutex;
+    std::condition_variable dumpCv;
+    const char* dumpReason = nullptr;
+    bool stopping = false;
+    uint64_t dumps = 0;
+    std::thread dumper;
+
+    ~Tracer ()
+    {
+        if (!dumper.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(dumpMutex);
+            stopping = true;
+        }
+        dumpCv.notify_one();
+        dumper.join();
+    }
+};
+
+Tracer&
+tracer ()
+{
+    static Tracer instance;
+    return instance;
+}
+
+thread_local Ring* threadRing = nullptr;
+thread_local uint64_t threadFrame = 0;
+
+Ring&
+ringForThisThread ()
+{
+    if (threadRing)
+        return *threadRing;
+
+    Tracer& t = tracer();
+    std::lock_guard<std::mutex> lock(t.ringsMutex);
+    t.rings.push_back(std::make_unique<Ring>(static_cast<uint32_t>(t.rings.size() + 1)));
+    threadRing = t.rings.back().get();
+    return *threadRing;
+}
+
+void
+writeJsonString (
+    std::ostream& out,
+    const char* text
+)
+{
+    out << '"';
+    for (const char* c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+void
+writeDump (
+    const char* reason
+)
+{
+    Tracer& t = tracer();
+
+    std::vector<Event> events;
+    std::vector<std::pair<uint32_t, const char*>> threads;
+    {
+        std::lock_guard<std::mutex> lock(t.ringsMutex);
+        events.reserve(t.rings.size() * ringCapacity);
+        for (const auto& ring : t.rings)
+        {
+            ring->collect(events);
+            threads.emplace_back(ring->tid(), ring->threadName.load(std::memory_order_relaxed));
+        }
+    }
+
+    char fileName[64];
+    std::snprintf(fileName, sizeof(fileName), "/trace-%llu-%llu.json",
+        static_cast<unsigned long long>(nowNs() / 1000000),
+        static_cast<unsigned long long>(t.dumps++));
+    std::string path = t.config.directory + fileName;
+
+    std::ofstream out(path);
+    if (!out)
+    {
+        LOG_ERROR("failed to open trace file {}", path);
+        return;
+    }
+
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& [tid, name] : threads)
+    {
+        if (!name)
+            continue;
+        out << (first ? "" : ",\n")
+            << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        writeJsonString(out, name);
+        out << "}}";
+        first = false;
+    }
+
+    char line[96];
+    for (const auto& event : events)
+    {
+        out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << event.tid << ",\"name\":";
+        writeJsonString(out, event.name ? event.name : "?");
+        std::snprintf(line, sizeof(line), ",\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+            event.beginNs / 1000.0,
+            (event.endNs - event.beginNs) / 1000.0,
+            static_cast<unsigned long long>(event.frameId));
+        out << line;
+        first = false;
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"reason\":";
+    writeJsonString(out, reason);
+    out << "}}\n";
+
+    LOG_INFO("wrote {} trace events to {} ({})", events.size(), path, reason);
+}
+
+void
+dumperLoop ()
+{
+    Tracer& t = tracer();
+    std::unique_lock<std::mutex> lock(t.dumpMutex);
+    while (true)
+    {
+        t.dumpCv.wait(lock, [&] { return t.stopping || t.dumpReason != nullptr; });
+        if (t.dumpReason)
+        {
+            const char* reason = t.dumpReason;
+            t.dumpReason = nullptr;
+            lock.unlock();
+            writeDump(reason);
+            lock.lock();
+        }
+        if (t.stopping)
+            return;
+    }
+}
+
+} // end anonymous namespace
+
+void
+start (
+    const Config& config
+)
+{
+    if (config.directory.empty())
+        return;
+
+    Tracer& t = tracer();
+    t.config = config;
+    t.stopping = false;
+    t.dumper = std::thread(dumperLoop);
+    t.enabled.store(true, std::memory_order_release);
+}
+
+void
+stop ()
+{
+    Tracer& t = tracer();
+    if (!t.enabled.exchange(false))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(t.dumpMutex);
+        t.stopping = true;
+    }
+    t.dumpCv.notify_one();
+    t.dumper.join();
+}
+
+bool
+enabled ()
+{
+    return tracer().enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t
+nextFrameId ()
+{
+    return tracer().nextFrame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+setCurrentFrame (
+    uint64_t frameId
+)
+{
+    threadFrame = frameId;
+}
+
+uint64_t
+currentFrame ()
+{
+    return threadFrame;
+}
+
+void
+setThreadName (
+    const char* name
+)
+{
+    if (!enabled())
+        return;
+    ringForThisThread().threadName.store(name, std::memory_order_relaxed);
+}
+
+void
+record (
+    const char* name,
+    uint64_t beginNs,
+    uint64_t endNs
+)
+{
+    if (!enabled())
+        return;
+    ringForThisThread().push(name, threadFrame, beginNs, endNs);
+}
+
+void
+frameDone (
+    uint64_t frameId,
+    uint64_t latencyNs
+)
+{
+    Tracer& t = tracer();
+    if (!enabled() || t.config.thresholdNs == 0 || latencyNs < t.config.thresholdNs)
+        return;
+
+    uint64_t now = nowNs();
+    uint64_t last = t.lastAutoDumpNs.load(std::memory_order_relaxed);
+    uint64_t interval = std::chrono::duration_cast<std::chrono::nanoseconds>(t.config.minDumpInterval).count();
+    if (last != 0 && now - last < interval)
+        return;
+    if (!t.lastAutoDumpNs.compare_exchange_strong(last, now, std::memory_order_relaxed))
+        return;
+
+    LOG_INFO("frame {} took {}ms, dumping trace", frameId, latencyNs / 1000000);
+    requestDump("latency threshold");
+}
+
+void
+requestDump (
+    const char* reason
+)
+{
+    Tracer& t = tracer();
+    if (!enabled())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(t.dumpMutex);
+        t.dumpReason = reason;
+    }
+    t.dumpCv.notify_one();
+}
+
+
+} // end namespace trace
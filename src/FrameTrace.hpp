@@ -0,0 +1,69 @@
+#ifndef FRAME_TRACE_H
+#define FRAME_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+// Per-frame span recording, exported as Chrome trace-event JSON that
+// Perfetto (ui.perfetto.dev) or chrome://tracing can open.
+//
+// Every thread records into its own fixed size ring buffer, created the
+// first time the thread records anything. After that recording a span is
+// a handful of relaxed stores: no locks, no allocation. Dumps are written
+// by a background thread from a copy of the rings.
+namespace trace
+{
+
+
+struct Config
+{
+    // empty disables tracing entirely
+    std::string directory;
+
+    // dump automatically when a frame takes longer than this, 0 disables
+    uint64_t thresholdNs = 0;
+
+    // minimum time between two automatic dumps
+    std::chrono::seconds minDumpInterval{10};
+};
+
+void start (const Config& config);
+void stop ();
+
+bool enabled ();
+
+inline
+uint64_t
+nowNs ()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// new id for a frame at grab time
+uint64_t nextFrameId ();
+
+// frame the calling thread is currently working on; spans inherit it
+void setCurrentFrame (uint64_t frameId);
+uint64_t currentFrame ();
+
+// shown as the track name in the trace viewer; the pointer must stay
+// valid. Placement and allocation counting are placement::registerThread's
+void setThreadName (const char* name);
+
+// name must be a string literal or otherwise outlive the tracer
+void record (const char* name, uint64_t beginNs, uint64_t endNs);
+
+// called once per frame with the frame's total latency; schedules a dump
+// when it exceeds the configured threshold
+void frameDone (uint64_t frameId, uint64_t latencyNs);
+
+// schedule a dump of everything currently in the rings
+void requestDump (const char* reason);
+
+
+} // end namespace trace
+
+#endif // FRAME_TRACE_H
@@ -1,8 +1,9 @@
 #include "Hailo8Device.hpp"
 
+#include "Log.hpp"
+
 #include <hailo/hailort.hpp>
 
-#include <iostream>
 #include <stdexcept>
 
 Hailo8Device
@@ -64,7 +65,7 @@ Hailo8Device::configureDefaultVStreams (
     auto network_groups = network_groups_result.release();
     if (network_groups.size() != 1)
     {
-        std::cerr << "wrong number of network groups: " << network_groups.size() << std::endl;
+        LOG_ERROR("wrong number of network groups: {}", network_groups.size());
         return HAILO_INVALID_ARGUMENT;
     }
     assert(network_groups.size() == 1);
@@ -157,3 +158,27 @@ Hailo8Device::getId (
 {
     return deviceId;
 }
+
+std::optional<hailo_chip_temperature_info_t>
+Hailo8Device::getChipTemperature (
+    void
+) const
+{
+    auto temperature_result = device->get_chip_temperature();
+    if (!temperature_result)
+        return std::nullopt;
+    return temperature_result.release();
+}
+
+std::optional<float32_t>
+Hailo8Device::getPowerWatts (
+    void
+) const
+{
+    auto power_result = device->power_measurement(
+        HAILO_DVM_OPTIONS_AUTO,
+        HAILO_POWER_MEASUREMENT_TYPES__POWER);
+    if (!power_result)
+        return std::nullopt;
+    return power_result.release();
+}
@@ -4,6 +4,7 @@
 #include <opencv2/core.hpp>
 #include <hailo/hailort.hpp>
 
+#include <optional>
 #include <vector>
 
 
@@ -25,6 +26,10 @@ public:
     const hailort::Hef& getHef () const;
     const hailo_device_identity_t& getId () const;
 
+    // empty when the board or firmware does not support the measurement
+    std::optional<hailo_chip_temperature_info_t> getChipTemperature () const;
+    std::optional<float32_t> getPowerWatts () const;
+
     size_t getInVStreamFrameSize () const;
     size_t getOutVStreamFrameSize () const;
 
@@ -0,0 +1,251 @@
+#include "HttpServer.hpp"
+
+#include "FrameTrace.hpp"
+#include "Log.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace http
+{
+
+int
+listenOn (
+    const std::string& address,
+    std::string& unixPath
+)
+{
+    static const std::string unixPrefix = "unix:";
+
+    int fd = -1;
+    if (address.starts_with(unixPrefix))
+    {
+        unixPath = address.substr(unixPrefix.size());
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (unixPath.empty() || unixPath.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("invalid unix socket path: " + unixPath);
+        std::memcpy(addr.sun_path, unixPath.c_str(), unixPath.size() + 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            throw std::runtime_error("socket: " + std::string(strerror(errno)));
+
+        unlink(unixPath.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("bind " + unixPath + ": " + strerror(errno));
+        }
+    }
+    else
+    {
+        int port = 0;
+        try
+        {
+            port = std::stoi(address);
+        }
+        catch (const std::exception&)
+        {
+            port = -1;
+        }
+        if (port <= 0 || port > 65535)
+            throw std::runtime_error("invalid port: " + address);
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            throw std::runtime_error("socket: " + std::string(strerror(errno)));
+
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("bind 127.0.0.1:" + address + ": " + strerror(errno));
+        }
+    }
+
+    if (listen(fd, 16) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("listen: " + std::string(strerror(errno)));
+    }
+    return fd;
+}
+
+std::string
+readRequestPath (
+    int fd
+)
+{
+    timeval timeout = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char buffer[4096];
+    size_t used = 0;
+    while (used < sizeof(buffer) - 1)
+    {
+        ssize_t got = recv(fd, buffer + used, sizeof(buffer) - 1 - used, 0);
+        if (got <= 0)
+            break;
+        used += static_cast<size_t>(got);
+        buffer[used] = '\0';
+        if (std::strstr(buffer, "\r\n\r\n") || std::strstr(buffer, "\n\n"))
+            break;
+    }
+    buffer[used] = '\0';
+    return parseRequestPath(std::string_view(buffer, used));
+}
+
+std::string
+parseRequestPath (
+    std::string_view request
+)
+{
+    if (!request.starts_with("GET "))
+        return {};
+
+    size_t pathEnd = request.find(' ', 4);
+    if (pathEnd == std::string_view::npos)
+        return {};
+
+    std::string_view path = request.substr(4, pathEnd - 4);
+    path = path.substr(0, path.find('?'));
+    return std::string(path);
+}
+
+bool
+writeAll (
+    int fd,
+    const char* data,
+    size_t size
+)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+const char*
+statusText (
+    int status
+)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 503: return "Service Unavailable";
+    default:  return "Error";
+    }
+}
+
+} // end namespace http
+
+HttpServer::HttpServer (
+    const std::string& address,
+    Handler handler
+)
+:
+    m_address(address),
+    m_handler(std::move(handler))
+{
+    m_listenFd = http::listenOn(address, m_unixPath);
+    m_thread = std::thread(&HttpServer::run, this);
+}
+
+HttpServer::~HttpServer (
+    void
+)
+{
+    m_stopping.store(true);
+    if (m_thread.joinable())
+        m_thread.join();
+
+    close(m_listenFd);
+    if (!m_unixPath.empty())
+        unlink(m_unixPath.c_str());
+}
+
+void
+HttpServer::run (
+    void
+)
+{
+    trace::setThreadName("http");
+    placement::registerThread("http");
+    pollfd pfd = { .fd = m_listenFd, .events = POLLIN, .revents = 0 };
+    while (!m_stopping.load())
+    {
+        // wake up regularly to notice shutdown
+        int ready = poll(&pfd, 1, 200);
+        if (ready <= 0)
+            continue;
+
+        int clientFd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (clientFd < 0)
+            continue;
+        serve(clientFd);
+        close(clientFd);
+    }
+}
+
+void
+HttpServer::serve (
+    int clientFd
+)
+{
+    std::string path = http::readRequestPath(clientFd);
+
+    HttpResponse response;
+    if (path.empty())
+    {
+        response.status = 400;
+        response.body = "bad request\n";
+    }
+    else
+    {
+        try
+        {
+            response = m_handler(path);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("http handler for {}: {}", path, e.what());
+            response = HttpResponse { .status = 503, .body = "unavailable\n" };
+        }
+    }
+
+    std::string head = "HTTP/1.0 " + std::to_string(response.status) + " "
+        + http::statusText(response.status)
+        + "\r\nContent-Type: " + response.contentType
+        + "\r\nContent-Length: " + std::to_string(response.body.size())
+        + "\r\nConnection: close\r\n\r\n";
+    if (http::writeAll(clientFd, head.data(), head.size()))
+        http::writeAll(clientFd, response.body.data(), response.body.size());
+}
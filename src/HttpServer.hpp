@@ -0,0 +1,68 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+
+struct HttpResponse
+{
+    int status = 200;
+    std::string contentType = "text/plain; charset=utf-8";
+    std::string body;
+};
+
+// Bare bones HTTP/1.0 server for local tooling: GET only, one request
+// per connection, served one at a time on a single thread. Listens on
+// 127.0.0.1 or on a Unix domain socket, never on a public interface.
+class HttpServer
+{
+public:
+    using Handler = std::function<HttpResponse (const std::string& path)>;
+
+    // address is a TCP port ("9100") bound to loopback, or
+    // "unix:/path/to.sock"; throws std::runtime_error if it cannot listen
+    HttpServer (const std::string& address, Handler handler);
+
+    ~HttpServer ();
+
+    HttpServer (const HttpServer&) = delete;
+    HttpServer& operator= (const HttpServer&) = delete;
+
+    const std::string& address () const { return m_address; }
+
+private:
+    const std::string m_address;
+    const Handler m_handler;
+    std::string m_unixPath;
+    int m_listenFd = -1;
+    std::atomic<bool> m_stopping{false};
+    std::thread m_thread;
+
+    void run ();
+    void serve (int clientFd);
+};
+
+// shared by the servers in this tree
+namespace http
+{
+
+int listenOn (const std::string& address, std::string& unixPath);
+
+// reads up to the end of the request head; returns the GET path or an
+// empty string if the request is malformed or not a GET
+std::string readRequestPath (int fd);
+
+// the GET path of a request head read some other way, same rules
+std::string parseRequestPath (std::string_view request);
+
+bool writeAll (int fd, const char* data, size_t size);
+
+const char* statusText (int status);
+
+} // end namespace http
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,129 @@
+#include "JsonLines.hpp"
+
+#include "CocoClass.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cmath>
+
+
+namespace json
+{
+
+void
+appendString (
+    std::string& out,
+    std::string_view value
+)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+
+    out.push_back('"');
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"':  out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                out.append("\\u00");
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 0xf]);
+            }
+            else
+            {
+                out.push_back(c);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+void
+appendNumber (
+    std::string& out,
+    uint64_t value
+)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void
+appendNumber (
+    std::string& out,
+    int64_t value
+)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void
+appendNumber (
+    std::string& out,
+    double value,
+    int precision
+)
+{
+    // JSON has no NaN or infinity
+    if (!std::isfinite(value))
+    {
+        out.append("null");
+        return;
+    }
+
+    char digits[64];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision);
+    if (result.ec != std::errc())
+    {
+        out.append("null");
+        return;
+    }
+    out.append(digits, result.ptr);
+}
+
+void
+appendDetectionEvent (
+    std::string& out,
+    const SinkFrame& frame
+)
+{
+    auto sinceEpoch = frame.timestamp.time_since_epoch();
+    out.append("{\"frame\":");
+    appendNumber(out, frame.frameId);
+    out.append(",\"timestamp_ms\":");
+    appendNumber(out, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(sinceEpoch).count()));
+    out.append(",\"fps\":");
+    appendNumber(out, frame.fps, 2);
+    out.append(",\"detections\":[");
+
+    for (size_t i = 0; i < frame.detections.size(); i++)
+    {
+        const auto& detection = frame.detections[i];
+        const auto& box = detection.boundingBox;
+        out.append(i == 0 ? "{\"class\":" : ",{\"class\":");
+        appendString(out, CocoClass::nameFromIndex(detection.classId));
+        out.append(",\"score\":");
+        appendNumber(out, box.score, 4);
+        out.append(",\"box\":[");
+        appendNumber(out, box.x_min, 4);
+        out.push_back(',');
+        appendNumber(out, box.y_min, 4);
+        out.push_back(',');
+        appendNumber(out, box.x_max, 4);
+        out.push_back(',');
+        appendNumber(out, box.y_max, 4);
+        out.append("]}");
+    }
+    out.append("]}\n");
+}
+
+} // end namespace json
@@ -0,0 +1,35 @@
+#ifndef JSON_LINES_H
+#define JSON_LINES_H
+
+#include "FrameSink.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+// Hand-rolled JSON for the detection stream. Everything appends to a
+// caller's string, so a buffer that is cleared and reused stops
+// allocating once it has grown to the longest line. Numbers go through
+// std::to_chars: no locale, no iostreams, no printf parsing.
+namespace json
+{
+
+// a quoted string with ", \ and control characters escaped; other bytes,
+// UTF-8 included, are copied as they are
+void appendString (std::string& out, std::string_view value);
+
+void appendNumber (std::string& out, uint64_t value);
+void appendNumber (std::string& out, int64_t value);
+
+// fixed notation with precision digits after the point; null for NaN
+// and infinity, which JSON cannot express
+void appendNumber (std::string& out, double value, int precision);
+
+// {"frame":..,"timestamp_ms":..,"fps":..,"detections":[{"class":"person",
+// "score":0.91,"box":[x_min,y_min,x_max,y_max]},..]} and a newline
+void appendDetectionEvent (std::string& out, const SinkFrame& frame);
+
+} // end namespace json
+
+#endif // JSON_LINES_H
@@ -0,0 +1,296 @@
+#include "JsonLinesSink.hpp"
+
+#include "FrameTrace.hpp"
+#include "HttpServer.hpp"
+#include "JsonLines.hpp"
+#include "Log.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace
+{
+
+// lines written with one system call when they pile up
+constexpr size_t maxBatchBytes = 64 * 1024;
+
+// room for a frame with a few dozen detections before a buffer grows
+constexpr size_t initialLineBytes = 1024;
+
+void
+wake (
+    int eventFd
+)
+{
+    uint64_t one = 1;
+    ssize_t written = ::write(eventFd, &one, sizeof(one));
+    (void)written;
+}
+
+} // end anonymous namespace
+
+JsonLinesSink::JsonLinesSink (
+    const std::string& target,
+    size_t queueLines
+)
+:
+    m_lines(queueLines, ring::WaitPolicy::Park),
+    m_free(queueLines, ring::WaitPolicy::Park)
+{
+    if (target == "-")
+    {
+        m_outFd = STDOUT_FILENO;
+    }
+    else if (target.starts_with("unix:"))
+    {
+        m_listenFd = http::listenOn(target, m_unixPath);
+        ::fcntl(m_listenFd, F_SETFL, ::fcntl(m_listenFd, F_GETFL) | O_NONBLOCK);
+    }
+    else
+    {
+        m_outFd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_outFd < 0)
+            throw std::runtime_error("failed to open " + target + " for writing: " + strerror(errno));
+        m_ownsOut = true;
+    }
+
+    m_wakeFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wakeFd < 0)
+    {
+        int error = errno;
+        close();
+        throw std::runtime_error("eventfd: " + std::string(strerror(error)));
+    }
+
+    for (size_t i = 0; i < m_free.capacity(); i++)
+    {
+        std::string line;
+        line.reserve(initialLineBytes);
+        m_free.tryPush(std::move(line));
+    }
+    m_batch.reserve(maxBatchBytes + initialLineBytes);
+    m_writer = std::thread(&JsonLinesSink::run, this);
+}
+
+JsonLinesSink::~JsonLinesSink (
+    void
+)
+{
+    close();
+}
+
+void
+JsonLinesSink::consume (
+    const SinkFrame& frame
+)
+{
+    std::string line;
+    if (!m_free.tryPop(line))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    line.clear();
+    json::appendDetectionEvent(line, frame);
+    // cannot fail, there are only as many buffers as slots
+    m_lines.tryPush(std::move(line));
+    wake(m_wakeFd);
+}
+
+uint64_t
+JsonLinesSink::dropped (
+    void
+) const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void
+JsonLinesSink::close (
+    void
+)
+{
+    if (m_writer.joinable())
+    {
+        m_stopping.store(true);
+        wake(m_wakeFd);
+        m_writer.join();
+    }
+
+    for (const Client& client : m_clients)
+        ::close(client.fd);
+    m_clients.clear();
+    if (m_ownsOut && m_outFd >= 0)
+        ::close(m_outFd);
+    m_outFd = -1;
+    if (m_listenFd >= 0)
+    {
+        ::close(m_listenFd);
+        ::unlink(m_unixPath.c_str());
+    }
+    m_listenFd = -1;
+    if (m_wakeFd >= 0)
+        ::close(m_wakeFd);
+    m_wakeFd = -1;
+}
+
+void
+JsonLinesSink::run (
+    void
+)
+{
+    trace::setThreadName("json");
+    placement::registerThread("json");
+    std::vector<pollfd> fds;
+    while (true)
+    {
+        // anything queued before close() is still written
+        bool stopping = m_stopping.load();
+        std::string line;
+        while (m_lines.tryPop(line))
+        {
+            m_batch.append(line);
+            line.clear();
+            m_free.tryPush(std::move(line));
+            if (m_batch.size() >= maxBatchBytes)
+                flush();
+        }
+        flush();
+        if (stopping)
+            break;
+
+        fds.clear();
+        fds.push_back({ .fd = m_wakeFd, .events = POLLIN, .revents = 0 });
+        if (m_listenFd >= 0)
+            fds.push_back({ .fd = m_listenFd, .events = POLLIN, .revents = 0 });
+        const size_t firstClient = fds.size();
+        for (const Client& client : m_clients)
+        {
+            short events = client.pending.empty() ? 0 : POLLOUT;
+            fds.push_back({ .fd = client.fd, .events = events, .revents = 0 });
+        }
+
+        if (::poll(fds.data(), fds.size(), -1) < 0)
+            continue;
+
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t count;
+            ssize_t read = ::read(m_wakeFd, &count, sizeof(count));
+            (void)read;
+        }
+
+        // clients accepted now go to the end and are not in fds yet
+        for (size_t i = 0; i < fds.size() - firstClient; i++)
+        {
+            short revents = fds[firstClient + i].revents;
+            Client& client = m_clients[i];
+            bool ok = (revents & (POLLERR | POLLHUP | POLLNVAL)) == 0;
+            if (ok && (revents & POLLOUT))
+                ok = sendPending(client);
+            if (!ok)
+            {
+                ::close(client.fd);
+                client.fd = -1;
+            }
+        }
+        std::erase_if(m_clients, [](const Client& client) { return client.fd < 0; });
+
+        if (m_listenFd >= 0 && (fds[1].revents & POLLIN))
+            acceptClients();
+    }
+}
+
+void
+JsonLinesSink::flush (
+    void
+)
+{
+    if (m_batch.empty())
+        return;
+
+    const uint64_t lines = std::count(m_batch.begin(), m_batch.end(), '\n');
+    if (m_outFd >= 0 && !m_failed)
+    {
+        // a slow reader blocks only this thread; the queue fills and
+        // consume() starts dropping
+        const char* data = m_batch.data();
+        size_t size = m_batch.size();
+        while (size > 0)
+        {
+            ssize_t written = ::write(m_outFd, data, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+            {
+                LOG_ERROR("json output failed: {}", strerror(errno));
+                m_failed = true;
+                break;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+    if (m_outFd >= 0 && m_failed)
+        m_dropped.fetch_add(lines, std::memory_order_relaxed);
+
+    for (Client& client : m_clients)
+    {
+        // still behind on an earlier batch, this one is skipped
+        if (!client.pending.empty())
+        {
+            m_dropped.fetch_add(lines, std::memory_order_relaxed);
+            continue;
+        }
+
+        ssize_t sent = ::send(client.fd, m_batch.data(), m_batch.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            ::close(client.fd);
+            client.fd = -1;
+            continue;
+        }
+        // the rest of a partly sent batch goes out first, so lines stay whole
+        client.pending.assign(m_batch, std::max<ssize_t>(sent, 0));
+    }
+    std::erase_if(m_clients, [](const Client& client) { return client.fd < 0; });
+    m_batch.clear();
+}
+
+void
+JsonLinesSink::acceptClients (
+    void
+)
+{
+    while (true)
+    {
+        int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0)
+            return;
+        m_clients.push_back(Client { fd, {} });
+        LOG_INFO("json client connected, {} connected", m_clients.size());
+    }
+}
+
+bool
+JsonLinesSink::sendPending (
+    Client& client
+)
+{
+    ssize_t sent = ::send(client.fd, client.pending.data(), client.pending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    client.pending.erase(0, static_cast<size_t>(sent));
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef JSON_LINES_SINK_H
+#define JSON_LINES_SINK_H
+
+#include "FrameSink.hpp"
+#include "RingQueue.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// One JSON object per frame and line, see json::appendDetectionEvent.
+// consume() serializes into a recycled buffer and queues it; a writer
+// thread of its own does the I/O. When the writer falls behind, lines
+// are dropped rather than held up, and a Unix socket client that stops
+// reading misses lines while the others keep getting them.
+class JsonLinesSink : public FrameSink
+{
+public:
+    // target is "-" for stdout, "unix:/path" to serve every client that
+    // connects there, or a file to (re)write; throws std::runtime_error
+    // if it cannot be opened
+    explicit JsonLinesSink (const std::string& target, size_t queueLines = 256);
+
+    ~JsonLinesSink () override;
+
+    const char* name () const override { return "json"; }
+    bool needsPixels () const override { return false; }
+
+    void consume (const SinkFrame& frame) override;
+    uint64_t dropped () const override;
+    void close () override;
+
+private:
+    struct Client
+    {
+        int fd;
+        std::string pending;
+    };
+
+    // line buffers go to the writer full and come back empty
+    SpscRing<std::string> m_lines;
+    SpscRing<std::string> m_free;
+    int m_wakeFd = -1;
+
+    int m_outFd = -1;
+    bool m_ownsOut = false;
+    int m_listenFd = -1;
+    std::string m_unixPath;
+
+    // writer thread only
+    std::string m_batch;
+    std::vector<Client> m_clients;
+    bool m_failed = false;
+
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<bool> m_stopping{false};
+
+    // last, so everything above exists before the thread starts
+    std::thread m_writer;
+
+    void run ();
+    void flush ();
+    void acceptClients ();
+    bool sendPending (Client& client);
+};
+
+#endif // JSON_LINES_SINK_H
@@ -0,0 +1,154 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+
+// Log-linear (HDR style) histogram of nanosecond latencies. Every power
+// of two range is split into 16 linear sub-buckets, so any value is
+// resolved to within ~6%. Recording is a couple of relaxed atomic
+// increments and never locks or allocates.
+class LatencyHistogram
+{
+public:
+    static constexpr size_t subBits = 4;
+    static constexpr size_t subCount = size_t(1) << subBits;
+    static constexpr size_t bucketCount = (64 - subBits + 1) * subCount;
+
+    void
+    record (uint64_t ns)
+    {
+        m_counts[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t prev = m_max.load(std::memory_order_relaxed);
+        while (ns > prev && !m_max.compare_exchange_weak(prev, ns, std::memory_order_relaxed))
+            ;
+    }
+
+    uint64_t count () const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t max () const { return m_max.load(std::memory_order_relaxed); }
+
+    // p in [0, 1]; 0 when nothing has been recorded
+    uint64_t
+    percentile (double p) const
+    {
+        uint64_t total = 0;
+        for (const auto& bucket : m_counts)
+            total += bucket.load(std::memory_order_relaxed);
+        if (total == 0)
+            return 0;
+
+        uint64_t target = static_cast<uint64_t>(p * total + 0.5);
+        target = target == 0 ? 1 : target;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucketCount; i++)
+        {
+            seen += m_counts[i].load(std::memory_order_relaxed);
+            if (seen >= target)
+            {
+                uint64_t value = bucketMidpoint(i);
+                return value < max() ? value : max();
+            }
+        }
+        return max();
+    }
+
+    void
+    reset ()
+    {
+        for (auto& bucket : m_counts)
+            bucket.store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    static
+    constexpr
+    size_t
+    bucketFor (uint64_t value)
+    {
+        if (value < subCount)
+            return static_cast<size_t>(value);
+
+        size_t shift = std::bit_width(value) - 1 - subBits;
+        size_t sub = static_cast<size_t>(value >> shift) - subCount;
+        return (shift + 1) * subCount + sub;
+    }
+
+    static
+    constexpr
+    uint64_t
+    bucketMidpoint (size_t index)
+    {
+        if (index < subCount)
+            return index;
+
+        size_t shift = index / subCount - 1;
+        uint64_t low = uint64_t(subCount + index % subCount) << shift;
+        return low + ((uint64_t(1) << shift) >> 1);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucketCount> m_counts{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// Three histograms used in turn: one collects the current window, one
+// holds the window that closed last, and the third, closed the rotation
+// before, is reset to become the next current one. Readers of the closed
+// window therefore never see it reset under them, as long as they are
+// done with it before the rotation after next. Samples racing with
+// rotate() may land in either the old or the new window, which is fine
+// for reporting. One thread rotates; any thread reads.
+class RollingLatency
+{
+public:
+    void
+    record (uint64_t ns)
+    {
+        m_windows[m_active.load(std::memory_order_acquire) % windowCount].record(ns);
+        m_totalCount.fetch_add(1, std::memory_order_relaxed);
+        m_totalNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // close the current window and return it; valid until the next rotate
+    const LatencyHistogram&
+    rotate ()
+    {
+        uint64_t closing = m_active.load(std::memory_order_relaxed);
+        m_windows[(closing + 1) % windowCount].reset();
+
+        // publishes the reset along with the switch
+        m_active.store(closing + 1, std::memory_order_release);
+        return m_windows[closing % windowCount];
+    }
+
+    // the window closed by the last rotate, without rotating; empty
+    // before the first
+    const LatencyHistogram&
+    closedWindow () const
+    {
+        return m_windows[(m_active.load(std::memory_order_acquire) + windowCount - 1) % windowCount];
+    }
+
+    // since startup, across all windows
+    uint64_t totalCount () const { return m_totalCount.load(std::memory_order_relaxed); }
+    uint64_t totalNs () const { return m_totalNs.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint64_t windowCount = 3;
+
+    std::array<LatencyHistogram, windowCount> m_windows;
+    std::atomic<uint64_t> m_active{0};
+    std::atomic<uint64_t> m_totalCount{0};
+    std::atomic<uint64_t> m_totalNs{0};
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,594 @@
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace logging
+{
+
+
+namespace
+{
+
+constexpr size_t recordAlignment = 8;
+
+// marks the unused end of a thread buffer; the next record starts over
+// at the beginning
+constexpr uint8_t skipMarker = 0xff;
+
+struct RecordHeader
+{
+    uint32_t size;
+    uint8_t level;
+    uint64_t timeNs;
+    const char* text;
+    detail::FormatFn format;
+};
+
+static_assert(sizeof(RecordHeader) % recordAlignment == 0);
+
+size_t
+alignUp (
+    size_t bytes
+)
+{
+    return (bytes + recordAlignment - 1) & ~(recordAlignment - 1);
+}
+
+uint64_t
+nowNs ()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// One producer, the thread that owns the buffer, and one consumer, the
+// flusher. Records never wrap: one that does not fit before the end
+// starts over at the beginning behind a skip marker.
+class ThreadBuffer
+{
+public:
+    explicit ThreadBuffer (size_t capacity)
+    :
+        m_capacity(alignUp(capacity)),
+        m_data(new std::byte[m_capacity])
+    { }
+
+    size_t capacity () const { return m_capacity; }
+
+    std::byte*
+    reserve (size_t bytes)
+    {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        const size_t offset = head % m_capacity;
+        const size_t skip = offset + bytes > m_capacity ? m_capacity - offset : 0;
+        if (head + skip + bytes - m_cachedTail > m_capacity)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head + skip + bytes - m_cachedTail > m_capacity)
+                return nullptr;
+        }
+
+        if (skip > 0)
+        {
+            RecordHeader marker {};
+            marker.size = static_cast<uint32_t>(skip);
+            marker.level = skipMarker;
+            std::memcpy(m_data.get() + offset, &marker, sizeof(marker.size) + sizeof(marker.level));
+        }
+        m_reserved = head + skip;
+        return m_data.get() + m_reserved % m_capacity;
+    }
+
+    void
+    commit (size_t bytes)
+    {
+        m_head.store(m_reserved + bytes, std::memory_order_release);
+    }
+
+    void
+    countDrop ()
+    {
+        m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    uint64_t dropped () const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // consumer side: calls visit(header, args) for every published record
+    template <typename Visit>
+    void
+    drain (Visit&& visit)
+    {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        while (tail < head)
+        {
+            const std::byte* record = m_data.get() + tail % m_capacity;
+            RecordHeader header;
+            std::memcpy(&header, record, sizeof(header.size) + sizeof(header.level));
+            if (header.level != skipMarker)
+            {
+                std::memcpy(&header, record, sizeof(header));
+                visit(header, record + sizeof(header));
+            }
+            tail += header.size;
+        }
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    // set while a thread writes into the buffer; an exiting thread hands
+    // it back for the next new thread
+    std::atomic<bool> owned{false};
+
+private:
+    const size_t m_capacity;
+    std::unique_ptr<std::byte[]> m_data;
+
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    uint64_t m_reserved = 0;
+    uint64_t m_cachedTail = 0;
+    std::atomic<uint64_t> m_dropped{0};
+
+    alignas(64) std::atomic<uint64_t> m_tail{0};
+};
+
+struct Line
+{
+    uint64_t timeNs;
+    Level level;
+    size_t begin;
+    size_t end;
+};
+
+struct Logger
+{
+    Config config;
+    std::atomic<bool> running{false};
+
+    // for the calls written right away, which never take drainMutex
+    std::atomic<int> directOutFd{STDOUT_FILENO};
+    std::atomic<int> directErrFd{STDERR_FILENO};
+
+    // buffers are reused, never freed while the process runs
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    // one consumer at a time: the flusher or a flush() caller
+    std::mutex drainMutex;
+    std::string text;
+    std::vector<Line> lines;
+    std::string out;
+    std::string err;
+    uint64_t reportedDrops = 0;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCv;
+    bool stopping = false;
+    std::thread flusher;
+
+    ~Logger ();
+};
+
+Logger&
+logger ()
+{
+    static Logger instance;
+    return instance;
+}
+
+struct BufferLease
+{
+    ThreadBuffer* buffer = nullptr;
+
+    ~BufferLease ()
+    {
+        if (buffer)
+            buffer->owned.store(false, std::memory_order_release);
+    }
+};
+
+thread_local BufferLease threadBuffer;
+
+// the record being written: in the thread's buffer, or in scratch when
+// the logger is not running
+thread_local std::byte* pendingRecord = nullptr;
+thread_local size_t pendingBytes = 0;
+thread_local bool pendingDirect = false;
+thread_local std::vector<std::byte> scratch;
+
+ThreadBuffer&
+bufferForThisThread ()
+{
+    if (threadBuffer.buffer)
+        return *threadBuffer.buffer;
+
+    Logger& l = logger();
+    std::lock_guard<std::mutex> lock(l.buffersMutex);
+    for (const auto& buffer : l.buffers)
+    {
+        bool expected = false;
+        if (buffer->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            threadBuffer.buffer = buffer.get();
+            return *threadBuffer.buffer;
+        }
+    }
+    l.buffers.push_back(std::make_unique<ThreadBuffer>(l.config.threadBufferBytes));
+    l.buffers.back()->owned.store(true, std::memory_order_relaxed);
+    threadBuffer.buffer = l.buffers.back().get();
+    return *threadBuffer.buffer;
+}
+
+const char*
+prefix (
+    Level level
+)
+{
+    switch (level)
+    {
+    case Level::Debug: return "[d] ";
+    case Level::Info:  return "[i] ";
+    case Level::Warn:  return "[w] ";
+    case Level::Error: return "[e] ";
+    }
+    return "";
+}
+
+void
+formatLine (
+    std::string& out,
+    const RecordHeader& header,
+    const std::byte* args
+)
+{
+    out.append(prefix(static_cast<Level>(header.level)));
+    header.format(args, header.text, out);
+    out.push_back('\n');
+}
+
+void
+writeAll (
+    int fd,
+    const std::string& data
+)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        // nowhere left to report a failure to
+        if (result <= 0)
+            return;
+        written += static_cast<size_t>(result);
+    }
+}
+
+// caller holds drainMutex
+void
+drainAll (
+    Logger& l
+)
+{
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(l.buffersMutex);
+        for (const auto& buffer : l.buffers)
+            buffers.push_back(buffer.get());
+    }
+
+    l.text.clear();
+    l.lines.clear();
+    uint64_t drops = 0;
+    for (ThreadBuffer* buffer : buffers)
+    {
+        buffer->drain([&](const RecordHeader& header, const std::byte* args)
+        {
+            size_t begin = l.text.size();
+            formatLine(l.text, header, args);
+            l.lines.push_back(Line { header.timeNs, static_cast<Level>(header.level), begin, l.text.size() });
+        });
+        drops += buffer->dropped();
+    }
+
+    // each buffer is in order already; this interleaves the threads
+    std::stable_sort(l.lines.begin(), l.lines.end(),
+        [](const Line& a, const Line& b) { return a.timeNs < b.timeNs; });
+
+    l.out.clear();
+    l.err.clear();
+    for (const Line& line : l.lines)
+    {
+        std::string& target = line.level >= Level::Warn ? l.err : l.out;
+        target.append(l.text, line.begin, line.end - line.begin);
+    }
+    if (drops > l.reportedDrops)
+    {
+        l.err.append("[e] ").append(std::to_string(drops - l.reportedDrops)).append(" log messages dropped, a thread's log buffer was full\n");
+        l.reportedDrops = drops;
+    }
+
+    writeAll(l.config.outFd, l.out);
+    writeAll(l.config.errFd, l.err);
+}
+
+void
+flushLogger (
+    Logger& l
+)
+{
+    std::lock_guard<std::mutex> lock(l.drainMutex);
+    drainAll(l);
+}
+
+void
+flusherLoop (
+    Logger& l
+)
+{
+    std::unique_lock<std::mutex> lock(l.wakeMutex);
+    while (!l.stopping)
+    {
+        l.wakeCv.wait_for(lock, l.config.flushInterval);
+        lock.unlock();
+        flushLogger(l);
+        lock.lock();
+    }
+}
+
+void
+stopLogger (
+    Logger& l
+)
+{
+    if (!l.flusher.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(l.wakeMutex);
+        l.stopping = true;
+    }
+    l.wakeCv.notify_one();
+    l.flusher.join();
+
+    l.running.store(false, std::memory_order_release);
+    flushLogger(l);
+}
+
+// anything still buffered at exit gets written
+Logger::~Logger ()
+{
+    stopLogger(*this);
+}
+
+} // end anonymous namespace
+
+
+void
+start (
+    const Config& config
+)
+{
+    Logger& l = logger();
+    if (l.flusher.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(l.drainMutex);
+        l.config = config;
+    }
+    l.directOutFd.store(config.outFd, std::memory_order_relaxed);
+    l.directErrFd.store(config.errFd, std::memory_order_relaxed);
+    l.stopping = false;
+    l.flusher = std::thread(flusherLoop, std::ref(l));
+    l.running.store(true, std::memory_order_release);
+}
+
+void
+stop ()
+{
+    stopLogger(logger());
+}
+
+void
+flush ()
+{
+    flushLogger(logger());
+}
+
+uint64_t
+dropped ()
+{
+    Logger& l = logger();
+    std::lock_guard<std::mutex> lock(l.buffersMutex);
+    uint64_t total = 0;
+    for (const auto& buffer : l.buffers)
+        total += buffer->dropped();
+    return total;
+}
+
+void
+writeLines (
+    Level level,
+    std::string_view text
+)
+{
+    while (!text.empty())
+    {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        Level lineLevel = level;
+        if (line.size() >= 4 && line[0] == '[' && line[2] == ']' && line[3] == ' ')
+        {
+            if (line[1] == 'w')
+                lineLevel = Level::Warn;
+            else if (line[1] == 'e')
+                lineLevel = Level::Error;
+            line.remove_prefix(4);
+        }
+        write(lineLevel, "{}", line);
+    }
+}
+
+
+namespace detail
+{
+
+void
+placeholderCountMismatch ()
+{
+}
+
+std::byte*
+beginRecord (
+    Level level,
+    const char* text,
+    FormatFn format,
+    size_t argBytes
+)
+{
+    const RecordHeader header {
+        .size = static_cast<uint32_t>(alignUp(sizeof(RecordHeader) + argBytes)),
+        .level = static_cast<uint8_t>(level),
+        .timeNs = nowNs(),
+        .text = text,
+        .format = format
+    };
+
+    std::byte* record = nullptr;
+    pendingDirect = !logger().running.load(std::memory_order_acquire);
+    if (pendingDirect)
+    {
+        scratch.resize(header.size);
+        record = scratch.data();
+    }
+    else
+    {
+        ThreadBuffer& buffer = bufferForThisThread();
+        if (header.size <= buffer.capacity() / 2)
+            record = buffer.reserve(header.size);
+        if (record == nullptr)
+        {
+            buffer.countDrop();
+            return nullptr;
+        }
+    }
+
+    std::memcpy(record, &header, sizeof(header));
+    pendingRecord = record;
+    pendingBytes = header.size;
+    return record + sizeof(header);
+}
+
+void
+endRecord ()
+{
+    if (!pendingDirect)
+    {
+        threadBuffer.buffer->commit(pendingBytes);
+        return;
+    }
+
+    RecordHeader header;
+    std::memcpy(&header, pendingRecord, sizeof(header));
+    std::string line;
+    formatLine(line, header, pendingRecord + sizeof(header));
+    Logger& l = logger();
+    writeAll(static_cast<Level>(header.level) >= Level::Warn
+        ? l.directErrFd.load(std::memory_order_relaxed)
+        : l.directOutFd.load(std::memory_order_relaxed), line);
+}
+
+const char*
+appendUntilPlaceholder (
+    std::string& out,
+    const char* text
+)
+{
+    const char* placeholder = std::strstr(text, "{}");
+    if (placeholder == nullptr)
+    {
+        out.append(text);
+        return text + std::strlen(text);
+    }
+    out.append(text, placeholder);
+    return placeholder + 2;
+}
+
+void
+appendValue (
+    std::string& out,
+    std::string_view value
+)
+{
+    out.append(value);
+}
+
+void
+appendValue (
+    std::string& out,
+    int64_t value
+)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void
+appendValue (
+    std::string& out,
+    uint64_t value
+)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void
+appendValue (
+    std::string& out,
+    double value
+)
+{
+    // six significant digits, like an ostream's default
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+    out.append(digits, result.ptr);
+}
+
+void
+appendValue (
+    std::string& out,
+    bool value
+)
+{
+    out.append(value ? "true" : "false");
+}
+
+void
+appendValue (
+    std::string& out,
+    char value
+)
+{
+    out.push_back(value);
+}
+
+} // end namespace detail
+
+
+} // end namespace logging
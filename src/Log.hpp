@@ -0,0 +1,296 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unistd.h>
+
+
+// Asynchronous logging for the pipeline's threads.
+//
+//   LOG_INFO("recording to {}", path);
+//   LOG_ERROR("write failed: {}", hailo_get_status_message(status));
+//
+// A call copies the format string's address and the raw arguments into a
+// buffer owned by the calling thread; strings are copied, everything else
+// is stored as is. No formatting, locking or system call happens on the
+// caller's thread. A flusher thread formats what the threads logged,
+// in the order it was logged, and writes it with one write() per batch.
+// When a thread's buffer is full its messages are dropped and counted
+// rather than waited for.
+//
+// Before start() and after stop() every call formats and writes right
+// away, so tools that never start the logger still print. After stop()
+// these writes keep going to the descriptors start() was given.
+//
+// The only placeholder is {}; the number of placeholders is checked
+// against the arguments at compile time. Arguments can be strings,
+// integers, enums, floating point values (printed like iostreams do),
+// bools and chars.
+namespace logging
+{
+
+
+enum class Level : uint8_t
+{
+    Debug,
+    Info,
+    Warn,
+    Error
+};
+
+struct Config
+{
+    // debug and info messages
+    int outFd = STDOUT_FILENO;
+
+    // warnings and errors
+    int errFd = STDERR_FILENO;
+
+    // per thread; a message larger than half of this is dropped
+    size_t threadBufferBytes = 64 * 1024;
+
+    std::chrono::milliseconds flushInterval{20};
+};
+
+void start (const Config& config = {});
+
+// writes everything logged so far and stops the flusher; meant for the
+// end of main, once the other threads are done logging
+void stop ();
+
+// writes everything logged so far before returning
+void flush ();
+
+// messages lost to full thread buffers
+uint64_t dropped ();
+
+
+namespace detail
+{
+
+using FormatFn = void (*)(const std::byte* args, const char* text, std::string& out);
+
+consteval
+size_t
+countPlaceholders (
+    const char* text
+)
+{
+    size_t count = 0;
+    for (; *text; text++)
+    {
+        if (text[0] == '{' && text[1] == '}')
+            count++;
+    }
+    return count;
+}
+
+// not constexpr: calling it from a consteval constructor fails to compile
+void placeholderCountMismatch ();
+
+std::byte* beginRecord (Level level, const char* text, FormatFn format, size_t argBytes);
+void endRecord ();
+
+// appends text up to the next {} and returns the position after it
+const char* appendUntilPlaceholder (std::string& out, const char* text);
+
+void appendValue (std::string& out, std::string_view value);
+void appendValue (std::string& out, int64_t value);
+void appendValue (std::string& out, uint64_t value);
+void appendValue (std::string& out, double value);
+void appendValue (std::string& out, bool value);
+void appendValue (std::string& out, char value);
+
+template <typename T>
+constexpr bool alwaysFalse = false;
+
+// arguments are narrowed to a handful of types so that few formatters
+// get instantiated
+template <typename T>
+auto
+normalize (
+    const T& value
+)
+{
+    if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+        return value ? std::string_view(value) : std::string_view("(null)");
+    else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+        return std::string_view(value);
+    else if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>)
+        return value;
+    else if constexpr (std::is_enum_v<T>)
+        return normalize(static_cast<std::underlying_type_t<T>>(value));
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        return static_cast<int64_t>(value);
+    else if constexpr (std::is_integral_v<T>)
+        return static_cast<uint64_t>(value);
+    else if constexpr (std::is_floating_point_v<T>)
+        return static_cast<double>(value);
+    else
+        static_assert(alwaysFalse<T>, "unsupported log argument type");
+}
+
+inline
+size_t
+encodedSize (
+    std::string_view value
+)
+{
+    return sizeof(uint32_t) + value.size();
+}
+
+template <typename T>
+size_t
+encodedSize (
+    const T&
+)
+{
+    return sizeof(T);
+}
+
+inline
+std::byte*
+encode (
+    std::byte* out,
+    std::string_view value
+)
+{
+    uint32_t size = static_cast<uint32_t>(value.size());
+    std::memcpy(out, &size, sizeof(size));
+    std::memcpy(out + sizeof(size), value.data(), size);
+    return out + sizeof(size) + size;
+}
+
+template <typename T>
+std::byte*
+encode (
+    std::byte* out,
+    const T& value
+)
+{
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+}
+
+template <typename T>
+const std::byte*
+appendEncoded (
+    std::string& out,
+    const std::byte* in
+)
+{
+    if constexpr (std::is_same_v<T, std::string_view>)
+    {
+        uint32_t size;
+        std::memcpy(&size, in, sizeof(size));
+        appendValue(out, std::string_view(reinterpret_cast<const char*>(in + sizeof(size)), size));
+        return in + sizeof(size) + size;
+    }
+    else
+    {
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        appendValue(out, value);
+        return in + sizeof(T);
+    }
+}
+
+// runs on the flusher thread
+template <typename... Values>
+void
+formatRecord (
+    const std::byte* args,
+    const char* text,
+    std::string& out
+)
+{
+    ((text = appendUntilPlaceholder(out, text), args = appendEncoded<Values>(out, args)), ...);
+    (void)args;
+    out.append(text);
+}
+
+template <typename... Values>
+void
+writeValues (
+    Level level,
+    const char* text,
+    const Values&... values
+)
+{
+    const size_t argBytes = (size_t{0} + ... + encodedSize(values));
+    std::byte* out = beginRecord(level, text, &formatRecord<Values...>, argBytes);
+    if (out == nullptr)
+        return;
+    ((out = encode(out, values)), ...);
+    endRecord();
+}
+
+} // end namespace detail
+
+
+// only converts from a string literal, whose placeholders must match
+// the arguments
+template <typename... Args>
+class FormatString
+{
+public:
+    template <size_t N>
+    consteval FormatString (const char (&text)[N])
+    :
+        m_text(text)
+    {
+        if (detail::countPlaceholders(text) != sizeof...(Args))
+            detail::placeholderCountMismatch();
+    }
+
+    const char* text () const { return m_text; }
+
+private:
+    const char* m_text;
+};
+
+template <typename... Args>
+void
+write (
+    Level level,
+    FormatString<std::type_identity_t<Args>...> format,
+    const Args&... args
+)
+{
+    detail::writeValues(level, format.text(), detail::normalize(args)...);
+}
+
+// logs each line of text, e.g. a report written to an ostringstream, as
+// a message of its own. A line starting with "[w] " or "[e] " is logged
+// at that level, any other at level; the prefix is not doubled.
+void writeLines (Level level, std::string_view text);
+
+
+} // end namespace logging
+
+
+// Messages below LOG_MIN_LEVEL (0 debug, 1 info, 2 warn, 3 error) are
+// compiled out, arguments included. Debug builds keep everything.
+#ifndef LOG_MIN_LEVEL
+#ifdef DBG
+#define LOG_MIN_LEVEL 0
+#else
+#define LOG_MIN_LEVEL 1
+#endif
+#endif
+
+#define LOG_AT(level, ...) \
+    do { if constexpr (static_cast<int>(level) >= LOG_MIN_LEVEL) logging::write(level, __VA_ARGS__); } while (false)
+
+#define LOG_DEBUG(...) LOG_AT(logging::Level::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(logging::Level::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(logging::Level::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(logging::Level::Error, __VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,148 @@
+#include "MetricsServer.hpp"
+
+#include <charconv>
+#include <cmath>
+
+
+static
+void
+appendLabelValue (
+    std::string& out,
+    std::string_view value
+)
+{
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '\\': out += "\\\\"; break;
+        case '"':  out += "\\\""; break;
+        case '\n': out += "\\n";  break;
+        default:   out += c;      break;
+        }
+    }
+}
+
+void
+PrometheusText::family (
+    std::string_view name,
+    std::string_view type,
+    std::string_view help
+)
+{
+    m_text.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    m_text.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void
+PrometheusText::sample (
+    std::string_view name,
+    double value,
+    Labels labels
+)
+{
+    m_text.append(name);
+    if (labels.size() > 0)
+    {
+        m_text += '{';
+        bool first = true;
+        for (const auto& [key, labelValue] : labels)
+        {
+            if (!first)
+                m_text += ',';
+            m_text.append(key).append("=\"");
+            appendLabelValue(m_text, labelValue);
+            m_text += '"';
+            first = false;
+        }
+        m_text += '}';
+    }
+    m_text += ' ';
+
+    if (std::isnan(value))
+    {
+        m_text += "NaN";
+    }
+    else
+    {
+        char number[32];
+        auto [end, ec] = std::to_chars(number, number + sizeof(number), value);
+        m_text.append(number, ec == std::errc() ? end : number);
+    }
+    m_text += '\n';
+}
+
+MetricsServer::MetricsServer (
+    const std::string& address,
+    std::vector<MetricsCollector> collectors
+)
+:
+    m_collectors(std::move(collectors)),
+    m_http(address, [this](const std::string& path) {
+        if (path != "/metrics")
+            return HttpResponse { .status = 404, .body = "try /metrics\n" };
+        return HttpResponse {
+            .status = 200,
+            .contentType = "text/plain; version=0.0.4; charset=utf-8",
+            .body = render()
+        };
+    })
+{ }
+
+std::string
+MetricsServer::render (
+    void
+) const
+{
+    PrometheusText out;
+    for (const auto& collect : m_collectors)
+        collect(out);
+    return out.str();
+}
+
+namespace metrics
+{
+
+void
+writeStageLatency (
+    PrometheusText& out,
+    const PipelineStats& stats
+)
+{
+    static constexpr std::pair<double, const char*> quantiles[] = {
+        {0.5, "0.5"}, {0.9, "0.9"}, {0.99, "0.99"}
+    };
+
+    out.family("detect_stage_latency_seconds", "summary",
+        "Per-stage latency; quantiles cover the last closed stats window");
+    for (size_t i = 0; i < PipelineStats::stageCount; i++)
+    {
+        const char* stage = stageName(static_cast<Stage>(i));
+        const RollingLatency& latency = stats.stage(static_cast<Stage>(i));
+        const LatencyHistogram& window = latency.closedWindow();
+        if (window.count() > 0)
+        {
+            for (const auto& [q, label] : quantiles)
+            {
+                out.sample("detect_stage_latency_seconds", window.percentile(q) / 1e9,
+                    {{"stage", stage}, {"quantile", label}});
+            }
+        }
+        out.sample("detect_stage_latency_seconds_sum", latency.totalNs() / 1e9, {{"stage", stage}});
+        out.sample("detect_stage_latency_seconds_count", latency.totalCount(), {{"stage", stage}});
+    }
+
+    out.family("detect_stage_latency_max_seconds", "gauge",
+        "Slowest sample of each stage in the last closed stats window");
+    for (size_t i = 0; i < PipelineStats::stageCount; i++)
+    {
+        const LatencyHistogram& window = stats.stage(static_cast<Stage>(i)).closedWindow();
+        if (window.count() > 0)
+        {
+            out.sample("detect_stage_latency_max_seconds", window.max() / 1e9,
+                {{"stage", stageName(static_cast<Stage>(i))}});
+        }
+    }
+}
+
+} // end namespace metrics
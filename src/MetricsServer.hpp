@@ -0,0 +1,59 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include "HttpServer.hpp"
+#include "PipelineStats.hpp"
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+// Builds a scrape in the Prometheus text exposition format.
+class PrometheusText
+{
+public:
+    using Labels = std::initializer_list<std::pair<std::string_view, std::string_view>>;
+
+    // HELP and TYPE lines; call once before the samples of a metric
+    void family (std::string_view name, std::string_view type, std::string_view help);
+
+    void sample (std::string_view name, double value, Labels labels = {});
+
+    const std::string& str () const { return m_text; }
+
+private:
+    std::string m_text;
+};
+
+using MetricsCollector = std::function<void (PrometheusText&)>;
+
+// Serves GET /metrics by running every collector on the server thread.
+// Collectors only read: whatever they look at is updated with relaxed
+// atomics by the threads that own it.
+class MetricsServer
+{
+public:
+    MetricsServer (const std::string& address, std::vector<MetricsCollector> collectors);
+
+    std::string render () const;
+
+    const std::string& address () const { return m_http.address(); }
+
+private:
+    const std::vector<MetricsCollector> m_collectors;
+    HttpServer m_http;
+};
+
+namespace metrics
+{
+
+// per stage quantiles over the last closed window, plus lifetime sum/count
+void writeStageLatency (PrometheusText& out, const PipelineStats& stats);
+
+} // end namespace metrics
+
+#endif // METRICS_SERVER_H
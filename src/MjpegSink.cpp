@@ -0,0 +1,430 @@
+#include "MjpegSink.hpp"
+
+#include "DetectPipeline.hpp"
+#include "FrameTrace.hpp"
+#include "HttpServer.hpp"
+#include "Log.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace
+{
+
+// parts still referenced by viewers come back to the pool when sent
+constexpr size_t pooledParts = 8;
+
+// a connection that has not sent its request head by then is dropped
+constexpr auto requestTimeout = std::chrono::seconds(2);
+
+constexpr size_t maxRequestBytes = 4096;
+
+constexpr char streamHead[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+    "Cache-Control: no-cache, no-store\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+std::string
+responseHead (
+    int status,
+    const char* contentType,
+    size_t length
+)
+{
+    char head[256];
+    std::snprintf(head, sizeof(head),
+        "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        status, http::statusText(status), contentType, length);
+    return head;
+}
+
+void
+wake (
+    int eventFd
+)
+{
+    uint64_t one = 1;
+    ssize_t written = ::write(eventFd, &one, sizeof(one));
+    (void)written;
+}
+
+} // end anonymous namespace
+
+MjpegSink::MjpegSink (
+    MjpegConfig config
+)
+:
+    m_config(std::move(config)),
+    m_jpegFlags({ cv::IMWRITE_JPEG_QUALITY, m_config.jpegQuality }),
+    m_pool(BufferPool::create(pooledParts))
+{
+    m_listenFd = http::listenOn(m_config.address, m_unixPath);
+    ::fcntl(m_listenFd, F_SETFL, ::fcntl(m_listenFd, F_GETFL) | O_NONBLOCK);
+
+    m_wakeFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wakeFd < 0)
+    {
+        int error = errno;
+        ::close(m_listenFd);
+        throw std::runtime_error("eventfd: " + std::string(strerror(error)));
+    }
+
+    m_server = std::thread(&MjpegSink::serve, this);
+    LOG_INFO("live view on {}", m_config.address);
+}
+
+MjpegSink::~MjpegSink (
+    void
+)
+{
+    close();
+}
+
+void
+MjpegSink::consume (
+    const SinkFrame& frame
+)
+{
+    // nobody watching, nothing to encode
+    if (m_viewers.load(std::memory_order_relaxed) == 0)
+    {
+        m_unwatched.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // other sinks share the pixels, so draw on a copy
+    frame.frame.copyTo(m_canvas);
+    annotateFrame(m_canvas, frame.detections, frame.fps);
+
+    uint64_t startNs = trace::nowNs();
+    bool ok = cv::imencode(".jpg", m_canvas, m_jpeg, m_jpegFlags);
+    if (!ok)
+    {
+        LOG_ERROR("live view frame encode failed");
+        return;
+    }
+
+    // the multipart headers go in front once, so a viewer's send is a
+    // single contiguous buffer
+    char head[128];
+    int headSize = std::snprintf(head, sizeof(head),
+        "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", m_jpeg.size());
+    auto part = m_pool->acquire();
+    part->reserve(headSize + m_jpeg.size() + 2);
+    part->insert(part->end(), head, head + headSize);
+    part->insert(part->end(), m_jpeg.begin(), m_jpeg.end());
+    part->push_back('\r');
+    part->push_back('\n');
+    uint64_t endNs = trace::nowNs();
+    trace::record("mjpeg encode", startNs, endNs);
+    m_encoded.fetch_add(1, std::memory_order_relaxed);
+    m_encodeUs.fetch_add((endNs - startNs) / 1000, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(m_latestMutex);
+        m_latest = std::move(part);
+        m_sequence++;
+    }
+    wake(m_wakeFd);
+}
+
+uint64_t
+MjpegSink::bufferedBytes (
+    void
+) const
+{
+    std::lock_guard<std::mutex> lock(m_latestMutex);
+    return m_latest ? m_latest->size() : 0;
+}
+
+void
+MjpegSink::close (
+    void
+)
+{
+    if (!m_server.joinable())
+        return;
+
+    m_stopping.store(true);
+    wake(m_wakeFd);
+    m_server.join();
+
+    ::close(m_listenFd);
+    if (!m_unixPath.empty())
+        ::unlink(m_unixPath.c_str());
+    ::close(m_wakeFd);
+
+    uint64_t encoded = m_encoded.load();
+    LOG_INFO("live view: {} frames encoded, avg encode {}us, {} frames without viewers",
+        encoded, encoded > 0 ? m_encodeUs.load() / encoded : 0, m_unwatched.load());
+}
+
+void
+MjpegSink::serve (
+    void
+)
+{
+    trace::setThreadName("http");
+    placement::registerThread("http");
+    std::vector<pollfd> fds;
+    while (!m_stopping.load())
+    {
+        fds.clear();
+        fds.push_back({ .fd = m_wakeFd, .events = POLLIN, .revents = 0 });
+        fds.push_back({ .fd = m_listenFd, .events = POLLIN, .revents = 0 });
+        for (const Viewer& viewer : m_connections)
+        {
+            // POLLIN also reports a viewer that hung up while idle
+            short events = POLLIN;
+            if (!viewer.head.empty() || viewer.part)
+                events |= POLLOUT;
+            fds.push_back({ .fd = viewer.fd, .events = events, .revents = 0 });
+        }
+
+        // wake up regularly to time out requests that never complete
+        if (::poll(fds.data(), fds.size(), 500) < 0)
+            continue;
+
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t count;
+            ssize_t read = ::read(m_wakeFd, &count, sizeof(count));
+            (void)read;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        // viewers accepted below go to the end and are not in fds yet
+        for (size_t i = 0; i + 2 < fds.size(); i++)
+        {
+            Viewer& viewer = m_connections[i];
+            short revents = fds[i + 2].revents;
+            bool ok = (revents & (POLLERR | POLLNVAL)) == 0;
+            if (ok && (revents & (POLLIN | POLLHUP)))
+                ok = readRequest(viewer);
+            if (ok && !viewer.streaming && !viewer.closeWhenSent && now - viewer.connected > requestTimeout)
+                ok = false;
+            // a new part, room in the socket, or both
+            if (ok)
+                ok = pump(viewer);
+            if (!ok)
+                disconnect(viewer);
+        }
+        std::erase_if(m_connections, [](const Viewer& viewer) { return viewer.fd < 0; });
+
+        if (fds[1].revents & POLLIN)
+            acceptViewers();
+    }
+
+    for (Viewer& viewer : m_connections)
+        disconnect(viewer);
+    m_connections.clear();
+}
+
+void
+MjpegSink::acceptViewers (
+    void
+)
+{
+    while (true)
+    {
+        int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0)
+            return;
+        Viewer viewer;
+        viewer.fd = fd;
+        viewer.id = m_nextId++;
+        viewer.connected = std::chrono::steady_clock::now();
+        m_connections.push_back(std::move(viewer));
+    }
+}
+
+// false once the connection is closed or unusable
+bool
+MjpegSink::readRequest (
+    Viewer& viewer
+)
+{
+    char buffer[1024];
+    while (true)
+    {
+        ssize_t got = ::recv(viewer.fd, buffer, sizeof(buffer), 0);
+        if (got == 0)
+            return false;
+        if (got < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        // anything a viewer sends after its request is ignored
+        if (viewer.streaming || viewer.closeWhenSent)
+            continue;
+
+        viewer.request.append(buffer, static_cast<size_t>(got));
+        if (viewer.request.size() > maxRequestBytes)
+            return false;
+        if (viewer.request.find("\r\n\r\n") == std::string::npos && viewer.request.find("\n\n") == std::string::npos)
+            continue;
+
+        std::string path = http::parseRequestPath(viewer.request);
+        viewer.request.clear();
+        viewer.request.shrink_to_fit();
+        size_t streaming = std::count_if(m_connections.begin(), m_connections.end(),
+            [](const Viewer& other) { return other.streaming; });
+        if ((path == "/" || path == "/stream") && streaming < m_config.maxViewers)
+        {
+            viewer.streaming = true;
+            viewer.head = streamHead;
+            m_viewers.store(streaming + 1, std::memory_order_relaxed);
+            LOG_INFO("live viewer {} connected, {} watching", viewer.id, streaming + 1);
+            continue;
+        }
+
+        std::string body;
+        int status = 200;
+        if (path == "/" || path == "/stream")
+        {
+            status = 503;
+            body = "too many viewers\n";
+        }
+        else if (path == "/stats")
+        {
+            body = statsText();
+        }
+        else
+        {
+            status = path.empty() ? 400 : 404;
+            body = std::string(http::statusText(status)) + "\n";
+        }
+        viewer.head = responseHead(status, "text/plain; charset=utf-8", body.size()) + body;
+        viewer.closeWhenSent = true;
+    }
+}
+
+// sends what fits without blocking; a viewer that finished a part moves
+// on to the newest one, skipping whatever came in between
+bool
+MjpegSink::pump (
+    Viewer& viewer
+)
+{
+    while (true)
+    {
+        if (!viewer.head.empty())
+        {
+            ssize_t sent = ::send(viewer.fd, viewer.head.data(), viewer.head.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            viewer.head.erase(0, static_cast<size_t>(sent));
+            if (!viewer.head.empty())
+                return true;
+            if (viewer.closeWhenSent)
+                return false;
+        }
+
+        if (!viewer.streaming)
+            return true;
+
+        if (!viewer.part)
+        {
+            std::lock_guard<std::mutex> lock(m_latestMutex);
+            if (!m_latest || m_sequence == viewer.sequence)
+                return true;
+            if (viewer.sequence > 0)
+                viewer.skipped += m_sequence - viewer.sequence - 1;
+            viewer.part = m_latest;
+            viewer.sequence = m_sequence;
+            viewer.offset = 0;
+        }
+
+        const BufferPool::Buffer& part = *viewer.part;
+        ssize_t sent = ::send(viewer.fd, part.data() + viewer.offset, part.size() - viewer.offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        viewer.offset += static_cast<size_t>(sent);
+        viewer.bytes += static_cast<uint64_t>(sent);
+        if (viewer.offset < part.size())
+            return true;
+        viewer.frames++;
+        viewer.part.reset();
+    }
+}
+
+void
+MjpegSink::disconnect (
+    Viewer& viewer
+)
+{
+    if (viewer.fd < 0)
+        return;
+    ::close(viewer.fd);
+    viewer.fd = -1;
+    viewer.part.reset();
+    if (!viewer.streaming)
+        return;
+
+    viewer.streaming = false;
+    size_t streaming = std::count_if(m_connections.begin(), m_connections.end(),
+        [](const Viewer& other) { return other.fd >= 0 && other.streaming; });
+    m_viewers.store(streaming, std::memory_order_relaxed);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - viewer.connected).count();
+    LOG_INFO("live viewer {} left after {}s: {} frames, {} skipped, {} KB/s",
+        viewer.id, seconds, viewer.frames, skipped(viewer),
+        seconds > 0 ? viewer.bytes / 1024.0 / seconds : 0.0);
+}
+
+// parts passed over so far, also by a viewer still stuck in an older
+// part: of the parts that came after it only the newest can still be sent
+uint64_t
+MjpegSink::skipped (
+    const Viewer& viewer
+) const
+{
+    if (viewer.sequence == 0)
+        return viewer.skipped;
+    std::lock_guard<std::mutex> lock(m_latestMutex);
+    return viewer.skipped + (m_sequence > viewer.sequence ? m_sequence - viewer.sequence - 1 : 0);
+}
+
+std::string
+MjpegSink::statsText (
+    void
+) const
+{
+    const uint64_t encoded = m_encoded.load(std::memory_order_relaxed);
+    const auto now = std::chrono::steady_clock::now();
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "encoded %llu frames, avg encode %llu us, %llu frames without viewers\n",
+        static_cast<unsigned long long>(encoded),
+        static_cast<unsigned long long>(encoded > 0 ? m_encodeUs.load(std::memory_order_relaxed) / encoded : 0),
+        static_cast<unsigned long long>(m_unwatched.load(std::memory_order_relaxed)));
+    std::string text = line;
+    text += "viewer  seconds    frames   skipped      KB/s\n";
+    for (const Viewer& viewer : m_connections)
+    {
+        if (!viewer.streaming)
+            continue;
+        double seconds = std::chrono::duration<double>(now - viewer.connected).count();
+        std::snprintf(line, sizeof(line), "%6u %8.1f %9llu %9llu %9.1f\n",
+            viewer.id,
+            seconds,
+            static_cast<unsigned long long>(viewer.frames),
+            static_cast<unsigned long long>(skipped(viewer)),
+            seconds > 0 ? viewer.bytes / 1024.0 / seconds : 0.0);
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,122 @@
+#ifndef MJPEG_SINK_H
+#define MJPEG_SINK_H
+
+#include "BufferPool.hpp"
+#include "FrameSink.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct MjpegConfig
+{
+    // a TCP port on loopback ("8090") or "unix:/path/to.sock"
+    std::string address;
+
+    int jpegQuality = 80;
+
+    // further connections are turned away with 503
+    size_t maxViewers = 8;
+};
+
+// Live view of the annotated stream as multipart/x-mixed-replace JPEG,
+// which browsers, VLC and ffplay show as video:
+//
+//   GET /        the stream (also /stream)
+//   GET /stats   encode cost and bandwidth per viewer, as text
+//
+// Each frame is annotated and compressed once on the sink's thread,
+// however many viewers there are, and not at all while there are none.
+// The compressed part is shared by reference with a server thread that
+// sends it to every viewer without blocking. A viewer still busy with an
+// older part skips ahead to the newest one when it is done, so a slow
+// viewer sees a lower frame rate and holds up nobody.
+class MjpegSink : public FrameSink
+{
+public:
+    // throws std::runtime_error if it cannot listen on the address
+    explicit MjpegSink (MjpegConfig config);
+
+    ~MjpegSink () override;
+
+    const char* name () const override { return "mjpeg"; }
+    bool needsPixels () const override { return true; }
+
+    void consume (const SinkFrame& frame) override;
+    uint64_t bufferedBytes () const override;
+    void close () override;
+
+    size_t viewers () const { return m_viewers.load(std::memory_order_relaxed); }
+
+private:
+    using Part = std::shared_ptr<const BufferPool::Buffer>;
+
+    struct Viewer
+    {
+        int fd;
+        uint32_t id;
+        std::chrono::steady_clock::time_point connected;
+        bool streaming = false;
+        bool closeWhenSent = false;
+
+        // request head while it arrives, then response bytes not sent yet
+        std::string request;
+        std::string head;
+
+        Part part;
+        size_t offset = 0;
+        uint64_t sequence = 0;
+
+        uint64_t frames = 0;
+        uint64_t skipped = 0;
+        uint64_t bytes = 0;
+    };
+
+    const MjpegConfig m_config;
+    const std::vector<int> m_jpegFlags;
+    std::shared_ptr<BufferPool> m_pool;
+
+    // sink thread only
+    cv::Mat m_canvas;
+    std::vector<uint8_t> m_jpeg;
+
+    // newest part, handed from the sink thread to the server thread
+    mutable std::mutex m_latestMutex;
+    Part m_latest;
+    uint64_t m_sequence = 0;
+
+    std::atomic<size_t> m_viewers{0};
+    std::atomic<uint64_t> m_encoded{0};
+    std::atomic<uint64_t> m_encodeUs{0};
+    std::atomic<uint64_t> m_unwatched{0};
+
+    std::string m_unixPath;
+    int m_listenFd = -1;
+    int m_wakeFd = -1;
+    std::atomic<bool> m_stopping{false};
+
+    // server thread only
+    std::vector<Viewer> m_connections;
+    uint32_t m_nextId = 1;
+
+    // last, so everything above exists before the thread starts
+    std::thread m_server;
+
+    void serve ();
+    void acceptViewers ();
+    bool readRequest (Viewer& viewer);
+    bool pump (Viewer& viewer);
+    void disconnect (Viewer& viewer);
+    uint64_t skipped (const Viewer& viewer) const;
+    std::string statsText () const;
+};
+
+#endif // MJPEG_SINK_H
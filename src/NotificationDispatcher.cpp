@@ -0,0 +1,254 @@
+#include "NotificationDispatcher.hpp"
+
+#include "FrameTrace.hpp"
+#include "Log.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <algorithm>
+
+
+static
+bool
+isRetryable (
+    EmailCode code
+)
+{
+    switch (code)
+    {
+    case CURLE_UNSUPPORTED_PROTOCOL:
+    case CURLE_URL_MALFORMAT:
+    case CURLE_LOGIN_DENIED:
+    case CURLE_OUT_OF_MEMORY:
+    case CURLE_FAILED_INIT:
+        return false;
+    default:
+        return true;
+    }
+}
+
+NotificationDispatcher::NotificationDispatcher (
+    const NotificationConfig& config
+)
+:
+    m_config(config)
+{
+    // curl_global_init is not thread safe, so do it before any worker
+    // gets a chance to call curl_easy_init
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    size_t workers = std::max<size_t>(m_config.workers, 1);
+    m_workers.reserve(workers);
+    for (size_t i = 0; i < workers; i++)
+        m_workers.emplace_back(&NotificationDispatcher::workerLoop, this);
+}
+
+NotificationDispatcher::~NotificationDispatcher (
+    void
+)
+{
+    shutdown();
+    curl_global_cleanup();
+}
+
+bool
+NotificationDispatcher::enqueue (
+    Notification&& notification
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping)
+            return false;
+
+        m_enqueued.fetch_add(1, std::memory_order_relaxed);
+        if (!notification.coalesceKey.empty())
+        {
+            auto pending = std::find_if(m_queue.begin(), m_queue.end(),
+                [&](const Notification& queued) {
+                    return queued.coalesceKey == notification.coalesceKey;
+                });
+            if (pending != m_queue.end())
+            {
+                *pending = std::move(notification);
+                m_coalesced.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        if (m_queue.size() >= std::max<size_t>(m_config.queueCapacity, 1))
+        {
+            m_queue.pop_front();
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_queue.push_back(std::move(notification));
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+void
+NotificationDispatcher::shutdown (
+    void
+)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopping && m_workers.empty())
+            return;
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+
+    // give the workers a chance to drain the queue, then cut retries short
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_cv.wait_for(lock, m_config.drainTimeout, [this] { return m_queue.empty() && m_inFlight == 0; }))
+        {
+            LOG_ERROR("notifier drain timed out, abandoning {} queued notifications", m_queue.size());
+            m_dropped.fetch_add(m_queue.size(), std::memory_order_relaxed);
+            m_queue.clear();
+        }
+        m_abort = true;
+    }
+    m_cv.notify_all();
+    m_retryCv.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+    m_workers.clear();
+}
+
+NotificationMetrics
+NotificationDispatcher::metrics (
+    void
+) const
+{
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        depth = m_queue.size();
+    }
+
+    return NotificationMetrics {
+        .queueDepth = depth,
+        .enqueued = m_enqueued.load(std::memory_order_relaxed),
+        .sent = m_sent.load(std::memory_order_relaxed),
+        .failed = m_failed.load(std::memory_order_relaxed),
+        .dropped = m_dropped.load(std::memory_order_relaxed),
+        .coalesced = m_coalesced.load(std::memory_order_relaxed),
+        .retries = m_retries.load(std::memory_order_relaxed),
+        .lastSendLatencyUs = m_lastSendLatencyUs.load(std::memory_order_relaxed),
+        .maxSendLatencyUs = m_maxSendLatencyUs.load(std::memory_order_relaxed),
+        .totalSendLatencyUs = m_totalSendLatencyUs.load(std::memory_order_relaxed)
+    };
+}
+
+void
+NotificationDispatcher::workerLoop (
+    void
+)
+{
+    trace::setThreadName("notifier");
+    placement::registerThread("notifier");
+    EmailNotifier notifier(
+        m_config.username,
+        m_config.password,
+        m_config.url,
+        m_config.useTls);
+
+    while (true)
+    {
+        Notification notification;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_abort || m_stopping || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                if (m_stopping || m_abort)
+                    return;
+                continue;
+            }
+            notification = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_inFlight++;
+        }
+
+        EmailCode status = deliver(notifier, notification);
+        if (status == CURLE_OK)
+        {
+            m_sent.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+            LOG_ERROR("notification failed: {}", curl_easy_strerror(status));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight--;
+        }
+        // wakes shutdown() waiting for the queue to drain
+        m_cv.notify_all();
+    }
+}
+
+EmailCode
+NotificationDispatcher::deliver (
+    EmailNotifier& notifier,
+    const Notification& notification
+)
+{
+    std::vector<std::span<const uint8_t>> images;
+    images.reserve(notification.images.size());
+    for (const auto& image : notification.images)
+    {
+        if (image && !image->empty())
+            images.emplace_back(*image);
+    }
+
+    auto backoff = m_config.initialBackoff;
+    EmailCode status = CURLE_OK;
+    for (size_t attempt = 1; ; attempt++)
+    {
+        uint64_t startNs = trace::nowNs();
+        status = notifier.connectAndSendImages(
+            m_config.mailFrom,
+            m_config.recipients,
+            notification.body,
+            images);
+        uint64_t endNs = trace::nowNs();
+        trace::record("notify", startNs, endNs);
+        recordLatency(std::chrono::nanoseconds(endNs - startNs));
+
+        if (status == CURLE_OK || !isRetryable(status) || attempt >= m_config.maxAttempts)
+            return status;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_retryCv.wait_for(lock, backoff, [this] { return m_abort; }))
+            return status;
+
+        m_retries.fetch_add(1, std::memory_order_relaxed);
+        backoff = std::min(backoff * 2, m_config.maxBackoff);
+    }
+}
+
+void
+NotificationDispatcher::recordLatency (
+    std::chrono::steady_clock::duration elapsed
+)
+{
+    if (m_config.sendLatency)
+        m_config.sendLatency->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    m_lastSendLatencyUs.store(us, std::memory_order_relaxed);
+    m_totalSendLatencyUs.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t prev = m_maxSendLatencyUs.load(std::memory_order_relaxed);
+    while (us > prev && !m_maxSendLatencyUs.compare_exchange_weak(prev, us, std::memory_order_relaxed))
+        ;
+}
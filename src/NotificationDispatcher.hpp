@@ -0,0 +1,119 @@
+#ifndef NOTIFICATION_DISPATCHER_H
+#define NOTIFICATION_DISPATCHER_H
+
+#include "EmailNotifier.hpp"
+#include "LatencyHistogram.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct NotificationConfig
+{
+    std::string username;
+    std::string password;
+    std::string url;
+    std::string mailFrom;
+    std::vector<std::string> recipients;
+
+    // plain SMTP, for a relay on the same box or a test server
+    bool useTls = true;
+
+    size_t workers = 2;
+    size_t queueCapacity = 8;
+    size_t maxAttempts = 4;
+    std::chrono::milliseconds initialBackoff{500};
+    std::chrono::milliseconds maxBackoff{8000};
+    std::chrono::milliseconds drainTimeout{15000};
+
+    // optional, receives the latency of every send attempt
+    RollingLatency* sendLatency = nullptr;
+};
+
+struct Notification
+{
+    std::string body;
+
+    // attached in order; a digest carries several snapshots
+    std::vector<std::shared_ptr<const std::vector<uint8_t>>> images;
+
+    // a pending notification with the same non-empty key is replaced
+    // in place instead of queueing another one behind it
+    std::string coalesceKey;
+};
+
+struct NotificationMetrics
+{
+    size_t queueDepth;
+    uint64_t enqueued;
+    uint64_t sent;
+    uint64_t failed;
+    uint64_t dropped;
+    uint64_t coalesced;
+    uint64_t retries;
+    uint64_t lastSendLatencyUs;
+    uint64_t maxSendLatencyUs;
+    uint64_t totalSendLatencyUs;
+};
+
+// Fixed pool of workers draining a bounded queue of outgoing emails.
+// When the queue is full the oldest pending notification is dropped.
+// Each worker owns its own EmailNotifier since curl handles must not
+// be shared between threads.
+class NotificationDispatcher
+{
+public:
+    explicit NotificationDispatcher (const NotificationConfig& config);
+
+    ~NotificationDispatcher ();
+
+    NotificationDispatcher (const NotificationDispatcher&) = delete;
+    NotificationDispatcher& operator= (const NotificationDispatcher&) = delete;
+
+    // returns false once shutdown has started
+    bool enqueue (Notification&& notification);
+
+    // stop accepting work and wait up to drainTimeout for pending
+    // notifications, abandoning retries after that
+    void shutdown ();
+
+    NotificationMetrics metrics () const;
+
+private:
+    const NotificationConfig m_config;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_retryCv;
+    std::deque<Notification> m_queue;
+    std::vector<std::thread> m_workers;
+    size_t m_inFlight = 0;
+    bool m_stopping = false;
+    bool m_abort = false;
+
+    std::atomic<uint64_t> m_enqueued{0};
+    std::atomic<uint64_t> m_sent{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_coalesced{0};
+    std::atomic<uint64_t> m_retries{0};
+    std::atomic<uint64_t> m_lastSendLatencyUs{0};
+    std::atomic<uint64_t> m_maxSendLatencyUs{0};
+    std::atomic<uint64_t> m_totalSendLatencyUs{0};
+
+    void workerLoop ();
+
+    EmailCode deliver (EmailNotifier& notifier, const Notification& notification);
+
+    void recordLatency (std::chrono::steady_clock::duration elapsed);
+};
+
+#endif // NOTIFICATION_DISPATCHER_H
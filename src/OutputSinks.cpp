@@ -0,0 +1,182 @@
+#include "OutputSinks.hpp"
+
+#include "DetectPipeline.hpp"
+#include "Log.hpp"
+
+#include <opencv2/highgui.hpp>
+
+#include <utility>
+
+
+namespace
+{
+
+// key presses that fit between two frames
+constexpr size_t keyQueueCapacity = 16;
+
+} // end anonymous namespace
+
+DisplaySink::DisplaySink (
+    void
+)
+:
+    m_keys(keyQueueCapacity, ring::WaitPolicy::Park)
+{ }
+
+DisplaySink::~DisplaySink (
+    void
+)
+{
+    // destroyed on the main thread, once the sink's thread is gone
+    if (m_windowOpen)
+        cv::destroyAllWindows();
+}
+
+void
+DisplaySink::consume (
+    const SinkFrame& frame
+)
+{
+    frame.frame.copyTo(m_drawing);
+    annotateFrame(m_drawing, frame.detections, frame.fps);
+
+    // the three canvases rotate, so none is reallocated once warm
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(m_drawing, m_pending);
+    m_hasPending = true;
+}
+
+void
+DisplaySink::pollMainThread (
+    void
+)
+{
+    bool fresh;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        fresh = std::exchange(m_hasPending, false);
+        if (fresh)
+            std::swap(m_pending, m_showing);
+    }
+    if (fresh)
+    {
+        cv::imshow(utils::windowName, m_showing);
+        m_windowOpen = true;
+    }
+
+    // every key HighGUI has queued, without waiting
+    int key;
+    while ((key = cv::pollKey()) >= 0)
+        m_keys.tryPush(std::move(key));
+}
+
+int
+DisplaySink::takeKey (
+    void
+)
+{
+    int key;
+    return m_keys.tryPop(key) ? key : -1;
+}
+
+std::unique_ptr<FrameSink>
+makeSink (
+    const std::string& spec,
+    const SinkOptions& options
+)
+{
+    if (spec == "display")
+        return std::make_unique<DisplaySink>();
+    if (spec == "null")
+        return std::make_unique<NullSink>();
+
+    size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon);
+    std::string path = colon == std::string::npos ? "" : spec.substr(colon + 1);
+    if (path.empty())
+    {
+        LOG_ERROR("unknown sink: {}", spec);
+        return nullptr;
+    }
+
+    if (kind == "video")
+    {
+        RecordingConfig recording = options.recording;
+        recording.path = path;
+        return std::make_unique<RecordingSink>(std::move(recording));
+    }
+
+    if (kind == "clip")
+    {
+        ClipConfig clip = options.clip;
+        clip.path = path;
+        return std::make_unique<ClipSink>(std::move(clip));
+    }
+
+    if (kind == "log")
+    {
+        DetectionLogConfig log = options.log;
+        log.directory = path;
+        return std::make_unique<DetectionLogSink>(std::move(log));
+    }
+
+    if (kind == "json")
+    {
+        try
+        {
+            return std::make_unique<JsonLinesSink>(path);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("{}", e.what());
+            return nullptr;
+        }
+    }
+
+    if (kind == "mjpeg")
+    {
+        MjpegConfig mjpeg = options.mjpeg;
+        mjpeg.address = path;
+        try
+        {
+            return std::make_unique<MjpegSink>(std::move(mjpeg));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("live view: {}", e.what());
+            return nullptr;
+        }
+    }
+
+    if (kind == "shm")
+    {
+        bus::WriterConfig config = options.bus;
+        config.name = path;
+        if (config.frameBytes == 0)
+        {
+            LOG_WARN("frame bus {}: the source did not report a frame size, sizing slots for {}x{}",
+                path, defaultCaptureWidth, defaultCaptureHeight);
+            config.frameBytes = defaultCaptureWidth * defaultCaptureHeight * 3;
+        }
+        try
+        {
+            return std::make_unique<FrameBusSink>(config);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("frame bus: {}", e.what());
+            return nullptr;
+        }
+    }
+
+    LOG_ERROR("unknown sink: {}", spec);
+    return nullptr;
+}
+
+bool
+writesToStdout (
+    const std::string& spec
+)
+{
+    return spec == "json:-";
+}
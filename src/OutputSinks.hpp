@@ -0,0 +1,93 @@
+#ifndef OUTPUT_SINKS_H
+#define OUTPUT_SINKS_H
+
+#include "ClipSink.hpp"
+#include "DetectionLogSink.hpp"
+#include "FrameBusSink.hpp"
+#include "FrameSink.hpp"
+#include "JsonLinesSink.hpp"
+#include "MjpegSink.hpp"
+#include "RecordingSink.hpp"
+#include "RingQueue.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+// The HighGUI window. Frames are annotated on the sink's thread, but
+// imshow and the key polling run in pollMainThread(), since HighGUI is
+// not thread safe and its Qt and Cocoa backends only work on the main
+// thread. The window shows the latest annotated frame.
+class DisplaySink : public FrameSink
+{
+public:
+    DisplaySink ();
+
+    ~DisplaySink () override;
+
+    const char* name () const override { return "display"; }
+    bool needsPixels () const override { return true; }
+
+    void consume (const SinkFrame& frame) override;
+    void pollMainThread () override;
+    int takeKey () override;
+
+private:
+    // sink thread only
+    cv::Mat m_drawing;
+
+    // handed from the sink's thread to the main thread
+    std::mutex m_mutex;
+    cv::Mat m_pending;
+    bool m_hasPending = false;
+
+    // main thread only
+    cv::Mat m_showing;
+    bool m_windowOpen = false;
+
+    // presses not taken yet; when full, newer ones are dropped
+    SpscRing<int> m_keys;
+};
+
+// takes frames and does nothing, for measuring the loop without outputs
+class NullSink : public FrameSink
+{
+public:
+    const char* name () const override { return "null"; }
+    bool needsPixels () const override { return false; }
+
+    void consume (const SinkFrame& /*frame*/) override { }
+};
+
+// settings of the sinks that have more than a path
+struct SinkOptions
+{
+    // path is taken from the spec
+    RecordingConfig recording;
+    ClipConfig clip;
+
+    // directory is taken from the spec
+    DetectionLogConfig log;
+
+    // address is taken from the spec
+    MjpegConfig mjpeg;
+
+    // name is taken from the spec; frameBytes 0 fits the default capture size
+    bus::WriterConfig bus;
+};
+
+// "display", "null", "video:PATH", "clip:PATH", "log:DIR", "json:PATH"
+// ("json:-" for stdout, "json:unix:/path" for a socket) or "mjpeg:PORT"
+// ("mjpeg:unix:/path") or "shm:NAME";
+// nullptr and a message on stderr if the spec is unknown or the file
+// cannot be opened
+std::unique_ptr<FrameSink> makeSink (const std::string& spec, const SinkOptions& options);
+
+// true for "json:-": the sink owns stdout, so logs and reports must go
+// elsewhere
+bool writesToStdout (const std::string& spec);
+
+#endif // OUTPUT_SINKS_H
@@ -0,0 +1,140 @@
+#ifndef PERCEPTUAL_HASH_H
+#define PERCEPTUAL_HASH_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+
+namespace phash
+{
+
+
+// 64 bit difference hash: shrink to 9x8, then one bit per horizontally
+// adjacent pair telling whether brightness increases, first row in the
+// top bits. Shrinking before the grayscale conversion leaves 72 pixels
+// to convert and compare, so the cost is the area resize reading the
+// frame once.
+inline
+uint64_t
+dHash (
+    cv::InputArray image
+)
+{
+    cv::Mat small, gray, mask;
+    cv::resize(image, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+    if (small.channels() == 3)
+        cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+    else if (small.channels() == 4)
+        cv::cvtColor(small, gray, cv::COLOR_BGRA2GRAY);
+    else
+        gray = small;
+
+    cv::compare(gray.colRange(1, 9), gray.colRange(0, 8), mask, cv::CMP_GT);
+
+    uint64_t hash = 0;
+    for (int row = 0; row < mask.rows; row++)
+    {
+        const uint8_t* bits = mask.ptr<uint8_t>(row);
+        for (int col = 0; col < mask.cols; col++)
+            hash = (hash << 1) | (bits[col] & 1);
+    }
+    return hash;
+}
+
+inline
+int
+hammingDistance (
+    uint64_t a,
+    uint64_t b
+)
+{
+    return std::popcount(a ^ b);
+}
+
+
+} // end namespace phash
+
+// Remembers the hashes of the last few snapshots that went out and
+// flags new ones within maxDistance bits of any of them.
+class SnapshotDeduper
+{
+public:
+    SnapshotDeduper (int maxDistance, size_t history)
+    :
+        m_maxDistance(maxDistance),
+        m_history(std::max<size_t>(history, 1))
+    { }
+
+    // true when the frame should be suppressed
+    bool
+    isDuplicate (cv::InputArray frame)
+    {
+        if (m_maxDistance < 0)
+            return false;
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t hash = phash::dHash(frame);
+        m_hashNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return isDuplicateHash(hash);
+    }
+
+    // the same for a frame already hashed with phash::dHash
+    bool
+    isDuplicateHash (uint64_t hash)
+    {
+        if (m_maxDistance < 0)
+            return false;
+
+        m_checked++;
+        auto match = std::find_if(m_recent.begin(), m_recent.end(),
+            [&](uint64_t recent) { return phash::hammingDistance(hash, recent) <= m_maxDistance; });
+        if (match != m_recent.end())
+        {
+            // keep the hash that went out, not this one, so slow drift
+            // eventually produces a fresh snapshot
+            uint64_t sent = *match;
+            m_recent.erase(match);
+            m_recent.push_front(sent);
+            m_suppressed++;
+            return true;
+        }
+
+        m_recent.push_front(hash);
+        if (m_recent.size() > m_history)
+            m_recent.pop_back();
+        return false;
+    }
+
+    size_t checked () const { return m_checked; }
+    size_t suppressed () const { return m_suppressed; }
+
+    double
+    suppressionRatio () const
+    {
+        return m_checked ? static_cast<double>(m_suppressed) / m_checked : 0.0;
+    }
+
+    double
+    averageHashMicros () const
+    {
+        return m_checked ? m_hashNs / 1000.0 / m_checked : 0.0;
+    }
+
+private:
+    const int m_maxDistance;
+    const size_t m_history;
+
+    std::deque<uint64_t> m_recent;
+    size_t m_checked = 0;
+    size_t m_suppressed = 0;
+    uint64_t m_hashNs = 0;
+};
+
+#endif // PERCEPTUAL_HASH_H
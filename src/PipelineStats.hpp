@@ -0,0 +1,146 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include "AllocationCounter.hpp"
+#include "FrameTrace.hpp"
+#include "LatencyHistogram.hpp"
+
+#include <array>
+#include <cstdio>
+#include <ostream>
+
+
+enum class Stage : size_t
+{
+    Capture,
+    Preprocess,
+    Write,
+    Read,
+    Postprocess,
+    Draw,
+    Publish,
+    Encode,
+    Notify,
+    Count
+};
+
+inline
+const char*
+stageName (
+    Stage stage
+)
+{
+    switch (stage)
+    {
+    case Stage::Capture:     return "capture";
+    case Stage::Preprocess:  return "preprocess";
+    case Stage::Write:       return "write";
+    case Stage::Read:        return "read";
+    case Stage::Postprocess: return "postprocess";
+    case Stage::Draw:        return "draw";
+    case Stage::Publish:     return "publish";
+    case Stage::Encode:      return "encode";
+    case Stage::Notify:      return "notify";
+    case Stage::Count:       break;
+    }
+    return "unknown";
+}
+
+// allocation tag of a stage; 0 is left for untagged code
+inline
+size_t
+stageTag (
+    Stage stage
+)
+{
+    return static_cast<size_t>(stage) + 1;
+}
+
+// Rolling latency histograms for every stage of the detect loop and the
+// threads hanging off it.
+class PipelineStats
+{
+public:
+    static constexpr size_t stageCount = static_cast<size_t>(Stage::Count);
+
+    RollingLatency&
+    stage (Stage stage)
+    {
+        return m_stages[static_cast<size_t>(stage)];
+    }
+
+    const RollingLatency&
+    stage (Stage stage) const
+    {
+        return m_stages[static_cast<size_t>(stage)];
+    }
+
+    // closes the current window of every stage; what report() and the
+    // metrics endpoint show
+    void
+    rotate ()
+    {
+        for (auto& stage : m_stages)
+            stage.rotate();
+    }
+
+    // prints the quantiles of the last closed window of every stage
+    void
+    report (std::ostream& out) const
+    {
+        char line[128];
+        out << "[i] stage latency (ms)      n      p50      p90      p99      max\n";
+        for (size_t i = 0; i < stageCount; i++)
+        {
+            const LatencyHistogram& window = m_stages[i].closedWindow();
+            if (window.count() == 0)
+                continue;
+
+            std::snprintf(line, sizeof(line), "[i]   %-14s %8llu %8.2f %8.2f %8.2f %8.2f\n",
+                stageName(static_cast<Stage>(i)),
+                static_cast<unsigned long long>(window.count()),
+                window.percentile(0.50) / 1e6,
+                window.percentile(0.90) / 1e6,
+                window.percentile(0.99) / 1e6,
+                window.max() / 1e6);
+            out << line;
+        }
+        out.flush();
+    }
+
+private:
+    std::array<RollingLatency, stageCount> m_stages;
+};
+
+// Records the lifetime of the enclosing scope into a stage histogram and,
+// when tracing is on, as a span of the current frame. Heap allocations
+// made in the scope are attributed to the stage.
+class ScopedStage
+{
+public:
+    ScopedStage (PipelineStats& stats, Stage stage)
+    :
+        m_latency(stats.stage(stage)),
+        m_stage(stage),
+        m_tag(stageTag(stage)),
+        m_startNs(trace::nowNs())
+    { }
+
+    ~ScopedStage ()
+    {
+        uint64_t endNs = trace::nowNs();
+        m_latency.record(endNs - m_startNs);
+        trace::record(stageName(m_stage), m_startNs, endNs);
+    }
+
+    ScopedStage (const ScopedStage&) = delete;
+    ScopedStage& operator= (const ScopedStage&) = delete;
+
+private:
+    RollingLatency& m_latency;
+    const Stage m_stage;
+    const alloc::ScopedTag m_tag;
+    const uint64_t m_startNs;
+};
+
+#endif // PIPELINE_STATS_H
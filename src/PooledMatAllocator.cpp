@@ -0,0 +1,247 @@
+#include "PooledMatAllocator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+
+namespace
+{
+
+constexpr size_t cacheLine = 64;
+constexpr size_t pageSize = 4096;
+
+// CV_AUTOSTEP: the caller passed a buffer but left the step to us
+constexpr size_t autoStep = 0x7fffffff;
+
+size_t
+alignmentFor (
+    size_t bucket
+)
+{
+    return bucket >= pageSize ? pageSize : cacheLine;
+}
+
+} // end anonymous namespace
+
+PooledMatAllocator::PooledMatAllocator (
+    size_t maxPooledBytes
+)
+:
+    m_maxPooledBytes(maxPooledBytes)
+{ }
+
+PooledMatAllocator::~PooledMatAllocator (
+    void
+)
+{
+    for (auto& [size, head] : m_buffers)
+    {
+        while (head != nullptr)
+        {
+            FreeBlock* next = head->next;
+            std::free(head);
+            head = next;
+        }
+    }
+
+    while (m_headers != nullptr)
+    {
+        FreeBlock* next = m_headers->next;
+        ::operator delete(m_headers);
+        m_headers = next;
+    }
+}
+
+PooledMatAllocator&
+PooledMatAllocator::instance (
+    void
+)
+{
+    static PooledMatAllocator* pool = new PooledMatAllocator();
+    return *pool;
+}
+
+void
+PooledMatAllocator::installAsDefault (
+    void
+)
+{
+    cv::Mat::setDefaultAllocator(&instance());
+}
+
+size_t
+PooledMatAllocator::bucketSize (
+    size_t bytes
+)
+{
+    size_t granule = bytes >= pageSize ? pageSize : cacheLine;
+    return (std::max<size_t>(bytes, 1) + granule - 1) / granule * granule;
+}
+
+// same step/size bookkeeping as OpenCV's StdMatAllocator; only where the
+// memory comes from differs
+cv::UMatData*
+PooledMatAllocator::allocate (
+    int dims,
+    const int* sizes,
+    int type,
+    void* data,
+    size_t* step,
+    cv::AccessFlag /*flags*/,
+    cv::UMatUsageFlags /*usageFlags*/
+) const
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+        {
+            if (data && step[i] != autoStep)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+            {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    cv::UMatData* u = takeHeader();
+    if (data)
+    {
+        u->data = u->origdata = static_cast<uchar*>(data);
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    else
+    {
+        u->data = u->origdata = static_cast<uchar*>(takeBuffer(bucketSize(total)));
+    }
+    u->size = total;
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    return u;
+}
+
+bool
+PooledMatAllocator::allocate (
+    cv::UMatData* data,
+    cv::AccessFlag /*accessFlags*/,
+    cv::UMatUsageFlags /*usageFlags*/
+) const
+{
+    return data != nullptr;
+}
+
+void
+PooledMatAllocator::deallocate (
+    cv::UMatData* data
+) const
+{
+    if (data == nullptr)
+        return;
+
+    CV_Assert(data->urefcount == 0);
+    CV_Assert(data->refcount == 0);
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED))
+        returnBuffer(data->origdata, bucketSize(data->size));
+    returnHeader(data);
+}
+
+MatPoolStats
+PooledMatAllocator::stats (
+    void
+) const
+{
+    MatPoolStats result;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        result.pooledBytes = m_pooledBytes;
+    }
+    result.allocations = m_allocations.load(std::memory_order_relaxed);
+    result.poolHits = m_poolHits.load(std::memory_order_relaxed);
+    result.outstandingBytes = m_outstandingBytes.load(std::memory_order_relaxed);
+    result.trimmedBytes = m_trimmedBytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+void*
+PooledMatAllocator::takeBuffer (
+    size_t size
+) const
+{
+    m_outstandingBytes.fetch_add(size, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto bucket = m_buffers.find(size);
+        if (bucket != m_buffers.end() && bucket->second != nullptr)
+        {
+            FreeBlock* block = bucket->second;
+            bucket->second = block->next;
+            m_pooledBytes -= size;
+            m_poolHits.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+    }
+
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, alignmentFor(size), size) != 0)
+    {
+        m_outstandingBytes.fetch_sub(size, std::memory_order_relaxed);
+        CV_Error(cv::Error::StsNoMem, "PooledMatAllocator: out of memory");
+    }
+    return buffer;
+}
+
+void
+PooledMatAllocator::returnBuffer (
+    void* buffer,
+    size_t size
+) const
+{
+    m_outstandingBytes.fetch_sub(size, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pooledBytes + size <= m_maxPooledBytes)
+        {
+            FreeBlock*& head = m_buffers[size];
+            head = new (buffer) FreeBlock { head };
+            m_pooledBytes += size;
+            return;
+        }
+    }
+
+    m_trimmedBytes.fetch_add(size, std::memory_order_relaxed);
+    std::free(buffer);
+}
+
+cv::UMatData*
+PooledMatAllocator::takeHeader (
+    void
+) const
+{
+    void* storage = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_headers != nullptr)
+        {
+            storage = m_headers;
+            m_headers = m_headers->next;
+        }
+    }
+    if (storage == nullptr)
+        storage = ::operator new(sizeof(cv::UMatData));
+    return new (storage) cv::UMatData(this);
+}
+
+void
+PooledMatAllocator::returnHeader (
+    cv::UMatData* header
+) const
+{
+    header->~UMatData();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_headers = new (header) FreeBlock { m_headers };
+}
@@ -0,0 +1,95 @@
+#ifndef POOLED_MAT_ALLOCATOR_H
+#define POOLED_MAT_ALLOCATOR_H
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+
+struct MatPoolStats
+{
+    uint64_t allocations;
+    uint64_t poolHits;
+    uint64_t pooledBytes;
+    uint64_t outstandingBytes;
+    uint64_t trimmedBytes;
+};
+
+// cv::MatAllocator that keeps freed pixel buffers for reuse instead of
+// handing them back to malloc. Buffers are bucketed by size, rounded up
+// to a cache line below a page and to whole pages above, and are aligned
+// the same way. The UMatData headers OpenCV needs for every allocation
+// are recycled too, so a warmed up pool allocates nothing at all.
+//
+// Mats keep their usual reference counting: the last Mat referring to a
+// buffer returns it here from whichever thread drops it, so frames can
+// be handed between threads without copies. Once more than maxPooledBytes
+// sit idle in the pool, further frees go straight back to the system.
+class PooledMatAllocator : public cv::MatAllocator
+{
+public:
+    static constexpr size_t defaultMaxPooledBytes = size_t(64) << 20;
+
+    explicit PooledMatAllocator (size_t maxPooledBytes = defaultMaxPooledBytes);
+
+    ~PooledMatAllocator () override;
+
+    PooledMatAllocator (const PooledMatAllocator&) = delete;
+    PooledMatAllocator& operator= (const PooledMatAllocator&) = delete;
+
+    // process wide pool, never destroyed so Mats may outlive main
+    static PooledMatAllocator& instance ();
+
+    // makes instance() the allocator of every Mat created without one
+    static void installAsDefault ();
+
+    cv::UMatData* allocate (
+        int dims,
+        const int* sizes,
+        int type,
+        void* data,
+        size_t* step,
+        cv::AccessFlag flags,
+        cv::UMatUsageFlags usageFlags) const override;
+
+    bool allocate (
+        cv::UMatData* data,
+        cv::AccessFlag accessFlags,
+        cv::UMatUsageFlags usageFlags) const override;
+
+    void deallocate (cv::UMatData* data) const override;
+
+    MatPoolStats stats () const;
+
+    static size_t bucketSize (size_t bytes);
+
+private:
+    // free blocks are chained through their first bytes
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    const size_t m_maxPooledBytes;
+
+    mutable std::mutex m_mutex;
+    mutable std::map<size_t, FreeBlock*> m_buffers;
+    mutable FreeBlock* m_headers = nullptr;
+    mutable size_t m_pooledBytes = 0;
+
+    mutable std::atomic<uint64_t> m_allocations{0};
+    mutable std::atomic<uint64_t> m_poolHits{0};
+    mutable std::atomic<uint64_t> m_outstandingBytes{0};
+    mutable std::atomic<uint64_t> m_trimmedBytes{0};
+
+    void* takeBuffer (size_t size) const;
+    void returnBuffer (void* buffer, size_t size) const;
+    cv::UMatData* takeHeader () const;
+    void returnHeader (cv::UMatData* header) const;
+};
+
+#endif // POOLED_MAT_ALLOCATOR_H
@@ -0,0 +1,93 @@
+#ifndef PROCESS_STATS_H
+#define PROCESS_STATS_H
+
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// Resource usage of the running process, read from getrusage, the thread
+// CPU clock and /proc/self. Linux only, like the rest of the tree.
+namespace process
+{
+
+inline
+size_t
+residentBytes (
+    void
+)
+{
+    long pages = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+    if (std::fscanf(statm, "%*s %ld", &pages) != 1)
+        pages = 0;
+    std::fclose(statm);
+    return static_cast<size_t>(pages) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+inline
+size_t
+peakResidentBytes (
+    void
+)
+{
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+inline
+size_t
+threadCount (
+    void
+)
+{
+    size_t threads = 0;
+    char line[256];
+    FILE* status = std::fopen("/proc/self/status", "r");
+    if (status == nullptr)
+        return 0;
+    while (std::fgets(line, sizeof(line), status) != nullptr)
+    {
+        if (std::strncmp(line, "Threads:", 8) == 0)
+        {
+            threads = std::strtoul(line + 8, nullptr, 10);
+            break;
+        }
+    }
+    std::fclose(status);
+    return threads;
+}
+
+inline
+double
+processCpuSeconds (
+    void
+)
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+// CPU time consumed so far by the calling thread
+inline
+double
+threadCpuSeconds (
+    void
+)
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+} // end namespace process
+
+#endif // PROCESS_STATS_H
@@ -0,0 +1,206 @@
+#include "RecordingSink.hpp"
+
+#include "DetectPipeline.hpp"
+#include "FrameTrace.hpp"
+#include "Log.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <ctime>
+#include <filesystem>
+
+
+namespace
+{
+
+// checking the file size costs a stat, so only every this many frames
+constexpr uint64_t sizeCheckInterval = 30;
+
+} // end anonymous namespace
+
+std::string
+timestampedPath (
+    const std::string& path,
+    std::chrono::system_clock::time_point time,
+    const std::string& defaultExtension
+)
+{
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    std::tm local = {};
+    localtime_r(&seconds, &local);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+
+    std::filesystem::path base(path);
+    std::string extension = base.has_extension() ? base.extension().string() : defaultExtension;
+    std::string prefix = (base.parent_path() / base.stem()).string() + "-" + stamp;
+    std::string result = prefix + extension;
+    for (int i = 1; std::filesystem::exists(result); i++)
+        result = prefix + "-" + std::to_string(i) + extension;
+    return result;
+}
+
+RecordingSink::RecordingSink (
+    RecordingConfig config
+)
+:
+    m_config(std::move(config)),
+    m_queue(m_config.queueCapacity, ring::WaitPolicy::Park),
+    m_thread(&RecordingSink::run, this)
+{ }
+
+RecordingSink::~RecordingSink (
+    void
+)
+{
+    close();
+}
+
+void
+RecordingSink::consume (
+    const SinkFrame& frame
+)
+{
+    // shares the pixels, copies only the detections
+    SinkFrame queued = frame;
+    if (!m_queue.tryPush(std::move(queued)))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t
+RecordingSink::dropped (
+    void
+) const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void
+RecordingSink::close (
+    void
+)
+{
+    m_queue.close();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+RecordingMetrics
+RecordingSink::metrics (
+    void
+) const
+{
+    return RecordingMetrics {
+        .written = m_written.load(std::memory_order_relaxed),
+        .dropped = m_dropped.load(std::memory_order_relaxed),
+        .segments = m_segments.load(std::memory_order_relaxed),
+        .totalWriteUs = m_totalWriteUs.load(std::memory_order_relaxed)
+    };
+}
+
+void
+RecordingSink::run (
+    void
+)
+{
+    trace::setThreadName("recorder");
+    placement::registerThread("recorder");
+    SinkFrame frame;
+    while (m_queue.pop(frame))
+    {
+        if (m_failed)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (!recording(frame))
+        {
+            closeSegment();
+            continue;
+        }
+
+        trace::setCurrentFrame(frame.frameId);
+        uint64_t startNs = trace::nowNs();
+
+        // other sinks share the pixels, so draw on a copy
+        frame.frame.copyTo(m_canvas);
+        frame.frame.release();
+        annotateFrame(m_canvas, frame.detections, frame.fps);
+
+        if (m_writer.isOpened() && segmentFull(frame.timestamp))
+            closeSegment();
+        if (!m_writer.isOpened() && !openSegment(frame.timestamp, m_canvas.size()))
+            continue;
+        m_writer.write(m_canvas);
+        m_segmentFrames++;
+
+        uint64_t endNs = trace::nowNs();
+        trace::record("record", startNs, endNs);
+        m_written.fetch_add(1, std::memory_order_relaxed);
+        m_totalWriteUs.fetch_add((endNs - startNs) / 1000, std::memory_order_relaxed);
+    }
+    closeSegment();
+}
+
+bool
+RecordingSink::recording (
+    const SinkFrame& frame
+)
+{
+    if (!m_config.onlyWhileDetecting)
+        return true;
+    if (!frame.detections.empty())
+        m_lastDetection = frame.timestamp;
+    return frame.timestamp - m_lastDetection <= m_config.holdAfterDetection;
+}
+
+bool
+RecordingSink::segmentFull (
+    std::chrono::system_clock::time_point now
+)
+{
+    if (m_config.maxSegmentDuration.count() > 0 && now - m_segmentStart >= m_config.maxSegmentDuration)
+        return true;
+
+    if (m_config.maxSegmentBytes > 0 && m_segmentFrames % sizeCheckInterval == 0)
+    {
+        std::error_code error;
+        uint64_t bytes = std::filesystem::file_size(m_segmentPath, error);
+        return !error && bytes >= m_config.maxSegmentBytes;
+    }
+    return false;
+}
+
+bool
+RecordingSink::openSegment (
+    std::chrono::system_clock::time_point now,
+    cv::Size size
+)
+{
+    m_segmentPath = timestampedPath(m_config.path, now, ".avi");
+    int fourcc = std::filesystem::path(m_segmentPath).extension() == ".mp4"
+        ? cv::VideoWriter::fourcc('m', 'p', '4', 'v')
+        : cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+    if (!m_writer.open(m_segmentPath, fourcc, m_config.fps, size))
+    {
+        LOG_ERROR("failed to open {}, recording stopped", m_segmentPath);
+        m_failed = true;
+        return false;
+    }
+
+    m_segmentStart = now;
+    m_segmentFrames = 0;
+    m_segments.fetch_add(1, std::memory_order_relaxed);
+    LOG_INFO("recording to {}", m_segmentPath);
+    return true;
+}
+
+void
+RecordingSink::closeSegment (
+    void
+)
+{
+    if (!m_writer.isOpened())
+        return;
+    m_writer.release();
+    LOG_INFO("closed {} after {} frames", m_segmentPath, m_segmentFrames);
+}
@@ -0,0 +1,100 @@
+#ifndef RECORDING_SINK_H
+#define RECORDING_SINK_H
+
+#include "FrameSink.hpp"
+#include "RingQueue.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+
+struct RecordingConfig
+{
+    // segments are named <stem>-<YYYYmmdd-HHMMSS><extension>; .mp4 is
+    // written as MPEG-4, anything else as MJPEG
+    std::string path;
+    double fps = 30.0;
+
+    // frames waiting for the encoder thread; beyond that new ones are dropped
+    size_t queueCapacity = 32;
+
+    // start a new segment when either is reached, 0 disables
+    uint64_t maxSegmentBytes = 0;
+    std::chrono::seconds maxSegmentDuration{0};
+
+    // record only frames with detections, plus holdAfterDetection after
+    // the last one; the segment is closed in between
+    bool onlyWhileDetecting = false;
+    std::chrono::seconds holdAfterDetection{5};
+};
+
+struct RecordingMetrics
+{
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t segments;
+    uint64_t totalWriteUs;
+};
+
+// <stem>-<YYYYmmdd-HHMMSS><extension> next to path, with -N appended if
+// that file exists; defaultExtension applies when path has none
+std::string timestampedPath (
+    const std::string& path,
+    std::chrono::system_clock::time_point time,
+    const std::string& defaultExtension);
+
+// Annotated video, written in rotating segments through cv::VideoWriter
+// on a thread of its own. consume() only queues the frame, so a slow
+// disk or encoder costs dropped frames, counted, rather than stalling
+// the sink thread or the loop.
+class RecordingSink : public FrameSink
+{
+public:
+    explicit RecordingSink (RecordingConfig config);
+
+    ~RecordingSink () override;
+
+    const char* name () const override { return "video"; }
+    bool needsPixels () const override { return true; }
+
+    void consume (const SinkFrame& frame) override;
+    uint64_t dropped () const override;
+    void close () override;
+
+    RecordingMetrics metrics () const;
+
+private:
+    const RecordingConfig m_config;
+    SpscRing<SinkFrame> m_queue;
+
+    // encoder thread only
+    cv::Mat m_canvas;
+    cv::VideoWriter m_writer;
+    std::string m_segmentPath;
+    std::chrono::system_clock::time_point m_segmentStart;
+    std::chrono::system_clock::time_point m_lastDetection;
+    uint64_t m_segmentFrames = 0;
+    bool m_failed = false;
+
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_segments{0};
+    std::atomic<uint64_t> m_totalWriteUs{0};
+
+    // last, so everything above exists before the thread starts
+    std::thread m_thread;
+
+    void run ();
+    bool recording (const SinkFrame& frame);
+    bool segmentFull (std::chrono::system_clock::time_point now);
+    bool openSegment (std::chrono::system_clock::time_point now, cv::Size size);
+    void closeSegment ();
+};
+
+#endif // RECORDING_SINK_H
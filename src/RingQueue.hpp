@@ -0,0 +1,382 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+
+// Bounded lock-free queues for handing frames between pipeline threads.
+//
+// SpscRing is for a fixed pair of threads, MpmcRing for worker pools;
+// both move elements in and out and never allocate after construction.
+// The try* calls never wait. push/pop wait according to a WaitPolicy,
+// and wake each other through an atomic wait/notify that is only
+// touched when somebody is actually asleep.
+namespace ring
+{
+
+constexpr size_t cacheLineSize = 64;
+
+enum class WaitPolicy
+{
+    Park,           // sleep right away; cheapest on CPU
+    SpinThenPark    // spin briefly first; lowest handoff latency
+};
+
+enum class FullPolicy
+{
+    Wait,           // push waits for space
+    DropOldest      // push evicts the oldest element instead (MpmcRing only)
+};
+
+inline
+void
+cpuRelax ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// Sleep/wake for one condition ("not empty", "not full"). The waker's
+// fast path is a fence and a load when nobody sleeps.
+class Parking
+{
+public:
+    template<typename Ready>
+    void
+    waitUntil (WaitPolicy policy, Ready ready)
+    {
+        // spinning on a single core only delays whoever we wait for
+        static const bool multiCore = std::thread::hardware_concurrency() > 1;
+        if (policy == WaitPolicy::SpinThenPark && multiCore)
+        {
+            for (int i = 0; i < spinLimit; i++)
+            {
+                if (ready())
+                    return;
+                cpuRelax();
+            }
+        }
+
+        // ready() may consume an element, so never call it again once it
+        // has returned true
+        while (true)
+        {
+            uint32_t epoch = m_epoch.load(std::memory_order_acquire);
+            m_sleepers.fetch_add(1, std::memory_order_relaxed);
+            // pairs with the fence in wake(): either we see the new state
+            // or the waker sees us asleep
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool done = ready();
+            if (!done)
+                m_epoch.wait(epoch, std::memory_order_acquire);
+            m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (done)
+                return;
+        }
+    }
+
+    void
+    wake ()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) > 0)
+        {
+            m_epoch.fetch_add(1, std::memory_order_release);
+            m_epoch.notify_all();
+        }
+    }
+
+private:
+    static constexpr int spinLimit = 256;
+
+    alignas(cacheLineSize) std::atomic<uint32_t> m_epoch{0};
+    std::atomic<uint32_t> m_sleepers{0};
+};
+
+// Blocking push/pop/close on top of a ring's tryPush/tryPop.
+template<typename Ring, typename T>
+class Blocking
+{
+public:
+    explicit Blocking (WaitPolicy policy) : m_policy(policy) { }
+
+    // false if the queue was closed
+    bool
+    push (T&& value)
+    {
+        Ring& self = static_cast<Ring&>(*this);
+        bool pushed = false;
+        m_notFull.waitUntil(m_policy, [&] {
+            if (closed())
+                return true;
+            pushed = self.tryPush(std::move(value));
+            return pushed;
+        });
+        return pushed;
+    }
+
+    // false once the queue is closed and drained
+    bool
+    pop (T& out)
+    {
+        Ring& self = static_cast<Ring&>(*this);
+        bool popped = false;
+        m_notEmpty.waitUntil(m_policy, [&] {
+            if (self.tryPop(out))
+                return popped = true;
+            if (!closed())
+                return false;
+            // closing happened after the last push, so look once more
+            popped = self.tryPop(out);
+            return true;
+        });
+        return popped;
+    }
+
+    // wakes everyone; pushes fail from now on, pops drain what is left
+    void
+    close ()
+    {
+        m_closed.store(true, std::memory_order_release);
+        m_notEmpty.wake();
+        m_notFull.wake();
+    }
+
+    bool closed () const { return m_closed.load(std::memory_order_acquire); }
+
+protected:
+    void pushed () { m_notEmpty.wake(); }
+    void popped () { m_notFull.wake(); }
+
+private:
+    const WaitPolicy m_policy;
+    std::atomic<bool> m_closed{false};
+    Parking m_notEmpty;
+    Parking m_notFull;
+};
+
+inline
+size_t
+roundCapacity (
+    size_t capacity
+)
+{
+    return std::bit_ceil(capacity < 2 ? size_t(2) : capacity);
+}
+
+} // end namespace ring
+
+// Single producer, single consumer. Each side caches the other's index,
+// so the shared cache lines are only read when the ring looks full or
+// empty. Capacity is rounded up to a power of two.
+template<typename T>
+class SpscRing : public ring::Blocking<SpscRing<T>, T>
+{
+public:
+    explicit
+    SpscRing (
+        size_t capacity,
+        ring::WaitPolicy policy = ring::WaitPolicy::SpinThenPark
+    )
+    :
+        ring::Blocking<SpscRing<T>, T>(policy),
+        m_mask(ring::roundCapacity(capacity) - 1),
+        m_slots(std::make_unique<T[]>(m_mask + 1))
+    { }
+
+    // producer only; leaves value untouched when full
+    bool
+    tryPush (T&& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead > m_mask)
+                return false;
+        }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        this->pushed();
+        return true;
+    }
+
+    // consumer only
+    bool
+    tryPop (T& out)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+                return false;
+        }
+        out = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        this->popped();
+        return true;
+    }
+
+    size_t capacity () const { return m_mask + 1; }
+
+    size_t
+    size () const
+    {
+        return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_relaxed);
+    }
+
+private:
+    const size_t m_mask;
+    const std::unique_ptr<T[]> m_slots;
+
+    // consumer side
+    alignas(ring::cacheLineSize) std::atomic<size_t> m_head{0};
+    size_t m_cachedTail = 0;
+
+    // producer side
+    alignas(ring::cacheLineSize) std::atomic<size_t> m_tail{0};
+    size_t m_cachedHead = 0;
+};
+
+// Multi producer, multi consumer, after Dmitry Vyukov's bounded queue:
+// every cell carries a sequence number telling producers and consumers
+// whose turn it is, so each side claims a cell with one CAS on its own
+// index. With FullPolicy::DropOldest a producer facing a full ring pops
+// the oldest element itself and counts it as dropped.
+template<typename T>
+class MpmcRing : public ring::Blocking<MpmcRing<T>, T>
+{
+public:
+    explicit
+    MpmcRing (
+        size_t capacity,
+        ring::WaitPolicy policy = ring::WaitPolicy::SpinThenPark,
+        ring::FullPolicy full = ring::FullPolicy::Wait
+    )
+    :
+        ring::Blocking<MpmcRing<T>, T>(policy),
+        m_full(full),
+        m_mask(ring::roundCapacity(capacity) - 1),
+        m_cells(std::make_unique<Cell[]>(m_mask + 1))
+    {
+        for (size_t i = 0; i <= m_mask; i++)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // leaves value untouched when full, unless dropping the oldest
+    bool
+    tryPush (T&& value)
+    {
+        while (!tryPushOnce(value))
+        {
+            if (m_full != ring::FullPolicy::DropOldest)
+                return false;
+
+            T evicted;
+            if (tryPop(evicted))
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool
+    tryPop (T& out)
+    {
+        size_t pos = m_dequeue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+
+        out = std::move(cell->value);
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        this->popped();
+        return true;
+    }
+
+    size_t capacity () const { return m_mask + 1; }
+
+    size_t
+    size () const
+    {
+        size_t tail = m_enqueue.load(std::memory_order_relaxed);
+        size_t head = m_dequeue.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    uint64_t dropped () const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(ring::cacheLineSize) Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const ring::FullPolicy m_full;
+    const size_t m_mask;
+    const std::unique_ptr<Cell[]> m_cells;
+
+    alignas(ring::cacheLineSize) std::atomic<size_t> m_enqueue{0};
+    alignas(ring::cacheLineSize) std::atomic<size_t> m_dequeue{0};
+    alignas(ring::cacheLineSize) std::atomic<uint64_t> m_dropped{0};
+
+    bool
+    tryPushOnce (T& value)
+    {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        this->pushed();
+        return true;
+    }
+};
+
+#endif // RING_QUEUE_H
@@ -0,0 +1,148 @@
+#ifndef SIMULATED_DEVICE_H
+#define SIMULATED_DEVICE_H
+
+#include "CocoClass.hpp"
+
+#include <hailo/hailort.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace simulated
+{
+
+// NMS-by-class output as postProcess reads it: per class a count followed
+// by that many 5 float boxes, detections spread round robin over classes
+inline
+std::vector<float32_t>
+nmsOutput (
+    size_t detections
+)
+{
+    const size_t classes = CocoClass::numClasses;
+    std::vector<size_t> perClass(classes, 0);
+    for (size_t i = 0; i < detections; i++)
+        perClass[1 + i % (classes - 1)]++;
+
+    std::vector<float32_t> output(classes * (1 + CocoClass::boxesPerClass * 5), 0.0f);
+    size_t offset = 0;
+    for (size_t cls = 1; cls < classes; cls++)
+    {
+        output[offset++] = static_cast<float32_t>(perClass[cls]);
+        for (size_t det = 0; det < perClass[cls]; det++)
+        {
+            float base = 0.01f * static_cast<float>((cls + det) % 50);
+            output[offset++] = base;            // y_min
+            output[offset++] = base;            // x_min
+            output[offset++] = base + 0.3f;     // y_max
+            output[offset++] = base + 0.2f;     // x_max
+            output[offset++] = 0.5f + base;     // score
+        }
+    }
+    return output;
+}
+
+// smooth noise with a few boxes drawn on it, so JPEG sizes and resize
+// costs look like a camera frame rather than white noise
+inline
+cv::Mat
+frame (
+    int width,
+    int height,
+    uint64_t seed = 1234
+)
+{
+    cv::Mat frame(height, width, CV_8UC3);
+    cv::RNG rng(seed);
+    rng.fill(frame, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(frame, frame, cv::Size(15, 15), 0);
+    for (int i = 0; i < 8; i++)
+    {
+        cv::Point p1(40 + i * 90, 60 + (i % 3) * 120);
+        cv::rectangle(frame, p1, p1 + cv::Point(80, 140), cv::Scalar(30 * i, 200 - 20 * i, 90), cv::FILLED);
+    }
+    return frame;
+}
+
+} // end namespace simulated
+
+// Stand-in for Hailo8Device with the same write/read shape. The device is
+// a single server: every write reserves the next serviceTime slot after
+// whatever is already queued on it, and the matching read on the same
+// thread blocks until that slot has passed, then returns canned output.
+// Several threads may share one instance, each with its own write/read
+// pairs in flight.
+class SimulatedDevice
+{
+public:
+    SimulatedDevice (
+        std::chrono::microseconds serviceTime,
+        size_t detectionsPerFrame
+    )
+    :
+        m_serviceTime(serviceTime),
+        m_output(simulated::nmsOutput(detectionsPerFrame))
+    { }
+
+    hailo_status
+    write (
+        const cv::Mat& frame,
+        size_t size
+    )
+    {
+        if (frame.empty() || frame.total() * frame.elemSize() < size)
+            return HAILO_INVALID_ARGUMENT;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto start = std::max(Clock::now(), m_busyUntil);
+        m_busyUntil = start + m_serviceTime;
+        pendingReady() = m_busyUntil;
+        return HAILO_SUCCESS;
+    }
+
+    template<typename T>
+    hailo_status
+    read (
+        std::vector<T>& out
+    )
+    {
+        Clock::time_point ready = pendingReady();
+        if (ready == Clock::time_point())
+            return HAILO_INVALID_OPERATION;
+        pendingReady() = Clock::time_point();
+
+        std::this_thread::sleep_until(ready);
+        size_t bytes = std::min(out.size() * sizeof(T), m_output.size() * sizeof(float32_t));
+        std::memcpy(out.data(), m_output.data(), bytes);
+        return HAILO_SUCCESS;
+    }
+
+    // in bytes, like the vstream frame size of the real device
+    size_t getOutVStreamFrameSize () const { return m_output.size() * sizeof(float32_t); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    const std::chrono::microseconds m_serviceTime;
+    const std::vector<float32_t> m_output;
+    std::mutex m_mutex;
+    Clock::time_point m_busyUntil;
+
+    // completion time of the calling thread's outstanding write
+    static
+    Clock::time_point&
+    pendingReady ()
+    {
+        thread_local Clock::time_point ready;
+        return ready;
+    }
+};
+
+#endif // SIMULATED_DEVICE_H
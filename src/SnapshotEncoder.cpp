@@ -0,0 +1,212 @@
+#include "SnapshotEncoder.hpp"
+
+#include "DetectPipeline.hpp"
+#include "FrameTrace.hpp"
+#include "Log.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+
+std::optional<JpegSettings>
+JpegSettings::fromPreset (
+    const std::string& name
+)
+{
+    if (name == "quality")
+        return fromPreset(JpegPreset::Quality);
+    if (name == "baseline")
+        return fromPreset(JpegPreset::Baseline);
+    if (name == "fast")
+        return fromPreset(JpegPreset::Fast);
+    return std::nullopt;
+}
+
+JpegSettings
+JpegSettings::fromPreset (
+    JpegPreset preset
+)
+{
+    JpegSettings settings;
+    settings.preset = preset;
+    switch (preset)
+    {
+    case JpegPreset::Quality:
+        settings.quality = 95;
+        settings.scale = 1.0;
+        settings.flags = {
+            cv::IMWRITE_JPEG_QUALITY, settings.quality,
+            cv::IMWRITE_JPEG_PROGRESSIVE, 1,
+            cv::IMWRITE_JPEG_OPTIMIZE, 1
+        };
+        break;
+    case JpegPreset::Baseline:
+        settings.quality = 90;
+        settings.scale = 1.0;
+        settings.flags = { cv::IMWRITE_JPEG_QUALITY, settings.quality };
+        break;
+    case JpegPreset::Fast:
+        settings.quality = 75;
+        settings.scale = 0.5;
+        settings.flags = { cv::IMWRITE_JPEG_QUALITY, settings.quality };
+        break;
+    }
+    return settings;
+}
+
+bool
+SnapshotEncoder::encode (
+    const cv::Mat& frame,
+    const JpegSettings& settings,
+    cv::Mat& scratch,
+    std::vector<uint8_t>& out
+)
+{
+    if (frame.empty())
+        return false;
+
+    const cv::Mat* source = &frame;
+    if (settings.scale > 0.0 && settings.scale < 1.0)
+    {
+        cv::resize(frame, scratch, cv::Size(), settings.scale, settings.scale, cv::INTER_AREA);
+        source = &scratch;
+    }
+    return cv::imencode(".jpg", *source, out, settings.flags);
+}
+
+SnapshotEncoder::SnapshotEncoder (
+    const JpegSettings& settings,
+    size_t queueCapacity,
+    RollingLatency* encodeLatency,
+    SnapshotDeduper* deduper
+)
+:
+    m_settings(settings),
+    m_queueCapacity(std::max<size_t>(queueCapacity, 1)),
+    m_pool(BufferPool::create(queueCapacity + 2)),
+    m_encodeLatency(encodeLatency),
+    m_deduper(deduper),
+    m_thread(&SnapshotEncoder::run, this)
+{ }
+
+SnapshotEncoder::~SnapshotEncoder (
+    void
+)
+{
+    shutdown();
+}
+
+void
+SnapshotEncoder::submit (
+    cv::Mat frame,
+    std::vector<utils::Detection> detections,
+    double fps,
+    Completion done
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping)
+            return;
+
+        if (m_queue.size() >= m_queueCapacity)
+        {
+            m_queue.pop_front();
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_queue.push_back({std::move(frame), std::move(detections), fps, std::move(done), trace::currentFrame()});
+    }
+    m_cv.notify_one();
+}
+
+void
+SnapshotEncoder::shutdown (
+    void
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_one();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+EncoderMetrics
+SnapshotEncoder::metrics (
+    void
+) const
+{
+    return EncoderMetrics {
+        .encoded = m_encoded.load(std::memory_order_relaxed),
+        .failed = m_failed.load(std::memory_order_relaxed),
+        .dropped = m_dropped.load(std::memory_order_relaxed),
+        .totalEncodeUs = m_totalEncodeUs.load(std::memory_order_relaxed),
+        .totalBytes = m_totalBytes.load(std::memory_order_relaxed)
+    };
+}
+
+void
+SnapshotEncoder::run (
+    void
+)
+{
+    trace::setThreadName("encoder");
+    placement::registerThread("encoder");
+    // the annotated copy; reused, since snapshots share the capture size
+    cv::Mat canvas;
+    cv::Mat scratch;
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty())
+                return;
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        trace::setCurrentFrame(job.frameId);
+        if (m_deduper && m_deduper->isDuplicate(job.frame))
+        {
+            LOG_INFO("snapshot suppressed, too similar to a recent one");
+            continue;
+        }
+
+        uint64_t drawNs = trace::nowNs();
+        job.frame.copyTo(canvas);
+        annotateFrame(canvas, job.detections, job.fps);
+        // the capture buffer can go back to its pool now
+        job.frame.release();
+        trace::record("annotate", drawNs, trace::nowNs());
+
+        auto jpg = m_pool->acquire();
+        uint64_t startNs = trace::nowNs();
+        bool ok = encode(canvas, m_settings, scratch, *jpg);
+        uint64_t endNs = trace::nowNs();
+        trace::record("encode", startNs, endNs);
+        if (!ok)
+        {
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+            LOG_ERROR("snapshot encode failed");
+            continue;
+        }
+
+        if (m_encodeLatency)
+            m_encodeLatency->record(endNs - startNs);
+
+        m_encoded.fetch_add(1, std::memory_order_relaxed);
+        m_totalBytes.fetch_add(jpg->size(), std::memory_order_relaxed);
+        m_totalEncodeUs.fetch_add((endNs - startNs) / 1000, std::memory_order_relaxed);
+
+        if (job.done)
+            job.done(std::move(jpg));
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef SNAPSHOT_ENCODER_H
+#define SNAPSHOT_ENCODER_H
+
+#include <hailo/hailort.h>
+#include <opencv2/core.hpp>
+
+#include "BufferPool.hpp"
+#include "LatencyHistogram.hpp"
+#include "PerceptualHash.hpp"
+#include "Utils.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+enum class JpegPreset
+{
+    Quality,    // progressive + optimized huffman tables, smallest and slowest
+    Baseline,   // plain baseline JPEG
+    Fast        // baseline at lower quality on a half size frame
+};
+
+struct JpegSettings
+{
+    JpegPreset preset;
+    int quality;
+    double scale;
+    std::vector<int> flags;
+
+    static std::optional<JpegSettings> fromPreset (const std::string& name);
+    static JpegSettings fromPreset (JpegPreset preset);
+};
+
+struct EncoderMetrics
+{
+    uint64_t encoded;
+    uint64_t failed;
+    uint64_t dropped;
+    uint64_t totalEncodeUs;
+    uint64_t totalBytes;
+};
+
+// Dedupes, annotates and encodes snapshots to JPEG on its own thread, so
+// the inference loop only pays for handing over a cv::Mat reference and
+// the detections. Output buffers come from a pool and go back to it once
+// every consumer of the JPEG is done.
+class SnapshotEncoder
+{
+public:
+    using Jpeg = std::shared_ptr<const std::vector<uint8_t>>;
+    using Completion = std::function<void (Jpeg)>;
+
+    // deduper, if any, is used on the encoder thread only from then on
+    SnapshotEncoder (
+        const JpegSettings& settings,
+        size_t queueCapacity,
+        RollingLatency* encodeLatency = nullptr,
+        SnapshotDeduper* deduper = nullptr);
+
+    ~SnapshotEncoder ();
+
+    SnapshotEncoder (const SnapshotEncoder&) = delete;
+    SnapshotEncoder& operator= (const SnapshotEncoder&) = delete;
+
+    // frame is the raw capture and only read, so it is shared rather than
+    // copied; it must not be written to afterwards. The encoder thread
+    // drops it if the deduper finds it too similar to a recent snapshot,
+    // otherwise draws the detections on a copy of its own and encodes
+    // that. The completion runs on the encoder thread and is skipped for
+    // duplicates and failed encodes.
+    void submit (
+        cv::Mat frame,
+        std::vector<utils::Detection> detections,
+        double fps,
+        Completion done);
+
+    // finish queued snapshots and stop the thread
+    void shutdown ();
+
+    EncoderMetrics metrics () const;
+
+    // synchronous encode into out, shared with the encoder thread's path
+    static bool encode (const cv::Mat& frame, const JpegSettings& settings, cv::Mat& scratch, std::vector<uint8_t>& out);
+
+private:
+    struct Job
+    {
+        cv::Mat frame;
+        std::vector<utils::Detection> detections;
+        double fps;
+        Completion done;
+        uint64_t frameId;
+    };
+
+    const JpegSettings m_settings;
+    const size_t m_queueCapacity;
+    std::shared_ptr<BufferPool> m_pool;
+    RollingLatency* const m_encodeLatency;
+    SnapshotDeduper* const m_deduper;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_queue;
+    bool m_stopping = false;
+
+    std::atomic<uint64_t> m_encoded{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_totalEncodeUs{0};
+    std::atomic<uint64_t> m_totalBytes{0};
+
+    // last, so everything above exists before the thread starts
+    std::thread m_thread;
+
+    void run ();
+};
+
+#endif // SNAPSHOT_ENCODER_H
@@ -0,0 +1,98 @@
+#ifndef SNAPSHOT_STORE_H
+#define SNAPSHOT_STORE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+
+struct Snapshot
+{
+    std::shared_ptr<const std::vector<uint8_t>> jpg;
+    float score;
+    std::chrono::system_clock::time_point timestamp;
+    std::vector<int> classIds;
+};
+
+// Keeps the best already-encoded snapshots of a digest window, bounded
+// both by count and by total JPEG bytes. When over budget the lowest
+// scoring snapshot is evicted, which may be the one just offered.
+// Not thread safe.
+class SnapshotStore
+{
+public:
+    SnapshotStore (size_t maxSnapshots, size_t maxBytes)
+    :
+        m_maxSnapshots(std::max<size_t>(maxSnapshots, 1)),
+        m_maxBytes(maxBytes)
+    { }
+
+    void
+    offer (Snapshot&& snapshot)
+    {
+        m_offered++;
+        for (int classId : snapshot.classIds)
+            m_classCounts[classId]++;
+
+        if (!snapshot.jpg || snapshot.jpg->size() > m_maxBytes)
+        {
+            m_evicted++;
+            return;
+        }
+
+        m_bytes += snapshot.jpg->size();
+        m_snapshots.push_back(std::move(snapshot));
+        while (m_snapshots.size() > m_maxSnapshots || m_bytes > m_maxBytes)
+        {
+            auto lowest = std::min_element(m_snapshots.begin(), m_snapshots.end(),
+                [](const Snapshot& a, const Snapshot& b) { return a.score < b.score; });
+            m_bytes -= lowest->jpg->size();
+            m_snapshots.erase(lowest);
+            m_evicted++;
+        }
+        // what the store holds between offers, always within the budget
+        m_peakBytes = std::max(m_peakBytes, m_bytes);
+    }
+
+    // best snapshot first; leaves the store empty for the next window
+    std::vector<Snapshot>
+    take ()
+    {
+        std::vector<Snapshot> result = std::move(m_snapshots);
+        std::sort(result.begin(), result.end(),
+            [](const Snapshot& a, const Snapshot& b) { return a.score > b.score; });
+        m_snapshots.clear();
+        m_classCounts.clear();
+        m_bytes = 0;
+        m_offered = 0;
+        m_evicted = 0;
+        return result;
+    }
+
+    bool empty () const { return m_offered == 0; }
+    size_t size () const { return m_snapshots.size(); }
+    size_t bytes () const { return m_bytes; }
+    size_t peakBytes () const { return m_peakBytes; }
+    size_t offered () const { return m_offered; }
+    size_t evicted () const { return m_evicted; }
+
+    // detections per class across every snapshot offered this window,
+    // including evicted ones
+    const std::map<int, size_t>& classCounts () const { return m_classCounts; }
+
+private:
+    const size_t m_maxSnapshots;
+    const size_t m_maxBytes;
+
+    std::vector<Snapshot> m_snapshots;
+    std::map<int, size_t> m_classCounts;
+    size_t m_bytes = 0;
+    size_t m_peakBytes = 0;
+    size_t m_offered = 0;
+    size_t m_evicted = 0;
+};
+
+#endif // SNAPSHOT_STORE_H
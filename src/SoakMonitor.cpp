@@ -0,0 +1,140 @@
+#include "SoakMonitor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+
+
+namespace
+{
+
+constexpr size_t minTrendSamples = 3;
+
+// least squares slope of value over time, in value units per hour
+double
+slopePerHour (
+    const std::vector<SoakSample>& samples,
+    const std::function<double (const SoakSample&)>& value
+)
+{
+    double n = static_cast<double>(samples.size());
+    double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+    for (const auto& sample : samples)
+    {
+        double x = sample.elapsedSeconds / 3600.0;
+        double y = value(sample);
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+
+    double denominator = n * sumXX - sumX * sumX;
+    if (denominator <= 0.0)
+        return 0.0;
+    return (n * sumXY - sumX * sumY) / denominator;
+}
+
+double
+mean (
+    const std::vector<SoakSample>& samples,
+    const std::function<double (const SoakSample&)>& value
+)
+{
+    double sum = 0.0;
+    for (const auto& sample : samples)
+        sum += value(sample);
+    return samples.empty() ? 0.0 : sum / static_cast<double>(samples.size());
+}
+
+bool
+verdict (
+    std::ostream& out,
+    const char* metric,
+    double growth,
+    double limit,
+    const char* unit
+)
+{
+    bool ok = growth <= limit;
+    char line[128];
+    std::snprintf(line, sizeof(line), "[%c]   %-20s %+10.2f %s (limit %.2f)\n",
+        ok ? 'i' : 'e', metric, growth, unit, limit);
+    out << line;
+    return ok;
+}
+
+} // end anonymous namespace
+
+SoakMonitor::SoakMonitor (
+    const SoakLimits& limits
+)
+:
+    m_limits(limits)
+{ }
+
+void
+SoakMonitor::add (
+    const SoakSample& sample,
+    std::ostream& out
+)
+{
+    if (m_samples.empty())
+        out << "[i] soak       min     frames   rss MB  heap MB  threads  alloc/frame  p99 ms\n";
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "[i] soak %9.1f %10llu %8.1f %8.1f %8zu %12.2f %7.2f%s\n",
+        sample.elapsedSeconds / 60.0,
+        static_cast<unsigned long long>(sample.frames),
+        sample.rssBytes / (1024.0 * 1024.0),
+        sample.liveHeapBytes / (1024.0 * 1024.0),
+        sample.threads,
+        sample.allocationsPerFrame,
+        sample.p99Ns / 1e6,
+        m_samples.size() < m_limits.warmupSamples ? "  (warmup)" : "");
+    out << line;
+    out.flush();
+
+    m_samples.push_back(sample);
+}
+
+bool
+SoakMonitor::check (
+    std::ostream& out
+) const
+{
+    if (m_samples.size() < m_limits.warmupSamples + minTrendSamples)
+    {
+        out << "[e] soak: " << m_samples.size() << " samples, need at least "
+            << m_limits.warmupSamples + minTrendSamples
+            << " to judge a trend; run longer or sample more often\n";
+        return false;
+    }
+
+    std::vector<SoakSample> steady(m_samples.begin() + m_limits.warmupSamples, m_samples.end());
+
+    auto rssMB = [](const SoakSample& s) { return s.rssBytes / (1024.0 * 1024.0); };
+    auto heapMB = [](const SoakSample& s) { return s.liveHeapBytes / (1024.0 * 1024.0); };
+    auto allocations = [](const SoakSample& s) { return s.allocationsPerFrame; };
+    auto p99Ms = [](const SoakSample& s) { return s.p99Ns / 1e6; };
+
+    // relative metrics are judged against their steady state mean; floor
+    // keeps a flat zero (no allocations per frame) from dividing by zero
+    auto percentPerHour = [&](const std::function<double (const SoakSample&)>& value, double floor) {
+        return 100.0 * slopePerHour(steady, value) / std::max(mean(steady, value), floor);
+    };
+
+    // thread counts are small integers, a slope says little about them
+    double threadGrowth = static_cast<double>(steady.back().threads)
+        - static_cast<double>(steady.front().threads);
+
+    out << "[i] soak trend after " << m_limits.warmupSamples << " warmup samples:\n";
+    bool ok = true;
+    ok &= verdict(out, "rss", slopePerHour(steady, rssMB), m_limits.maxRssGrowthMBPerHour, "MB/h");
+    ok &= verdict(out, "live heap", slopePerHour(steady, heapMB), m_limits.maxHeapGrowthMBPerHour, "MB/h");
+    ok &= verdict(out, "allocations/frame", percentPerHour(allocations, 1.0), m_limits.maxAllocationGrowthPercentPerHour, "%/h");
+    ok &= verdict(out, "p99 latency", percentPerHour(p99Ms, 0.001), m_limits.maxLatencyGrowthPercentPerHour, "%/h");
+    ok &= verdict(out, "threads", threadGrowth, static_cast<double>(m_limits.maxThreadGrowth), "threads");
+    out << (ok ? "[i] soak passed\n" : "[e] soak failed\n");
+    return ok;
+}
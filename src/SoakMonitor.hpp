@@ -0,0 +1,53 @@
+#ifndef SOAK_MONITOR_H
+#define SOAK_MONITOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+
+// One periodic reading of the process during a soak run.
+struct SoakSample
+{
+    double elapsedSeconds;
+    uint64_t frames;
+    size_t rssBytes;
+    uint64_t liveHeapBytes;
+    size_t threads;
+    double allocationsPerFrame;
+    uint64_t p99Ns;
+};
+
+// Growth allowed over the run. Rates are per hour of wall time and are
+// judged on the least squares slope of the samples after warmup, so a
+// single noisy sample cannot fail a run on its own.
+struct SoakLimits
+{
+    double maxRssGrowthMBPerHour = 8.0;
+    double maxHeapGrowthMBPerHour = 4.0;
+    double maxAllocationGrowthPercentPerHour = 10.0;
+    double maxLatencyGrowthPercentPerHour = 25.0;
+    size_t maxThreadGrowth = 0;
+
+    // samples ignored while caches, pools and the allocator settle
+    size_t warmupSamples = 2;
+};
+
+class SoakMonitor
+{
+public:
+    explicit SoakMonitor (const SoakLimits& limits);
+
+    // records the sample and prints it as one line
+    void add (const SoakSample& sample, std::ostream& out);
+
+    // prints the trend of every metric; false if any grew past its limit
+    bool check (std::ostream& out) const;
+
+private:
+    const SoakLimits m_limits;
+    std::vector<SoakSample> m_samples;
+};
+
+#endif // SOAK_MONITOR_H
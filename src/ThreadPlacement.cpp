@@ -0,0 +1,307 @@
+#include "ThreadPlacement.hpp"
+
+#include "Log.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+
+namespace placement
+{
+
+
+namespace
+{
+
+std::mutex planMutex;
+Plan currentPlan;
+
+// the "default" entry, completed with the placement the configuring
+// thread had before it; what every role falls back on
+Placement basePlacement;
+
+bool
+parseInt (
+    std::string_view text,
+    int& value
+)
+{
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+// calls entry(role, value) for every "role=value" in a space separated list
+template<typename Entry>
+bool
+forEachEntry (
+    const std::string& list,
+    std::string& error,
+    Entry entry
+)
+{
+    std::istringstream in(list);
+    std::string item;
+    while (in >> item)
+    {
+        size_t equals = item.find('=');
+        if (equals == 0 || equals == std::string::npos || !entry(item.substr(0, equals), item.substr(equals + 1)))
+        {
+            error = item;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string
+formatCpuList (
+    const cpu_set_t& set
+)
+{
+    std::string out;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set))
+            last++;
+        if (!out.empty())
+            out += ",";
+        out += std::to_string(cpu);
+        if (last > cpu)
+            out += "-" + std::to_string(last);
+        cpu = last;
+    }
+    return out.empty() ? "none" : out;
+}
+
+// the calling thread's placement as it is now, as an entry
+Placement
+currentPlacement (
+    void
+)
+{
+    Placement result;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &set))
+                result.cpus.push_back(cpu);
+        }
+    }
+
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, static_cast<id_t>(gettid()));
+    if (errno == 0)
+        result.nice = nice;
+    return result;
+}
+
+// entry with what it leaves out taken from fallback; fifo is never
+// inherited
+Placement
+completed (
+    const Placement& entry,
+    const Placement& fallback
+)
+{
+    Placement result = entry;
+    if (result.cpus.empty())
+        result.cpus = fallback.cpus;
+    if (!result.nice)
+        result.nice = fallback.nice;
+    return result;
+}
+
+void
+applyPlacement (
+    const std::string& role,
+    const Placement& placement
+)
+{
+    if (!placement.cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : placement.cpus)
+            CPU_SET(cpu, &set);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error != 0)
+            LOG_ERROR("pinning {} failed: {}", role, std::strerror(error));
+    }
+
+    // a thread spawned by a SCHED_FIFO one starts out SCHED_FIFO too, so
+    // an entry without fifo puts it back; leaving SCHED_FIFO needs no
+    // privileges
+    int policy;
+    sched_param current = {};
+    if (pthread_getschedparam(pthread_self(), &policy, &current) == 0
+        && (placement.fifoPriority > 0 || policy != SCHED_OTHER))
+    {
+        sched_param param = {};
+        param.sched_priority = placement.fifoPriority;
+        int error = pthread_setschedparam(pthread_self(), placement.fifoPriority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+        if (error != 0)
+        {
+            LOG_ERROR("{} for {} failed: {}", placement.fifoPriority > 0 ? "SCHED_FIFO" : "SCHED_OTHER",
+                role, std::strerror(error));
+        }
+    }
+
+    // on Linux nice is per thread when given a thread id
+    if (placement.nice)
+    {
+        errno = 0;
+        int nice = getpriority(PRIO_PROCESS, static_cast<id_t>(gettid()));
+        if ((errno != 0 || nice != *placement.nice)
+            && setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), *placement.nice) != 0)
+        {
+            LOG_ERROR("nice for {} failed: {}", role, std::strerror(errno));
+        }
+    }
+
+    LOG_INFO("thread {}: {}", role, describeCurrentThread());
+}
+
+} // end anonymous namespace
+
+bool
+parseCpuList (
+    const std::string& text,
+    std::vector<int>& cpus
+)
+{
+    cpus.clear();
+    std::istringstream in(text);
+    std::string range;
+    while (std::getline(in, range, ','))
+    {
+        size_t dash = range.find('-');
+        int first, last;
+        if (dash == std::string::npos)
+        {
+            if (!parseInt(range, first))
+                return false;
+            last = first;
+        }
+        else if (!parseInt(std::string_view(range).substr(0, dash), first)
+            || !parseInt(std::string_view(range).substr(dash + 1), last))
+        {
+            return false;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return !cpus.empty();
+}
+
+bool
+parse (
+    const std::string& pin,
+    const std::string& priority,
+    Plan& plan,
+    std::string& error
+)
+{
+    bool ok = forEachEntry(pin, error, [&](const std::string& role, const std::string& value) {
+        return parseCpuList(value, plan[role].cpus);
+    });
+
+    return ok && forEachEntry(priority, error, [&](const std::string& role, const std::string& value) {
+        int number;
+        size_t colon = value.find(':');
+        if (colon == std::string::npos || !parseInt(std::string_view(value).substr(colon + 1), number))
+            return false;
+
+        std::string kind = value.substr(0, colon);
+        if (kind == "fifo" && number >= 1 && number <= 99)
+            plan[role].fifoPriority = number;
+        else if (kind == "nice" && number >= -20 && number <= 19)
+            plan[role].nice = number;
+        else
+            return false;
+        return true;
+    });
+}
+
+void
+configure (
+    Plan plan
+)
+{
+    std::lock_guard<std::mutex> lock(planMutex);
+    currentPlan = std::move(plan);
+    registeredThreadHook.store(&applyToCurrentThread, std::memory_order_release);
+    auto entry = currentPlan.find("default");
+    basePlacement = completed(entry != currentPlan.end() ? entry->second : Placement(), currentPlacement());
+    if (entry != currentPlan.end())
+        applyPlacement(entry->first, basePlacement);
+}
+
+void
+applyToCurrentThread (
+    const char* role
+)
+{
+    std::lock_guard<std::mutex> lock(planMutex);
+    if (currentPlan.empty())
+        return;
+
+    auto entry = currentPlan.find(role);
+    if (entry != currentPlan.end())
+        applyPlacement(entry->first, completed(entry->second, basePlacement));
+    else
+        applyPlacement(role, basePlacement);
+}
+
+std::string
+describeCurrentThread (
+    void
+)
+{
+    std::ostringstream out;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+        out << "cpus " << formatCpuList(set);
+    else
+        out << "cpus unknown";
+
+    int policy;
+    sched_param param = {};
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0)
+    {
+        if (policy == SCHED_FIFO)
+            out << ", SCHED_FIFO " << param.sched_priority;
+        else if (policy == SCHED_RR)
+            out << ", SCHED_RR " << param.sched_priority;
+        else
+            out << ", SCHED_OTHER";
+    }
+
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, static_cast<id_t>(gettid()));
+    if (errno == 0)
+        out << ", nice " << nice;
+
+    return out.str();
+}
+
+
+} // end namespace placement
@@ -0,0 +1,86 @@
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// Per-role core pinning and scheduling for the pipeline's threads.
+//
+// A plan maps thread roles, the names threads pass to registerThread
+// ("detect", "encoder", "notifier", "http", ...), to the cores they may
+// run on and optionally SCHED_FIFO or a nice value. Threads pick up
+// their entry when they register. The "default" role is applied to the
+// configuring thread right away, so threads created after that which
+// never register, HailoRT's and OpenCV's among them, inherit it. A
+// thread registering under a role the plan leaves out gets the
+// "default" entry too, rather than whatever it inherited from
+// the thread that spawned it. What an entry leaves out, cores or nice,
+// comes from "default", and failing that from how the process started;
+// an entry without fifo runs under SCHED_OTHER.
+//
+// Linux only. SCHED_FIFO and negative nice values need CAP_SYS_NICE or an
+// rtprio limit; when the kernel refuses, the thread keeps running with
+// what it had and the failure is reported.
+namespace placement
+{
+
+struct Placement
+{
+    // empty leaves the affinity alone
+    std::vector<int> cpus;
+
+    // SCHED_FIFO priority 1-99, 0 keeps the normal time-sharing policy
+    int fifoPriority = 0;
+
+    std::optional<int> nice;
+};
+
+using Plan = std::map<std::string, Placement>;
+
+// "0,2-3" style, as taskset and /sys print them
+bool parseCpuList (const std::string& text, std::vector<int>& cpus);
+
+// pin: space separated role=cpus, e.g. "detect=3 encoder=1-2 default=0-2"
+// priority: space separated role=fifo:N or role=nice:N, e.g. "detect=fifo:20 encoder=nice:10"
+// on failure returns false and describes the offending entry in error
+bool parse (const std::string& pin, const std::string& priority, Plan& plan, std::string& error);
+
+// installs the plan and applies its "default" entry to the calling thread
+void configure (Plan plan);
+
+// applies role's entry, or "default" if the plan has none for role, and
+// reports the result; does nothing while the plan is empty
+void applyToCurrentThread (const char* role);
+
+// set by configure(), so code that only starts threads does not have to
+// link the placement code
+inline std::atomic<void (*)(const char*)> registeredThreadHook{nullptr};
+
+// called first thing by each of the pipeline's threads: attributes the
+// thread's allocations to role and, once a plan is configured, applies
+// its placement. role must be a string literal or otherwise outlive the
+// process
+inline
+void
+registerThread (
+    const char* role
+)
+{
+    alloc::nameThread(role);
+    if (auto apply = registeredThreadHook.load(std::memory_order_acquire))
+        apply(role);
+}
+
+// effective affinity, policy and nice value of the calling thread,
+// e.g. "cpus 2-3, SCHED_FIFO 20, nice 0"
+std::string describeCurrentThread ();
+
+} // end namespace placement
+
+#endif // THREAD_PLACEMENT_H
@@ -6,14 +6,11 @@
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
-#include <opencv2/videoio.hpp>
 
 #include <iostream>
 #include <vector>
 
 
-constexpr char DEVICE_AUTO[] = "auto";
-
 namespace utils
 {
 
@@ -55,31 +52,11 @@ softmax (
     return result;   
 }
 
-cv::VideoCapture
-getVideoCapture (
-    const cv::String& deviceAddress,
-    const size_t width,
-    const size_t height
-)
-{
-    cv::VideoCapture cap;
-    if (deviceAddress == DEVICE_AUTO)
-        cap.open(0);
-    else
-        cap.open(deviceAddress);
-    
-    if (!cap.isOpened())
-        throw std::runtime_error("failed to initialize capture device");
-
-    cap.set(cv::CAP_PROP_FRAME_WIDTH, width);
-    cap.set(cv::CAP_PROP_FRAME_HEIGHT, height);
-    return cap;
-}
-
+inline
 void
-showFrame (
+drawFpsLabel (
     cv::InputOutputArray& frame,
-    cv::String& fpsString
+    const cv::String& fpsString
 )
 {
     cv::Scalar fontColor(255, 255, 255);
@@ -90,9 +67,20 @@ showFrame (
     cv::Point p2(stringSize.width, stringSize.height * 1.1);
     cv::rectangle(frame, p1, p2, bgColor, cv::FILLED);
     cv::putText(frame, fpsString, cv::Point(0, stringSize.height), cv::FONT_HERSHEY_COMPLEX, 0.5, fontColor);
+}
+
+inline
+void
+showFrame (
+    cv::InputOutputArray& frame,
+    cv::String& fpsString
+)
+{
+    drawFpsLabel(frame, fpsString);
     cv::imshow(windowName, frame);
 }
 
+inline
 cv::Rect
 rectFromDetection (
     const Detection& detection,
@@ -108,6 +96,7 @@ rectFromDetection (
     return cv::Rect(cv::Point(x1, y1), cv::Point(x2, y2));
 }
 
+inline
 void
 drawRectOnFrame (
     cv::InputOutputArray& frame,
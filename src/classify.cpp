@@ -1,13 +1,20 @@
+#include "ClassifyPipeline.hpp"
+#include "FrameSource.hpp"
+#include "FrameTrace.hpp"
 #include "Hailo8Device.hpp"
 #include "ImageNetLabels.hpp"
+#include "Log.hpp"
+#include "PooledMatAllocator.hpp"
 #include "Utils.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
-#include <iostream>
+#include <memory>
 
 #include <hailo/hailort.hpp>
 #include <opencv2/core.hpp>
-#include <opencv2/imgcodecs.hpp>
+#include <opencv2/core/utility.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
@@ -16,19 +23,6 @@ constexpr float confidenceThreshold = 0.50;
 constexpr const std::string imageWindowName = "Classifier";
 
 
-static
-void
-preprocessImage (
-    const cv::String& inputPicture,
-    cv::Mat& imageIn,
-    cv::Mat& imageOut
-)
-{
-    cv::imread(inputPicture, imageIn);
-    cv::cvtColor(imageIn, imageOut, cv::COLOR_BGR2RGB);
-    cv::resize(imageOut, imageOut, cv::Size(224, 224));
-}
-
 static
 void
 showImage (
@@ -65,102 +59,179 @@ showImage (
     cv::imshow(windowName, image);
 }
 
+struct ProgramArguments {
+    std::string source;
+    std::string modelPath;
+    bool headless;
+    PrefetchConfig prefetch;
+};
+
+static
+int
+parseArguments (
+    int argc,
+    const char* const* argv,
+    ProgramArguments& args
+)
+{
+    const cv::String keys = "{ h help ?   | | print this message }"
+                            "{ m model hef | ../models/resnet_v1_50.hef | path of the model to load in HEF format }"
+                            "{ headless   | false | only log the results, without a window }"
+                            "{ loops      | 1 | times to go through a video file or images }"
+                            "{ prefetch   | 4 | frames decoded ahead of inference }"
+                            "{ prefetch-threads | 2 | threads decoding images ahead of inference }"
+                            "{ @source    | | an image, an image directory or glob, a video file, a camera (auto, a device path or index), a stream URL or shm:NAME }"
+                            ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help") || parser.get<std::string>("@source").empty())
+    {
+        parser.printMessage();
+        return -1;
+    }
+
+    args.source = parser.get<std::string>("@source");
+    args.modelPath = parser.get<std::string>("model");
+    args.headless = parser.get<bool>("headless");
+    args.prefetch.loops = parser.get<size_t>("loops");
+    args.prefetch.depth = std::max<size_t>(parser.get<size_t>("prefetch"), 1);
+    args.prefetch.threads = std::max<size_t>(parser.get<size_t>("prefetch-threads"), 1);
+    return 0;
+}
+
+// q, e or ESC, or the window was closed
+static
+bool
+quitRequested (
+    int delayMs
+)
+{
+    try
+    {
+        cv::getWindowImageRect(imageWindowName);
+    }
+    catch (cv::Exception& e)
+    {
+        LOG_ERROR("failed to get window properties: {}", e.what());
+        return true;
+    }
+
+    char keyPress = (char)cv::waitKey(delayMs);
+    return keyPress == 'e' || keyPress == 'q' || keyPress == 27; // 27 is ESC
+}
+
 int
 main (
     int argc,
     char* argv[]
 )
 {
-    using namespace std;
-    if (argc < 2)
+    ProgramArguments args;
+    if (parseArguments(argc, argv, args) != 0)
     {
-        cerr << "Usage: " << argv[0] << " input.jpg" << endl;
         return 1;
     }
-    std::string inputPicture(argv[1]);
+
+    using namespace std;
+    PooledMatAllocator::installAsDefault();
+    logging::start();
 
     using namespace hailort;
     hailo_status status = HAILO_SUCCESS;
-    auto device = Hailo8Device::create("../models/resnet_v1_50.hef");
+    auto device = Hailo8Device::create(args.modelPath);
 
     status = device.configureDefaultVStreams();
     if(status != HAILO_SUCCESS)
     {
-        cerr << "[e] failed to configure vstreams: " << status << endl;
+        LOG_ERROR("failed to configure vstreams: {}", status);
         return status;
     }
 
-    cv::Mat inputImage, preprocessedImage;
-    cout << "[i] preprocessing image" << endl;
-    preprocessImage(inputPicture, inputImage, preprocessedImage);
-
-    std::vector<uint8_t> outputData(device.getOutVStreamFrameSize());
-    cout << "[i] writing image bytes to Hailo8" << endl;
-    status = device.write(preprocessedImage, 224 * 224 * 3 * 1);
-    if (status != HAILO_SUCCESS)
+    unique_ptr<FrameSource> source;
+    try
     {
-        cerr << "[e] failed to write to hailo: "
-            << hailo_get_status_message(status) << endl;
-        return status;
+        source = openFrameSource(args.source, cv::Size());
     }
-
-    cout << "[i] reading bytes from Hailo8" << endl;
-    status = device.read(outputData);
-    if (status != HAILO_SUCCESS)
+    catch (const std::exception& e)
     {
-        cerr << "[e] failed to read from hailo device: "
-            << hailo_get_status_message(status) << endl;
-        return status;
+        LOG_ERROR("{}", e.what());
+        return 1;
     }
+    const bool singleImage = source->indexedCount() == 1 && args.prefetch.loops == 1;
 
-    // assume softmax is done on-chip based on output
-    // of "hailo parse-hef resnet_v1_50.hef":
-    // > Output resnet_v1_50/softmax1 UINT8, NC(1000)
-    int maxIndex = utils::argmax(outputData);
-    static ImageNetLabels net_labels;
-    std::string label;
-    float confidence = outputData[maxIndex] / 255.0;
-    if (confidence < confidenceThreshold)
-    {
-        label = "unknown";
-        cout << "[i] too low (< " 
-            << confidenceThreshold << ")" << endl;
-    }
-    else
-    {
-        label = net_labels.imagenet_labelstring(maxIndex);
-        cout << label << " (" << confidence << ") " << endl;
-    }
+    // images decode on the prefetcher's threads while the device works
+    FramePrefetcher frames(std::move(source), args.prefetch);
+    LOG_INFO("classifying {} frames, {} decoding threads", frames.source().kind(), frames.threads());
 
-    showImage(inputImage, imageWindowName, label, confidence);
+    static ImageNetLabels net_labels;
+    cv::Mat preprocessedImage;
+    std::vector<uint8_t> outputData(device.getOutVStreamFrameSize());
+    SourceFrame input;
+    uint64_t classified = 0;
+    uint64_t waitNs = 0;
+    auto start = chrono::steady_clock::now();
+    bool quit = false;
 
-    bool shouldBreak = false;
-    while (true)
+    while (!quit)
     {
-        if (shouldBreak) break;
+        uint64_t waitStartNs = trace::nowNs();
+        if (!frames.next(input))
+            break;
+        waitNs += trace::nowNs() - waitStartNs;
 
-        try
+        preprocessImage(input.frame, preprocessedImage);
+        status = device.write(preprocessedImage, resnetInputSize * resnetInputSize * 3 * 1);
+        if (status != HAILO_SUCCESS)
         {
-            cv::getWindowImageRect(imageWindowName);
+            LOG_ERROR("failed to write to hailo: {}", hailo_get_status_message(status));
+            return status;
         }
-        catch (cv::Exception& e)
+
+        status = device.read(outputData);
+        if (status != HAILO_SUCCESS)
         {
-            cerr << "[e] failed to get window properties: " << e.what() << endl;
-            break;
+            LOG_ERROR("failed to read from hailo device: {}", hailo_get_status_message(status));
+            return status;
+        }
+        classified++;
+
+        // assume softmax is done on-chip based on output
+        // of "hailo parse-hef resnet_v1_50.hef":
+        // > Output resnet_v1_50/softmax1 UINT8, NC(1000)
+        int maxIndex = utils::argmax(outputData);
+        std::string label;
+        float confidence = outputData[maxIndex] / 255.0;
+        const std::string name = input.name.empty() ? "frame " + std::to_string(classified) : input.name;
+        if (confidence < confidenceThreshold)
+        {
+            label = "unknown";
+            LOG_INFO("{}: too low (< {})", name, confidenceThreshold);
+        }
+        else
+        {
+            label = net_labels.imagenet_labelstring(maxIndex);
+            LOG_INFO("{}: {} ({})", name, label, confidence);
         }
 
-        char keyPress = (char)cv::waitKey(10);
-        switch (keyPress)
+        if (!args.headless)
         {
-        case 'e': case 'q': case 27: // 27 is ESC
-            shouldBreak = true;
-            break;
-        default:
-            break;
+            showImage(input.frame, imageWindowName, label, confidence);
+            quit = quitRequested(1);
         }
     }
 
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    frames.stop();
+    PrefetchMetrics prefetched = frames.metrics();
+    LOG_INFO("{} frames in {}s, {} fps; waited {}ms for decoding, decoding took {}ms; {} unreadable",
+        classified, seconds, seconds > 0 ? classified / seconds : 0.0,
+        waitNs / 1000000, prefetched.decodeNs / 1000000, prefetched.lost);
+
+    // a single picture stays up until dismissed
+    while (singleImage && !args.headless && !quit)
+        quit = quitRequested(10);
+
     cv::destroyAllWindows();
-    cout << "[i] exiting, goodbye." << endl;
+    LOG_INFO("exiting, goodbye.");
+    logging::stop();
     return status;
 }
@@ -1,22 +1,37 @@
 #include "CocoClass.hpp"
-#include "EmailNotifier.hpp"
+#include "DetectPipeline.hpp"
+#include "FrameSink.hpp"
+#include "FrameSource.hpp"
+#include "FrameTrace.hpp"
 #include "Hailo8Device.hpp"
+#include "Log.hpp"
+#include "MetricsServer.hpp"
+#include "NotificationDispatcher.hpp"
+#include "OutputSinks.hpp"
+#include "PerceptualHash.hpp"
+#include "PipelineStats.hpp"
+#include "PooledMatAllocator.hpp"
+#include "SnapshotEncoder.hpp"
+#include "SnapshotStore.hpp"
+#include "ThreadPlacement.hpp"
 #include "Utils.hpp"
 
+#ifdef COUNT_ALLOCATIONS
+#include "AllocationReport.hpp"
+#endif
+
 #include <hailo/hailort.h>
 #include <opencv2/core.hpp>
 #include <opencv2/core/utility.hpp>
 #include <opencv2/imgproc.hpp>
 
-#include <iostream>
-#include <thread>
-
-constexpr size_t defaultCaptureHeight = 600;
-constexpr size_t defaultCaptureWidth = 800;
-constexpr size_t yolov8ModelInputHeight = 640;
-constexpr size_t yolov8ModelInputWidth = 640;
-constexpr size_t defaultDeviceId = 0;
-constexpr size_t inputSize = yolov8ModelInputHeight * yolov8ModelInputHeight * 3;
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <memory>
+#include <mutex>
+#include <sstream>
 
 struct ProgramArguments {
     std::string deviceAddress;
@@ -25,53 +40,47 @@ struct ProgramArguments {
     std::string emailPassword;
     std::string SMTPAddress;
     std::string emailTo;
+    size_t notifyWorkers;
+    size_t notifyQueue;
+    size_t digestMinutes;
+    size_t digestCount;
+    size_t digestMaxKB;
+    int dedupeDistance;
+    size_t dedupeHistory;
+    JpegSettings jpegSettings;
+    size_t statsInterval;
+    size_t statsWindow;
+    std::string traceDir;
+    size_t traceThresholdMs;
+    std::string metricsAddress;
+    placement::Plan placement;
+    int cvThreads;
+    std::vector<std::string> sinks;
+    RecordingConfig recording;
+    ClipConfig clip;
+    DetectionLogConfig log;
+    MjpegConfig mjpeg;
+    uint32_t shmSlots;
+    PrefetchConfig prefetch;
 };
 
-EmailCode
-sendEmailNotification (
-   const std::string& username,
-   const std::string& password,
-   const std::string& url,
-   const std::vector<std::string>& to,
-   const std::string& body,
-   const std::vector<uint8_t>& jpg
-)
-{
-    EmailNotifier curl(
-        username,
-        password,
-        url);
-
-    EmailCode mailStatus = curl.connectAndSendImage(
-        username,
-        to,
-        body,
-        jpg);
-
-    if (mailStatus != CURLE_OK)
-        std::cerr << curl_easy_strerror(mailStatus) << std::endl;
+// written by the detect loop, read by the metrics scrape
+struct LoopCounters {
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<double> fps{0.0};
+};
 
-    return mailStatus;
-}
+// set by SIGINT/SIGTERM; the only way to stop a headless run
+static std::atomic<bool> stopRequested{false};
 
+static
 void
-spawnEmailThread (
-    const std::vector<uint8_t>& jpg,
-    ProgramArguments& args
+requestStop (
+    int /*signal*/
 )
 {
-    std::cout << "[i] sending email" << std::endl;
-    std::vector<std::string> to;
-    to.push_back(args.emailTo);
-    std::thread emailThread(
-        sendEmailNotification,
-        args.emailAccount,
-        args.emailPassword,
-        args.SMTPAddress,
-        to,
-        "email alert System",
-        jpg);
-    emailThread.detach();
+    stopRequested.store(true);
 }
 
 static
@@ -87,7 +96,42 @@ parseArguments (
                             "{ e email    | | email account for SMTP authentication and \"MAIL FROM:\" }"
                             "{ s smtp     | smtp://smtp.gmail.com:587 | SMTP server address }"
                             "{ t to       | | \"RCPT:\" field for sending email }"
-                            "{ @device    | auto | video device to open. Can be IP address or device path }"
+                            "{ notify-workers | 2 | number of threads sending email notifications }"
+                            "{ notify-queue | 8 | pending notifications kept before the oldest is dropped }"
+                            "{ digest-minutes | 0 | batch snapshots into one email every N minutes, 0 sends each one immediately }"
+                            "{ digest-count | 4 | best snapshots attached to each digest email }"
+                            "{ digest-max-kb | 4096 | memory budget for snapshots waiting for the next digest }"
+                            "{ dedupe-distance | 6 | suppress snapshots within this many hash bits of a recent one, -1 disables }"
+                            "{ dedupe-history | 16 | number of recent snapshot hashes to compare against }"
+                            "{ jpeg-preset | baseline | snapshot encoding: quality (progressive, slowest), baseline or fast (half size) }"
+                            "{ stats-interval | 10 | seconds between per-stage latency reports, 0 disables them }"
+                            "{ stats-window | 10 | seconds of latency the reports and the metrics quantiles cover }"
+                            "{ trace-dir | | write Chrome trace-event JSON here ('p' key or slow frames), empty disables tracing }"
+                            "{ trace-threshold-ms | 0 | dump a trace when a frame takes longer than this, 0 disables }"
+                            "{ metrics    | | serve Prometheus metrics on this loopback port or unix:/path socket, empty disables }"
+                            "{ pin        | | pin threads to cores, space separated role=cpus: detect (inference), capture (decoding frames), encoder, notifier, http, a sink's name or helper thread (recorder, clip-writer, dlog), default (all other threads), e.g. \"detect=3 default=0-2\" }"
+                            "{ priority   | | space separated role=fifo:N or role=nice:N, e.g. \"detect=fifo:20 encoder=nice:10\" }"
+                            "{ cv-threads | -1 | size of OpenCV's internal thread pool, -1 keeps OpenCV's default }"
+                            "{ sinks      | display | comma separated outputs: display, video:PATH (annotated video), clip:PATH (pre/post-event clips), log:DIR (binary detection log), json:PATH (detections as JSON lines, json:- for stdout with logs and reports moved to stderr, json:unix:/path for a socket), mjpeg:PORT (live view over HTTP on loopback, mjpeg:unix:/path for a socket), shm:NAME (frames and detections in shared memory for local readers, see detect_bus), null }"
+                            "{ record-segment-mb | 256 | start a new video:PATH segment after this many MB, 0 disables }"
+                            "{ record-segment-minutes | 10 | start a new video:PATH segment after this many minutes, 0 disables }"
+                            "{ record-on-detection | false | record video:PATH only while something is detected }"
+                            "{ record-hold-seconds | 5 | keep recording this long after the last detection }"
+                            "{ record-queue | 32 | frames waiting for the video encoder before new ones are dropped }"
+                            "{ clip-pre-seconds | 10 | clip:PATH keeps this much video from before the event }"
+                            "{ clip-post-seconds | 10 | clip:PATH ends this long after the last detection }"
+                            "{ clip-buffer-mb | 32 | memory for clip:PATH's compressed pre-roll, also the largest clip }"
+                            "{ clip-quality | 75 | JPEG quality of clip:PATH frames }"
+                            "{ log-stream | 0 | stream id recorded by log:DIR, to tell cameras apart }"
+                            "{ log-segment-mb | 64 | start a new log:DIR segment after this many MB }"
+                            "{ log-segment-minutes | 60 | start a new log:DIR segment after this many minutes, 0 disables }"
+                            "{ mjpeg-quality | 80 | JPEG quality of the mjpeg:PORT live view }"
+                            "{ mjpeg-max-viewers | 8 | mjpeg:PORT viewers served at once, more are turned away }"
+                            "{ shm-slots  | 4 | frames kept in the shm:NAME ring; readers have about one frame less than this to use one in place }"
+                            "{ headless   | false | run without a window: drops the display sink and key commands, stop with SIGINT or SIGTERM }"
+                            "{ prefetch   | 2 | frames decoded ahead of inference; a camera or shm:NAME keeps only the newest }"
+                            "{ prefetch-threads | 2 | threads decoding an image directory or glob ahead of inference }"
+                            "{ @device    | auto | frame source: auto (first camera), a device path or index, a stream URL, a video file, an image directory or glob, or shm:NAME }"
                             ;
     cv::CommandLineParser parser(argc, argv, keys);
     if (parser.has("help"))
@@ -99,7 +143,7 @@ parseArguments (
     char* SMTPPass = getenv("SMTP_PASS");
     if (SMTPPass == nullptr)
     {
-        std::cout << "SMTP_PASS environment variable needs to be set" << std::endl;
+        LOG_ERROR("SMTP_PASS environment variable needs to be set");
         return -2;
     }
 
@@ -110,79 +154,204 @@ parseArguments (
     args.emailPassword = SMTPPass;
     args.SMTPAddress = parser.get<string>("smtp");
     args.emailTo = parser.get<string>("to");
+    args.notifyWorkers = parser.get<size_t>("notify-workers");
+    args.notifyQueue = parser.get<size_t>("notify-queue");
+    args.digestMinutes = parser.get<size_t>("digest-minutes");
+    args.digestCount = parser.get<size_t>("digest-count");
+    args.digestMaxKB = parser.get<size_t>("digest-max-kb");
+    args.dedupeDistance = parser.get<int>("dedupe-distance");
+    args.dedupeHistory = parser.get<size_t>("dedupe-history");
+
+    auto jpegSettings = JpegSettings::fromPreset(parser.get<string>("jpeg-preset"));
+    if (!jpegSettings)
+    {
+        LOG_ERROR("unknown jpeg preset: {}", parser.get<string>("jpeg-preset"));
+        return -3;
+    }
+    args.jpegSettings = *jpegSettings;
+    args.statsInterval = parser.get<size_t>("stats-interval");
+    args.statsWindow = std::max<size_t>(parser.get<size_t>("stats-window"), 1);
+    args.traceDir = parser.get<string>("trace-dir");
+    args.traceThresholdMs = parser.get<size_t>("trace-threshold-ms");
+    args.metricsAddress = parser.get<string>("metrics");
+
+    string placementError;
+    if (!placement::parse(parser.get<string>("pin"), parser.get<string>("priority"), args.placement, placementError))
+    {
+        LOG_ERROR("invalid thread placement: {}", placementError);
+        return -4;
+    }
+    args.cvThreads = parser.get<int>("cv-threads");
+
+    args.recording.maxSegmentBytes = parser.get<size_t>("record-segment-mb") << 20;
+    args.recording.maxSegmentDuration = std::chrono::minutes(parser.get<int>("record-segment-minutes"));
+    args.recording.onlyWhileDetecting = parser.get<bool>("record-on-detection");
+    args.recording.holdAfterDetection = std::chrono::seconds(parser.get<int>("record-hold-seconds"));
+    args.recording.queueCapacity = parser.get<size_t>("record-queue");
+
+    args.clip.preRoll = std::chrono::seconds(parser.get<int>("clip-pre-seconds"));
+    args.clip.postRoll = std::chrono::seconds(parser.get<int>("clip-post-seconds"));
+    args.clip.maxBytes = parser.get<size_t>("clip-buffer-mb") << 20;
+    args.clip.jpegQuality = parser.get<int>("clip-quality");
+
+    args.log.streamId = parser.get<uint32_t>("log-stream");
+    args.log.segmentBytes = parser.get<size_t>("log-segment-mb") << 20;
+    args.log.segmentDuration = std::chrono::minutes(parser.get<int>("log-segment-minutes"));
+
+    args.mjpeg.jpegQuality = parser.get<int>("mjpeg-quality");
+    args.mjpeg.maxViewers = parser.get<size_t>("mjpeg-max-viewers");
+    args.shmSlots = std::max(parser.get<uint32_t>("shm-slots"), 2u);
+    args.prefetch.depth = std::max<size_t>(parser.get<size_t>("prefetch"), 1);
+    args.prefetch.threads = std::max<size_t>(parser.get<size_t>("prefetch-threads"), 1);
+
+    bool headless = parser.get<bool>("headless");
+    std::istringstream sinks(parser.get<string>("sinks"));
+    string sink;
+    while (std::getline(sinks, sink, ','))
+    {
+        if (!sink.empty() && !(headless && sink == "display"))
+            args.sinks.push_back(sink);
+    }
 
     unsetenv("SMTP_PASS");
     return 0;
 }
 
-void
-preProcess (
-    cv::InputArray& inputFrame,
-    cv::OutputArray& processed
+Snapshot
+makeSnapshot (
+    std::shared_ptr<const std::vector<uint8_t>> jpg,
+    const std::vector<utils::Detection>& detections
 )
 {
-    cv::resize(
-        inputFrame,
-        processed,
-        cv::Size(yolov8ModelInputHeight, yolov8ModelInputWidth));
+    Snapshot snapshot;
+    snapshot.jpg = std::move(jpg);
+    snapshot.score = 0.0f;
+    snapshot.timestamp = std::chrono::system_clock::now();
+    snapshot.classIds.reserve(detections.size());
+    for (const auto& detection : detections)
+    {
+        snapshot.score = std::max(snapshot.score, detection.boundingBox.score);
+        snapshot.classIds.push_back(detection.classId);
+    }
+    return snapshot;
 }
 
-std::vector<utils::Detection>
-postProcess (
-    const std::vector<float32_t>& inferenceOutput
+void
+sendDigest (
+    SnapshotStore& store,
+    NotificationDispatcher& notifier,
+    size_t windowMinutes
 )
 {
-    assert(sizeof(float32_t) == 4);
-
-    std::vector<utils::Detection> detections;
-    const float32_t* data = inferenceOutput.data();
-    size_t offset = 0;
-    
-    // skip class index 0: _background_ which is not detected
-    for (size_t classIndex = 1; classIndex < CocoClass::numClasses; classIndex++)
-    {
-        float32_t detCount = *(data + offset);
-        offset++;
-
-        for (size_t detIndex = 0; detIndex < detCount; detIndex++)
-        {
-            utils::Detection det;
-            hailo_bbox_float32_t bbox =
-                *(reinterpret_cast<const hailo_bbox_float32_t*>(data + offset));
-            det.classId = classIndex;
-            det.boundingBox = bbox;
-            detections.push_back(det);
-            offset += 5; // each bbox is 5 floats wide
-        }
-    }
-
-    return detections;
+    if (store.empty())
+        return;
+
+    std::ostringstream summary;
+    summary << "detections in the last " << windowMinutes << " minutes:\n";
+    for (const auto& [classId, count] : store.classCounts())
+        summary << "  " << CocoClass::nameFromIndex(classId) << ": " << count << "\n";
+    summary << "snapshots: " << store.offered()
+        << ", attached: " << store.size()
+        << " (" << store.bytes() / 1024 << " KB)\n";
+
+    Notification notification;
+    notification.body = summary.str();
+    for (auto& snapshot : store.take())
+        notification.images.push_back(std::move(snapshot.jpg));
+
+    LOG_INFO("queueing digest email");
+    notifier.enqueue(std::move(notification));
 }
 
-void
-drawDetections (
-    cv::InputOutputArray& frame,
-    const std::vector<utils::Detection>& detections,
-    const std::string& fps
+std::vector<MetricsCollector>
+detectCollectors (
+    const LoopCounters& counters,
+    const PipelineStats& stats,
+    const NotificationDispatcher& notifier,
+    const SnapshotEncoder& encoder,
+    const SinkSet& sinks,
+    const Hailo8Device& hailo
 )
 {
-    cv::String fpsString, boxLabel;
-    fpsString.reserve(24);
-    boxLabel.reserve(32);
-    for (const auto& detection : detections)
-    {
-        boxLabel.clear();
-        boxLabel += CocoClass::nameFromIndex(detection.classId)
-            + " "
-            + std::to_string(detection.boundingBox.score * 100)
-            + "%";
-        cv::Rect rect = utils::rectFromDetection(detection,
-            defaultCaptureWidth,
-            defaultCaptureHeight);
-        utils::drawRectOnFrame(frame, rect, boxLabel);
-    }
-    fpsString += "FPS: " + fps;
-    utils::showFrame(frame, fpsString);
+    std::vector<MetricsCollector> collectors;
+
+    collectors.push_back([&counters](PrometheusText& out) {
+        out.family("detect_frames_total", "counter", "Frames run through inference");
+        out.sample("detect_frames_total", counters.frames.load(std::memory_order_relaxed));
+        out.family("detect_frames_dropped_total", "counter", "Frames lost before inference: failed grabs, unreadable images and live frames dropped while inference was behind");
+        out.sample("detect_frames_dropped_total", counters.dropped.load(std::memory_order_relaxed));
+        out.family("detect_fps", "gauge", "Frames per second of the capture to postprocess path");
+        out.sample("detect_fps", counters.fps.load(std::memory_order_relaxed));
+    });
+
+    collectors.push_back([&stats](PrometheusText& out) {
+        metrics::writeStageLatency(out, stats);
+    });
+
+    collectors.push_back([&notifier, &encoder](PrometheusText& out) {
+        NotificationMetrics notify = notifier.metrics();
+        out.family("detect_notifier_queue_depth", "gauge", "Notifications waiting for a worker");
+        out.sample("detect_notifier_queue_depth", notify.queueDepth);
+        out.family("detect_notifier_notifications_total", "counter", "Notifications by outcome");
+        out.sample("detect_notifier_notifications_total", notify.sent, {{"outcome", "sent"}});
+        out.sample("detect_notifier_notifications_total", notify.failed, {{"outcome", "failed"}});
+        out.sample("detect_notifier_notifications_total", notify.dropped, {{"outcome", "dropped"}});
+        out.sample("detect_notifier_notifications_total", notify.coalesced, {{"outcome", "coalesced"}});
+        out.family("detect_notifier_retries_total", "counter", "Send attempts that were retried");
+        out.sample("detect_notifier_retries_total", notify.retries);
+
+        MatPoolStats matPool = PooledMatAllocator::instance().stats();
+        out.family("detect_mat_allocations_total", "counter", "Mat buffers requested from the pool, by where they came from");
+        out.sample("detect_mat_allocations_total", matPool.poolHits, {{"source", "pool"}});
+        out.sample("detect_mat_allocations_total", matPool.allocations - matPool.poolHits, {{"source", "system"}});
+        out.family("detect_mat_pool_bytes", "gauge", "Mat buffer bytes by state");
+        out.sample("detect_mat_pool_bytes", matPool.pooledBytes, {{"state", "idle"}});
+        out.sample("detect_mat_pool_bytes", matPool.outstandingBytes, {{"state", "in_use"}});
+
+        EncoderMetrics encode = encoder.metrics();
+        out.family("detect_snapshots_encoded_total", "counter", "Snapshots encoded to JPEG");
+        out.sample("detect_snapshots_encoded_total", encode.encoded);
+        out.family("detect_snapshots_dropped_total", "counter", "Snapshots dropped because the encoder fell behind");
+        out.sample("detect_snapshots_dropped_total", encode.dropped);
+    });
+
+    collectors.push_back([&sinks](PrometheusText& out) {
+        out.family("detect_sink_frames_total", "counter", "Frames per output sink, by whether the sink got to them");
+        for (const SinkMetrics& sink : sinks.metrics())
+        {
+            out.sample("detect_sink_frames_total", sink.delivered, {{"sink", sink.name}, {"outcome", "delivered"}});
+            out.sample("detect_sink_frames_total", sink.replaced, {{"sink", sink.name}, {"outcome", "replaced"}});
+            out.sample("detect_sink_frames_total", sink.dropped, {{"sink", sink.name}, {"outcome", "dropped"}});
+        }
+        out.family("detect_sink_buffer_bytes", "gauge", "Memory output sinks hold between frames, e.g. clip pre-roll");
+        for (const SinkMetrics& sink : sinks.metrics())
+            out.sample("detect_sink_buffer_bytes", sink.bufferedBytes, {{"sink", sink.name}});
+    });
+
+    collectors.push_back([&hailo](PrometheusText& out) {
+        const hailo_device_identity_t& id = hailo.getId();
+        std::string board(id.board_name, id.board_name_length);
+        std::string serial(id.serial_number, id.serial_number_length);
+        std::string firmware = std::to_string(id.fw_version.major) + "."
+            + std::to_string(id.fw_version.minor) + "."
+            + std::to_string(id.fw_version.revision);
+        out.family("detect_device_info", "gauge", "Identity of the Hailo device");
+        out.sample("detect_device_info", 1, {{"board", board}, {"serial", serial}, {"firmware", firmware}});
+
+        if (auto temperature = hailo.getChipTemperature())
+        {
+            out.family("detect_device_temperature_celsius", "gauge", "Hailo chip temperature sensors");
+            out.sample("detect_device_temperature_celsius", temperature->ts0_temperature, {{"sensor", "ts0"}});
+            out.sample("detect_device_temperature_celsius", temperature->ts1_temperature, {{"sensor", "ts1"}});
+        }
+        if (auto power = hailo.getPowerWatts())
+        {
+            out.family("detect_device_power_watts", "gauge", "Hailo device power draw");
+            out.sample("detect_device_power_watts", *power);
+        }
+    });
+
+    return collectors;
 }
 
 int
@@ -200,74 +369,298 @@ main (
     using namespace std;
     using namespace hailort;
 
+    // before HailoRT and OpenCV start their threads, so they inherit the
+    // "default" placement rather than the detect loop's
+    placement::configure(std::move(args.placement));
+    if (args.cvThreads >= 0)
+        cv::setNumThreads(args.cvThreads);
+    cv::parallel_for_(cv::Range(0, cv::getNumThreads()), [](const cv::Range&) { });
+
+    // json:- owns stdout; anything else printed there would corrupt it
+    logging::Config logConfig;
+    if (std::any_of(args.sinks.begin(), args.sinks.end(), writesToStdout))
+        logConfig.outFd = STDERR_FILENO;
+    logging::start(logConfig);
+    LOG_INFO("main thread: {}, OpenCV threads: {}", placement::describeCurrentThread(), cv::getNumThreads());
+
+    // capture, preprocessing and snapshot Mats recycle their buffers, also
+    // when a frame is released on the encoder thread
+    PooledMatAllocator::installAsDefault();
+
     Hailo8Device hailo = Hailo8Device::create(args.modelPath);
     hailo_status hailoStatus = hailo.configureDefaultVStreams();
     if (hailoStatus != HAILO_SUCCESS)
     {
-        cerr << "failed to initialize hailo device: "
-            << hailo_get_status_message(hailoStatus) << endl;
+        LOG_ERROR("failed to initialize hailo device: {}", hailo_get_status_message(hailoStatus));
         return static_cast<int>(hailoStatus);
     }
 
+    trace::Config traceConfig;
+    traceConfig.directory = args.traceDir;
+    traceConfig.thresholdNs = args.traceThresholdMs * 1000000;
+    trace::start(traceConfig);
+    trace::setThreadName("detect");
+    placement::registerThread("detect");
+
+    PipelineStats stats;
+    const auto statsWindow = chrono::seconds(args.statsWindow);
+    auto windowStart = chrono::steady_clock::now();
+    const auto statsInterval = chrono::seconds(args.statsInterval);
+    auto statsStart = chrono::steady_clock::now();
+#ifdef COUNT_ALLOCATIONS
+    alloc::Snapshot allocStart = alloc::snapshot();
+    uint64_t allocStartFrames = 0;
+#endif
+
+    NotificationConfig notifyConfig;
+    notifyConfig.username = args.emailAccount;
+    notifyConfig.password = args.emailPassword;
+    notifyConfig.url = args.SMTPAddress;
+    notifyConfig.mailFrom = args.emailAccount;
+    notifyConfig.recipients.push_back(args.emailTo);
+    notifyConfig.workers = args.notifyWorkers;
+    notifyConfig.queueCapacity = args.notifyQueue;
+    notifyConfig.sendLatency = &stats.stage(Stage::Notify);
+    NotificationDispatcher notifier(notifyConfig);
+
+    const bool digestMode = args.digestMinutes > 0;
+    const auto digestWindow = chrono::minutes(args.digestMinutes);
+    auto digestStart = chrono::steady_clock::now();
+    SnapshotStore digest(args.digestCount, args.digestMaxKB * 1024);
+    SnapshotDeduper deduper(args.dedupeDistance, args.dedupeHistory);
+    std::mutex digestMutex;
+    SnapshotEncoder encoder(args.jpegSettings, 4, &stats.stage(Stage::Encode), &deduper);
+
     cv::Mat frame, processingFrame;
-    cv::VideoCapture cap = utils::getVideoCapture(
-        args.deviceAddress,
-        defaultCaptureWidth,
-        defaultCaptureHeight);
+    unique_ptr<FrameSource> source;
+    try
+    {
+        source = openFrameSource(args.deviceAddress, cv::Size(defaultCaptureWidth, defaultCaptureHeight));
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("{}", e.what());
+        return -1;
+    }
+    const double captureFps = source->fps();
+    const cv::Size captureSize = source->frameSize();
+
+    // annotation and display happen on the sinks' threads, counted as draw
+    SinkOptions sinkOptions;
+    sinkOptions.recording = args.recording;
+    sinkOptions.clip = args.clip;
+    sinkOptions.log = args.log;
+    sinkOptions.mjpeg = args.mjpeg;
+    if (captureFps > 0.0)
+        sinkOptions.recording.fps = captureFps;
+    sinkOptions.bus.slotCount = args.shmSlots;
+    sinkOptions.bus.frameBytes = static_cast<size_t>(captureSize.area()) * 3;
+    SinkSet sinks(&stats.stage(Stage::Draw));
+    for (const auto& spec : args.sinks)
+    {
+        auto sink = makeSink(spec, sinkOptions);
+        if (!sink)
+            return -1;
+        sinks.add(std::move(sink));
+    }
+    if (sinks.empty())
+        LOG_INFO("no output sinks, detections are only counted");
+
+    LoopCounters counters;
+    std::unique_ptr<MetricsServer> metricsServer;
+    if (!args.metricsAddress.empty())
+    {
+        metricsServer = std::make_unique<MetricsServer>(
+            args.metricsAddress,
+            detectCollectors(counters, stats, notifier, encoder, sinks, hailo));
+        LOG_INFO("serving metrics on {}", metricsServer->address());
+    }
+
+    // decoding starts here, on the prefetcher's threads
+    FramePrefetcher frames(std::move(source), args.prefetch);
+    LOG_INFO("source: {} {}x{}, {} decoding threads, {} frames ahead",
+        frames.source().kind(), captureSize.width, captureSize.height, frames.threads(), args.prefetch.depth);
+    SourceFrame captured;
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
 
     cv::TickMeter tick;
     hailo_status status;
     size_t outFrameSize = hailo.getOutVStreamFrameSize();
     vector<float32_t> inferenceOutput(outFrameSize);
+    vector<utils::Detection> detections;
 
-    std::vector<int> jpgFlags;
-    jpgFlags.push_back(cv::IMWRITE_JPEG_PROGRESSIVE);
-    jpgFlags.push_back(1U);
-    jpgFlags.push_back(cv::IMWRITE_JPEG_OPTIMIZE);
-    jpgFlags.push_back(1U);
-
-    while (true)
+    while (!stopRequested.load())
     {
         tick.start();
-        cap >> frame;
+        uint64_t frameId = trace::nextFrameId();
+        uint64_t frameStartNs = trace::nowNs();
+        trace::setCurrentFrame(frameId);
+        // only the wait for the next decoded frame
+        bool captureOk;
+        {
+            ScopedStage timer(stats, Stage::Capture);
+            captureOk = frames.next(captured);
+        }
+        if (!captureOk)
+        {
+            LOG_INFO("{} source ended", frames.source().kind());
+            break;
+        }
+        frame = std::move(captured.frame);
+        PrefetchMetrics prefetched = frames.metrics();
+        counters.dropped.store(prefetched.lost + prefetched.dropped, std::memory_order_relaxed);
 
-        preProcess(frame, processingFrame);
+        {
+            ScopedStage timer(stats, Stage::Preprocess);
+            preProcess(frame, processingFrame);
+        }
 
-        status = hailo.write(processingFrame, inputSize);
+        {
+            ScopedStage timer(stats, Stage::Write);
+            status = hailo.write(processingFrame, inputSize);
+        }
         if (status != HAILO_SUCCESS)
         {
-            cerr << "write failed: " << hailo_get_status_message(status) << endl;
+            LOG_ERROR("write failed: {}", hailo_get_status_message(status));
             return static_cast<int>(status);
         }
 
-        status = hailo.read(inferenceOutput);
+        {
+            ScopedStage timer(stats, Stage::Read);
+            status = hailo.read(inferenceOutput);
+        }
         if (status != HAILO_SUCCESS)
         {
-            cerr << "read failed: " << hailo_get_status_message(status) << endl;
+            LOG_ERROR("read failed: {}", hailo_get_status_message(status));
             return static_cast<int>(status);
         }
 
-        vector<utils::Detection> detections = postProcess(inferenceOutput);
+        {
+            ScopedStage timer(stats, Stage::Postprocess);
+            postProcess(inferenceOutput, detections);
+        }
         tick.stop();
+        counters.frames.fetch_add(1, std::memory_order_relaxed);
+        counters.fps.store(tick.getFPS(), std::memory_order_relaxed);
 
-        drawDetections(frame, detections, to_string(tick.getFPS()));
-
-        char keyPress = (char)cv::waitKey(1);
+        sinks.pollMainThread();
+        char keyPress = (char)sinks.takeKey();
         if (keyPress == 'q' || keyPress == 'e' || keyPress == (char)27)
         {
             break;
         }
+        else if (keyPress == 'p')
+        {
+            trace::requestDump("on demand");
+        }
         else if (keyPress == 't')
         {
-            vector<uint8_t> jpg;
-            if (cv::imencode(".jpg", frame, jpg, jpgFlags))
-                spawnEmailThread(jpg, args);
+            // the encoder shares the raw capture buffer with the sinks,
+            // which only read it, and dedupes and annotates on its thread
+            if (digestMode)
+            {
+                Snapshot snapshot = makeSnapshot(nullptr, detections);
+                encoder.submit(frame, detections, tick.getFPS(), [&, snapshot](SnapshotEncoder::Jpeg jpg) mutable {
+                    snapshot.jpg = std::move(jpg);
+                    std::lock_guard<std::mutex> lock(digestMutex);
+                    digest.offer(std::move(snapshot));
+                });
+            }
+            else
+            {
+                LOG_INFO("queueing email");
+                encoder.submit(frame, detections, tick.getFPS(), [&](SnapshotEncoder::Jpeg jpg) {
+                    notifier.enqueue({"email alert System", {std::move(jpg)}, ""});
+                });
+            }
+        }
+
+        {
+            ScopedStage timer(stats, Stage::Publish);
+            sinks.publish(frameId, frame, detections, tick.getFPS());
+        }
+        trace::frameDone(frameId, trace::nowNs() - frameStartNs);
+
+        if (digestMode && chrono::steady_clock::now() - digestStart >= digestWindow)
+        {
+            std::lock_guard<std::mutex> lock(digestMutex);
+            sendDigest(digest, notifier, args.digestMinutes);
+            digestStart = chrono::steady_clock::now();
+        }
+
+        // the window rolls over whether or not it is reported, so that
+        // /metrics has quantiles either way
+        if (chrono::steady_clock::now() - windowStart >= statsWindow)
+        {
+            stats.rotate();
+            windowStart = chrono::steady_clock::now();
+        }
+
+        if (args.statsInterval > 0 && chrono::steady_clock::now() - statsStart >= statsInterval)
+        {
+            // formatted here, written by the logger's flusher
+            std::ostringstream report;
+            stats.report(report);
+            statsStart = chrono::steady_clock::now();
+#ifdef COUNT_ALLOCATIONS
+            alloc::Snapshot allocNow = alloc::snapshot();
+            uint64_t frames = counters.frames.load(std::memory_order_relaxed);
+            alloc::reportPerFrame(report, allocStart, allocNow, frames - allocStartFrames);
+            allocStart = std::move(allocNow);
+            allocStartFrames = frames;
+#endif
+            logging::writeLines(logging::Level::Info, report.str());
         }
 
         tick.reset();
     }
 
-    cout << "[i] exiting, goodbye." << endl;
-    cv::destroyAllWindows();
+    frames.stop();
+    PrefetchMetrics prefetched = frames.metrics();
+    LOG_INFO("source {}: {} frames decoded, avg decode: {}us, {} lost, {} dropped while inference was behind",
+        frames.source().kind(), prefetched.decoded,
+        prefetched.decoded > 0 ? prefetched.decodeNs / prefetched.decoded / 1000 : 0,
+        prefetched.lost, prefetched.dropped);
+
+    sinks.shutdown();
+    for (const SinkMetrics& sink : sinks.metrics())
+    {
+        LOG_INFO("sink {}: {} frames, {} replaced by newer ones before it got to them, {} dropped by the sink",
+            sink.name, sink.delivered, sink.replaced, sink.dropped);
+    }
+
+    encoder.shutdown();
+    EncoderMetrics encodeStats = encoder.metrics();
+    if (encodeStats.encoded > 0)
+    {
+        LOG_INFO("snapshots encoded: {} avg encode: {}us avg size: {} KB",
+            encodeStats.encoded,
+            encodeStats.totalEncodeUs / encodeStats.encoded,
+            encodeStats.totalBytes / encodeStats.encoded / 1024);
+    }
+
+    MatPoolStats matPool = PooledMatAllocator::instance().stats();
+    LOG_INFO("mat buffers: {} allocations, {} reused from the pool, {} KB pooled",
+        matPool.allocations, matPool.poolHits, matPool.pooledBytes / 1024);
+
+    if (digestMode)
+    {
+        LOG_INFO("digest snapshot memory peak: {} KB", digest.peakBytes() / 1024);
+        sendDigest(digest, notifier, args.digestMinutes);
+    }
+
+    LOG_INFO("snapshots suppressed: {}/{} ({}%), hash cost: {}us",
+        deduper.suppressed(), deduper.checked(), deduper.suppressionRatio() * 100, deduper.averageHashMicros());
+
+    notifier.shutdown();
+    NotificationMetrics notifyStats = notifier.metrics();
+    LOG_INFO("notifications sent: {} failed: {} dropped: {} max latency: {}ms",
+        notifyStats.sent, notifyStats.failed, notifyStats.dropped, notifyStats.maxSendLatencyUs / 1000);
+
+    trace::stop();
+    LOG_INFO("exiting, goodbye.");
+    logging::stop();
     return 0;
 }
@@ -0,0 +1,382 @@
+// Reads the frame bus detect publishes with --sinks=shm:NAME, from
+// another process on the same box:
+//
+//   detect_bus detect                      frame rate, latency and skipped frames
+//   detect_bus --print detect              every frame's detections
+//   detect_bus --save=latest.jpg detect    the newest frame as a JPEG
+//
+// It also checks the bus itself. --publish writes frames with a known
+// pattern and --verify reads them back; run one publisher and as many
+// verifying readers as you like next to each other:
+//
+//   detect_bus --publish --fps=120 --seconds=30 bustest &
+//   detect_bus --verify --work-us=20000 --seconds=30 bustest
+
+#include "CocoClass.hpp"
+#include "FrameBus.hpp"
+#include "LatencyHistogram.hpp"
+#include "Log.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct ProgramArguments {
+    std::string name;
+    bool publish;
+    bool verify;
+    bool print;
+    std::string savePath;
+    double fps;
+    uint32_t width;
+    uint32_t height;
+    uint32_t slots;
+    double seconds;
+    uint64_t workUs;
+    double interval;
+};
+
+static std::atomic<bool> stopRequested{false};
+
+static
+void
+requestStop (
+    int /*signal*/
+)
+{
+    stopRequested.store(true);
+}
+
+static
+int
+parseArguments (
+    int argc,
+    const char* const* argv,
+    ProgramArguments& args
+)
+{
+    const cv::String keys = "{ h help ?   | | print this message }"
+                            "{ print      | false | print every frame's detections }"
+                            "{ save       | | write the newest frame to this image file and exit }"
+                            "{ interval   | 1 | seconds between reports }"
+                            "{ seconds    | 0 | stop after this long, 0 runs until SIGINT }"
+                            "{ work-us    | 0 | pretend to use each frame in place for this long before checking it is still intact }"
+                            "{ verify     | false | check frames written by --publish, exit with an error if one was intact but wrong }"
+                            "{ publish    | false | write frames with a known pattern instead of reading }"
+                            "{ fps        | 30 | --publish frame rate }"
+                            "{ width      | 800 | --publish frame width }"
+                            "{ height     | 600 | --publish frame height }"
+                            "{ slots      | 4 | --publish ring size }"
+                            "{ @name      | | bus name, as in shm:NAME }"
+                            ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help") || parser.get<std::string>("@name").empty())
+    {
+        parser.printMessage();
+        return -1;
+    }
+
+    args.name = parser.get<std::string>("@name");
+    args.publish = parser.get<bool>("publish");
+    args.verify = parser.get<bool>("verify");
+    args.print = parser.get<bool>("print");
+    args.savePath = parser.get<std::string>("save");
+    args.fps = std::max(parser.get<double>("fps"), 1.0);
+    args.width = parser.get<uint32_t>("width");
+    args.height = parser.get<uint32_t>("height");
+    args.slots = std::max(parser.get<uint32_t>("slots"), 2u);
+    args.seconds = parser.get<double>("seconds");
+    args.workUs = parser.get<uint64_t>("work-us");
+    args.interval = std::max(parser.get<double>("interval"), 0.1);
+    return 0;
+}
+
+static
+int64_t
+nowUs (
+    void
+)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// frame n is filled with n's low byte and carries n % 8 detections of
+// classes n, n + 1, ...
+static
+int
+publish (
+    const ProgramArguments& args,
+    std::chrono::steady_clock::time_point deadline
+)
+{
+    bus::WriterConfig config;
+    config.name = args.name;
+    config.slotCount = args.slots;
+    config.frameBytes = static_cast<size_t>(args.width) * args.height * 3;
+    config.maxDetections = 8;
+
+    std::vector<uint8_t> pixels(config.frameBytes);
+    std::vector<bus::Detection> detections;
+    try
+    {
+        bus::Writer writer(config);
+        LOG_INFO("publishing {}x{} at {} fps on {}", args.width, args.height, args.fps, writer.name());
+
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / args.fps));
+        auto next = std::chrono::steady_clock::now();
+        for (uint64_t frameId = 0; !stopRequested.load() && next < deadline; frameId++)
+        {
+            std::memset(pixels.data(), static_cast<uint8_t>(frameId), pixels.size());
+            detections.clear();
+            for (uint64_t i = 0; i < frameId % 8; i++)
+                detections.push_back({ static_cast<uint32_t>((frameId + i) % CocoClass::numClasses), 0.5f, 0.1f, 0.1f, 0.2f, 0.2f });
+
+            bus::FrameInfo info;
+            info.frameId = frameId;
+            info.timestampUs = nowUs();
+            info.fps = args.fps;
+            info.width = args.width;
+            info.height = args.height;
+            info.type = CV_8UC3;
+            info.step = args.width * 3;
+            writer.publish(info, pixels.data(), detections);
+
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+        LOG_INFO("published {} frames", writer.published());
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("{}", e.what());
+        return -1;
+    }
+    return 0;
+}
+
+static
+bool
+matchesPattern (
+    const bus::FrameView& view
+)
+{
+    const uint8_t expected = static_cast<uint8_t>(view.info.frameId);
+    const size_t bytes = static_cast<size_t>(view.info.height) * view.info.step;
+    if (std::find_if(view.pixels, view.pixels + bytes, [expected](uint8_t value) { return value != expected; }) != view.pixels + bytes)
+        return false;
+
+    if (view.detections.size() != view.info.frameId % 8)
+        return false;
+    for (size_t i = 0; i < view.detections.size(); i++)
+    {
+        if (view.detections[i].classId != (view.info.frameId + i) % CocoClass::numClasses)
+            return false;
+    }
+    return true;
+}
+
+static
+void
+printFrame (
+    const bus::FrameView& view
+)
+{
+    std::printf("frame %llu %ux%u %.1f fps:",
+        static_cast<unsigned long long>(view.info.frameId), view.info.width, view.info.height, view.info.fps);
+    for (const bus::Detection& detection : view.detections)
+    {
+        std::printf(" %s %.2f [%.3f %.3f %.3f %.3f]",
+            CocoClass::nameFromIndex(detection.classId), detection.score,
+            detection.xMin, detection.yMin, detection.xMax, detection.yMax);
+    }
+    std::printf("\n");
+}
+
+// cv::Mat over the shared memory; imwrite reads it in place
+static
+int
+save (
+    const bus::Reader& reader,
+    const std::string& path
+)
+{
+    for (int attempt = 0; attempt < 10; attempt++)
+    {
+        bus::FrameView view;
+        if (!reader.waitNewer(0, std::chrono::seconds(5)) || !reader.latest(view))
+            break;
+
+        cv::Mat frame(static_cast<int>(view.info.height), static_cast<int>(view.info.width), view.info.type,
+            const_cast<uint8_t*>(view.pixels), view.info.step);
+        std::vector<uint8_t> encoded;
+        cv::imencode(".jpg", frame, encoded);
+        if (!reader.valid(view))
+            continue;
+
+        FILE* out = std::fopen(path.c_str(), "wb");
+        if (out == nullptr || std::fwrite(encoded.data(), 1, encoded.size(), out) != encoded.size())
+        {
+            LOG_ERROR("failed to write {}", path);
+            if (out != nullptr)
+                std::fclose(out);
+            return -1;
+        }
+        std::fclose(out);
+        LOG_INFO("frame {} written to {}", view.info.frameId, path);
+        return 0;
+    }
+    LOG_ERROR("no intact frame to save");
+    return -1;
+}
+
+// reports, prints, verifies or saves frames until the deadline
+static
+int
+readBus (
+    const ProgramArguments& args,
+    std::chrono::steady_clock::time_point deadline
+)
+{
+    using namespace std;
+
+    // the writer may not be up yet, or restart while we run
+    bus::Reader reader;
+    string error;
+    auto waitForBus = [&]() {
+        bool reported = false;
+        while (!reader.open(args.name, error))
+        {
+            if (!reported)
+                LOG_INFO("waiting for {}", error);
+            reported = true;
+            if (stopRequested.load() || chrono::steady_clock::now() >= deadline)
+                return false;
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+        LOG_INFO("reading {}", bus::shmName(args.name));
+        return true;
+    };
+    if (!waitForBus())
+        return -1;
+
+    if (!args.savePath.empty())
+        return save(reader, args.savePath);
+
+    LatencyHistogram latency;
+    uint64_t seen = reader.published();
+    uint64_t frames = 0;
+    uint64_t skipped = 0;
+    uint64_t torn = 0;
+    uint64_t corrupt = 0;
+    uint64_t totalFrames = 0;
+    uint64_t lastFrameId = 0;
+    auto reportStart = chrono::steady_clock::now();
+
+    while (!stopRequested.load() && chrono::steady_clock::now() < deadline)
+    {
+        if (reader.writerClosed())
+        {
+            LOG_INFO("writer closed the bus");
+            reader.close();
+            if (!waitForBus())
+                break;
+            seen = 0;
+        }
+
+        bus::FrameView view;
+        if (reader.waitNewer(seen, chrono::milliseconds(200)) && reader.latest(view) && view.sequence >= seen)
+        {
+            skipped += view.sequence - seen;
+            seen = view.sequence + 1;
+            latency.record(static_cast<uint64_t>(max<int64_t>(nowUs() - view.info.timestampUs, 0)) * 1000);
+
+            if (args.workUs > 0)
+                this_thread::sleep_for(chrono::microseconds(args.workUs));
+            const bool intact = !args.verify || matchesPattern(view);
+            if (args.print)
+                printFrame(view);
+
+            if (!reader.valid(view))
+                torn++;
+            else
+            {
+                if (!intact || (totalFrames > 0 && view.info.frameId <= lastFrameId))
+                    corrupt++;
+                lastFrameId = view.info.frameId;
+                frames++;
+                totalFrames++;
+            }
+        }
+
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - reportStart).count();
+        if (elapsed >= args.interval)
+        {
+            char line[256];
+            snprintf(line, sizeof(line), "%.1f fps, latency p50 %.2f ms p99 %.2f ms, %llu skipped, %llu overwritten while in use%s",
+                frames / elapsed,
+                latency.percentile(0.5) / 1e6, latency.percentile(0.99) / 1e6,
+                static_cast<unsigned long long>(skipped), static_cast<unsigned long long>(torn),
+                args.verify ? (", " + to_string(corrupt) + " wrong").c_str() : "");
+            LOG_INFO("{}", line);
+            frames = 0;
+            skipped = 0;
+            torn = 0;
+            latency.reset();
+            reportStart = chrono::steady_clock::now();
+        }
+    }
+
+    if (args.verify)
+    {
+        // a run that never saw a frame checked nothing
+        if (corrupt > 0 || totalFrames == 0)
+        {
+            LOG_ERROR("{} intact frames checked, {} wrong", totalFrames, corrupt);
+            return 1;
+        }
+        LOG_INFO("{} intact frames checked, 0 wrong", totalFrames);
+    }
+    return 0;
+}
+
+int
+main (
+    int argc,
+    char *argv[]
+)
+{
+    ProgramArguments args;
+    if (parseArguments(argc, argv, args) != 0)
+    {
+        return -1;
+    }
+
+    using namespace std;
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    const auto deadline = args.seconds > 0
+        ? chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(args.seconds))
+        : chrono::steady_clock::time_point::max();
+
+    // status goes to stderr like warnings do; stdout is for --print
+    logging::Config logConfig;
+    logConfig.outFd = STDERR_FILENO;
+    logging::start(logConfig);
+    int result = args.publish ? publish(args, deadline) : readBus(args, deadline);
+    logging::stop();
+    return result;
+}
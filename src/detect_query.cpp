@@ -0,0 +1,221 @@
+// Answers time, class and confidence queries over the segments detect
+// writes with --sinks=log:DIR, e.g. every person between 02:00 and 04:00
+// on stream 3:
+//
+//   detect_query --from="2025-03-01 02:00" --to="2025-03-01 04:00" --class=person --stream=3 /var/log/detect
+
+#include "CocoClass.hpp"
+#include "DetectionQuery.hpp"
+#include "Log.hpp"
+
+#include <opencv2/core/utility.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <string>
+
+
+struct ProgramArguments {
+    std::string directory;
+    dlog::Query query;
+    size_t threads;
+    bool countOnly;
+    size_t repeat;
+    double generateDays;
+    double generateFps;
+};
+
+// "YYYY-mm-dd HH:MM[:SS]" in local time or seconds since the epoch;
+// false if time is neither, or too many seconds for microseconds to fit
+// in 64 bits
+static
+bool
+parseTime (
+    const std::string& time,
+    int64_t& timestampUs
+)
+{
+    if (!time.empty() && time.find_first_not_of("0123456789") == std::string::npos)
+    {
+        if (time.size() > 12)
+            return false;
+        timestampUs = std::stoll(time) * 1000000;
+        return true;
+    }
+
+    std::tm local = {};
+    const char* end = strptime(time.c_str(), "%Y-%m-%d %H:%M", &local);
+    if (end != nullptr && *end == ':')
+        end = strptime(end + 1, "%S", &local);
+    if (end == nullptr || *end != '\0')
+        return false;
+
+    local.tm_isdst = -1;
+    timestampUs = static_cast<int64_t>(std::mktime(&local)) * 1000000;
+    return true;
+}
+
+static
+int
+parseArguments (
+    int argc,
+    const char* const* argv,
+    ProgramArguments& args
+)
+{
+    const cv::String keys = "{ h help ?   | | print this message }"
+                            "{ from       | | start of the range, \"YYYY-mm-dd HH:MM[:SS]\" local time or seconds since the epoch; empty is the beginning }"
+                            "{ to         | | end of the range, same formats; empty is the end }"
+                            "{ class      | | class name, e.g. person; empty matches every class }"
+                            "{ stream     | -1 | stream id, -1 matches every stream }"
+                            "{ min-score  | 0 | lowest detection confidence to report }"
+                            "{ threads    | 4 | segments scanned in parallel }"
+                            "{ count      | false | print matches per class instead of every match }"
+                            "{ no-index   | false | decode every record instead of skipping blocks by the index }"
+                            "{ repeat     | 1 | run the query this many times and report the latency of each run }"
+                            "{ generate-days | 0 | write this many days of synthetic detections into the directory and exit }"
+                            "{ generate-fps | 10 | frames per second of the synthetic detections }"
+                            "{ @directory | | directory the log:DIR sink writes to }"
+                            ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help") || parser.get<std::string>("@directory").empty())
+    {
+        parser.printMessage();
+        return -1;
+    }
+
+    using std::string;
+    args.directory = parser.get<string>("@directory");
+    args.threads = parser.get<size_t>("threads");
+    args.countOnly = parser.get<bool>("count");
+    args.repeat = std::max<size_t>(parser.get<size_t>("repeat"), 1);
+    args.generateDays = parser.get<double>("generate-days");
+    args.generateFps = parser.get<double>("generate-fps");
+
+    for (const char* key : { "from", "to" })
+    {
+        string time = parser.get<string>(key);
+        int64_t& bound = string(key) == "from" ? args.query.fromUs : args.query.toUs;
+        if (!time.empty() && !parseTime(time, bound))
+        {
+            LOG_ERROR("invalid time for --{}: {}", key, time);
+            return -2;
+        }
+    }
+
+    string className = parser.get<string>("class");
+    if (!className.empty())
+    {
+        args.query.classId = CocoClass::indexFromName(className);
+        if (args.query.classId < 0)
+        {
+            LOG_ERROR("unknown class: {}", className);
+            return -3;
+        }
+    }
+    args.query.streamId = parser.get<int>("stream");
+    args.query.minScore = parser.get<float>("min-score");
+    args.query.useIndex = !parser.get<bool>("no-index");
+    return 0;
+}
+
+static
+void
+printMatch (
+    const dlog::Match& match
+)
+{
+    std::time_t seconds = match.timestampUs / 1000000;
+    std::tm local = {};
+    localtime_r(&seconds, &local);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    std::printf("%s.%03lld stream %u frame %llu %s %.2f [%.3f %.3f %.3f %.3f]\n",
+        stamp,
+        static_cast<long long>(match.timestampUs % 1000000 / 1000),
+        match.streamId,
+        static_cast<unsigned long long>(match.frameId),
+        CocoClass::nameFromIndex(match.classId),
+        match.box.score,
+        match.box.x_min, match.box.y_min, match.box.x_max, match.box.y_max);
+}
+
+static
+int
+run (
+    const ProgramArguments& args
+)
+{
+    using namespace std;
+
+    if (args.generateDays > 0)
+    {
+        auto start = chrono::steady_clock::now();
+        uint32_t streamId = args.query.streamId >= 0 ? static_cast<uint32_t>(args.query.streamId) : 0;
+        if (!dlog::writeSyntheticLog(args.directory, args.generateDays, args.generateFps, streamId))
+            return -1;
+        LOG_INFO("wrote {} days of synthetic detections in {}s",
+            args.generateDays, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        return 0;
+    }
+
+    vector<string> segments = dlog::listSegments(args.directory);
+    if (segments.empty())
+    {
+        LOG_ERROR("no {} segments in {}", dlog::extension, args.directory);
+        return -1;
+    }
+
+    vector<dlog::Match> matches;
+    dlog::QueryStats stats;
+    for (size_t run = 0; run < args.repeat; run++)
+    {
+        auto start = chrono::steady_clock::now();
+        matches = dlog::runQuery(segments, args.query, args.threads, stats);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        LOG_INFO("{} matches in {} ms: {}/{} segments, {}/{} blocks read, {} records decoded, {} segments without index",
+            matches.size(), ms,
+            stats.segmentsRead, stats.segments,
+            stats.blocksRead, stats.blocks,
+            stats.records, stats.unindexed);
+    }
+
+    if (args.countOnly)
+    {
+        map<int, size_t> counts;
+        for (const auto& match : matches)
+            counts[match.classId]++;
+        for (const auto& [classId, count] : counts)
+            printf("%s %zu\n", CocoClass::nameFromIndex(classId), count);
+        return 0;
+    }
+
+    for (const auto& match : matches)
+        printMatch(match);
+    return 0;
+}
+
+int
+main (
+    int argc,
+    char *argv[]
+)
+{
+    ProgramArguments args;
+    if (parseArguments(argc, argv, args) != 0)
+    {
+        return -1;
+    }
+
+    // status goes to stderr like errors do; stdout is for the matches
+    logging::Config logConfig;
+    logConfig.outFd = STDERR_FILENO;
+    logging::start(logConfig);
+    int result = run(args);
+    logging::stop();
+    return result;
+}
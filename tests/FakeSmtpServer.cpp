@@ -0,0 +1,283 @@
+#include "FakeSmtpServer.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace
+{
+
+bool
+sendAll (
+    int fd,
+    const std::string& text
+)
+{
+    size_t sent = 0;
+    while (sent < text.size())
+    {
+        ssize_t n = ::send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// "<a@b>" out of "MAIL FROM:<a@b> SIZE=10"
+std::string
+address (
+    const std::string& line
+)
+{
+    size_t open = line.find('<');
+    size_t close = line.find('>', open);
+    if (open == std::string::npos || close == std::string::npos)
+        return std::string();
+    return line.substr(open + 1, close - open - 1);
+}
+
+bool
+startsWith (
+    const std::string& line,
+    const char* command
+)
+{
+    return ::strncasecmp(line.c_str(), command, std::strlen(command)) == 0;
+}
+
+} // end anonymous namespace
+
+
+FakeSmtpServer::FakeSmtpServer (
+    void
+)
+{
+    m_listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0)
+        throw std::runtime_error("socket failed");
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (::bind(m_listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(m_listenFd, 16) != 0
+        || ::getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    {
+        ::close(m_listenFd);
+        throw std::runtime_error("failed to listen on loopback");
+    }
+    m_port = ntohs(address.sin_port);
+    m_acceptor = std::thread(&FakeSmtpServer::acceptLoop, this);
+}
+
+FakeSmtpServer::~FakeSmtpServer (
+    void
+)
+{
+    m_stopping.store(true);
+    ::shutdown(m_listenFd, SHUT_RDWR);
+    m_acceptor.join();
+    ::close(m_listenFd);
+
+    std::vector<std::thread> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int fd : m_sessionFds)
+            ::shutdown(fd, SHUT_RDWR);
+        sessions = std::move(m_sessions);
+    }
+    m_changed.notify_all();
+    for (auto& session : sessions)
+        session.join();
+    for (int fd : m_sessionFds)
+        ::close(fd);
+}
+
+std::string
+FakeSmtpServer::url (
+    void
+) const
+{
+    return "smtp://127.0.0.1:" + std::to_string(m_port);
+}
+
+void
+FakeSmtpServer::holdMessages (
+    void
+)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_holding = true;
+}
+
+void
+FakeSmtpServer::releaseMessages (
+    void
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_holding = false;
+    }
+    m_changed.notify_all();
+}
+
+bool
+FakeSmtpServer::waitForMessages (
+    size_t count,
+    std::chrono::milliseconds timeout
+)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_changed.wait_for(lock, timeout, [&] { return m_messages.size() >= count; });
+}
+
+std::vector<FakeSmtpServer::Message>
+FakeSmtpServer::messages (
+    void
+) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_messages;
+}
+
+void
+FakeSmtpServer::acceptLoop (
+    void
+)
+{
+    while (!m_stopping.load())
+    {
+        int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        m_connections.fetch_add(1);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sessionFds.push_back(fd);
+        m_sessions.emplace_back(&FakeSmtpServer::serve, this, fd);
+    }
+}
+
+void
+FakeSmtpServer::serve (
+    int fd
+)
+{
+    auto pause = [this](int64_t ms) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait_for(lock, std::chrono::milliseconds(ms), [this] { return m_stopping.load(); });
+    };
+
+    pause(m_greetingDelayMs.load());
+    sendAll(fd, "220 fake.smtp ESMTP\r\n");
+
+    std::string buffer;
+    Message message;
+    bool inData = false;
+    bool awaitingAuth = false;
+    char chunk[4096];
+    while (!m_stopping.load())
+    {
+        // commands may arrive pipelined, so everything buffered is
+        // handled before reading more
+        size_t end;
+        if (inData && (end = buffer.find("\r\n.\r\n")) != std::string::npos)
+        {
+            message.data = buffer.substr(0, end);
+            buffer.erase(0, end + 5);
+            inData = false;
+
+            pause(m_messageDelayMs.load());
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [this] { return !m_holding || m_stopping.load(); });
+                if (m_stopping.load())
+                    return;
+                m_messages.push_back(std::move(message));
+            }
+            m_changed.notify_all();
+            if (!sendAll(fd, "250 queued\r\n"))
+                return;
+            continue;
+        }
+
+        if (!inData && (end = buffer.find("\r\n")) != std::string::npos)
+        {
+            std::string line = buffer.substr(0, end);
+            buffer.erase(0, end + 2);
+
+            std::string reply;
+            if (awaitingAuth)
+            {
+                awaitingAuth = false;
+                reply = "235 ok\r\n";
+            }
+            else if (startsWith(line, "EHLO"))
+                reply = "250-fake.smtp\r\n250-AUTH PLAIN\r\n250 8BITMIME\r\n";
+            else if (startsWith(line, "HELO"))
+                reply = "250 fake.smtp\r\n";
+            else if (startsWith(line, "AUTH"))
+            {
+                // "AUTH PLAIN" alone asks for the credentials on a line of their own
+                awaitingAuth = line.find(' ', 5) == std::string::npos;
+                reply = awaitingAuth ? "334 \r\n" : "235 ok\r\n";
+            }
+            else if (startsWith(line, "MAIL"))
+            {
+                m_mailCommands.fetch_add(1);
+                uint32_t failures = m_failMail.load();
+                while (failures > 0 && !m_failMail.compare_exchange_weak(failures, failures - 1))
+                    ;
+                if (failures > 0)
+                    reply = "451 try again later\r\n";
+                else
+                {
+                    message = Message();
+                    message.from = address(line);
+                    reply = "250 ok\r\n";
+                }
+            }
+            else if (startsWith(line, "RCPT"))
+            {
+                message.recipients.push_back(address(line));
+                reply = "250 ok\r\n";
+            }
+            else if (startsWith(line, "DATA"))
+            {
+                inData = true;
+                reply = "354 go ahead\r\n";
+            }
+            else if (startsWith(line, "QUIT"))
+            {
+                sendAll(fd, "221 bye\r\n");
+                return;
+            }
+            else
+                reply = "250 ok\r\n";
+
+            if (!sendAll(fd, reply))
+                return;
+            continue;
+        }
+
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+}
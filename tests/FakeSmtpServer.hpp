@@ -0,0 +1,86 @@
+#ifndef FAKE_SMTP_SERVER_H
+#define FAKE_SMTP_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// An SMTP server on a loopback port that accepts whatever it is sent,
+// for tests of EmailNotifier and NotificationDispatcher. It speaks just
+// enough ESMTP for curl (EHLO, AUTH PLAIN, MAIL, RCPT, DATA, RSET, QUIT)
+// and never offers STARTTLS, so clients must be configured without TLS.
+//
+// Knobs stand in for a real server's behaviour: a greeting delay for the
+// connect and handshake cost, a per-message delay, a number of MAIL
+// commands to refuse with a temporary error, and a gate that holds every
+// message until opened.
+class FakeSmtpServer
+{
+public:
+    struct Message
+    {
+        std::string from;
+        std::vector<std::string> recipients;
+        std::string data;
+    };
+
+    // listens on 127.0.0.1 on a free port; throws std::runtime_error
+    FakeSmtpServer ();
+
+    // closes the listening socket and every session
+    ~FakeSmtpServer ();
+
+    FakeSmtpServer (const FakeSmtpServer&) = delete;
+    FakeSmtpServer& operator= (const FakeSmtpServer&) = delete;
+
+    // "smtp://127.0.0.1:PORT"
+    std::string url () const;
+
+    void setGreetingDelay (std::chrono::milliseconds delay) { m_greetingDelayMs.store(delay.count()); }
+    void setMessageDelay (std::chrono::milliseconds delay) { m_messageDelayMs.store(delay.count()); }
+
+    // the next count MAIL commands are answered with 451
+    void failNextMail (uint32_t count) { m_failMail.store(count); }
+
+    // while closed, messages are read but not acknowledged
+    void holdMessages ();
+    void releaseMessages ();
+
+    // waits until count messages were accepted; false on timeout
+    bool waitForMessages (size_t count, std::chrono::milliseconds timeout);
+
+    uint64_t connections () const { return m_connections.load(); }
+    uint64_t mailCommands () const { return m_mailCommands.load(); }
+    std::vector<Message> messages () const;
+
+private:
+    int m_listenFd = -1;
+    uint16_t m_port = 0;
+
+    std::atomic<int64_t> m_greetingDelayMs{0};
+    std::atomic<int64_t> m_messageDelayMs{0};
+    std::atomic<uint32_t> m_failMail{0};
+    std::atomic<uint64_t> m_connections{0};
+    std::atomic<uint64_t> m_mailCommands{0};
+    std::atomic<bool> m_stopping{false};
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    bool m_holding = false;
+    std::vector<Message> m_messages;
+    std::vector<int> m_sessionFds;
+    std::vector<std::thread> m_sessions;
+
+    std::thread m_acceptor;
+
+    void acceptLoop ();
+    void serve (int fd);
+};
+
+#endif // FAKE_SMTP_SERVER_H
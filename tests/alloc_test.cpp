@@ -0,0 +1,92 @@
+// AllocationCounter linked into a test binary: totals, live bytes and the
+// attribution of allocations to tags and threads.
+
+#include "AllocationCounter.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <thread>
+
+
+namespace
+{
+
+constexpr size_t testTag = 7;
+
+// kept out of reach of the optimizer, which may elide a new/delete pair
+void* volatile escape;
+
+void
+allocate (
+    size_t count,
+    size_t bytes
+)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        char* p = new char[bytes];
+        escape = p;
+        delete[] p;
+    }
+}
+
+} // end anonymous namespace
+
+
+TEST(AllocationCounter, CountsAllocationsAndFrees)
+{
+    alloc::Counts before = alloc::totals();
+    allocate(10, 64);
+    alloc::Counts after = alloc::totals();
+
+    EXPECT_GE(after.allocations - before.allocations, 10u);
+    EXPECT_GE(after.frees - before.frees, 10u);
+}
+
+TEST(AllocationCounter, TracksLiveBytes)
+{
+    uint64_t before = alloc::totals().liveBytes;
+    auto block = std::make_unique<char[]>(1 << 20);
+    escape = block.get();
+    EXPECT_GE(alloc::totals().liveBytes - before, uint64_t(1) << 20);
+    block.reset();
+    EXPECT_LT(alloc::totals().liveBytes, before + (1 << 20));
+}
+
+TEST(AllocationCounter, AttributesAllocationsToTheCurrentTag)
+{
+    uint64_t before = alloc::snapshot().perTag[testTag];
+    {
+        alloc::ScopedTag tag(testTag);
+        allocate(5, 32);
+    }
+    allocate(5, 32);
+    EXPECT_EQ(alloc::snapshot().perTag[testTag] - before, 5u);
+
+    // out of range tags count as untagged
+    {
+        alloc::ScopedTag tag(alloc::maxTags);
+        EXPECT_EQ(alloc::currentTag, 0u);
+    }
+}
+
+TEST(AllocationCounter, AttributesAllocationsToNamedThreads)
+{
+    std::thread worker([] {
+        alloc::nameThread("alloc-test");
+        allocate(25, 16);
+    });
+    worker.join();
+
+    alloc::Snapshot now = alloc::snapshot();
+    const alloc::ThreadCounts* named = nullptr;
+    for (const auto& thread : now.perThread)
+    {
+        if (thread.name != nullptr && std::strcmp(thread.name, "alloc-test") == 0)
+            named = &thread;
+    }
+    ASSERT_NE(named, nullptr);
+    EXPECT_GE(named->allocations, 25u);
+}
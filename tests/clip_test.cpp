@@ -0,0 +1,204 @@
+// ClipBuffer's byte and age bounds and the window it hands out for a
+// clip, and ClipSink's event flow: a clip made of the pre-roll before the
+// first detection, running until the post-roll after the last one.
+
+#include "ClipBuffer.hpp"
+#include "ClipSink.hpp"
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <opencv2/core.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+const auto epoch = std::chrono::system_clock::from_time_t(1740839100);
+
+EncodedFrame
+encodedFrame (
+    uint64_t frameId,
+    std::chrono::milliseconds at,
+    size_t bytes
+)
+{
+    return EncodedFrame { frameId, epoch + at, std::make_shared<const std::vector<uint8_t>>(bytes) };
+}
+
+std::vector<uint64_t>
+frameIds (
+    const std::vector<EncodedFrame>& frames
+)
+{
+    std::vector<uint64_t> result;
+    for (const auto& frame : frames)
+        result.push_back(frame.frameId);
+    return result;
+}
+
+// JPEGs in a motion JPEG file; entropy coded data never holds FF D8
+size_t
+countJpegs (
+    const std::filesystem::path& path
+)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t count = 0;
+    for (size_t at = data.find("\xff\xd8"); at != std::string::npos; at = data.find("\xff\xd8", at + 2))
+        count++;
+    return count;
+}
+
+std::vector<std::filesystem::path>
+clipsIn (
+    const std::filesystem::path& directory
+)
+{
+    std::vector<std::filesystem::path> result;
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.path().extension() == ".mjpg")
+            result.push_back(entry.path());
+    }
+    return result;
+}
+
+} // end anonymous namespace
+
+
+TEST(ClipBuffer, EvictsByAge)
+{
+    ClipBuffer buffer(1 << 20, 1s);
+    for (uint64_t i = 0; i < 30; i++)
+        buffer.push(encodedFrame(i, i * 100ms, 100));
+
+    // 2.9s is the newest; 1.9s is exactly a second old and stays
+    EXPECT_EQ(buffer.size(), 11u);
+    EXPECT_EQ(buffer.bytes(), 1100u);
+    EXPECT_EQ(frameIds(buffer.since(epoch)).front(), 19u);
+    EXPECT_EQ(buffer.evicted(), 0u);
+}
+
+TEST(ClipBuffer, EvictsByBytesAndCountsIt)
+{
+    ClipBuffer buffer(1000, 1h);
+    for (uint64_t i = 0; i < 10; i++)
+        buffer.push(encodedFrame(i, i * 100ms, 300));
+
+    EXPECT_EQ(buffer.size(), 3u);
+    EXPECT_EQ(buffer.bytes(), 900u);
+    EXPECT_EQ(buffer.peakBytes(), 900u);
+    EXPECT_EQ(buffer.evicted(), 7u);
+    EXPECT_EQ(frameIds(buffer.since(epoch)), (std::vector<uint64_t>{ 7, 8, 9 }));
+
+    // one frame over the budget on its own does not stay either
+    buffer.push(encodedFrame(10, 1s, 1001));
+    EXPECT_EQ(buffer.size(), 0u);
+    EXPECT_EQ(buffer.bytes(), 0u);
+}
+
+TEST(ClipBuffer, SinceSharesTheFramesOldestFirst)
+{
+    ClipBuffer buffer(1 << 20, 10s);
+    for (uint64_t i = 0; i < 5; i++)
+        buffer.push(encodedFrame(i, i * 1s, 10));
+
+    std::vector<EncodedFrame> window = buffer.since(epoch + 2s);
+    EXPECT_EQ(frameIds(window), (std::vector<uint64_t>{ 2, 3, 4 }));
+    // held by the buffer and the window, not copied
+    EXPECT_EQ(window.front().data.use_count(), 2);
+    EXPECT_TRUE(buffer.since(epoch + 5s).empty());
+}
+
+TEST(ClipSink, WritesPreRollEventAndPostRoll)
+{
+    const std::filesystem::path directory = "/tmp/detect_clip_test_" + std::to_string(::getpid());
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    ClipConfig config;
+    config.path = (directory / "event").string();
+    config.preRoll = 2s;
+    config.postRoll = 1s;
+    ClipSink sink(config);
+
+    utils::Detection detection;
+    detection.classId = 0;
+    detection.boundingBox.x_min = 0.25f;
+    detection.boundingBox.y_min = 0.25f;
+    detection.boundingBox.x_max = 0.5f;
+    detection.boundingBox.y_max = 0.5f;
+    detection.boundingBox.score = 0.9f;
+
+    // 10 fps: quiet until 5.0s, detections until 5.2s, quiet up to 8.0s
+    SinkFrame frame;
+    frame.fps = 10.0;
+    frame.frame = cv::Mat(240, 320, CV_8UC3, cv::Scalar::all(0));
+    for (uint64_t i = 0; i <= 80; i++)
+    {
+        frame.frameId = i;
+        frame.timestamp = epoch + i * 100ms;
+        frame.detections.clear();
+        if (i >= 50 && i <= 52)
+            frame.detections.push_back(detection);
+        sink.consume(frame);
+    }
+    sink.close();
+
+    // 3.0s to 4.9s of pre-roll, then 5.0s until the frame a second after
+    // the last detection, 6.2s
+    std::vector<std::filesystem::path> clips = clipsIn(directory);
+    ASSERT_EQ(clips.size(), 1u);
+    EXPECT_EQ(countJpegs(clips.front()), 20u + 13u);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(ClipSink, EachEventAfterAQuietStretchGetsItsOwnClip)
+{
+    const std::filesystem::path directory = "/tmp/detect_clip_test_events_" + std::to_string(::getpid());
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    ClipConfig config;
+    config.path = (directory / "event").string();
+    config.preRoll = 1s;
+    config.postRoll = 1s;
+    ClipSink sink(config);
+
+    SinkFrame frame;
+    frame.fps = 10.0;
+    frame.frame = cv::Mat(240, 320, CV_8UC3, cv::Scalar::all(0));
+    for (uint64_t i = 0; i < 100; i++)
+    {
+        frame.frameId = i;
+        frame.timestamp = epoch + i * 100ms;
+        frame.detections.clear();
+        // events at 2.0s and 6.0s, seconds apart so they land in files
+        // with different names
+        if (i == 20 || i == 60)
+            frame.detections.push_back(utils::Detection());
+        sink.consume(frame);
+    }
+    sink.close();
+
+    // 1.0s to 1.9s, then 2.0s to 3.0s; the same around 6.0s
+    std::vector<std::filesystem::path> clips = clipsIn(directory);
+    ASSERT_EQ(clips.size(), 2u);
+    for (const auto& clip : clips)
+        EXPECT_EQ(countJpegs(clip), 10u + 11u) << clip;
+
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,129 @@
+// The digest path: SnapshotStore's budget and ordering, and a digest
+// delivered as one email through NotificationDispatcher to
+// FakeSmtpServer.
+
+#include "FakeSmtpServer.hpp"
+#include "NotificationDispatcher.hpp"
+#include "SnapshotStore.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+Snapshot
+snapshot (
+    float score,
+    size_t bytes,
+    uint8_t fill = 0
+)
+{
+    Snapshot result;
+    result.jpg = std::make_shared<const std::vector<uint8_t>>(bytes, fill);
+    result.score = score;
+    result.timestamp = std::chrono::system_clock::now();
+    result.classIds = { 0 };
+    return result;
+}
+
+} // end anonymous namespace
+
+
+TEST(SnapshotStore, KeepsTheBestWithinTheCount)
+{
+    SnapshotStore store(2, 1 << 20);
+    store.offer(snapshot(0.5f, 100));
+    store.offer(snapshot(0.9f, 100));
+    store.offer(snapshot(0.2f, 100));
+    store.offer(snapshot(0.7f, 100));
+
+    EXPECT_EQ(store.size(), 2u);
+    EXPECT_EQ(store.offered(), 4u);
+    EXPECT_EQ(store.evicted(), 2u);
+    EXPECT_EQ(store.classCounts().at(0), 4u);
+
+    auto best = store.take();
+    ASSERT_EQ(best.size(), 2u);
+    EXPECT_FLOAT_EQ(best[0].score, 0.9f);
+    EXPECT_FLOAT_EQ(best[1].score, 0.7f);
+    EXPECT_TRUE(store.empty());
+    EXPECT_EQ(store.bytes(), 0u);
+}
+
+TEST(SnapshotStore, KeepsWithinTheByteBudget)
+{
+    SnapshotStore store(10, 250);
+    store.offer(snapshot(0.5f, 100));
+    store.offer(snapshot(0.6f, 100));
+    store.offer(snapshot(0.9f, 100));
+    EXPECT_EQ(store.size(), 2u);
+    EXPECT_LE(store.bytes(), 250u);
+
+    // larger than the whole budget: never stored
+    store.offer(snapshot(1.0f, 300));
+    EXPECT_EQ(store.size(), 2u);
+    EXPECT_EQ(store.evicted(), 2u);
+}
+
+TEST(SnapshotStore, PeakIsWhatIsHeldAfterEviction)
+{
+    SnapshotStore store(1, 1 << 20);
+    store.offer(snapshot(0.9f, 1000));
+    store.offer(snapshot(0.1f, 500));
+
+    // the lower scoring snapshot went straight back out
+    EXPECT_EQ(store.bytes(), 1000u);
+    EXPECT_EQ(store.peakBytes(), 1000u);
+
+    store.offer(snapshot(0.95f, 1200));
+    EXPECT_EQ(store.bytes(), 1200u);
+    EXPECT_EQ(store.peakBytes(), 1200u);
+}
+
+TEST(Digest, IsOneEmailWithTheBestFirst)
+{
+    FakeSmtpServer server;
+    NotificationConfig config;
+    config.url = server.url();
+    config.useTls = false;
+    config.mailFrom = "detect@example.com";
+    config.recipients = { "owner@example.com" };
+    NotificationDispatcher dispatcher(config);
+
+    // filled so that their base64 runs tell them apart: 0x00 is "A",
+    // 0x10 0x41 0x04 is "EEEE"
+    SnapshotStore store(2, 1 << 20);
+    store.offer(snapshot(0.3f, 300, 0x00));
+    Snapshot best = snapshot(0.8f, 3);
+    best.jpg = std::make_shared<const std::vector<uint8_t>>(std::vector<uint8_t>{ 0x10, 0x41, 0x04 });
+    store.offer(std::move(best));
+    store.offer(snapshot(0.1f, 300, 0x00));
+
+    Notification digest;
+    digest.body = "digest of 3 snapshots";
+    for (auto& kept : store.take())
+        digest.images.push_back(std::move(kept.jpg));
+    ASSERT_EQ(digest.images.size(), 2u);
+    dispatcher.enqueue(std::move(digest));
+    dispatcher.shutdown();
+
+    auto messages = server.messages();
+    ASSERT_EQ(messages.size(), 1u);
+    const std::string& data = messages[0].data;
+    EXPECT_NE(data.find("digest of 3 snapshots"), std::string::npos);
+    size_t first = data.find("filename=\"image1.jpg\"");
+    size_t second = data.find("filename=\"image2.jpg\"");
+    ASSERT_NE(first, std::string::npos);
+    ASSERT_NE(second, std::string::npos);
+    EXPECT_EQ(data.find("filename=\"image3.jpg\""), std::string::npos);
+    EXPECT_LT(data.find("EEEE", first), second);
+    EXPECT_NE(data.find("AAAA", second), std::string::npos);
+}
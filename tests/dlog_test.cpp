@@ -0,0 +1,261 @@
+// DetectionLog segments: a reader following a segment while it is being
+// written, a closed segment and its index, and files that are not
+// segments.
+
+#include "DetectionLog.hpp"
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+constexpr int64_t baseUs = 1'700'000'000'000'000;
+
+// a scratch directory removed with everything in it
+class ScratchDirectory
+{
+public:
+    ScratchDirectory ()
+    :
+        m_path(std::filesystem::temp_directory_path() / ("dlog_test-" + std::to_string(::getpid())))
+    {
+        std::filesystem::remove_all(m_path);
+        std::filesystem::create_directories(m_path);
+    }
+
+    ~ScratchDirectory () { std::filesystem::remove_all(m_path); }
+
+    std::string file (const std::string& name) const { return (m_path / name).string(); }
+
+private:
+    const std::filesystem::path m_path;
+};
+
+// record n has n % 4 detections of class n % 90, scores and boxes
+// derived from n
+std::vector<utils::Detection>
+detectionsFor (
+    uint64_t n
+)
+{
+    std::vector<utils::Detection> result(n % 4);
+    for (size_t i = 0; i < result.size(); i++)
+    {
+        auto& detection = result[i];
+        detection.classId = static_cast<int>((n + i) % 90);
+        float f = static_cast<float>((n * 7 + i) % 100) / 100.0f;
+        detection.boundingBox = { f * 0.5f, f * 0.25f, 0.5f + f * 0.5f, 0.25f + f * 0.75f, f };
+    }
+    return result;
+}
+
+void
+expectRecord (
+    const dlog::RecordView& record,
+    uint64_t n
+)
+{
+    // one quantization step of 0..1 in 16 bits
+    constexpr float step = 1.0f / 65535.0f;
+
+    EXPECT_EQ(record.streamId, 3u);
+    EXPECT_EQ(record.frameId, 1000 + 2 * n);
+    EXPECT_EQ(record.timestampUs, baseUs + static_cast<int64_t>(n) * 33'333);
+    auto expected = detectionsFor(n);
+    ASSERT_EQ(record.count, expected.size());
+    for (size_t i = 0; i < record.count; i++)
+    {
+        EXPECT_EQ(record.classId(i), expected[i].classId);
+        auto box = record.box(i);
+        EXPECT_NEAR(box.score, expected[i].boundingBox.score, step);
+        EXPECT_NEAR(box.x_min, expected[i].boundingBox.x_min, step);
+        EXPECT_NEAR(box.y_min, expected[i].boundingBox.y_min, step);
+        EXPECT_NEAR(box.x_max, expected[i].boundingBox.x_max, step);
+        EXPECT_NEAR(box.y_max, expected[i].boundingBox.y_max, step);
+    }
+}
+
+bool
+append (
+    dlog::SegmentWriter& writer,
+    uint64_t n
+)
+{
+    return writer.append(baseUs + static_cast<int64_t>(n) * 33'333, 1000 + 2 * n, detectionsFor(n));
+}
+
+} // end anonymous namespace
+
+
+TEST(DetectionLog, ReaderFollowsASegmentBeingWritten)
+{
+    ScratchDirectory directory;
+    const std::string path = directory.file("live.dlog");
+    dlog::SegmentWriter writer;
+    ASSERT_TRUE(writer.open(path, 3, 1 << 20, baseUs, 1000));
+
+    dlog::SegmentReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.open(path, error)) << error;
+    dlog::RecordView record;
+    EXPECT_FALSE(reader.next(record));
+
+    uint64_t read = 0;
+    for (uint64_t n = 0; n < 500; n++)
+    {
+        ASSERT_TRUE(append(writer, n));
+        if (n % 50 == 49)
+        {
+            while (reader.next(record))
+                expectRecord(record, read++);
+            EXPECT_EQ(read, n + 1);
+        }
+    }
+    EXPECT_FALSE(reader.damaged());
+    EXPECT_EQ(reader.header().records, 500u);
+}
+
+TEST(DetectionLog, ClosedSegmentRoundTripsWithItsIndex)
+{
+    ScratchDirectory directory;
+    const std::string path = directory.file("closed.dlog");
+    constexpr uint64_t records = 1000;
+    {
+        dlog::SegmentWriter writer;
+        ASSERT_TRUE(writer.open(path, 3, 1 << 20, baseUs, 1000));
+        for (uint64_t n = 0; n < records; n++)
+            ASSERT_TRUE(append(writer, n));
+        writer.close();
+        EXPECT_LT(std::filesystem::file_size(path), size_t(1) << 20);
+    }
+
+    dlog::SegmentReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.open(path, error)) << error;
+    dlog::RecordView record;
+    uint64_t n = 0;
+    while (reader.next(record))
+        expectRecord(record, n++);
+    EXPECT_EQ(n, records);
+    EXPECT_FALSE(reader.damaged());
+
+    // the saved index matches one built by scanning, and every block
+    // starts where it says
+    dlog::SegmentIndex saved;
+    ASSERT_TRUE(saved.load(path + dlog::indexExtension, reader.header()));
+    dlog::SegmentIndex scanned;
+    reader.buildIndex(scanned);
+    ASSERT_EQ(saved.entries().size(), (records + dlog::defaultBlockRecords - 1) / dlog::defaultBlockRecords);
+    ASSERT_EQ(saved.entries().size(), scanned.entries().size());
+    for (size_t block = 0; block < saved.entries().size(); block++)
+    {
+        const auto& entry = saved.entries()[block];
+        EXPECT_EQ(entry.offset, scanned.entries()[block].offset);
+        EXPECT_EQ(entry.records, scanned.entries()[block].records);
+        EXPECT_EQ(entry.maxScore, scanned.entries()[block].maxScore);
+        EXPECT_EQ(entry.classes[0], scanned.entries()[block].classes[0]);
+
+        reader.seek(entry);
+        ASSERT_TRUE(reader.next(record));
+        expectRecord(record, block * dlog::defaultBlockRecords);
+    }
+
+    EXPECT_EQ(dlog::listSegments(directory.file("")), std::vector<std::string>{ path });
+}
+
+TEST(DetectionLog, FullSegmentRefusesRecords)
+{
+    ScratchDirectory directory;
+    dlog::SegmentWriter writer;
+    ASSERT_TRUE(writer.open(directory.file("small.dlog"), 3, 1024, baseUs, 1000));
+    uint64_t n = 0;
+    while (append(writer, n))
+        n++;
+    EXPECT_GT(n, 0u);
+    EXPECT_EQ(writer.records(), n);
+    EXPECT_LE(writer.bytes(), 1024u);
+}
+
+TEST(DetectionLog, RejectsFilesThatAreNotSegments)
+{
+    ScratchDirectory directory;
+    dlog::SegmentReader reader;
+    std::string error;
+
+    EXPECT_FALSE(reader.open(directory.file("missing.dlog"), error));
+
+    const std::string shortFile = directory.file("short.dlog");
+    std::ofstream(shortFile) << "DLOG";
+    EXPECT_FALSE(reader.open(shortFile, error));
+
+    const std::string badMagic = directory.file("magic.dlog");
+    std::ofstream(badMagic) << std::string(256, 'x');
+    EXPECT_FALSE(reader.open(badMagic, error));
+    EXPECT_NE(error.find("not a detection log segment"), std::string::npos) << error;
+
+    // a valid segment from a later version
+    const std::string newer = directory.file("newer.dlog");
+    {
+        dlog::SegmentWriter writer;
+        ASSERT_TRUE(writer.open(newer, 3, 4096, baseUs, 1000));
+        ASSERT_TRUE(append(writer, 1));
+    }
+    {
+        std::fstream file(newer, std::ios::in | std::ios::out | std::ios::binary);
+        uint16_t later = dlog::version + 1;
+        file.seekp(offsetof(dlog::SegmentHeader, version));
+        file.write(reinterpret_cast<const char*>(&later), sizeof(later));
+    }
+    EXPECT_FALSE(reader.open(newer, error));
+    EXPECT_NE(error.find("newer than this reader"), std::string::npos) << error;
+
+    EXPECT_TRUE(dlog::listSegments(directory.file("")).empty());
+}
+
+TEST(DetectionLog, StopsAtADamagedRecord)
+{
+    ScratchDirectory directory;
+    const std::string path = directory.file("damaged.dlog");
+    {
+        dlog::SegmentWriter writer;
+        ASSERT_TRUE(writer.open(path, 3, 1 << 16, baseUs, 1000));
+        for (uint64_t n = 0; n < 10; n++)
+            ASSERT_TRUE(append(writer, n));
+    }
+
+    // the third record's length, past the end of the data
+    size_t offset;
+    {
+        dlog::SegmentReader reader;
+        std::string error;
+        ASSERT_TRUE(reader.open(path, error)) << error;
+        dlog::RecordView record;
+        for (int i = 0; i < 3; i++)
+            ASSERT_TRUE(reader.next(record));
+        offset = record.offset;
+    }
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write("\xff\xff\x7f", 3);
+    }
+
+    dlog::SegmentReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.open(path, error)) << error;
+    dlog::RecordView record;
+    size_t read = 0;
+    while (reader.next(record))
+        read++;
+    EXPECT_EQ(read, 2u);
+    EXPECT_TRUE(reader.damaged());
+}
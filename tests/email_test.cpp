@@ -0,0 +1,139 @@
+// EmailNotifier against FakeSmtpServer: persistent sessions, concurrent
+// recipients and attachments. The server's greeting delay stands in for
+// the connect and TLS handshake a real server costs.
+
+#include "EmailNotifier.hpp"
+#include "FakeSmtpServer.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+constexpr char mailFrom[] = "detect@example.com";
+
+std::unique_ptr<EmailNotifier>
+notifierFor (
+    const FakeSmtpServer& server
+)
+{
+    return std::make_unique<EmailNotifier>("detect", "secret", server.url(), false);
+}
+
+double
+millisecondsSince (
+    std::chrono::steady_clock::time_point start
+)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // end anonymous namespace
+
+
+// the comparison persistent sessions were made for: one handshake for a
+// run of messages instead of one per message
+TEST(EmailNotifier, ReusesSessionAcrossMessages)
+{
+    constexpr int messages = 5;
+    FakeSmtpServer server;
+    server.setGreetingDelay(100ms);
+    const std::vector<std::string> to = { "owner@example.com" };
+    const std::vector<uint8_t> image(20000, 0xab);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto notifier = notifierFor(server);
+        for (int i = 0; i < messages; i++)
+            ASSERT_EQ(notifier->connectAndSendImage(mailFrom, to, "persistent", image), CURLE_OK);
+    }
+    double persistentMs = millisecondsSince(start);
+    EXPECT_EQ(server.connections(), 1u);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++)
+    {
+        auto notifier = notifierFor(server);
+        ASSERT_EQ(notifier->connectAndSendImage(mailFrom, to, "fresh", image), CURLE_OK);
+    }
+    double freshMs = millisecondsSince(start);
+    EXPECT_EQ(server.connections(), 1u + messages);
+
+    RecordProperty("persistent_ms", static_cast<int>(persistentMs));
+    RecordProperty("fresh_ms", static_cast<int>(freshMs));
+    EXPECT_GE(freshMs, messages * 100.0);
+    EXPECT_LT(persistentMs, freshMs / 2);
+    EXPECT_EQ(server.messages().size(), 2u * messages);
+}
+
+// curl waits for each server's final reply to a message in turn, but
+// the sessions are set up and the messages uploaded side by side
+TEST(EmailNotifier, ConnectsToRecipientsConcurrently)
+{
+    FakeSmtpServer server;
+    server.setGreetingDelay(200ms);
+    auto notifier = notifierFor(server);
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(notifier->connectAndSendImages(mailFrom, { "a@example.com", "b@example.com", "c@example.com" }, "all", {}), CURLE_OK);
+    double elapsedMs = millisecondsSince(start);
+
+    EXPECT_EQ(server.messages().size(), 3u);
+    EXPECT_LT(elapsedMs, 3 * 200.0);
+}
+
+TEST(EmailNotifier, SendsOnceToARecipientListedTwice)
+{
+    FakeSmtpServer server;
+    auto notifier = notifierFor(server);
+
+    ASSERT_EQ(notifier->connectAndSendImages(mailFrom, { "a@example.com", "b@example.com", "a@example.com" }, "dup", {}), CURLE_OK);
+    ASSERT_EQ(notifier->connectAndSendImages(mailFrom, { "a@example.com", "a@example.com" }, "again", {}), CURLE_OK);
+
+    auto messages = server.messages();
+    ASSERT_EQ(messages.size(), 3u);
+    size_t toA = 0;
+    for (const auto& message : messages)
+    {
+        ASSERT_EQ(message.recipients.size(), 1u);
+        toA += message.recipients[0] == "a@example.com";
+    }
+    EXPECT_EQ(toA, 2u);
+}
+
+TEST(EmailNotifier, AttachesImagesInOrder)
+{
+    FakeSmtpServer server;
+    auto notifier = notifierFor(server);
+
+    // "AAAA", "BBBB", "CCCC" in base64
+    const std::vector<uint8_t> first = { 0x00, 0x00, 0x00 };
+    const std::vector<uint8_t> second = { 0x04, 0x10, 0x41 };
+    const std::vector<uint8_t> third = { 0x08, 0x20, 0x82 };
+    std::vector<std::span<const uint8_t>> images = { first, second, third };
+    ASSERT_EQ(notifier->connectAndSendImages(mailFrom, { "owner@example.com" }, "three", images), CURLE_OK);
+
+    auto messages = server.messages();
+    ASSERT_EQ(messages.size(), 1u);
+    const std::string& data = messages[0].data;
+    size_t one = data.find("filename=\"image1.jpg\"");
+    size_t two = data.find("filename=\"image2.jpg\"");
+    size_t three = data.find("filename=\"image3.jpg\"");
+    ASSERT_NE(one, std::string::npos);
+    ASSERT_NE(two, std::string::npos);
+    ASSERT_NE(three, std::string::npos);
+    EXPECT_LT(one, two);
+    EXPECT_LT(two, three);
+    EXPECT_LT(data.find("AAAA", one), two);
+    EXPECT_LT(data.find("BBBB", two), three);
+    EXPECT_NE(data.find("CCCC", three), std::string::npos);
+}
@@ -0,0 +1,74 @@
+// The frame bus across processes: one detect_bus --publish and several
+// detect_bus --verify readers on the same bus, some slow enough to be
+// overwritten mid-frame. No reader may accept a frame that passed the
+// version check but holds another frame's data.
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+extern char** environ;
+
+
+namespace
+{
+
+// detect_bus with args; -1 if it could not be started
+pid_t
+spawnBus (
+    const std::vector<std::string>& args
+)
+{
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(DETECT_BUS_PATH));
+    for (const std::string& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (::posix_spawn(&pid, DETECT_BUS_PATH, nullptr, nullptr, argv.data(), environ) != 0)
+        return -1;
+    return pid;
+}
+
+// the exit status, or -1 if the process did not exit normally
+int
+waitForExit (
+    pid_t pid
+)
+{
+    int status;
+    if (::waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+} // end anonymous namespace
+
+
+TEST(FrameBus, VerifyingReadersSeeNoWrongFrames)
+{
+    const std::string name = "framebus_test_" + std::to_string(::getpid());
+
+    // started first, they wait for the bus and give up once it closes
+    std::vector<pid_t> readers;
+    for (const char* workUs : { "0", "2000", "20000" })
+    {
+        pid_t pid = spawnBus({ "--verify", "--seconds=4", std::string("--work-us=") + workUs, name });
+        ASSERT_GT(pid, 0);
+        readers.push_back(pid);
+    }
+
+    pid_t publisher = spawnBus({ "--publish", "--fps=200", "--width=320", "--height=240", "--seconds=2", name });
+    ASSERT_GT(publisher, 0);
+    EXPECT_EQ(waitForExit(publisher), 0);
+
+    // 1 if a reader saw a wrong frame or none at all
+    for (pid_t reader : readers)
+        EXPECT_EQ(waitForExit(reader), 0) << "reader " << reader;
+}
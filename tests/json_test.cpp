@@ -0,0 +1,162 @@
+// The JSON lines serializer: string escaping, including control and
+// non-ASCII characters, number formatting, null for NaN and infinity,
+// and a whole detection event.
+
+#include "JsonLines.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+
+namespace
+{
+
+std::string
+quoted (
+    std::string_view value
+)
+{
+    std::string out;
+    json::appendString(out, value);
+    return out;
+}
+
+std::string
+number (
+    double value,
+    int precision
+)
+{
+    std::string out;
+    json::appendNumber(out, value, precision);
+    return out;
+}
+
+template<typename Integer>
+std::string
+integer (
+    Integer value
+)
+{
+    std::string out;
+    json::appendNumber(out, value);
+    return out;
+}
+
+utils::Detection
+detection (
+    int classId,
+    float score
+)
+{
+    utils::Detection result;
+    result.classId = classId;
+    result.boundingBox.x_min = 0.125f;
+    result.boundingBox.y_min = 0.25f;
+    result.boundingBox.x_max = 0.5f;
+    result.boundingBox.y_max = 0.75f;
+    result.boundingBox.score = score;
+    return result;
+}
+
+} // end anonymous namespace
+
+
+TEST(JsonString, EscapesQuotesAndBackslashes)
+{
+    EXPECT_EQ(quoted("plain"), "\"plain\"");
+    EXPECT_EQ(quoted(""), "\"\"");
+    EXPECT_EQ(quoted("say \"hi\""), "\"say \\\"hi\\\"\"");
+    EXPECT_EQ(quoted("C:\\clips\\a.mjpg"), "\"C:\\\\clips\\\\a.mjpg\"");
+}
+
+TEST(JsonString, EscapesControlCharacters)
+{
+    EXPECT_EQ(quoted("a\nb\rc\td"), "\"a\\nb\\rc\\td\"");
+    EXPECT_EQ(quoted(std::string_view("\0\x01\x1f", 3)), "\"\\u0000\\u0001\\u001f\"");
+    // DEL and space are fine as they are
+    EXPECT_EQ(quoted("\x7f "), "\"\x7f \"");
+}
+
+TEST(JsonString, PassesUtf8Through)
+{
+    // JSON text is UTF-8, so multibyte characters need no escaping
+    EXPECT_EQ(quoted("caf\xc3\xa9"), "\"caf\xc3\xa9\"");
+    EXPECT_EQ(quoted("/var/lib/detect/\xe6\x91\x84\xe5\x83\x8f.mjpg"), "\"/var/lib/detect/\xe6\x91\x84\xe5\x83\x8f.mjpg\"");
+}
+
+TEST(JsonNumber, FormatsIntegers)
+{
+    EXPECT_EQ(integer(uint64_t(0)), "0");
+    EXPECT_EQ(integer(std::numeric_limits<uint64_t>::max()), "18446744073709551615");
+    EXPECT_EQ(integer(int64_t(-42)), "-42");
+    EXPECT_EQ(integer(std::numeric_limits<int64_t>::min()), "-9223372036854775808");
+}
+
+TEST(JsonNumber, FixedPrecisionWithoutExponent)
+{
+    EXPECT_EQ(number(0.5, 4), "0.5000");
+    EXPECT_EQ(number(30.0, 2), "30.00");
+    EXPECT_EQ(number(0.0, 2), "0.00");
+    EXPECT_EQ(number(-1.25, 2), "-1.25");
+    EXPECT_EQ(number(1e-9, 4), "0.0000");
+    EXPECT_EQ(number(1e20, 0), "100000000000000000000");
+    // rounds the double's exact value: 0.12345 is stored slightly above
+    EXPECT_EQ(number(0.12345, 4), "0.1235");
+    EXPECT_EQ(number(2.675, 2), "2.67");
+}
+
+TEST(JsonNumber, NullForNonFinite)
+{
+    EXPECT_EQ(number(std::numeric_limits<double>::quiet_NaN(), 2), "null");
+    EXPECT_EQ(number(std::numeric_limits<double>::infinity(), 2), "null");
+    EXPECT_EQ(number(-std::numeric_limits<double>::infinity(), 2), "null");
+}
+
+TEST(JsonDetectionEvent, WholeLine)
+{
+    SinkFrame frame;
+    frame.frameId = 7;
+    frame.timestamp = std::chrono::system_clock::time_point(std::chrono::milliseconds(1740839100123));
+    frame.fps = 29.97;
+    frame.detections = { detection(1, 0.91f), detection(3, 0.5f) };
+
+    std::string line;
+    json::appendDetectionEvent(line, frame);
+    EXPECT_EQ(line,
+        "{\"frame\":7,\"timestamp_ms\":1740839100123,\"fps\":29.97,\"detections\":["
+        "{\"class\":\"person\",\"score\":0.9100,\"box\":[0.1250,0.2500,0.5000,0.7500]},"
+        "{\"class\":\"car\",\"score\":0.5000,\"box\":[0.1250,0.2500,0.5000,0.7500]}]}\n");
+}
+
+TEST(JsonDetectionEvent, NonFiniteValuesStayValidJson)
+{
+    SinkFrame frame;
+    frame.frameId = 1;
+    frame.timestamp = std::chrono::system_clock::time_point(std::chrono::milliseconds(0));
+    frame.fps = std::numeric_limits<double>::infinity();
+    frame.detections = { detection(1, std::numeric_limits<float>::quiet_NaN()) };
+
+    std::string line;
+    json::appendDetectionEvent(line, frame);
+    EXPECT_EQ(line,
+        "{\"frame\":1,\"timestamp_ms\":0,\"fps\":null,\"detections\":["
+        "{\"class\":\"person\",\"score\":null,\"box\":[0.1250,0.2500,0.5000,0.7500]}]}\n");
+}
+
+TEST(JsonDetectionEvent, AppendsToWhatIsThere)
+{
+    SinkFrame frame;
+    frame.frameId = 2;
+    frame.timestamp = std::chrono::system_clock::time_point(std::chrono::milliseconds(5));
+    frame.fps = 0.0;
+
+    std::string line = "previous\n";
+    json::appendDetectionEvent(line, frame);
+    EXPECT_EQ(line, "previous\n{\"frame\":2,\"timestamp_ms\":5,\"fps\":0.00,\"detections\":[]}\n");
+}
@@ -0,0 +1,37 @@
+// RollingLatency's windows: what closedWindow() shows across rotations.
+
+#include "LatencyHistogram.hpp"
+
+#include <gtest/gtest.h>
+
+
+TEST(RollingLatency, ClosedWindowIsEmptyBeforeTheFirstRotate)
+{
+    RollingLatency latency;
+    latency.record(1000);
+    EXPECT_EQ(latency.closedWindow().count(), 0u);
+    EXPECT_EQ(latency.totalCount(), 1u);
+}
+
+TEST(RollingLatency, ClosedWindowHoldsTheLastRotation)
+{
+    RollingLatency latency;
+    latency.record(1000);
+    latency.record(2000);
+    const LatencyHistogram& closed = latency.rotate();
+    EXPECT_EQ(&closed, &latency.closedWindow());
+    EXPECT_EQ(closed.count(), 2u);
+
+    latency.record(3000);
+    EXPECT_EQ(latency.closedWindow().count(), 2u);
+
+    // the window closed before is left alone until the rotation after
+    latency.rotate();
+    EXPECT_EQ(closed.count(), 2u);
+    EXPECT_EQ(latency.closedWindow().count(), 1u);
+
+    latency.rotate();
+    EXPECT_EQ(latency.closedWindow().count(), 0u);
+    EXPECT_EQ(latency.totalCount(), 3u);
+    EXPECT_EQ(latency.totalNs(), 6000u);
+}
@@ -0,0 +1,131 @@
+// MetricsServer: the exposition text, the stage latency collector across
+// stats windows, and a scrape over a unix socket.
+
+#include "MetricsServer.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+
+namespace
+{
+
+// the whole response to a GET of path, or an empty string
+std::string
+get (
+    const std::string& socketPath,
+    const std::string& path
+)
+{
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return std::string();
+    }
+
+    std::string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+    ::send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    std::string response;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = ::recv(fd, chunk, sizeof(chunk), 0)) > 0)
+        response.append(chunk, static_cast<size_t>(n));
+    ::close(fd);
+    return response;
+}
+
+bool
+contains (
+    const std::string& text,
+    const std::string& part
+)
+{
+    return text.find(part) != std::string::npos;
+}
+
+// the value of the sample line starting with prefix, or -1
+double
+sampleValue (
+    const std::string& text,
+    const std::string& prefix
+)
+{
+    size_t start = text.find("\n" + prefix + " ");
+    if (start == std::string::npos)
+        return -1;
+    return std::stod(text.substr(start + prefix.size() + 2));
+}
+
+} // end anonymous namespace
+
+
+TEST(PrometheusText, WritesFamiliesAndEscapedLabels)
+{
+    PrometheusText out;
+    out.family("detect_frames_total", "counter", "Frames read");
+    out.sample("detect_frames_total", 42);
+    out.sample("detect_source_up", 1, {{"source", "rtsp://cam \"front\"\\1\n"}});
+
+    EXPECT_EQ(out.str(),
+        "# HELP detect_frames_total Frames read\n"
+        "# TYPE detect_frames_total counter\n"
+        "detect_frames_total 42\n"
+        "detect_source_up{source=\"rtsp://cam \\\"front\\\"\\\\1\\n\"} 1\n");
+}
+
+TEST(MetricsServer, ExposesQuantilesOnceAWindowIsClosed)
+{
+    PipelineStats stats;
+    MetricsServer server("unix:/tmp/detect_metrics_test_quantiles.sock", {
+        [&stats](PrometheusText& out) { metrics::writeStageLatency(out, stats); }
+    });
+
+    for (int i = 0; i < 100; i++)
+        stats.stage(Stage::Read).record(2'000'000);
+
+    // lifetime totals straight away, quantiles only for a closed window
+    std::string before = server.render();
+    EXPECT_TRUE(contains(before, "detect_stage_latency_seconds_count{stage=\"read\"} 100\n"));
+    EXPECT_FALSE(contains(before, "quantile="));
+    EXPECT_FALSE(contains(before, "detect_stage_latency_max_seconds{"));
+
+    stats.rotate();
+    std::string after = server.render();
+    // within the histogram's bucket resolution
+    EXPECT_NEAR(sampleValue(after, "detect_stage_latency_seconds{stage=\"read\",quantile=\"0.5\"}"), 0.002, 0.0001);
+    EXPECT_NEAR(sampleValue(after, "detect_stage_latency_seconds{stage=\"read\",quantile=\"0.99\"}"), 0.002, 0.0001);
+    EXPECT_DOUBLE_EQ(sampleValue(after, "detect_stage_latency_max_seconds{stage=\"read\"}"), 0.002);
+    EXPECT_FALSE(contains(after, "{stage=\"capture\",quantile="));
+}
+
+TEST(MetricsServer, ServesMetricsOverAUnixSocket)
+{
+    const std::string path = "/tmp/detect_metrics_test_scrape.sock";
+    int scrapes = 0;
+    MetricsServer server("unix:" + path, {
+        [&scrapes](PrometheusText& out) {
+            out.family("detect_scrapes_total", "counter", "Scrapes so far");
+            out.sample("detect_scrapes_total", ++scrapes);
+        }
+    });
+
+    std::string response = get(path, "/metrics");
+    EXPECT_TRUE(response.starts_with("HTTP/1.0 200"));
+    EXPECT_TRUE(contains(response, "text/plain; version=0.0.4"));
+    EXPECT_TRUE(contains(response, "\r\n\r\n# HELP detect_scrapes_total Scrapes so far\n"));
+    EXPECT_TRUE(contains(response, "detect_scrapes_total 1\n"));
+    EXPECT_TRUE(contains(get(path, "/metrics"), "detect_scrapes_total 2\n"));
+
+    EXPECT_TRUE(get(path, "/").starts_with("HTTP/1.0 404"));
+    EXPECT_EQ(scrapes, 2);
+}
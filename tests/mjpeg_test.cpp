@@ -0,0 +1,237 @@
+// MjpegSink with two viewers over a unix socket: one that reads as fast
+// as it can and one that never reads. Each frame is encoded once, the
+// fast viewer keeps getting parts and the stalled one skips ahead.
+
+#include "MjpegSink.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+constexpr char boundary[] = "--frame\r\n";
+
+int
+connectTo (
+    const std::string& socketPath
+)
+{
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int
+requestStream (
+    const std::string& socketPath
+)
+{
+    int fd = connectTo(socketPath);
+    if (fd >= 0)
+        ::send(fd, "GET / HTTP/1.0\r\n\r\n", 18, MSG_NOSIGNAL);
+    return fd;
+}
+
+// the whole response to a GET of path
+std::string
+get (
+    const std::string& socketPath,
+    const std::string& path
+)
+{
+    int fd = connectTo(socketPath);
+    if (fd < 0)
+        return std::string();
+    std::string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+    ::send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    std::string response;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = ::recv(fd, chunk, sizeof(chunk), 0)) > 0)
+        response.append(chunk, static_cast<size_t>(n));
+    ::close(fd);
+    return response;
+}
+
+struct ViewerStats
+{
+    uint64_t frames = 0;
+    uint64_t skipped = 0;
+};
+
+// the viewer table of /stats by viewer id
+std::map<unsigned, ViewerStats>
+viewerStats (
+    const std::string& stats
+)
+{
+    std::map<unsigned, ViewerStats> result;
+    std::istringstream lines(stats);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        unsigned id;
+        double seconds;
+        unsigned long long frames;
+        unsigned long long skipped;
+        if (std::sscanf(line.c_str(), "%u %lf %llu %llu", &id, &seconds, &frames, &skipped) == 4)
+            result[id] = { frames, skipped };
+    }
+    return result;
+}
+
+// reads until the server hangs up, counting the multipart boundaries
+class FastViewer
+{
+public:
+    explicit FastViewer (int fd) : m_fd(fd), m_thread(&FastViewer::read, this) { }
+
+    ~FastViewer ()
+    {
+        ::shutdown(m_fd, SHUT_RDWR);
+        m_thread.join();
+        ::close(m_fd);
+    }
+
+    uint64_t parts () const { return m_parts.load(); }
+
+private:
+    int m_fd;
+    std::atomic<uint64_t> m_parts{0};
+    std::thread m_thread;
+
+    void
+    read ()
+    {
+        // a boundary can straddle two reads
+        const size_t keep = sizeof(boundary) - 2;
+        std::string buffer;
+        char chunk[64 * 1024];
+        ssize_t n;
+        while ((n = ::recv(m_fd, chunk, sizeof(chunk), 0)) > 0)
+        {
+            buffer.append(chunk, static_cast<size_t>(n));
+            size_t at = 0;
+            while ((at = buffer.find(boundary, at)) != std::string::npos)
+            {
+                m_parts.fetch_add(1);
+                at += sizeof(boundary) - 1;
+            }
+            if (buffer.size() > keep)
+                buffer.erase(0, buffer.size() - keep);
+        }
+    }
+};
+
+bool
+waitForViewers (
+    const MjpegSink& sink,
+    size_t viewers
+)
+{
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (sink.viewers() != viewers && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(1ms);
+    return sink.viewers() == viewers;
+}
+
+} // end anonymous namespace
+
+
+TEST(MjpegSink, EncodesOnceAndLetsAStalledViewerSkip)
+{
+    const std::string path = "/tmp/detect_mjpeg_test_" + std::to_string(::getpid()) + ".sock";
+    MjpegConfig config;
+    config.address = "unix:" + path;
+    MjpegSink sink(config);
+
+    // noise compresses badly, so the stalled viewer's socket fills quickly
+    SinkFrame frame;
+    frame.frame = cv::Mat(480, 640, CV_8UC3);
+    cv::randu(frame.frame, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    // nobody watching yet
+    for (int i = 0; i < 3; i++)
+        sink.consume(frame);
+
+    FastViewer fast(requestStream(path));
+    ASSERT_TRUE(waitForViewers(sink, 1));
+    int stalled = requestStream(path);
+    ASSERT_GE(stalled, 0);
+    ASSERT_TRUE(waitForViewers(sink, 2));
+
+    constexpr int frames = 200;
+    uint64_t halfway = 0;
+    for (int i = 0; i < frames; i++)
+    {
+        frame.frameId = i;
+        sink.consume(frame);
+        std::this_thread::sleep_for(2ms);
+        if (i == frames / 2)
+            halfway = fast.parts();
+    }
+    std::string stats = get(path, "/stats");
+    EXPECT_NE(stats.find("encoded " + std::to_string(frames) + " frames"), std::string::npos) << stats;
+    EXPECT_NE(stats.find("3 frames without viewers"), std::string::npos) << stats;
+
+    // the fast viewer is 1, the stalled one 2
+    auto viewers = viewerStats(stats);
+    ASSERT_EQ(viewers.count(1), 1u) << stats;
+    ASSERT_EQ(viewers.count(2), 1u) << stats;
+    EXPECT_GT(viewers[2].skipped, static_cast<uint64_t>(frames / 2)) << stats;
+    EXPECT_LT(viewers[2].frames, static_cast<uint64_t>(frames / 4)) << stats;
+
+    // what the server finished sending arrives
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (fast.parts() < viewers[1].frames && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(1ms);
+
+    // still getting parts long after the stalled viewer stopped reading
+    EXPECT_GE(fast.parts(), viewers[1].frames);
+    EXPECT_GT(fast.parts(), halfway);
+    EXPECT_GT(fast.parts(), viewers[2].frames * 2);
+    EXPECT_LE(fast.parts(), static_cast<uint64_t>(frames));
+
+    sink.close();
+    ::close(stalled);
+}
+
+TEST(MjpegSink, TurnsAwayViewersPastTheLimit)
+{
+    const std::string path = "/tmp/detect_mjpeg_test_limit_" + std::to_string(::getpid()) + ".sock";
+    MjpegConfig config;
+    config.address = "unix:" + path;
+    config.maxViewers = 1;
+    MjpegSink sink(config);
+
+    FastViewer first(requestStream(path));
+    ASSERT_TRUE(waitForViewers(sink, 1));
+    std::string second = get(path, "/");
+    EXPECT_EQ(second.rfind("HTTP/1.0 503", 0), 0u) << second;
+    EXPECT_EQ(sink.viewers(), 1u);
+    sink.close();
+}
@@ -0,0 +1,251 @@
+// NotificationDispatcher against FakeSmtpServer: delivery, drop-oldest,
+// coalescing, retries with backoff and the drain on shutdown.
+
+#include "FakeSmtpServer.hpp"
+#include "NotificationDispatcher.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+NotificationConfig
+configFor (
+    const FakeSmtpServer& server
+)
+{
+    NotificationConfig config;
+    config.username = "detect";
+    config.password = "secret";
+    config.url = server.url();
+    config.useTls = false;
+    config.mailFrom = "detect@example.com";
+    config.recipients = { "owner@example.com" };
+    config.workers = 1;
+    config.queueCapacity = 2;
+    config.initialBackoff = 50ms;
+    config.maxBackoff = 60ms;
+    config.drainTimeout = 5s;
+    return config;
+}
+
+Notification
+notification (
+    const std::string& body,
+    const std::string& coalesceKey = std::string()
+)
+{
+    Notification result;
+    result.body = body;
+    result.coalesceKey = coalesceKey;
+    return result;
+}
+
+// the worker has taken a notification and is stuck delivering it
+void
+waitUntilSending (
+    const FakeSmtpServer& server,
+    uint64_t mailCommands
+)
+{
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (server.mailCommands() < mailCommands && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(1ms);
+    ASSERT_GE(server.mailCommands(), mailCommands);
+}
+
+// bodies of the messages received, in order, by the marker they contain
+std::vector<std::string>
+received (
+    const FakeSmtpServer& server,
+    const std::vector<std::string>& markers
+)
+{
+    std::vector<std::string> result;
+    for (const auto& message : server.messages())
+    {
+        for (const auto& marker : markers)
+        {
+            if (message.data.find(marker) != std::string::npos)
+                result.push_back(marker);
+        }
+    }
+    return result;
+}
+
+} // end anonymous namespace
+
+
+TEST(NotificationDispatcher, DeliversToEveryRecipient)
+{
+    FakeSmtpServer server;
+    NotificationConfig config = configFor(server);
+    config.recipients = { "a@example.com", "b@example.com" };
+    NotificationDispatcher dispatcher(config);
+
+    ASSERT_TRUE(dispatcher.enqueue(notification("person at the door")));
+    ASSERT_TRUE(server.waitForMessages(2, 5s));
+    dispatcher.shutdown();
+
+    auto messages = server.messages();
+    ASSERT_EQ(messages.size(), 2u);
+    std::vector<std::string> recipients;
+    for (const auto& message : messages)
+    {
+        EXPECT_EQ(message.from, "detect@example.com");
+        ASSERT_EQ(message.recipients.size(), 1u);
+        recipients.push_back(message.recipients[0]);
+        EXPECT_NE(message.data.find("person at the door"), std::string::npos);
+    }
+    std::sort(recipients.begin(), recipients.end());
+    EXPECT_EQ(recipients, (std::vector<std::string>{ "a@example.com", "b@example.com" }));
+
+    NotificationMetrics metrics = dispatcher.metrics();
+    EXPECT_EQ(metrics.sent, 1u);
+    EXPECT_EQ(metrics.failed, 0u);
+}
+
+TEST(NotificationDispatcher, DropsOldestWhenFull)
+{
+    FakeSmtpServer server;
+    server.holdMessages();
+    NotificationDispatcher dispatcher(configFor(server));
+
+    dispatcher.enqueue(notification("first"));
+    waitUntilSending(server, 1);
+    dispatcher.enqueue(notification("second"));
+    dispatcher.enqueue(notification("third"));
+    dispatcher.enqueue(notification("fourth"));
+    EXPECT_EQ(dispatcher.metrics().queueDepth, 2u);
+
+    server.releaseMessages();
+    dispatcher.shutdown();
+
+    EXPECT_EQ(received(server, { "first", "second", "third", "fourth" }),
+        (std::vector<std::string>{ "first", "third", "fourth" }));
+    NotificationMetrics metrics = dispatcher.metrics();
+    EXPECT_EQ(metrics.enqueued, 4u);
+    EXPECT_EQ(metrics.dropped, 1u);
+    EXPECT_EQ(metrics.sent, 3u);
+}
+
+TEST(NotificationDispatcher, CoalescesPendingNotificationsWithTheSameKey)
+{
+    FakeSmtpServer server;
+    server.holdMessages();
+    NotificationDispatcher dispatcher(configFor(server));
+
+    dispatcher.enqueue(notification("first"));
+    waitUntilSending(server, 1);
+    dispatcher.enqueue(notification("digest-1", "digest"));
+    dispatcher.enqueue(notification("digest-2", "digest"));
+    dispatcher.enqueue(notification("digest-3", "digest"));
+    EXPECT_EQ(dispatcher.metrics().queueDepth, 1u);
+
+    server.releaseMessages();
+    dispatcher.shutdown();
+
+    EXPECT_EQ(received(server, { "first", "digest-1", "digest-2", "digest-3" }),
+        (std::vector<std::string>{ "first", "digest-3" }));
+    NotificationMetrics metrics = dispatcher.metrics();
+    EXPECT_EQ(metrics.coalesced, 2u);
+    EXPECT_EQ(metrics.dropped, 0u);
+}
+
+TEST(NotificationDispatcher, RetriesTemporaryFailuresWithBackoff)
+{
+    FakeSmtpServer server;
+    server.failNextMail(2);
+    NotificationDispatcher dispatcher(configFor(server));
+
+    auto start = std::chrono::steady_clock::now();
+    dispatcher.enqueue(notification("retried"));
+    ASSERT_TRUE(server.waitForMessages(1, 5s));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    dispatcher.shutdown();
+
+    // 50 ms, then doubled but capped at 60 ms
+    EXPECT_GE(elapsed, 110ms);
+    NotificationMetrics metrics = dispatcher.metrics();
+    EXPECT_EQ(metrics.retries, 2u);
+    EXPECT_EQ(metrics.sent, 1u);
+    EXPECT_EQ(metrics.failed, 0u);
+    EXPECT_EQ(server.mailCommands(), 3u);
+}
+
+TEST(NotificationDispatcher, GivesUpAfterMaxAttempts)
+{
+    FakeSmtpServer server;
+    server.failNextMail(100);
+    NotificationConfig config = configFor(server);
+    config.maxAttempts = 3;
+    NotificationDispatcher dispatcher(config);
+
+    dispatcher.enqueue(notification("hopeless"));
+    dispatcher.shutdown();
+
+    NotificationMetrics metrics = dispatcher.metrics();
+    EXPECT_EQ(metrics.failed, 1u);
+    EXPECT_EQ(metrics.retries, 2u);
+    EXPECT_EQ(server.mailCommands(), 3u);
+    EXPECT_TRUE(server.messages().empty());
+}
+
+TEST(NotificationDispatcher, ShutdownDrainsPendingNotifications)
+{
+    FakeSmtpServer server;
+    server.setMessageDelay(30ms);
+    NotificationConfig config = configFor(server);
+    config.queueCapacity = 8;
+    NotificationDispatcher dispatcher(config);
+
+    for (int i = 0; i < 4; i++)
+        dispatcher.enqueue(notification("pending-" + std::to_string(i)));
+    dispatcher.shutdown();
+
+    EXPECT_EQ(server.messages().size(), 4u);
+    EXPECT_EQ(dispatcher.metrics().sent, 4u);
+    EXPECT_FALSE(dispatcher.enqueue(notification("too late")));
+}
+
+TEST(NotificationDispatcher, ShutdownAbandonsQueueAfterDrainTimeout)
+{
+    FakeSmtpServer server;
+    server.holdMessages();
+    NotificationConfig config = configFor(server);
+    config.queueCapacity = 8;
+    config.drainTimeout = 100ms;
+    NotificationDispatcher dispatcher(config);
+
+    dispatcher.enqueue(notification("stuck"));
+    waitUntilSending(server, 1);
+    dispatcher.enqueue(notification("abandoned-1"));
+    dispatcher.enqueue(notification("abandoned-2"));
+
+    // the message in flight is only let through well after the timeout
+    std::thread release([&] {
+        std::this_thread::sleep_for(400ms);
+        server.releaseMessages();
+    });
+    auto start = std::chrono::steady_clock::now();
+    dispatcher.shutdown();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    release.join();
+
+    EXPECT_LT(elapsed, 3s);
+    EXPECT_EQ(received(server, { "stuck", "abandoned-1", "abandoned-2" }),
+        (std::vector<std::string>{ "stuck" }));
+    NotificationMetrics metrics = dispatcher.metrics();
+    EXPECT_EQ(metrics.dropped, 2u);
+    EXPECT_EQ(metrics.sent, 1u);
+    EXPECT_EQ(metrics.queueDepth, 0u);
+}
@@ -0,0 +1,179 @@
+// The difference hash and the snapshot deduper: bit order on frames with
+// a known brightness gradient, identical and slightly shifted frames
+// landing within the threshold and unrelated ones far outside it, and
+// the deduper's threshold and least recently matched eviction.
+
+#include "PerceptualHash.hpp"
+
+#include <gtest/gtest.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cstdint>
+
+
+namespace
+{
+
+constexpr uint64_t allBits = ~uint64_t(0);
+
+// brightness rising (or falling) from left to right in every row
+cv::Mat
+horizontalRamp (
+    int type,
+    bool rising
+)
+{
+    cv::Mat ramp(8, 9, CV_8UC1);
+    for (int row = 0; row < ramp.rows; row++)
+    {
+        for (int col = 0; col < ramp.cols; col++)
+            ramp.at<uint8_t>(row, col) = static_cast<uint8_t>(rising ? 20 * col : 200 - 20 * col);
+    }
+    if (type == CV_8UC1)
+        return ramp;
+    cv::Mat color;
+    cv::cvtColor(ramp, color, cv::COLOR_GRAY2BGR);
+    return color;
+}
+
+// random gray blocks on the hash's 9x8 cells, each at least 64 levels
+// from its left neighbour, so that a shift of a few pixels moves a
+// cell's mean by far less than the gap and cannot flip a bit
+cv::Mat
+scene (
+    uint64_t seed
+)
+{
+    cv::RNG rng(seed);
+    cv::Mat levels(8, 9, CV_8UC3);
+    for (int row = 0; row < levels.rows; row++)
+    {
+        int previous = -1;
+        for (int col = 0; col < levels.cols; col++)
+        {
+            int level;
+            do
+                level = 64 * rng.uniform(0, 4);
+            while (level == previous);
+            levels.at<cv::Vec3b>(row, col) = cv::Vec3b(level, level, level);
+            previous = level;
+        }
+    }
+    cv::Mat frame;
+    cv::resize(levels, frame, cv::Size(9 * 70, 8 * 60), 0, 0, cv::INTER_NEAREST);
+    return frame;
+}
+
+// frame moved right by dx pixels, the uncovered edge repeated
+cv::Mat
+shifted (
+    const cv::Mat& frame,
+    int dx
+)
+{
+    cv::Mat result;
+    cv::copyMakeBorder(frame.colRange(0, frame.cols - dx), result, 0, 0, dx, 0, cv::BORDER_REPLICATE);
+    return result;
+}
+
+} // end anonymous namespace
+
+
+TEST(DifferenceHash, OneBitPerRisingPair)
+{
+    EXPECT_EQ(phash::dHash(horizontalRamp(CV_8UC1, true)), allBits);
+    EXPECT_EQ(phash::dHash(horizontalRamp(CV_8UC1, false)), 0u);
+    EXPECT_EQ(phash::dHash(horizontalRamp(CV_8UC3, true)), allBits);
+}
+
+TEST(DifferenceHash, FirstRowInTheTopBits)
+{
+    cv::Mat ramp = horizontalRamp(CV_8UC1, false);
+    for (int col = 0; col < ramp.cols; col++)
+        ramp.at<uint8_t>(0, col) = static_cast<uint8_t>(20 * col);
+    EXPECT_EQ(phash::dHash(ramp), uint64_t(0xff) << 56);
+}
+
+TEST(DifferenceHash, IdenticalFramesHashAlike)
+{
+    cv::Mat frame = scene(1);
+    EXPECT_EQ(phash::dHash(frame), phash::dHash(frame.clone()));
+}
+
+TEST(DifferenceHash, ShiftedFrameStaysWithinTheDefaultThreshold)
+{
+    cv::Mat frame = scene(2);
+    int distance = phash::hammingDistance(phash::dHash(frame), phash::dHash(shifted(frame, 4)));
+    EXPECT_LE(distance, 6);
+}
+
+TEST(DifferenceHash, DifferentScenesAreFarApart)
+{
+    for (uint64_t seed = 3; seed < 8; seed++)
+    {
+        int distance = phash::hammingDistance(phash::dHash(scene(seed)), phash::dHash(scene(seed + 100)));
+        EXPECT_GT(distance, 12) << "seed " << seed;
+    }
+}
+
+TEST(HammingDistance, CountsDifferingBits)
+{
+    EXPECT_EQ(phash::hammingDistance(0, 0), 0);
+    EXPECT_EQ(phash::hammingDistance(0, allBits), 64);
+    EXPECT_EQ(phash::hammingDistance(0b1011, 0b0001), 2);
+}
+
+TEST(SnapshotDeduper, SuppressesUpToTheThreshold)
+{
+    SnapshotDeduper deduper(3, 4);
+    const uint64_t sent = 0xf0f0f0f0f0f0f0f0;
+    EXPECT_FALSE(deduper.isDuplicateHash(sent));
+    EXPECT_TRUE(deduper.isDuplicateHash(sent));
+    EXPECT_TRUE(deduper.isDuplicateHash(sent ^ 0b111));
+    EXPECT_FALSE(deduper.isDuplicateHash(sent ^ 0b1111));
+    EXPECT_EQ(deduper.checked(), 4u);
+    EXPECT_EQ(deduper.suppressed(), 2u);
+}
+
+TEST(SnapshotDeduper, NegativeDistanceDisables)
+{
+    SnapshotDeduper deduper(-1, 4);
+    EXPECT_FALSE(deduper.isDuplicateHash(42));
+    EXPECT_FALSE(deduper.isDuplicateHash(42));
+    EXPECT_EQ(deduper.checked(), 0u);
+}
+
+TEST(SnapshotDeduper, EvictsTheLeastRecentlyMatched)
+{
+    // 32 bits or more apart from each other
+    const uint64_t a = 0;
+    const uint64_t b = allBits;
+    const uint64_t c = 0x00000000ffffffff;
+    const uint64_t d = 0xffffffff00000000;
+    const uint64_t e = 0x0000ffffffff0000;
+
+    SnapshotDeduper deduper(2, 3);
+    EXPECT_FALSE(deduper.isDuplicateHash(a));
+    EXPECT_FALSE(deduper.isDuplicateHash(b));
+    EXPECT_FALSE(deduper.isDuplicateHash(c));
+
+    // a matches and moves to the front, so d pushes out b
+    EXPECT_TRUE(deduper.isDuplicateHash(a ^ 1));
+    EXPECT_FALSE(deduper.isDuplicateHash(d));
+    EXPECT_TRUE(deduper.isDuplicateHash(a));
+    EXPECT_TRUE(deduper.isDuplicateHash(c));
+    EXPECT_TRUE(deduper.isDuplicateHash(d));
+
+    // b was evicted and comes back as new, pushing out the oldest, a
+    EXPECT_FALSE(deduper.isDuplicateHash(b));
+    EXPECT_FALSE(deduper.isDuplicateHash(a));
+
+    // a near match keeps the hash that went out: e drifts away one bit
+    // at a time and is only sent again once it is too far from it
+    SnapshotDeduper drifting(2, 1);
+    EXPECT_FALSE(drifting.isDuplicateHash(e));
+    EXPECT_TRUE(drifting.isDuplicateHash(e ^ 0b1));
+    EXPECT_TRUE(drifting.isDuplicateHash(e ^ 0b11));
+    EXPECT_FALSE(drifting.isDuplicateHash(e ^ 0b111));
+}
@@ -0,0 +1,71 @@
+// annotateFrame on frames of sizes other than the camera default: boxes
+// land where the detection's relative coordinates put them.
+
+#include "DetectPipeline.hpp"
+
+#include <gtest/gtest.h>
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+
+namespace
+{
+
+const cv::Vec3b green(0, 255, 0);
+
+utils::Detection
+detection (
+    float xMin,
+    float yMin,
+    float xMax,
+    float yMax
+)
+{
+    utils::Detection result;
+    result.classId = 0;
+    result.boundingBox.x_min = xMin;
+    result.boundingBox.y_min = yMin;
+    result.boundingBox.x_max = xMax;
+    result.boundingBox.y_max = yMax;
+    result.boundingBox.score = 0.9f;
+    return result;
+}
+
+// the box's right and bottom edges, clear of its label; cv::rectangle
+// draws a Rect's outline inside it
+void
+expectBoxEdges (
+    const cv::Mat& frame,
+    cv::Rect box
+)
+{
+    const int midY = box.y + box.height * 3 / 4;
+    const int midX = box.x + box.width * 3 / 4;
+    EXPECT_EQ(frame.at<cv::Vec3b>(midY, box.x + box.width - 1), green) << frame.size();
+    EXPECT_EQ(frame.at<cv::Vec3b>(box.y + box.height - 1, midX), green) << frame.size();
+    // and nothing inside it
+    EXPECT_EQ(frame.at<cv::Vec3b>(midY, midX), cv::Vec3b(0, 0, 0)) << frame.size();
+}
+
+} // end anonymous namespace
+
+
+TEST(AnnotateFrame, ScalesBoxesToASmallFrame)
+{
+    cv::Mat frame(240, 320, CV_8UC3, cv::Scalar::all(0));
+    annotateFrame(frame, { detection(0.5f, 0.5f, 0.9f, 0.9f) }, 30.0);
+
+    // (160, 120) to (288, 216); scaled to 800x600 it would be off the frame
+    expectBoxEdges(frame, cv::Rect(cv::Point(160, 120), cv::Point(288, 216)));
+}
+
+TEST(AnnotateFrame, ScalesBoxesToALargeFrame)
+{
+    cv::Mat frame(1080, 1920, CV_8UC3, cv::Scalar::all(0));
+    annotateFrame(frame, { detection(0.25f, 0.25f, 0.5f, 0.5f) }, 30.0);
+
+    expectBoxEdges(frame, cv::Rect(cv::Point(480, 270), cv::Point(960, 540)));
+    // where the box would be at 800x600
+    EXPECT_EQ(frame.at<cv::Vec3b>(225, 400), cv::Vec3b(0, 0, 0));
+}
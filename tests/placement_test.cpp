@@ -0,0 +1,204 @@
+// ThreadPlacement: parsing, and what a thread ends up with when it
+// registers under a role, or under one the plan leaves out, while the thread
+// that spawned it runs with another role's placement. Every case runs on
+// threads of its own so the test binary's main thread stays untouched.
+
+#include "ThreadPlacement.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <string>
+#include <thread>
+
+
+namespace
+{
+
+using namespace placement;
+
+void
+onThread (
+    const std::function<void ()>& body
+)
+{
+    std::thread thread(body);
+    thread.join();
+}
+
+// what a thread spawned by one that applied parentRole gets when it
+// registers as childRole
+std::string
+spawnedPlacement (
+    const Plan& plan,
+    const char* parentRole,
+    const char* childRole
+)
+{
+    std::string result;
+    onThread([&] {
+        configure(plan);
+        onThread([&] {
+            applyToCurrentThread(parentRole);
+            onThread([&] {
+                registerThread(childRole);
+                result = describeCurrentThread();
+            });
+        });
+    });
+    onThread([] { configure(Plan()); });
+    return result;
+}
+
+// lowering nice and SCHED_FIFO need CAP_SYS_NICE or matching rlimits
+bool
+canLowerNice (
+    void
+)
+{
+    bool ok = false;
+    onThread([&] {
+        id_t tid = static_cast<id_t>(gettid());
+        ok = setpriority(PRIO_PROCESS, tid, 3) == 0 && setpriority(PRIO_PROCESS, tid, 1) == 0;
+    });
+    return ok;
+}
+
+bool
+canUseFifo (
+    void
+)
+{
+    bool ok = false;
+    onThread([&] {
+        sched_param param = {};
+        param.sched_priority = 1;
+        ok = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    });
+    return ok;
+}
+
+Plan
+parsed (
+    const std::string& pin,
+    const std::string& priority
+)
+{
+    Plan plan;
+    std::string error;
+    EXPECT_TRUE(parse(pin, priority, plan, error)) << error;
+    return plan;
+}
+
+} // end anonymous namespace
+
+
+TEST(ThreadPlacement, ParsesCpuLists)
+{
+    std::vector<int> cpus;
+    ASSERT_TRUE(parseCpuList("0,2-4", cpus));
+    EXPECT_EQ(cpus, (std::vector<int>{ 0, 2, 3, 4 }));
+    EXPECT_FALSE(parseCpuList("3-1", cpus));
+    EXPECT_FALSE(parseCpuList("", cpus));
+    EXPECT_FALSE(parseCpuList("a", cpus));
+}
+
+TEST(ThreadPlacement, ParsesPinAndPriority)
+{
+    Plan plan = parsed("detect=3 default=0-2", "detect=fifo:20 encoder=nice:10");
+    EXPECT_EQ(plan["detect"].cpus, (std::vector<int>{ 3 }));
+    EXPECT_EQ(plan["detect"].fifoPriority, 20);
+    EXPECT_EQ(plan["default"].cpus, (std::vector<int>{ 0, 1, 2 }));
+    EXPECT_EQ(plan["encoder"].nice, 10);
+
+    Plan rejected;
+    std::string error;
+    EXPECT_FALSE(parse("detect", "", rejected, error));
+    EXPECT_EQ(error, "detect");
+    EXPECT_FALSE(parse("", "detect=fifo:100", rejected, error));
+    EXPECT_FALSE(parse("", "detect=rr:5", rejected, error));
+}
+
+TEST(ThreadPlacement, RoleWithoutAnEntryGetsTheDefault)
+{
+    if (!canLowerNice())
+        GTEST_SKIP() << "cannot lower nice values here";
+
+    Plan plan = parsed("", "detect=nice:6 default=nice:2");
+    std::string placement = spawnedPlacement(plan, "detect", "capture");
+    EXPECT_TRUE(placement.ends_with(", SCHED_OTHER, nice 2")) << placement;
+}
+
+TEST(ThreadPlacement, RoleWithoutAnEntryLeavesFifo)
+{
+    if (!canUseFifo())
+        GTEST_SKIP() << "SCHED_FIFO is not permitted here";
+
+    Plan plan = parsed("", "detect=fifo:10");
+    std::string placement = spawnedPlacement(plan, "detect", "encoder");
+    EXPECT_NE(placement.find(", SCHED_OTHER,"), std::string::npos) << placement;
+}
+
+TEST(ThreadPlacement, EntryTakesWhatItLeavesOutFromTheDefault)
+{
+    if (!canLowerNice() || !canUseFifo())
+        GTEST_SKIP() << "cannot lower nice values or use SCHED_FIFO here";
+
+    Plan plan = parsed("", "detect=nice:6 encoder=fifo:5 default=nice:1");
+    std::string placement = spawnedPlacement(plan, "detect", "encoder");
+    EXPECT_TRUE(placement.ends_with(", SCHED_FIFO 5, nice 1")) << placement;
+}
+
+TEST(ThreadPlacement, WithoutADefaultRolesReturnToTheStartingPlacement)
+{
+    if (!canLowerNice())
+        GTEST_SKIP() << "cannot lower nice values here";
+
+    std::string start;
+    onThread([&] { start = describeCurrentThread(); });
+    Plan plan = parsed("", "detect=nice:7");
+    EXPECT_EQ(spawnedPlacement(plan, "detect", "json"), start);
+}
+
+TEST(ThreadPlacement, RoleWithoutAnEntryGetsTheDefaultCores)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(set), &set), 0);
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    }
+    if (cpus.size() < 2)
+        GTEST_SKIP() << "needs two cores";
+
+    const std::string first = std::to_string(cpus[0]);
+    const std::string second = std::to_string(cpus[1]);
+    Plan plan = parsed("detect=" + first + " default=" + second, "");
+    std::string placement = spawnedPlacement(plan, "detect", "shm");
+    EXPECT_TRUE(placement.starts_with("cpus " + second + ",")) << placement;
+}
+
+TEST(ThreadPlacement, EmptyPlanChangesNothing)
+{
+    std::string inherited;
+    std::string named;
+    onThread([&] {
+        configure(Plan());
+        setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 4);
+        onThread([&] {
+            inherited = describeCurrentThread();
+            applyToCurrentThread("capture");
+            named = describeCurrentThread();
+        });
+    });
+    EXPECT_EQ(inherited, named);
+    EXPECT_TRUE(named.ends_with(", nice 4")) << named;
+}
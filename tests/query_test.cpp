@@ -0,0 +1,189 @@
+// runQuery over writeSyntheticLog output: the index may only skip what a
+// full scan would not match, so both must return the same matches.
+
+#include "DetectionQuery.hpp"
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace
+{
+
+constexpr int person = 1;
+constexpr int car = 3;
+constexpr int dog = 17;
+
+// half a day of synthetic detections on two streams, written once for
+// every test, plus a segment still open for writing
+class QueryTest : public testing::Test
+{
+protected:
+    static void
+    SetUpTestSuite ()
+    {
+        directory = (std::filesystem::temp_directory_path() / ("query_test-" + std::to_string(::getpid()))).string();
+        std::filesystem::remove_all(directory);
+        ASSERT_TRUE(dlog::writeSyntheticLog(directory, 0.5, 5, 1));
+        ASSERT_TRUE(dlog::writeSyntheticLog(directory, 0.25, 5, 2));
+
+        // the last hour again, on a stream of its own, never closed
+        live = new dlog::SegmentWriter();
+        int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t startUs = nowUs - 3600LL * 1000000;
+        ASSERT_TRUE(live->open(directory + "/stream7-live.dlog", 7, 16 << 20, startUs, 0));
+        for (uint64_t frame = 0; frame < 3600 * 5; frame++)
+        {
+            std::vector<utils::Detection> detections;
+            if (frame % 100 < 20)
+            {
+                utils::Detection detection;
+                detection.classId = frame % 200 < 100 ? person : dog;
+                detection.boundingBox = { 0.1f, 0.1f, 0.5f, 0.5f, 0.3f + (frame % 13) / 20.0f };
+                detections.push_back(detection);
+            }
+            ASSERT_TRUE(live->append(startUs + static_cast<int64_t>(frame) * 200000, frame, detections));
+        }
+        segments = dlog::listSegments(directory);
+    }
+
+    static void
+    TearDownTestSuite ()
+    {
+        delete live;
+        live = nullptr;
+        std::filesystem::remove_all(directory);
+    }
+
+    // runs query with and without the index and expects the same matches
+    static std::vector<dlog::Match>
+    compare (
+        dlog::Query query,
+        dlog::QueryStats& indexed
+    )
+    {
+        query.useIndex = true;
+        std::vector<dlog::Match> withIndex = dlog::runQuery(segments, query, 4, indexed);
+
+        dlog::QueryStats scanned;
+        query.useIndex = false;
+        std::vector<dlog::Match> withoutIndex = dlog::runQuery(segments, query, 4, scanned);
+        EXPECT_EQ(scanned.blocksRead, scanned.blocks);
+
+        EXPECT_EQ(withIndex.size(), withoutIndex.size());
+        for (size_t i = 0; i < std::min(withIndex.size(), withoutIndex.size()); i++)
+        {
+            const auto& a = withIndex[i];
+            const auto& b = withoutIndex[i];
+            EXPECT_EQ(std::tie(a.streamId, a.frameId, a.timestampUs, a.classId),
+                std::tie(b.streamId, b.frameId, b.timestampUs, b.classId)) << "match " << i;
+            EXPECT_EQ(std::memcmp(&a.box, &b.box, sizeof(a.box)), 0) << "match " << i;
+        }
+        for (size_t i = 1; i < withIndex.size(); i++)
+            EXPECT_LE(withIndex[i - 1].timestampUs, withIndex[i].timestampUs);
+        return withIndex;
+    }
+
+    static int64_t
+    hoursAgo (
+        double hours
+    )
+    {
+        int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        return nowUs - static_cast<int64_t>(hours * 3600e6);
+    }
+
+    static inline std::string directory;
+    static inline std::vector<std::string> segments;
+    static inline dlog::SegmentWriter* live = nullptr;
+};
+
+} // end anonymous namespace
+
+
+TEST_F(QueryTest, EverythingMatchesAFullScan)
+{
+    ASSERT_GE(segments.size(), 3u);
+    dlog::QueryStats stats;
+    auto matches = compare(dlog::Query(), stats);
+    EXPECT_GT(matches.size(), 0u);
+    EXPECT_EQ(stats.unindexed, 1u);
+}
+
+TEST_F(QueryTest, ClassQueryMatchesAFullScanAndSkipsBlocks)
+{
+    for (int classId : { person, car, dog })
+    {
+        dlog::Query query;
+        query.classId = classId;
+        dlog::QueryStats stats;
+        auto matches = compare(query, stats);
+        EXPECT_GT(matches.size(), 0u) << classId;
+        EXPECT_LT(stats.blocksRead, stats.blocks) << classId;
+        for (const auto& match : matches)
+            ASSERT_EQ(match.classId, classId);
+    }
+}
+
+TEST_F(QueryTest, TimeRangeMatchesAFullScan)
+{
+    dlog::Query query;
+    query.fromUs = hoursAgo(5.5);
+    query.toUs = hoursAgo(2.25);
+    dlog::QueryStats stats;
+    auto matches = compare(query, stats);
+    EXPECT_GT(matches.size(), 0u);
+    EXPECT_LT(stats.segmentsRead, stats.segments);
+    for (const auto& match : matches)
+    {
+        ASSERT_GE(match.timestampUs, query.fromUs);
+        ASSERT_LE(match.timestampUs, query.toUs);
+    }
+}
+
+TEST_F(QueryTest, StreamClassAndScoreMatchAFullScan)
+{
+    dlog::Query query;
+    query.streamId = 1;
+    query.classId = person;
+    query.minScore = 0.9f;
+    query.fromUs = hoursAgo(10);
+    dlog::QueryStats stats;
+    auto matches = compare(query, stats);
+    for (const auto& match : matches)
+    {
+        ASSERT_EQ(match.streamId, 1u);
+        ASSERT_GE(match.box.score, 0.9f);
+    }
+}
+
+TEST_F(QueryTest, LiveSegmentIsScannedWithoutAnIndex)
+{
+    dlog::Query query;
+    query.streamId = 7;
+    query.classId = dog;
+    dlog::QueryStats stats;
+    auto matches = compare(query, stats);
+    EXPECT_EQ(matches.size(), 3600u * 5 / 200 * 20);
+}
+
+TEST_F(QueryTest, EmptyRangeFindsNothing)
+{
+    dlog::Query query;
+    query.fromUs = hoursAgo(48);
+    query.toUs = hoursAgo(47);
+    dlog::QueryStats stats;
+    EXPECT_TRUE(compare(query, stats).empty());
+    // only the segment without an index has to be opened to tell
+    EXPECT_EQ(stats.segmentsRead, stats.unindexed);
+}
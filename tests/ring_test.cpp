@@ -0,0 +1,215 @@
+// SpscRing and MpmcRing under contention: every element delivered exactly
+// once and in order per producer, drop-oldest accounting, and close.
+// Worth running in a build configured with -DDETECT_TSAN=ON.
+
+#include "RingQueue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+constexpr uint64_t perProducer = 100000;
+
+// producer in the high bits, sequence number in the low ones
+constexpr uint64_t
+tagged (
+    uint64_t producer,
+    uint64_t sequence
+)
+{
+    return producer << 32 | sequence;
+}
+
+// producers push perProducer elements each, consumers pop until the ring
+// is closed and drained; checks exactly once and per producer order
+void
+runMpmc (
+    size_t producers,
+    size_t consumers,
+    ring::WaitPolicy policy
+)
+{
+    MpmcRing<uint64_t> queue(8, policy);
+    std::vector<std::vector<uint64_t>> received(consumers);
+
+    std::vector<std::thread> consumerThreads;
+    for (size_t c = 0; c < consumers; c++)
+    {
+        consumerThreads.emplace_back([&queue, &mine = received[c]] {
+            uint64_t value;
+            while (queue.pop(value))
+                mine.push_back(value);
+        });
+    }
+
+    std::vector<std::thread> producerThreads;
+    for (size_t p = 0; p < producers; p++)
+    {
+        producerThreads.emplace_back([&queue, p] {
+            for (uint64_t i = 0; i < perProducer; i++)
+                ASSERT_TRUE(queue.push(tagged(p, i)));
+        });
+    }
+    for (auto& thread : producerThreads)
+        thread.join();
+    queue.close();
+    for (auto& thread : consumerThreads)
+        thread.join();
+
+    std::vector<std::vector<uint8_t>> seen(producers, std::vector<uint8_t>(perProducer, 0));
+    for (const auto& mine : received)
+    {
+        // a consumer claims cells in ring order, so what it gets from one
+        // producer comes in that producer's order
+        std::vector<int64_t> last(producers, -1);
+        for (uint64_t value : mine)
+        {
+            uint64_t producer = value >> 32;
+            uint64_t sequence = value & 0xffffffff;
+            ASSERT_LT(producer, producers);
+            ASSERT_LT(sequence, perProducer);
+            ASSERT_GT(static_cast<int64_t>(sequence), last[producer]);
+            last[producer] = static_cast<int64_t>(sequence);
+            ASSERT_EQ(seen[producer][sequence]++, 0) << "delivered twice: " << producer << "/" << sequence;
+        }
+    }
+    for (size_t p = 0; p < producers; p++)
+    {
+        for (uint64_t i = 0; i < perProducer; i++)
+            ASSERT_EQ(seen[p][i], 1) << "never delivered: " << p << "/" << i;
+    }
+    EXPECT_EQ(queue.dropped(), 0u);
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+} // end anonymous namespace
+
+
+class RingTest : public testing::TestWithParam<ring::WaitPolicy> { };
+
+INSTANTIATE_TEST_SUITE_P(
+    WaitPolicies,
+    RingTest,
+    testing::Values(ring::WaitPolicy::Park, ring::WaitPolicy::SpinThenPark),
+    [](const testing::TestParamInfo<ring::WaitPolicy>& info) {
+        return info.param == ring::WaitPolicy::Park ? "Park" : "SpinThenPark";
+    });
+
+TEST_P(RingTest, SpscDeliversInOrder)
+{
+    SpscRing<std::unique_ptr<uint64_t>> queue(4, GetParam());
+    std::thread producer([&queue] {
+        for (uint64_t i = 0; i < perProducer; i++)
+            ASSERT_TRUE(queue.push(std::make_unique<uint64_t>(i)));
+        queue.close();
+    });
+
+    uint64_t expected = 0;
+    std::unique_ptr<uint64_t> value;
+    while (queue.pop(value))
+    {
+        ASSERT_NE(value, nullptr);
+        ASSERT_EQ(*value, expected);
+        expected++;
+    }
+    producer.join();
+    EXPECT_EQ(expected, perProducer);
+}
+
+TEST_P(RingTest, MpmcOneProducerOneConsumer)
+{
+    runMpmc(1, 1, GetParam());
+}
+
+TEST_P(RingTest, MpmcFourProducersFourConsumers)
+{
+    runMpmc(4, 4, GetParam());
+}
+
+TEST_P(RingTest, MpmcOneProducerSixConsumers)
+{
+    runMpmc(1, 6, GetParam());
+}
+
+// a producer that never waits on a slow consumer: everything pushed is
+// either delivered once, in order, or counted as dropped
+TEST_P(RingTest, MpmcDropOldestAccountsForEveryElement)
+{
+    MpmcRing<uint64_t> queue(4, GetParam(), ring::FullPolicy::DropOldest);
+    std::vector<uint64_t> received;
+    std::thread consumer([&] {
+        uint64_t value;
+        while (queue.pop(value))
+        {
+            received.push_back(value);
+            if (received.size() % 64 == 0)
+                std::this_thread::yield();
+        }
+    });
+
+    for (uint64_t i = 0; i < perProducer; i++)
+        ASSERT_TRUE(queue.push(uint64_t(i)));
+    queue.close();
+    consumer.join();
+
+    for (size_t i = 1; i < received.size(); i++)
+        ASSERT_LT(received[i - 1], received[i]);
+    EXPECT_EQ(received.size() + queue.dropped(), perProducer);
+    EXPECT_GT(queue.dropped(), 0u);
+
+    // the newest element always survives
+    ASSERT_FALSE(received.empty());
+    EXPECT_EQ(received.back(), perProducer - 1);
+}
+
+TEST(Ring, CloseDrainsThenFails)
+{
+    MpmcRing<uint64_t> queue(4);
+    ASSERT_TRUE(queue.push(uint64_t(1)));
+    ASSERT_TRUE(queue.push(uint64_t(2)));
+    queue.close();
+    EXPECT_FALSE(queue.push(uint64_t(3)));
+
+    uint64_t value = 0;
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, 1u);
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, 2u);
+    EXPECT_FALSE(queue.pop(value));
+}
+
+TEST(Ring, CloseWakesABlockedConsumer)
+{
+    SpscRing<uint64_t> queue(2, ring::WaitPolicy::Park);
+    std::atomic<bool> returned{false};
+    std::thread consumer([&] {
+        uint64_t value;
+        EXPECT_FALSE(queue.pop(value));
+        returned.store(true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(returned.load());
+    queue.close();
+    consumer.join();
+    EXPECT_TRUE(returned.load());
+}
+
+TEST(Ring, TryPushLeavesTheValueWhenFull)
+{
+    MpmcRing<std::unique_ptr<int>> queue(2);
+    ASSERT_TRUE(queue.tryPush(std::make_unique<int>(1)));
+    ASSERT_TRUE(queue.tryPush(std::make_unique<int>(2)));
+    auto third = std::make_unique<int>(3);
+    EXPECT_FALSE(queue.tryPush(std::move(third)));
+    ASSERT_NE(third, nullptr);
+    EXPECT_EQ(*third, 3);
+    EXPECT_EQ(queue.size(), 2u);
+}
@@ -0,0 +1,221 @@
+// SinkSet: every published frame is either delivered or replaced, slots
+// are not reused while a slow sink still reads them, sinks that queue
+// every frame see every frame however slow their writer, and publish()
+// stops allocating once warmed up.
+
+#include "AllocationCounter.hpp"
+#include "FrameSink.hpp"
+#include "RingQueue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+constexpr size_t testTag = 9;
+
+// frameId in every detection's classId, checked again after a pause
+class CheckingSink : public FrameSink
+{
+public:
+    CheckingSink (const char* name, std::chrono::microseconds pause) : m_name(name), m_pause(pause) { }
+
+    const char* name () const override { return m_name; }
+    bool needsPixels () const override { return false; }
+
+    void
+    consume (const SinkFrame& frame) override
+    {
+        uint64_t frameId = frame.frameId;
+        std::vector<utils::Detection> detections = frame.detections;
+        std::this_thread::sleep_for(m_pause);
+        if (frame.frameId != frameId || frame.detections.size() != detections.size())
+            torn.fetch_add(1);
+        for (const auto& detection : frame.detections)
+        {
+            if (static_cast<uint64_t>(detection.classId) != frameId)
+                torn.fetch_add(1);
+        }
+        if (frameId <= lastFrameId.load())
+            outOfOrder.fetch_add(1);
+        lastFrameId.store(frameId);
+    }
+
+    std::atomic<uint64_t> torn{0};
+    std::atomic<uint64_t> outOfOrder{0};
+    std::atomic<uint64_t> lastFrameId{0};
+
+private:
+    const char* const m_name;
+    const std::chrono::microseconds m_pause;
+};
+
+// queues frame ids for a writer thread that takes a while per frame
+class QueueingSink : public FrameSink
+{
+public:
+    explicit QueueingSink (std::chrono::microseconds pause) : m_pause(pause), m_thread(&QueueingSink::run, this) { }
+
+    ~QueueingSink () override { close(); }
+
+    const char* name () const override { return "queueing"; }
+    bool needsPixels () const override { return false; }
+    bool queuesEveryFrame () const override { return true; }
+
+    void
+    consume (const SinkFrame& frame) override
+    {
+        uint64_t frameId = frame.frameId;
+        if (!m_queue.tryPush(std::move(frameId)))
+            m_dropped.fetch_add(1);
+    }
+
+    uint64_t dropped () const override { return m_dropped.load(); }
+
+    void
+    close () override
+    {
+        m_queue.close();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> outOfOrder{0};
+
+private:
+    const std::chrono::microseconds m_pause;
+    SpscRing<uint64_t> m_queue{4096, ring::WaitPolicy::Park};
+    std::atomic<uint64_t> m_dropped{0};
+    std::thread m_thread;
+
+    void
+    run ()
+    {
+        uint64_t last = 0;
+        uint64_t frameId;
+        while (m_queue.pop(frameId))
+        {
+            std::this_thread::sleep_for(m_pause);
+            if (frameId != last + 1)
+                outOfOrder.fetch_add(1);
+            last = frameId;
+            written.fetch_add(1);
+        }
+    }
+};
+
+std::vector<utils::Detection>
+detectionsFor (
+    uint64_t frameId,
+    size_t count
+)
+{
+    std::vector<utils::Detection> result(count);
+    for (auto& detection : result)
+        detection.classId = static_cast<int>(frameId);
+    return result;
+}
+
+} // end anonymous namespace
+
+
+TEST(SinkSet, DeliversOrReplacesEveryFrame)
+{
+    constexpr uint64_t frames = 2000;
+    SinkSet sinks;
+    auto fast = std::make_unique<CheckingSink>("fast", 0us);
+    auto slow = std::make_unique<CheckingSink>("slow", 500us);
+    CheckingSink& fastSink = *fast;
+    CheckingSink& slowSink = *slow;
+    sinks.add(std::move(fast));
+    sinks.add(std::move(slow));
+
+    cv::Mat frame;
+    for (uint64_t id = 1; id <= frames; id++)
+    {
+        sinks.publish(id, frame, detectionsFor(id, 1 + id % 7), 30.0);
+        if (id % 16 == 0)
+            std::this_thread::sleep_for(100us);
+    }
+    sinks.shutdown();
+
+    for (const auto& metrics : sinks.metrics())
+    {
+        EXPECT_EQ(metrics.delivered + metrics.replaced, frames) << metrics.name;
+        EXPECT_GT(metrics.delivered, 0u) << metrics.name;
+    }
+    for (CheckingSink* sink : { &fastSink, &slowSink })
+    {
+        EXPECT_EQ(sink->torn.load(), 0u) << sink->name();
+        EXPECT_EQ(sink->outOfOrder.load(), 0u) << sink->name();
+        EXPECT_EQ(sink->lastFrameId.load(), frames) << sink->name();
+    }
+}
+
+TEST(SinkSet, QueueingSinkSeesEveryFrame)
+{
+    constexpr uint64_t frames = 2000;
+    SinkSet sinks;
+    auto queueing = std::make_unique<QueueingSink>(50us);
+    QueueingSink& queueingSink = *queueing;
+    sinks.add(std::move(queueing));
+    sinks.add(std::make_unique<CheckingSink>("slow", 500us));
+
+    // published far faster than the writer keeps up
+    cv::Mat frame;
+    for (uint64_t id = 1; id <= frames; id++)
+        sinks.publish(id, frame, detectionsFor(id, 3), 30.0);
+    sinks.shutdown();
+
+    EXPECT_EQ(queueingSink.written.load(), frames);
+    EXPECT_EQ(queueingSink.outOfOrder.load(), 0u);
+    bool found = false;
+    for (const auto& metrics : sinks.metrics())
+    {
+        if (std::string(metrics.name) != "queueing")
+            continue;
+        found = true;
+        EXPECT_EQ(metrics.delivered, frames);
+        EXPECT_EQ(metrics.replaced, 0u);
+        EXPECT_EQ(metrics.dropped, 0u);
+    }
+    EXPECT_TRUE(found);
+}
+
+TEST(SinkSet, PublishDoesNotAllocateOnceWarm)
+{
+    SinkSet sinks;
+    sinks.add(std::make_unique<CheckingSink>("fast", 0us));
+    sinks.add(std::make_unique<CheckingSink>("slow", 200us));
+
+    // the vectors are built outside the counted scope
+    std::vector<std::vector<utils::Detection>> detections;
+    for (uint64_t id = 0; id < 1000; id++)
+        detections.push_back(detectionsFor(id, 10));
+
+    cv::Mat frame;
+    for (uint64_t id = 0; id < 100; id++)
+        sinks.publish(id, frame, detections[id], 30.0);
+
+    uint64_t before = alloc::snapshot().perTag[testTag];
+    for (uint64_t id = 100; id < 1000; id++)
+    {
+        alloc::ScopedTag tag(testTag);
+        sinks.publish(id, frame, detections[id], 30.0);
+    }
+    uint64_t allocations = alloc::snapshot().perTag[testTag] - before;
+    sinks.shutdown();
+
+    EXPECT_EQ(allocations, 0u);
+}
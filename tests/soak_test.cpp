@@ -0,0 +1,118 @@
+// SoakMonitor's verdicts on synthetic runs: flat, leaking, noisy and too
+// short.
+
+#include "SoakMonitor.hpp"
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <sstream>
+#include <string>
+
+
+namespace
+{
+
+constexpr double mb = 1024.0 * 1024.0;
+
+// a sample a minute for an hour, steady unless change says otherwise
+bool
+judge (
+    const std::function<void (SoakSample&, size_t minute)>& change,
+    std::string* report = nullptr,
+    size_t minutes = 60
+)
+{
+    SoakMonitor monitor{SoakLimits()};
+    std::ostringstream out;
+    for (size_t minute = 0; minute < minutes; minute++)
+    {
+        SoakSample sample;
+        sample.elapsedSeconds = 60.0 * minute;
+        sample.frames = 1800 * minute;
+        sample.rssBytes = static_cast<size_t>(200 * mb);
+        sample.liveHeapBytes = static_cast<uint64_t>(50 * mb);
+        sample.threads = 12;
+        sample.allocationsPerFrame = 0.0;
+        sample.p99Ns = 20'000'000;
+        change(sample, minute);
+        monitor.add(sample, out);
+    }
+    bool ok = monitor.check(out);
+    if (report != nullptr)
+        *report = out.str();
+    return ok;
+}
+
+} // end anonymous namespace
+
+
+TEST(SoakMonitor, PassesAFlatRun)
+{
+    std::string report;
+    EXPECT_TRUE(judge([](SoakSample&, size_t) { }, &report));
+    EXPECT_NE(report.find("[i] soak passed"), std::string::npos);
+}
+
+TEST(SoakMonitor, IgnoresTheWarmupSamples)
+{
+    // everything settles during the first two samples
+    EXPECT_TRUE(judge([](SoakSample& sample, size_t minute) {
+        if (minute < 2)
+        {
+            sample.rssBytes /= 2;
+            sample.threads = 3;
+        }
+    }));
+}
+
+TEST(SoakMonitor, FailsAHeapLeak)
+{
+    std::string report;
+    EXPECT_FALSE(judge([](SoakSample& sample, size_t minute) {
+        sample.liveHeapBytes += static_cast<uint64_t>(minute * 0.5 * mb);
+        sample.rssBytes += static_cast<size_t>(minute * 0.5 * mb);
+    }, &report));
+    EXPECT_NE(report.find("[e]   live heap"), std::string::npos);
+    EXPECT_NE(report.find("[e]   rss"), std::string::npos);
+    EXPECT_NE(report.find("[e] soak failed"), std::string::npos);
+}
+
+TEST(SoakMonitor, FailsGrowingLatency)
+{
+    EXPECT_FALSE(judge([](SoakSample& sample, size_t minute) {
+        sample.p99Ns += minute * 200'000;
+    }));
+}
+
+TEST(SoakMonitor, FailsGrowingAllocationsPerFrame)
+{
+    EXPECT_FALSE(judge([](SoakSample& sample, size_t minute) {
+        sample.allocationsPerFrame = 2.0 + 0.05 * minute;
+    }));
+}
+
+TEST(SoakMonitor, FailsAThreadLeak)
+{
+    EXPECT_FALSE(judge([](SoakSample& sample, size_t minute) {
+        sample.threads += minute / 30;
+    }));
+}
+
+TEST(SoakMonitor, ToleratesASingleSpike)
+{
+    EXPECT_TRUE(judge([](SoakSample& sample, size_t minute) {
+        if (minute == 30)
+        {
+            sample.p99Ns *= 3;
+            sample.rssBytes += static_cast<size_t>(4 * mb);
+        }
+    }));
+}
+
+TEST(SoakMonitor, RefusesToJudgeTooFewSamples)
+{
+    std::string report;
+    EXPECT_FALSE(judge([](SoakSample&, size_t) { }, &report, 4));
+    EXPECT_NE(report.find("need at least 5"), std::string::npos);
+}